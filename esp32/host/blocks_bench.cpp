@@ -0,0 +1,213 @@
+// blocks_bench compares the size and encode time of a backlog of readings sent as one sensor_data packet per reading,
+// as sensor_data_batch packets and as sensor_data_blocks packets, and checks that the blocks decode back to the same
+// readings.
+//
+//   blocks_bench --sensors 9 --hours 4 --interval-s 10 --drift 0.005
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "Constants.h"
+#include "pb_encode.h"
+#include "generated/firmware_backend.pb.h"
+#include "packets/SensorDataBatch.h"
+#include "packets/SensorDataBlocks.h"
+
+namespace {
+    struct Options {
+        int sensors = 9;
+        double hours = 4;
+        int intervalS = 10;
+        double drift = 0.005;
+        size_t blockReadings = UPLINK_MAX_REPLAY_READINGS;
+    };
+
+    struct Result {
+        size_t packets = 0;
+        size_t bytes = 0;
+        double nsPerReading = 0;
+    };
+
+    void usage(const char *name) {
+        fprintf(stderr, "usage: %s [--sensors N] [--hours H] [--interval-s S] [--drift D]\n"
+                        "          [--block-readings N]\n"
+                        "  --sensors          number of sensors, each sending a temperature and a humidity (default 9)\n"
+                        "  --hours            length of the backlog (default 4)\n"
+                        "  --interval-s       time between the readings of a sensor (default 10)\n"
+                        "  --drift            standard deviation of the change between readings (default 0.005)\n"
+                        "  --block-readings   most readings in a sensor_data_blocks packet (default %d)\n", name,
+                UPLINK_MAX_REPLAY_READINGS);
+        exit(1);
+    }
+
+    Options parse(int argc, char **argv) {
+        Options o;
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            if (i + 1 == argc) {
+                usage(argv[0]);
+            }
+            const char *value = argv[++i];
+            if (arg == "--sensors") {
+                o.sensors = atoi(value);
+            } else if (arg == "--hours") {
+                o.hours = atof(value);
+            } else if (arg == "--interval-s") {
+                o.intervalS = atoi(value);
+            } else if (arg == "--drift") {
+                o.drift = atof(value);
+            } else if (arg == "--block-readings") {
+                o.blockReadings = strtoul(value, nullptr, 10);
+            } else {
+                usage(argv[0]);
+            }
+        }
+        if (o.sensors <= 0 || o.hours <= 0 || o.intervalS <= 0 || o.drift < 0 || o.blockReadings == 0) {
+            usage(argv[0]);
+        }
+        return o;
+    }
+
+    /// backlog makes the readings of fridge sensors in the order they come in: the temperature and humidity drift
+    /// slowly and are reported in hundredths, and a reading is now and then a second late
+    std::vector<SensorData> backlog(const Options &options) {
+        std::mt19937 generator{42};
+        std::normal_distribution<double> drift{0, options.drift};
+        std::uniform_int_distribution<int> late{0, 19};
+        std::vector<double> temperatures(options.sensors);
+        std::vector<double> humidities(options.sensors);
+        for (int s = 0; s < options.sensors; s++) {
+            temperatures[s] = 3 + s % 3;
+            humidities[s] = 40 + s;
+        }
+
+        std::vector<SensorData> readings;
+        long long const start = 1'700'000'000;
+        auto const steps = static_cast<long long>(options.hours * 3600 / options.intervalS);
+        for (long long step = 0; step < steps; step++) {
+            for (int s = 0; s < options.sensors; s++) {
+                long long const timestamp = start + step * options.intervalS + (late(generator) == 0 ? 1 : 0);
+                temperatures[s] += drift(generator);
+                humidities[s] += drift(generator);
+                for (auto [dataType, value]: {std::make_tuple(DataType_DATA_TYPE_TEMP, temperatures[s]),
+                                              std::make_tuple(DataType_DATA_TYPE_HUMIDITY, humidities[s])}) {
+                    SensorData reading = SensorData_init_zero;
+                    snprintf(reading.address, sizeof(reading.address), "aa:bb:cc:dd:%02x:%02x", (s >> 8) & 0xff,
+                             s & 0xff);
+                    reading.data_type = dataType;
+                    reading.value = static_cast<float>(std::round(value * 100) / 100);
+                    reading.timestamp = timestamp;
+                    readings.push_back(reading);
+                }
+            }
+        }
+        return readings;
+    }
+
+    template<typename Encode>
+    Result measure(const std::vector<SensorData> &readings, size_t perPacket, const Encode &encode) {
+        Result result;
+        std::vector<uint8_t> buf(64 * 1024);
+        auto const start = std::chrono::steady_clock::now();
+        for (size_t first = 0; first < readings.size(); first += perPacket) {
+            size_t const count = std::min(perPacket, readings.size() - first);
+            pb_ostream_t output = pb_ostream_from_buffer(buf.data(), buf.size());
+            if (!encode(&output, &readings[first], count)) {
+                fprintf(stderr, "Encoding failed: %s\n", PB_GET_ERROR(&output));
+                exit(1);
+            }
+            result.packets++;
+            result.bytes += output.bytes_written;
+        }
+        auto const elapsed = std::chrono::steady_clock::now() - start;
+        result.nsPerReading = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) /
+                              static_cast<double>(readings.size());
+        return result;
+    }
+
+    bool encodeSensorData(pb_ostream_t *stream, const SensorData *readings, size_t count) {
+        FirmwareToBackendPacket packet = FirmwareToBackendPacket_init_zero;
+        packet.which_type = FirmwareToBackendPacket_sensor_data_tag;
+        packet.type.sensor_data = readings[0];
+        return count == 1 && pb_encode(stream, FirmwareToBackendPacket_fields, &packet);
+    }
+
+    bool encodeBatch(pb_ostream_t *stream, const SensorData *readings, size_t count) {
+        size_t entriesSize = 0;
+        for (size_t i = 0; i < count; i++) {
+            entriesSize += sensorDataBatchEntrySize(readings[i]);
+        }
+        return encodeSensorDataBatch(stream, readings, count, entriesSize);
+    }
+
+    /// roundTrips checks that every sensor_data_blocks packet decodes to the readings it was encoded from
+    bool roundTrips(const std::vector<SensorData> &readings, size_t perPacket) {
+        using Key = std::tuple<std::string, int, long long>;
+        std::vector<uint8_t> buf(64 * 1024);
+        for (size_t first = 0; first < readings.size(); first += perPacket) {
+            size_t const count = std::min(perPacket, readings.size() - first);
+            pb_ostream_t output = pb_ostream_from_buffer(buf.data(), buf.size());
+            if (!encodeSensorDataBlocks(&output, &readings[first], count)) {
+                return false;
+            }
+            std::vector<SensorData> decoded;
+            pb_istream_t input = pb_istream_from_buffer(buf.data(), output.bytes_written);
+            if (!decodeSensorDataBlocks(&input, decoded) || decoded.size() != count) {
+                return false;
+            }
+            // Blocks reorder the readings by sensor, so compare them as multisets
+            std::multimap<Key, uint32_t> expected;
+            for (size_t i = first; i < first + count; i++) {
+                uint32_t bits;
+                memcpy(&bits, &readings[i].value, sizeof(bits));
+                expected.emplace(Key{readings[i].address, readings[i].data_type, readings[i].timestamp}, bits);
+            }
+            for (const auto &reading: decoded) {
+                uint32_t bits;
+                memcpy(&bits, &reading.value, sizeof(bits));
+                auto [begin, end] = expected.equal_range(Key{reading.address, reading.data_type, reading.timestamp});
+                auto match = std::find_if(begin, end, [bits](const auto &e) { return e.second == bits; });
+                if (match == end) {
+                    return false;
+                }
+                expected.erase(match);
+            }
+        }
+        return true;
+    }
+
+    void print(const char *name, const Result &result, const Result &baseline, size_t readings) {
+        printf("%-20s %8zu packets %10zu bytes %6.2f bytes/reading %6.1fx smaller %8.1f ns/reading\n", name,
+               result.packets, result.bytes, static_cast<double>(result.bytes) / static_cast<double>(readings),
+               static_cast<double>(baseline.bytes) / static_cast<double>(result.bytes), result.nsPerReading);
+    }
+}
+
+int main(int argc, char **argv) {
+    Options const options = parse(argc, argv);
+    std::vector<SensorData> const readings = backlog(options);
+    printf("%zu readings from %d sensors over %.1f hours, one every %d s\n", readings.size(), options.sensors,
+           options.hours, options.intervalS);
+
+    Result const sensorData = measure(readings, 1, encodeSensorData);
+    Result const batch = measure(readings, UPLINK_MAX_READINGS, encodeBatch);
+    Result const blocks = measure(readings, options.blockReadings, encodeSensorDataBlocks);
+    print("sensor_data", sensorData, sensorData, readings.size());
+    print("sensor_data_batch", batch, sensorData, readings.size());
+    print("sensor_data_blocks", blocks, sensorData, readings.size());
+
+    if (!roundTrips(readings, options.blockReadings)) {
+        fprintf(stderr, "sensor_data_blocks didn't decode to the readings it was encoded from\n");
+        return 1;
+    }
+    printf("sensor_data_blocks round trip ok\n");
+    return 0;
+}
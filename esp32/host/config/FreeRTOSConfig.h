@@ -0,0 +1,77 @@
+#ifndef ESP32_HOST_FREERTOSCONFIG_H
+#define ESP32_HOST_FREERTOSCONFIG_H
+
+// FreeRTOS configuration for the POSIX (Linux) port used by the host build.
+// It mirrors the parts of esp32/sdkconfig that the firmware depends on (run time stats, trace facility,
+// static allocation). The tick rate is higher than CONFIG_FREERTOS_HZ so latencies are measured in 1 ms steps.
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/// ulHostRunTimeCounter returns a microsecond counter, like the esp_timer based run time stats on the ESP32
+uint32_t ulHostRunTimeCounter(void);
+/// vHostAssertCalled reports a failed configASSERT and aborts
+void vHostAssertCalled(const char *file, int line);
+#ifdef __cplusplus
+}
+#endif
+
+#define configUSE_PREEMPTION                    1
+#define configUSE_PORT_OPTIMISED_TASK_SELECTION 0
+#define configUSE_IDLE_HOOK                     0
+#define configUSE_TICK_HOOK                     0
+#define configUSE_DAEMON_TASK_STARTUP_HOOK      0
+#define configTICK_RATE_HZ                      1000
+#define configMINIMAL_STACK_SIZE                ((unsigned short) 4096)
+#define configTOTAL_HEAP_SIZE                   ((size_t) (64 * 1024 * 1024))
+#define configMAX_TASK_NAME_LEN                 16
+#define configMAX_PRIORITIES                    25
+#define configSTACK_DEPTH_TYPE                  uint32_t
+#define configUSE_16_BIT_TICKS                  0
+#define configIDLE_SHOULD_YIELD                 1
+#define configUSE_MUTEXES                       1
+#define configUSE_RECURSIVE_MUTEXES             1
+#define configUSE_COUNTING_SEMAPHORES           1
+#define configUSE_TASK_NOTIFICATIONS            1
+#define configUSE_QUEUE_SETS                    0
+#define configQUEUE_REGISTRY_SIZE               20
+#define configCHECK_FOR_STACK_OVERFLOW          0
+#define configUSE_MALLOC_FAILED_HOOK            1
+#define configUSE_APPLICATION_TASK_TAG          0
+#define configUSE_ALTERNATIVE_API               0
+#define configSUPPORT_STATIC_ALLOCATION         1
+#define configSUPPORT_DYNAMIC_ALLOCATION        1
+
+#define configUSE_TIMERS                        1
+#define configTIMER_TASK_PRIORITY               (configMAX_PRIORITIES - 1)
+#define configTIMER_QUEUE_LENGTH                20
+#define configTIMER_TASK_STACK_DEPTH            (configMINIMAL_STACK_SIZE * 2)
+
+// CONFIG_FREERTOS_USE_TRACE_FACILITY and CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS are enabled on the board
+#define configUSE_TRACE_FACILITY                1
+#define configGENERATE_RUN_TIME_STATS           1
+#define configUSE_STATS_FORMATTING_FUNCTIONS    0
+// uint32_t is unsigned long on the ESP32 toolchains and the firmware passes unsigned long counters to the kernel
+#define configRUN_TIME_COUNTER_TYPE             unsigned long
+#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS()
+#define portGET_RUN_TIME_COUNTER_VALUE()        ulHostRunTimeCounter()
+
+#define INCLUDE_vTaskPrioritySet                1
+#define INCLUDE_uxTaskPriorityGet               1
+#define INCLUDE_vTaskDelete                     1
+#define INCLUDE_vTaskSuspend                    1
+#define INCLUDE_xTaskDelayUntil                 1
+#define INCLUDE_vTaskDelay                      1
+#define INCLUDE_uxTaskGetStackHighWaterMark     1
+#define INCLUDE_xTaskGetCurrentTaskHandle       1
+#define INCLUDE_xTaskGetIdleTaskHandle          1
+#define INCLUDE_eTaskGetState                   1
+#define INCLUDE_xTimerPendFunctionCall          1
+#define INCLUDE_pcTaskGetTaskName               1
+#define INCLUDE_xSemaphoreGetMutexHolder        1
+
+#define configASSERT(x) if ((x) == 0) vHostAssertCalled(__FILE__, __LINE__)
+
+#endif //ESP32_HOST_FREERTOSCONFIG_H
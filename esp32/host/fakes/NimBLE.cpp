@@ -0,0 +1,994 @@
+// Host fake of esp-nimble-cpp. See NimBLEDevice.h.
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <mutex>
+#include "NimBLEDevice.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "../sim/HeapTracker.h"
+#include "../sim/Simulator.h"
+
+namespace {
+    /// hostMutex stands in for the NimBLE host lock. Callbacks run with it held, like they run on the host task.
+    std::recursive_mutex &hostMutex() {
+        static std::recursive_mutex m;
+        return m;
+    }
+
+    struct Subscription {
+        NimBLERemoteCharacteristic *characteristic;
+        NimBLEClient *client;
+        sim::Peripheral *peer;
+        int role;
+        int64_t nextDueUs;
+    };
+
+    std::vector<Subscription> subscriptions;
+    std::vector<NimBLEClient *> clients;
+    NimBLEScan *scan = nullptr;
+    NimBLEServer *server = nullptr;
+    NimBLEAdvertising *advertising = nullptr;
+    bool initialized = false;
+    uint16_t mtu = 255;
+    uint16_t nextConnHandle = 1;
+
+    /// waitForAir blocks the caller for the air time of a radio operation. The host lock is not held.
+    void waitForAir(uint32_t ms) {
+        if (ms > 0) {
+            vTaskDelay(pdMS_TO_TICKS(ms));
+        }
+    }
+
+    void removeSubscriptions(const std::function<bool(const Subscription &)> &predicate) {
+        subscriptions.erase(std::remove_if(subscriptions.begin(), subscriptions.end(), predicate),
+                            subscriptions.end());
+    }
+
+    size_t connectedCount() {
+        return std::count_if(clients.begin(), clients.end(), [](NimBLEClient *c) { return c->isConnected(); });
+    }
+
+    std::string canonicalUUID(std::string uuid) {
+        std::transform(uuid.begin(), uuid.end(), uuid.begin(), [](unsigned char c) { return std::tolower(c); });
+        if (uuid.rfind("0x", 0) == 0) {
+            uuid.erase(0, 2);
+        }
+        if (uuid.size() == 4) {
+            uuid = "0000" + uuid;
+        }
+        if (uuid.size() == 8) {
+            uuid += "-0000-1000-8000-00805f9b34fb";
+        }
+        return uuid;
+    }
+}
+
+// NimBLEAddress
+
+NimBLEAddress::NimBLEAddress(const uint8_t address[6], uint8_t type) : m_addrType(type) {
+    memcpy(m_address, address, sizeof(m_address));
+}
+
+NimBLEAddress::NimBLEAddress(const std::string &stringAddress, uint8_t type) : m_addrType(type) {
+    unsigned int bytes[6];
+    if (stringAddress.size() != 17 ||
+        sscanf(stringAddress.c_str(), "%2x:%2x:%2x:%2x:%2x:%2x", &bytes[5], &bytes[4], &bytes[3], &bytes[2],
+               &bytes[1], &bytes[0]) != 6) {
+        return;
+    }
+    for (int i = 0; i < 6; i++) {
+        m_address[i] = static_cast<uint8_t>(bytes[i]);
+    }
+}
+
+NimBLEAddress::NimBLEAddress(const uint64_t &address, uint8_t type) : m_addrType(type) {
+    for (int i = 0; i < 6; i++) {
+        m_address[i] = static_cast<uint8_t>(address >> (8 * i));
+    }
+}
+
+bool NimBLEAddress::equals(const NimBLEAddress &otherAddress) const {
+    return *this == otherAddress;
+}
+
+const uint8_t *NimBLEAddress::getNative() const {
+    return m_address;
+}
+
+std::string NimBLEAddress::toString() const {
+    char buffer[18];
+    snprintf(buffer, sizeof(buffer), "%02x:%02x:%02x:%02x:%02x:%02x", m_address[5], m_address[4], m_address[3],
+             m_address[2], m_address[1], m_address[0]);
+    return buffer;
+}
+
+uint8_t NimBLEAddress::getType() const {
+    return m_addrType;
+}
+
+bool NimBLEAddress::operator==(const NimBLEAddress &rhs) const {
+    return memcmp(m_address, rhs.m_address, sizeof(m_address)) == 0;
+}
+
+bool NimBLEAddress::operator!=(const NimBLEAddress &rhs) const {
+    return !(*this == rhs);
+}
+
+NimBLEAddress::operator std::string() const {
+    return toString();
+}
+
+NimBLEAddress::operator uint64_t() const {
+    uint64_t address = 0;
+    for (int i = 5; i >= 0; i--) {
+        address = (address << 8) | m_address[i];
+    }
+    return address;
+}
+
+// NimBLEUUID
+
+NimBLEUUID::NimBLEUUID(const std::string &uuid) : m_uuid(canonicalUUID(uuid)) {}
+
+NimBLEUUID::NimBLEUUID(const char *uuid) : m_uuid(canonicalUUID(uuid)) {}
+
+std::string NimBLEUUID::toString() const {
+    return m_uuid;
+}
+
+bool NimBLEUUID::operator==(const NimBLEUUID &rhs) const {
+    return m_uuid == rhs.m_uuid;
+}
+
+bool NimBLEUUID::operator!=(const NimBLEUUID &rhs) const {
+    return m_uuid != rhs.m_uuid;
+}
+
+// NimBLEAdvertisedDevice
+
+NimBLEAddress NimBLEAdvertisedDevice::getAddress() const {
+    return m_address;
+}
+
+uint8_t NimBLEAdvertisedDevice::getAddressType() const {
+    return m_address.getType();
+}
+
+std::string NimBLEAdvertisedDevice::getName() const {
+    return m_name;
+}
+
+bool NimBLEAdvertisedDevice::haveName() const {
+    return !m_name.empty();
+}
+
+int NimBLEAdvertisedDevice::getRSSI() const {
+    return m_rssi;
+}
+
+bool NimBLEAdvertisedDevice::haveRSSI() const {
+    return m_rssi != -127;
+}
+
+std::string NimBLEAdvertisedDevice::getManufacturerData() const {
+    return m_manufacturerData;
+}
+
+bool NimBLEAdvertisedDevice::haveManufacturerData() const {
+    return !m_manufacturerData.empty();
+}
+
+size_t NimBLEAdvertisedDevice::getServiceUUIDCount() const {
+    return m_serviceUUIDs.size();
+}
+
+NimBLEUUID NimBLEAdvertisedDevice::getServiceUUID(uint8_t index) const {
+    return index < m_serviceUUIDs.size() ? m_serviceUUIDs[index] : NimBLEUUID("");
+}
+
+bool NimBLEAdvertisedDevice::haveServiceUUID() const {
+    return !m_serviceUUIDs.empty();
+}
+
+bool NimBLEAdvertisedDevice::isAdvertisingService(const NimBLEUUID &uuid) const {
+    return std::find(m_serviceUUIDs.begin(), m_serviceUUIDs.end(), uuid) != m_serviceUUIDs.end();
+}
+
+time_t NimBLEAdvertisedDevice::getTimestamp() const {
+    return m_timestamp;
+}
+
+// NimBLEScanResults
+
+void NimBLEScanResults::dump() {
+    for (const auto &device: m_advertisedDevices) {
+        printf("%s %s rssi %d\n", device.getAddress().toString().c_str(), device.getName().c_str(), device.getRSSI());
+    }
+}
+
+int NimBLEScanResults::getCount() {
+    return static_cast<int>(m_advertisedDevices.size());
+}
+
+NimBLEAdvertisedDevice NimBLEScanResults::getDevice(uint32_t i) {
+    return i < m_advertisedDevices.size() ? m_advertisedDevices[i] : NimBLEAdvertisedDevice();
+}
+
+std::vector<NimBLEAdvertisedDevice>::iterator NimBLEScanResults::begin() {
+    return m_advertisedDevices.begin();
+}
+
+std::vector<NimBLEAdvertisedDevice>::iterator NimBLEScanResults::end() {
+    return m_advertisedDevices.end();
+}
+
+NimBLEAdvertisedDevice *NimBLEScanResults::getDevice(const NimBLEAddress &address) {
+    for (auto &device: m_advertisedDevices) {
+        if (device.getAddress() == address) {
+            return &device;
+        }
+    }
+    return nullptr;
+}
+
+// NimBLEScan
+
+void NimBLEScan::onAdvertisement(const NimBLEAdvertisedDevice &device) {
+    const uint64_t address = device.getAddress();
+    const bool seen = std::find(m_seen.begin(), m_seen.end(), address) != m_seen.end();
+    if (!seen) {
+        m_seen.push_back(address);
+    }
+    NimBLEAdvertisedDevice *stored = m_scanResults.getDevice(device.getAddress());
+    if (stored != nullptr) {
+        *stored = device;
+    } else if (m_maxResults > 0 && m_scanResults.m_advertisedDevices.size() < m_maxResults) {
+        m_scanResults.m_advertisedDevices.push_back(device);
+        stored = &m_scanResults.m_advertisedDevices.back();
+    }
+    if (m_pAdvertisedDeviceCallbacks != nullptr && (!seen || m_wantDuplicates || !m_duplicateFilter)) {
+        NimBLEAdvertisedDevice copy = device;
+        m_pAdvertisedDeviceCallbacks->onResult(stored != nullptr ? stored : &copy);
+    }
+}
+
+void NimBLEScan::onTick(int64_t nowUs) {
+    if (m_scanning && m_endUs != 0 && nowUs >= m_endUs) {
+        m_scanning = false;
+        if (m_scanCompleteCB != nullptr) {
+            m_scanCompleteCB(m_scanResults);
+        }
+    }
+}
+
+bool NimBLEScan::start(uint32_t duration, void (*scanCompleteCB)(NimBLEScanResults), bool is_continue) {
+    std::lock_guard<std::recursive_mutex> lock(hostMutex());
+    if (m_scanning) {
+        return false;
+    }
+    if (!is_continue) {
+        clearResults();
+    }
+    m_seen.clear();
+    m_scanCompleteCB = scanCompleteCB;
+    m_endUs = duration == 0 ? 0 : esp_timer_get_time() + static_cast<int64_t>(duration) * 1'000'000;
+    m_scanning = true;
+    return true;
+}
+
+NimBLEScanResults NimBLEScan::start(uint32_t duration, bool is_continue) {
+    return getResults(duration * 1000, is_continue);
+}
+
+bool NimBLEScan::isScanning() {
+    return m_scanning;
+}
+
+void NimBLEScan::setAdvertisedDeviceCallbacks(NimBLEAdvertisedDeviceCallbacks *pAdvertisedDeviceCallbacks,
+                                              bool wantDuplicates) {
+    std::lock_guard<std::recursive_mutex> lock(hostMutex());
+    m_pAdvertisedDeviceCallbacks = pAdvertisedDeviceCallbacks;
+    m_wantDuplicates = wantDuplicates;
+}
+
+void NimBLEScan::setActiveScan(bool active) {
+    m_activeScan = active;
+}
+
+void NimBLEScan::setInterval(uint16_t intervalMSecs) {
+    m_interval = intervalMSecs;
+}
+
+void NimBLEScan::setWindow(uint16_t windowMSecs) {
+    m_window = windowMSecs;
+}
+
+void NimBLEScan::setDuplicateFilter(bool enabled) {
+    m_duplicateFilter = enabled;
+}
+
+void NimBLEScan::setMaxResults(uint8_t maxResults) {
+    m_maxResults = maxResults;
+}
+
+bool NimBLEScan::stop() {
+    std::lock_guard<std::recursive_mutex> lock(hostMutex());
+    if (!m_scanning) {
+        return true;
+    }
+    m_scanning = false;
+    if (m_scanCompleteCB != nullptr) {
+        m_scanCompleteCB(m_scanResults);
+    }
+    return true;
+}
+
+void NimBLEScan::clearResults() {
+    std::lock_guard<std::recursive_mutex> lock(hostMutex());
+    m_scanResults.m_advertisedDevices.clear();
+}
+
+void NimBLEScan::clearDuplicateCache() {
+    std::lock_guard<std::recursive_mutex> lock(hostMutex());
+    m_seen.clear();
+}
+
+NimBLEScanResults NimBLEScan::getResults() {
+    std::lock_guard<std::recursive_mutex> lock(hostMutex());
+    return m_scanResults;
+}
+
+NimBLEScanResults NimBLEScan::getResults(uint32_t duration, bool is_continue) {
+    {
+        std::lock_guard<std::recursive_mutex> lock(hostMutex());
+        if (m_scanning) {
+            return {};
+        }
+        if (!is_continue) {
+            clearResults();
+        }
+        m_seen.clear();
+        m_scanCompleteCB = nullptr;
+        m_endUs = esp_timer_get_time() + static_cast<int64_t>(duration) * 1000;
+        m_scanning = true;
+    }
+    while (m_scanning) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    return getResults();
+}
+
+void NimBLEScan::erase(const NimBLEAddress &address) {
+    std::lock_guard<std::recursive_mutex> lock(hostMutex());
+    auto &devices = m_scanResults.m_advertisedDevices;
+    devices.erase(std::remove_if(devices.begin(), devices.end(), [&address](const NimBLEAdvertisedDevice &d) {
+        return d.getAddress() == address;
+    }), devices.end());
+}
+
+// NimBLEConnInfo
+
+NimBLEAddress NimBLEConnInfo::getAddress() const {
+    return m_address;
+}
+
+NimBLEAddress NimBLEConnInfo::getIdAddress() const {
+    return m_address;
+}
+
+uint16_t NimBLEConnInfo::getConnHandle() const {
+    return m_connHandle;
+}
+
+uint16_t NimBLEConnInfo::getMTU() const {
+    return m_mtu;
+}
+
+// NimBLEClient
+
+NimBLEClient::NimBLEClient(const NimBLEAddress &peerAddress) : m_peerAddress(peerAddress) {}
+
+NimBLEClient::~NimBLEClient() {
+    deleteServices();
+    if (m_deleteCallbacks) {
+        delete m_pClientCallbacks;
+    }
+}
+
+void NimBLEClient::onPeerLost() {
+    removeSubscriptions([this](const Subscription &s) { return s.client == this; });
+    if (m_peer != nullptr && m_peer->central == this) {
+        m_peer->central = nullptr;
+    }
+    m_peer = nullptr;
+    m_connected = false;
+    m_connHandle = BLE_HS_CONN_HANDLE_NONE;
+    if (m_pClientCallbacks != nullptr) {
+        m_pClientCallbacks->onDisconnect(this);
+    }
+}
+
+bool NimBLEClient::connect(NimBLEAdvertisedDevice *device, bool deleteAttributes) {
+    return connect(device->getAddress(), deleteAttributes);
+}
+
+bool NimBLEClient::connect(const NimBLEAddress &address, bool deleteAttributes) {
+    {
+        std::lock_guard<std::recursive_mutex> lock(hostMutex());
+        if (m_connected) {
+            return false;
+        }
+        if (connectedCount() >= CONFIG_BT_NIMBLE_MAX_CONNECTIONS) {
+            // ble_gap_connect fails straight away with BLE_HS_ENOMEM
+            sim::Metrics::get().bleConnectFailures++;
+            return false;
+        }
+        m_peerAddress = address;
+        // ble_gap_connect fails with BLE_HS_EBUSY while scanning, so NimBLEClient stops the scan and retries
+        if (scan != nullptr && scan->isScanning()) {
+            scan->stop();
+        }
+    }
+    waitForAir(sim::timing().connectMs);
+    {
+        std::lock_guard<std::recursive_mutex> lock(hostMutex());
+        auto peer = sim::World::get().find(address);
+        if (peer != nullptr && peer->central == nullptr) {
+            if (deleteAttributes) {
+                deleteServices();
+            }
+            peer->central = this;
+            peer->onConnect();
+            m_peer = peer;
+            m_connected = true;
+            m_connHandle = nextConnHandle++;
+            if (nextConnHandle == BLE_HS_CONN_HANDLE_NONE) {
+                nextConnHandle = 1;
+            }
+            sim::Metrics::get().bleConnects++;
+            if (m_pClientCallbacks != nullptr) {
+                m_pClientCallbacks->onConnect(this);
+            }
+            return true;
+        }
+    }
+    // Nothing answers, so the connection attempt runs until it times out
+    waitForAir(m_connectTimeout);
+    sim::Metrics::get().bleConnectFailures++;
+    return false;
+}
+
+bool NimBLEClient::connect(bool deleteAttributes) {
+    return connect(m_peerAddress, deleteAttributes);
+}
+
+int NimBLEClient::disconnect(uint8_t reason) {
+    std::lock_guard<std::recursive_mutex> lock(hostMutex());
+    if (!m_connected) {
+        // BLE_HS_ENOTCONN
+        return 7;
+    }
+    onPeerLost();
+    return 0;
+}
+
+NimBLEAddress NimBLEClient::getPeerAddress() const {
+    return m_peerAddress;
+}
+
+void NimBLEClient::setPeerAddress(const NimBLEAddress &address) {
+    std::lock_guard<std::recursive_mutex> lock(hostMutex());
+    if (!m_connected) {
+        m_peerAddress = address;
+    }
+}
+
+NimBLERemoteService *NimBLEClient::getService(const char *uuid) {
+    return getService(NimBLEUUID(uuid));
+}
+
+NimBLERemoteService *NimBLEClient::getService(const NimBLEUUID &uuid) {
+    if (!discoverAttributes()) {
+        return nullptr;
+    }
+    std::lock_guard<std::recursive_mutex> lock(hostMutex());
+    for (auto service: m_servicesVector) {
+        if (service->getUUID() == uuid) {
+            return service;
+        }
+    }
+    return nullptr;
+}
+
+std::vector<NimBLERemoteService *> *NimBLEClient::getServices(bool refresh) {
+    if (refresh) {
+        std::lock_guard<std::recursive_mutex> lock(hostMutex());
+        deleteServices();
+    }
+    discoverAttributes();
+    return &m_servicesVector;
+}
+
+void NimBLEClient::deleteServices() {
+    std::lock_guard<std::recursive_mutex> lock(hostMutex());
+    removeSubscriptions([this](const Subscription &s) { return s.client == this; });
+    for (auto service: m_servicesVector) {
+        delete service;
+    }
+    m_servicesVector.clear();
+}
+
+bool NimBLEClient::discoverAttributes() {
+    {
+        std::lock_guard<std::recursive_mutex> lock(hostMutex());
+        if (!m_connected) {
+            return false;
+        }
+        if (!m_servicesVector.empty()) {
+            return true;
+        }
+    }
+    waitForAir(sim::timing().discoveryMs);
+    std::lock_guard<std::recursive_mutex> lock(hostMutex());
+    if (!m_connected) {
+        return false;
+    }
+    if (m_servicesVector.empty()) {
+        m_peer->buildServices(this);
+    }
+    return true;
+}
+
+bool NimBLEClient::isConnected() {
+    return m_connected;
+}
+
+void NimBLEClient::setClientCallbacks(NimBLEClientCallbacks *pClientCallbacks, bool deleteCallbacks) {
+    std::lock_guard<std::recursive_mutex> lock(hostMutex());
+    if (m_deleteCallbacks && m_pClientCallbacks != pClientCallbacks) {
+        delete m_pClientCallbacks;
+    }
+    m_pClientCallbacks = pClientCallbacks;
+    m_deleteCallbacks = deleteCallbacks;
+}
+
+void NimBLEClient::setConnectTimeout(uint32_t timeout) {
+    // Like esp-nimble-cpp 1.4, the timeout is in seconds
+    m_connectTimeout = timeout * 1000;
+}
+
+uint16_t NimBLEClient::getConnId() const {
+    return m_connHandle;
+}
+
+NimBLEConnInfo NimBLEClient::getConnInfo() {
+    std::lock_guard<std::recursive_mutex> lock(hostMutex());
+    NimBLEConnInfo info;
+    if (m_connected) {
+        info.m_address = m_peerAddress;
+        info.m_connHandle = m_connHandle;
+        info.m_mtu = mtu;
+    }
+    return info;
+}
+
+// NimBLERemoteService
+
+NimBLERemoteService::NimBLERemoteService(NimBLEClient *pClient, const NimBLEUUID &uuid) : m_uuid(uuid),
+                                                                                         m_pClient(pClient) {}
+
+NimBLERemoteService::~NimBLERemoteService() {
+    for (auto characteristic: m_characteristicVector) {
+        delete characteristic;
+    }
+}
+
+NimBLERemoteCharacteristic *NimBLERemoteService::getCharacteristic(const char *uuid) {
+    return getCharacteristic(NimBLEUUID(uuid));
+}
+
+NimBLERemoteCharacteristic *NimBLERemoteService::getCharacteristic(const NimBLEUUID &uuid) {
+    std::lock_guard<std::recursive_mutex> lock(hostMutex());
+    for (auto characteristic: m_characteristicVector) {
+        if (characteristic->getUUID() == uuid) {
+            return characteristic;
+        }
+    }
+    return nullptr;
+}
+
+std::vector<NimBLERemoteCharacteristic *> *NimBLERemoteService::getCharacteristics(bool refresh) {
+    return &m_characteristicVector;
+}
+
+NimBLEClient *NimBLERemoteService::getClient() {
+    return m_pClient;
+}
+
+NimBLEUUID NimBLERemoteService::getUUID() const {
+    return m_uuid;
+}
+
+// NimBLERemoteCharacteristic
+
+NimBLERemoteCharacteristic::NimBLERemoteCharacteristic(NimBLERemoteService *pRemoteService, const NimBLEUUID &uuid,
+                                                       uint8_t properties, int role) :
+        m_uuid(uuid), m_charProp(properties), m_pRemoteService(pRemoteService), m_role(role) {}
+
+void NimBLERemoteCharacteristic::onNotify(uint8_t *pData, size_t length) {
+    m_value.assign(reinterpret_cast<const char *>(pData), length);
+    if (m_notifyCallback != nullptr) {
+        // The firmware's notify path must not allocate
+        sim::heap::Counted counted;
+        m_notifyCallback(this, pData, length, true);
+    }
+}
+
+bool NimBLERemoteCharacteristic::canRead() const {
+    return (m_charProp & PROPERTY_READ) != 0;
+}
+
+bool NimBLERemoteCharacteristic::canWrite() const {
+    return (m_charProp & PROPERTY_WRITE) != 0;
+}
+
+bool NimBLERemoteCharacteristic::canWriteNoResponse() const {
+    return (m_charProp & PROPERTY_WRITE_NR) != 0;
+}
+
+bool NimBLERemoteCharacteristic::canNotify() const {
+    return (m_charProp & PROPERTY_NOTIFY) != 0;
+}
+
+bool NimBLERemoteCharacteristic::canIndicate() const {
+    return (m_charProp & PROPERTY_INDICATE) != 0;
+}
+
+NimBLEAttValue NimBLERemoteCharacteristic::readValue(time_t *timestamp) {
+    auto client = m_pRemoteService->getClient();
+    if (!client->isConnected()) {
+        return "";
+    }
+    waitForAir(sim::timing().gattOpMs);
+    std::lock_guard<std::recursive_mutex> lock(hostMutex());
+    if (!client->isConnected()) {
+        return "";
+    }
+    m_value = client->m_peer->readValue(m_role);
+    if (timestamp != nullptr) {
+        *timestamp = time(nullptr);
+    }
+    return m_value;
+}
+
+bool NimBLERemoteCharacteristic::writeValue(const uint8_t *data, size_t length, bool response) {
+    auto client = m_pRemoteService->getClient();
+    if (!client->isConnected()) {
+        return false;
+    }
+    if (response) {
+        waitForAir(sim::timing().gattOpMs);
+    }
+    std::lock_guard<std::recursive_mutex> lock(hostMutex());
+    if (!client->isConnected()) {
+        return false;
+    }
+    client->m_peer->onWrite(m_role, data, length);
+    return true;
+}
+
+bool NimBLERemoteCharacteristic::writeValue(const std::vector<uint8_t> &v, bool response) {
+    return writeValue(v.data(), v.size(), response);
+}
+
+bool NimBLERemoteCharacteristic::writeValue(const char *s, bool response) {
+    return writeValue(reinterpret_cast<const uint8_t *>(s), strlen(s), response);
+}
+
+bool NimBLERemoteCharacteristic::subscribe(bool notifications, notify_callback notifyCallback, bool response) {
+    auto client = m_pRemoteService->getClient();
+    if (!client->isConnected() || !(notifications ? canNotify() : canIndicate())) {
+        return false;
+    }
+    // The CCCD write
+    waitForAir(sim::timing().gattOpMs);
+    std::lock_guard<std::recursive_mutex> lock(hostMutex());
+    if (!client->isConnected()) {
+        return false;
+    }
+    m_notifyCallback = std::move(notifyCallback);
+    removeSubscriptions([this](const Subscription &s) { return s.characteristic == this; });
+    auto peer = client->m_peer;
+    subscriptions.push_back({this, client, peer, m_role,
+                             esp_timer_get_time() + static_cast<int64_t>(peer->notifyIntervalMs()) * 1000});
+    return true;
+}
+
+bool NimBLERemoteCharacteristic::unsubscribe(bool response) {
+    auto client = m_pRemoteService->getClient();
+    if (!client->isConnected()) {
+        return false;
+    }
+    waitForAir(sim::timing().gattOpMs);
+    std::lock_guard<std::recursive_mutex> lock(hostMutex());
+    if (!client->isConnected()) {
+        return false;
+    }
+    removeSubscriptions([this](const Subscription &s) { return s.characteristic == this; });
+    return true;
+}
+
+NimBLERemoteService *NimBLERemoteCharacteristic::getRemoteService() {
+    return m_pRemoteService;
+}
+
+NimBLEUUID NimBLERemoteCharacteristic::getUUID() const {
+    return m_uuid;
+}
+
+// The hub's own GATT server. Nothing connects to it in the simulation.
+
+NimBLECharacteristic::NimBLECharacteristic(const NimBLEUUID &uuid, uint16_t properties) : m_uuid(uuid),
+                                                                                         m_properties(properties) {}
+
+void NimBLECharacteristic::setValue(const uint8_t *data, size_t size) {
+    m_value.assign(reinterpret_cast<const char *>(data), size);
+}
+
+void NimBLECharacteristic::setValue(const std::string &value) {
+    m_value = value;
+}
+
+NimBLEAttValue NimBLECharacteristic::getValue() {
+    return m_value;
+}
+
+void NimBLECharacteristic::notify(bool is_notification) {}
+
+void NimBLECharacteristic::indicate() {}
+
+NimBLEUUID NimBLECharacteristic::getUUID() const {
+    return m_uuid;
+}
+
+NimBLEService::NimBLEService(const NimBLEUUID &uuid) : m_uuid(uuid) {}
+
+NimBLECharacteristic *NimBLEService::createCharacteristic(const char *uuid, uint32_t properties) {
+    auto characteristic = new NimBLECharacteristic(NimBLEUUID(uuid), static_cast<uint16_t>(properties));
+    m_chrVec.push_back(characteristic);
+    return characteristic;
+}
+
+bool NimBLEService::start() {
+    return true;
+}
+
+NimBLEUUID NimBLEService::getUUID() const {
+    return m_uuid;
+}
+
+NimBLEService *NimBLEServer::createService(const char *uuid) {
+    auto service = new NimBLEService(NimBLEUUID(uuid));
+    m_svcVec.push_back(service);
+    return service;
+}
+
+void NimBLEServer::start() {}
+
+void NimBLEAdvertising::addServiceUUID(const char *serviceUUID) {
+    addServiceUUID(NimBLEUUID(serviceUUID));
+}
+
+void NimBLEAdvertising::addServiceUUID(const NimBLEUUID &serviceUUID) {
+    m_serviceUUIDs.push_back(serviceUUID);
+}
+
+void NimBLEAdvertising::setScanResponse(bool scan) {
+    m_scanResp = scan;
+}
+
+bool NimBLEAdvertising::start(uint32_t duration) {
+    m_advertising = true;
+    return true;
+}
+
+bool NimBLEAdvertising::stop() {
+    m_advertising = false;
+    return true;
+}
+
+bool NimBLEAdvertising::isAdvertising() {
+    return m_advertising;
+}
+
+// NimBLEDevice
+
+void NimBLEDevice::hostTask(void *) {
+    std::vector<NimBLERemoteCharacteristic *> due;
+    uint8_t buffer[64];
+    for (;;) {
+        {
+            std::lock_guard<std::recursive_mutex> lock(hostMutex());
+            const int64_t now = esp_timer_get_time();
+            const auto advertisingUs = static_cast<int64_t>(sim::timing().advertisingIntervalMs) * 1000;
+            for (const auto &peripheral: sim::World::get().peripherals()) {
+                if (now < peripheral->nextAdvertisementUs) {
+                    continue;
+                }
+                // The sensors keep their own advertising clocks whether or not anyone listens, so advance by whole
+                // intervals rather than lining every late sensor up on now
+                const int64_t late = now - peripheral->nextAdvertisementUs;
+                peripheral->nextAdvertisementUs += (late / advertisingUs + 1) * advertisingUs;
+                // The sensors stop advertising while a central is connected
+                if (scan != nullptr && scan->isScanning() && peripheral->central == nullptr) {
+                    scan->onAdvertisement(peripheral->advertisement());
+                }
+            }
+            if (scan != nullptr) {
+                scan->onTick(now);
+            }
+
+            due.clear();
+            for (auto &subscription: subscriptions) {
+                if (now >= subscription.nextDueUs) {
+                    subscription.nextDueUs += static_cast<int64_t>(subscription.peer->notifyIntervalMs()) * 1000;
+                    if (subscription.peer->notifies(subscription.role)) {
+                        due.push_back(subscription.characteristic);
+                    }
+                }
+            }
+            for (auto characteristic: due) {
+                // An earlier callback may have unsubscribed or disconnected
+                auto it = std::find_if(subscriptions.begin(), subscriptions.end(), [characteristic](auto &s) {
+                    return s.characteristic == characteristic;
+                });
+                if (it == subscriptions.end()) {
+                    continue;
+                }
+                size_t length = it->peer->nextNotification(it->role, buffer, std::min<size_t>(sizeof(buffer),
+                                                                                               mtu - 3));
+                if (length > 0) {
+                    characteristic->onNotify(buffer, length);
+                }
+            }
+        }
+        vTaskDelay(1);
+    }
+}
+
+void NimBLEDevice::init(const std::string &deviceName) {
+    std::lock_guard<std::recursive_mutex> lock(hostMutex());
+    if (initialized) {
+        return;
+    }
+    initialized = true;
+    scan = new NimBLEScan();
+    // The NimBLE host task runs at configMAX_PRIORITIES - 4 on the ESP32
+    xTaskCreate(hostTask, "nimble_host", 4096, nullptr, configMAX_PRIORITIES - 4, nullptr);
+}
+
+void NimBLEDevice::deinit(bool clearAll) {}
+
+bool NimBLEDevice::getInitialized() {
+    return initialized;
+}
+
+NimBLEAddress NimBLEDevice::getAddress() {
+    return NimBLEAddress(static_cast<uint64_t>(0x246f28000001));
+}
+
+NimBLEScan *NimBLEDevice::getScan() {
+    return scan;
+}
+
+NimBLEServer *NimBLEDevice::createServer() {
+    std::lock_guard<std::recursive_mutex> lock(hostMutex());
+    if (server == nullptr) {
+        server = new NimBLEServer();
+    }
+    return server;
+}
+
+NimBLEServer *NimBLEDevice::getServer() {
+    return server;
+}
+
+NimBLEAdvertising *NimBLEDevice::getAdvertising() {
+    std::lock_guard<std::recursive_mutex> lock(hostMutex());
+    if (advertising == nullptr) {
+        advertising = new NimBLEAdvertising();
+    }
+    return advertising;
+}
+
+bool NimBLEDevice::startAdvertising() {
+    return getAdvertising()->start();
+}
+
+bool NimBLEDevice::stopAdvertising() {
+    return getAdvertising()->stop();
+}
+
+NimBLEClient *NimBLEDevice::createClient(NimBLEAddress peerAddress) {
+    std::lock_guard<std::recursive_mutex> lock(hostMutex());
+    if (clients.size() >= CONFIG_BT_NIMBLE_MAX_CONNECTIONS) {
+        printf("Unable to create client; already at max: %d\n", CONFIG_BT_NIMBLE_MAX_CONNECTIONS);
+        return nullptr;
+    }
+    auto client = new NimBLEClient(peerAddress);
+    clients.push_back(client);
+    return client;
+}
+
+bool NimBLEDevice::deleteClient(NimBLEClient *pClient) {
+    if (pClient == nullptr) {
+        return false;
+    }
+    std::lock_guard<std::recursive_mutex> lock(hostMutex());
+    auto it = std::find(clients.begin(), clients.end(), pClient);
+    if (it == clients.end()) {
+        return false;
+    }
+    if (pClient->isConnected()) {
+        pClient->disconnect();
+    }
+    clients.erase(it);
+    delete pClient;
+    return true;
+}
+
+NimBLEClient *NimBLEDevice::getClientByID(uint16_t conn_id) {
+    std::lock_guard<std::recursive_mutex> lock(hostMutex());
+    for (auto client: clients) {
+        if (client->getConnId() == conn_id) {
+            return client;
+        }
+    }
+    return nullptr;
+}
+
+NimBLEClient *NimBLEDevice::getClientByPeerAddress(const NimBLEAddress &peer_addr) {
+    std::lock_guard<std::recursive_mutex> lock(hostMutex());
+    for (auto client: clients) {
+        if (client->getPeerAddress() == peer_addr) {
+            return client;
+        }
+    }
+    return nullptr;
+}
+
+NimBLEClient *NimBLEDevice::getDisconnectedClient() {
+    std::lock_guard<std::recursive_mutex> lock(hostMutex());
+    for (auto client: clients) {
+        if (!client->isConnected()) {
+            return client;
+        }
+    }
+    return nullptr;
+}
+
+size_t NimBLEDevice::getClientListSize() {
+    std::lock_guard<std::recursive_mutex> lock(hostMutex());
+    return clients.size();
+}
+
+std::vector<NimBLEClient *> NimBLEDevice::getClientList() {
+    std::lock_guard<std::recursive_mutex> lock(hostMutex());
+    return clients;
+}
+
+int NimBLEDevice::setMTU(uint16_t newMtu) {
+    if (newMtu < 23 || newMtu > 517) {
+        return 3;
+    }
+    // Negotiation settles on what the sensors support
+    mtu = std::min<uint16_t>(newMtu, 247);
+    return 0;
+}
+
+uint16_t NimBLEDevice::getMTU() {
+    return mtu;
+}
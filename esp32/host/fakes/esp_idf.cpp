@@ -0,0 +1,317 @@
+// Host fakes of the ESP-IDF system services the firmware uses: esp_timer, esp_system, heap_caps, gpio, the default
+// event loop, wifi, netif and sntp.
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <vector>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "esp_heap_caps.h"
+#include "esp_event.h"
+#include "esp_netif.h"
+#include "esp_wifi.h"
+#include "driver/gpio.h"
+#include "lwip/apps/sntp.h"
+#include "../sim/Simulator.h"
+
+ESP_EVENT_DEFINE_BASE(WIFI_EVENT);
+ESP_EVENT_DEFINE_BASE(IP_EVENT);
+
+static const auto startTime = std::chrono::steady_clock::now();
+
+int64_t esp_timer_get_time() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+esp_reset_reason_t esp_reset_reason() {
+    return ESP_RST_POWERON;
+}
+
+void esp_restart() {
+    fprintf(stderr, "esp_restart: the firmware asked for a restart, ending the run\n");
+    fflush(stdout);
+    fflush(stderr);
+    std::_Exit(2);
+}
+
+uint32_t esp_get_free_heap_size() {
+    return xPortGetFreeHeapSize();
+}
+
+uint32_t esp_get_minimum_free_heap_size() {
+    return xPortGetMinimumEverFreeHeapSize();
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps) {
+    return xPortGetFreeHeapSize();
+}
+
+uint32_t esp_random() {
+    static std::mutex m;
+    static std::mt19937 generator{std::random_device{}()};
+    std::lock_guard<std::mutex> lock(m);
+    return generator();
+}
+
+const char *esp_err_to_name(esp_err_t code) {
+    switch (code) {
+        case ESP_OK:
+            return "ESP_OK";
+        case ESP_FAIL:
+            return "ESP_FAIL";
+        case ESP_ERR_NO_MEM:
+            return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG:
+            return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE:
+            return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_INVALID_SIZE:
+            return "ESP_ERR_INVALID_SIZE";
+        case ESP_ERR_NOT_FOUND:
+            return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_TIMEOUT:
+            return "ESP_ERR_TIMEOUT";
+        case ESP_ERR_NVS_NOT_INITIALIZED:
+            return "ESP_ERR_NVS_NOT_INITIALIZED";
+        case ESP_ERR_NVS_NOT_FOUND:
+            return "ESP_ERR_NVS_NOT_FOUND";
+        case ESP_ERR_NVS_INVALID_LENGTH:
+            return "ESP_ERR_NVS_INVALID_LENGTH";
+        default:
+            return "UNKNOWN ERROR";
+    }
+}
+
+// GPIO
+
+static std::array<std::atomic<uint32_t>, GPIO_NUM_MAX> gpioLevels{};
+
+esp_err_t gpio_config(const gpio_config_t *pGPIOConfig) {
+    if (pGPIOConfig == nullptr || pGPIOConfig->pin_bit_mask >> GPIO_NUM_MAX != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level) {
+    if (gpio_num < 0 || gpio_num >= GPIO_NUM_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    gpioLevels[gpio_num] = level != 0;
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio_num) {
+    if (gpio_num < 0 || gpio_num >= GPIO_NUM_MAX) {
+        return 0;
+    }
+    return static_cast<int>(gpioLevels[gpio_num].load());
+}
+
+// Default event loop
+
+namespace {
+    struct EventHandler {
+        esp_event_base_t base;
+        int32_t id;
+        esp_event_handler_t handler;
+        void *arg;
+    };
+
+    struct PostedEvent {
+        esp_event_base_t base;
+        int32_t id;
+        void *data;
+    };
+
+    std::mutex handlersMutex;
+    std::vector<EventHandler> handlers;
+    QueueHandle_t eventQueue = nullptr;
+
+    [[noreturn]] void eventLoopTask(void *) {
+        for (;;) {
+            PostedEvent event{};
+            if (xQueueReceive(eventQueue, &event, portMAX_DELAY) != pdTRUE) {
+                continue;
+            }
+            std::vector<EventHandler> toCall;
+            {
+                std::lock_guard<std::mutex> lock(handlersMutex);
+                for (const auto &h: handlers) {
+                    if ((h.base == ESP_EVENT_ANY_BASE || h.base == event.base) &&
+                        (h.id == ESP_EVENT_ANY_ID || h.id == event.id)) {
+                        toCall.push_back(h);
+                    }
+                }
+            }
+            for (const auto &h: toCall) {
+                h.handler(h.arg, event.base, event.id, event.data);
+            }
+            free(event.data);
+        }
+    }
+}
+
+esp_err_t esp_event_loop_create_default() {
+    if (eventQueue != nullptr) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    eventQueue = xQueueCreate(32, sizeof(PostedEvent));
+    if (eventQueue == nullptr) {
+        return ESP_ERR_NO_MEM;
+    }
+    // Same priority as the ESP-IDF "sys_evt" task
+    if (xTaskCreate(eventLoopTask, "sys_evt", 4096, nullptr, 20, nullptr) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_event_handler_instance_register(esp_event_base_t event_base, int32_t event_id,
+                                              esp_event_handler_t event_handler, void *event_handler_arg,
+                                              esp_event_handler_instance_t *instance) {
+    if (event_handler == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    std::lock_guard<std::mutex> lock(handlersMutex);
+    handlers.push_back({event_base, event_id, event_handler, event_handler_arg});
+    if (instance != nullptr) {
+        *instance = reinterpret_cast<esp_event_handler_instance_t>(handlers.size());
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_event_handler_register(esp_event_base_t event_base, int32_t event_id,
+                                     esp_event_handler_t event_handler, void *event_handler_arg) {
+    return esp_event_handler_instance_register(event_base, event_id, event_handler, event_handler_arg, nullptr);
+}
+
+esp_err_t esp_event_post(esp_event_base_t event_base, int32_t event_id, const void *event_data,
+                         size_t event_data_size, TickType_t ticks_to_wait) {
+    if (eventQueue == nullptr) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    PostedEvent event{.base = event_base, .id = event_id, .data = nullptr};
+    if (event_data != nullptr && event_data_size > 0) {
+        event.data = malloc(event_data_size);
+        memcpy(event.data, event_data, event_data_size);
+    }
+    if (xQueueSend(eventQueue, &event, ticks_to_wait) != pdTRUE) {
+        free(event.data);
+        return ESP_ERR_TIMEOUT;
+    }
+    return ESP_OK;
+}
+
+// Netif, wifi and sntp
+
+struct esp_netif_obj {
+    int unused;
+};
+
+esp_err_t esp_netif_init() {
+    return ESP_OK;
+}
+
+esp_netif_t *esp_netif_create_default_wifi_sta() {
+    static esp_netif_obj sta{};
+    return &sta;
+}
+
+namespace {
+    TaskHandle_t wifiTaskHandle = nullptr;
+    std::atomic<bool> stationConnected{false};
+
+    void postDisconnected() {
+        wifi_event_sta_disconnected_t disconnected{};
+        // WIFI_REASON_BEACON_TIMEOUT
+        disconnected.reason = 200;
+        esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, &disconnected, sizeof(disconnected), portMAX_DELAY);
+    }
+
+    /// wifiTask plays the access point: it answers connection requests and drops the station when the simulated
+    /// access point goes down
+    [[noreturn]] void wifiTask(void *) {
+        for (;;) {
+            if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(10)) > 0) {
+                vTaskDelay(pdMS_TO_TICKS(sim::timing().wifiConnectMs));
+                if (sim::Network::get().wifiUp()) {
+                    stationConnected = true;
+                    esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_CONNECTED, nullptr, 0, portMAX_DELAY);
+                    ip_event_got_ip_t gotIp{};
+                    const uint8_t ip[4] = {192, 168, 4, 2};
+                    memcpy(&gotIp.ip_info.ip.addr, ip, sizeof(ip));
+                    gotIp.ip_changed = true;
+                    esp_event_post(IP_EVENT, IP_EVENT_STA_GOT_IP, &gotIp, sizeof(gotIp), portMAX_DELAY);
+                } else {
+                    postDisconnected();
+                }
+            } else if (stationConnected && !sim::Network::get().wifiUp()) {
+                stationConnected = false;
+                postDisconnected();
+            }
+        }
+    }
+}
+
+esp_err_t esp_wifi_init(const wifi_init_config_t *config) {
+    if (config == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (wifiTaskHandle != nullptr) {
+        return ESP_OK;
+    }
+    if (xTaskCreate(wifiTask, "wifi", 4096, nullptr, 23, &wifiTaskHandle) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode) {
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_config(wifi_interface_t interface, wifi_config_t *conf) {
+    return conf == nullptr ? ESP_ERR_INVALID_ARG : ESP_OK;
+}
+
+esp_err_t esp_wifi_start() {
+    if (wifiTaskHandle == nullptr) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_START, nullptr, 0, portMAX_DELAY);
+}
+
+esp_err_t esp_wifi_connect() {
+    if (wifiTaskHandle == nullptr) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xTaskNotifyGive(wifiTaskHandle);
+    return ESP_OK;
+}
+
+static std::atomic<bool> sntpRunning{false};
+
+uint8_t sntp_enabled() {
+    return sntpRunning;
+}
+
+void sntp_stop() {
+    sntpRunning = false;
+}
+
+void sntp_setoperatingmode(uint8_t operating_mode) {}
+
+void sntp_setservername(uint8_t idx, const char *server) {}
+
+void sntp_init() {
+    sntpRunning = true;
+}
@@ -0,0 +1,88 @@
+// Host fake of the partition API and the ROM crc. The "readings" partition of partitions.csv is kept in memory for
+// the lifetime of the process and behaves like NOR flash: a write can only clear bits, and only an erase of whole
+// sectors sets them again.
+
+#include <cstring>
+#include <mutex>
+#include <vector>
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+
+namespace {
+    constexpr uint32_t SECTOR_SIZE = 4096;
+
+    const esp_partition_t readings{
+            .type = ESP_PARTITION_TYPE_DATA,
+            .subtype = static_cast<esp_partition_subtype_t>(0x40),
+            .address = 0x190000,
+            .size = 448 * 1024,
+            .erase_size = SECTOR_SIZE,
+            .label = "readings",
+            .encrypted = false,
+    };
+
+    std::mutex flashMutex;
+    std::vector<uint8_t> flash(readings.size, 0xff);
+
+    bool inRange(const esp_partition_t *partition, size_t offset, size_t size) {
+        return partition == &readings && offset <= partition->size && size <= partition->size - offset;
+    }
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char *label) {
+    if (type != readings.type || (subtype != ESP_PARTITION_SUBTYPE_ANY && subtype != readings.subtype)) {
+        return nullptr;
+    }
+    if (label != nullptr && strcmp(label, readings.label) != 0) {
+        return nullptr;
+    }
+    return &readings;
+}
+
+esp_err_t esp_partition_mmap(const esp_partition_t *partition, size_t offset, size_t size,
+                             esp_partition_mmap_memory_t memory, const void **out_ptr,
+                             esp_partition_mmap_handle_t *out_handle) {
+    if (!inRange(partition, offset, size) || memory != ESP_PARTITION_MMAP_DATA || out_ptr == nullptr ||
+        out_handle == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *out_ptr = flash.data() + offset;
+    *out_handle = 1;
+    return ESP_OK;
+}
+
+void esp_partition_munmap(esp_partition_mmap_handle_t) {
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size) {
+    if (!inRange(partition, dst_offset, size) || src == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    std::lock_guard<std::mutex> lock(flashMutex);
+    auto bytes = static_cast<const uint8_t *>(src);
+    for (size_t i = 0; i < size; i++) {
+        flash[dst_offset + i] &= bytes[i];
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size) {
+    if (!inRange(partition, offset, size) || offset % SECTOR_SIZE != 0 || size % SECTOR_SIZE != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    std::lock_guard<std::mutex> lock(flashMutex);
+    memset(flash.data() + offset, 0xff, size);
+    return ESP_OK;
+}
+
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len) {
+    crc = ~crc;
+    for (uint32_t i = 0; i < len; i++) {
+        crc ^= buf[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xedb88320 & (0u - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
@@ -0,0 +1,275 @@
+// Host fake of espressif/esp_websocket_client. Each client runs a task like the real one: it connects to the
+// simulated backend, dispatches events from that task and delivers messages from the backend in chunks of
+// buffer_size bytes, with op_code, payload_len, payload_offset and fin set as the real client sets them. Messages are
+// split into frames of sim::timing().downlinkFrameBytes when it is set.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_websocket_client.h"
+#include "sdkconfig.h"
+#include "../sim/HeapTracker.h"
+#include "../sim/Simulator.h"
+
+ESP_EVENT_DEFINE_BASE(WEBSOCKET_EVENTS);
+
+struct esp_websocket_client {
+    std::string uri;
+    int bufferSize = CONFIG_WS_BUFFER_SIZE;
+    int reconnectTimeoutMs = 10'000;
+    bool autoReconnect = true;
+    esp_event_handler_t handler = nullptr;
+    void *handlerArg = nullptr;
+    int32_t handlerEvent = WEBSOCKET_EVENT_ANY;
+    void *userContext = nullptr;
+    TaskHandle_t task = nullptr;
+    std::atomic<bool> running{false};
+    std::atomic<bool> stopRequested{false};
+    std::atomic<bool> connected{false};
+    /// txLock serializes senders like the client lock of the real implementation
+    std::timed_mutex txLock;
+};
+
+namespace {
+    void dispatch(esp_websocket_client *client, esp_websocket_event_id_t event, const char *data, int len,
+                  int payloadLen, int payloadOffset, bool fin,
+                  ws_transport_opcodes_t opCode = WS_TRANSPORT_OPCODES_BINARY) {
+        if (client->handler == nullptr) {
+            return;
+        }
+        if (client->handlerEvent != WEBSOCKET_EVENT_ANY && client->handlerEvent != event) {
+            return;
+        }
+        esp_websocket_event_data_t eventData{};
+        eventData.data_ptr = data;
+        eventData.data_len = len;
+        eventData.fin = fin;
+        eventData.op_code = opCode;
+        eventData.client = client;
+        eventData.user_context = client->userContext;
+        eventData.payload_len = payloadLen;
+        eventData.payload_offset = payloadOffset;
+        client->handler(client->handlerArg, WEBSOCKET_EVENTS, event, &eventData);
+    }
+
+    void dispatch(esp_websocket_client *client, esp_websocket_event_id_t event) {
+        dispatch(client, event, nullptr, 0, 0, 0, true);
+    }
+
+    /// waitOrStop sleeps for ms milliseconds and returns early with true if the client is being stopped
+    bool waitOrStop(esp_websocket_client *client, uint32_t ms) {
+        for (uint32_t waited = 0; waited < ms; waited += 10) {
+            if (client->stopRequested) {
+                return true;
+            }
+            vTaskDelay(pdMS_TO_TICKS(10));
+        }
+        return client->stopRequested;
+    }
+
+    [[noreturn]] void websocketTask(void *parameters) {
+        auto client = static_cast<esp_websocket_client *>(parameters);
+        auto &network = sim::Network::get();
+        while (!client->stopRequested) {
+            if (!client->connected) {
+                if (waitOrStop(client, sim::timing().websocketConnectMs)) {
+                    break;
+                }
+                if (network.wifiUp() && network.backendUp()) {
+                    client->connected = true;
+                    sim::Metrics::get().websocketConnects++;
+                    dispatch(client, WEBSOCKET_EVENT_CONNECTED);
+                } else {
+                    dispatch(client, WEBSOCKET_EVENT_ERROR);
+                    if (!client->autoReconnect || waitOrStop(client, client->reconnectTimeoutMs)) {
+                        break;
+                    }
+                }
+                continue;
+            }
+            if (!network.wifiUp() || !network.backendUp()) {
+                client->connected = false;
+                dispatch(client, WEBSOCKET_EVENT_DISCONNECTED);
+                if (!client->autoReconnect || waitOrStop(client, client->reconnectTimeoutMs)) {
+                    break;
+                }
+                continue;
+            }
+            std::vector<uint8_t> message;
+            while (client->connected && network.takeToHub(message)) {
+                const int messageLen = static_cast<int>(message.size());
+                const int frameBytes = sim::timing().downlinkFrameBytes > 0
+                                       ? static_cast<int>(sim::timing().downlinkFrameBytes) : std::max(messageLen, 1);
+                int frameStart = 0;
+                do {
+                    const int payloadLen = std::min(frameBytes, messageLen - frameStart);
+                    const bool fin = frameStart + payloadLen == messageLen;
+                    const auto opCode = frameStart == 0 ? WS_TRANSPORT_OPCODES_BINARY : WS_TRANSPORT_OPCODES_CONT;
+                    int offset = 0;
+                    do {
+                        const int len = std::min(client->bufferSize, payloadLen - offset);
+                        dispatch(client, WEBSOCKET_EVENT_DATA,
+                                 reinterpret_cast<const char *>(message.data()) + frameStart + offset, len,
+                                 payloadLen, offset, fin, opCode);
+                        offset += len;
+                    } while (offset < payloadLen);
+                    frameStart += payloadLen;
+                } while (frameStart < messageLen);
+            }
+            vTaskDelay(1);
+        }
+        if (client->connected) {
+            client->connected = false;
+            dispatch(client, WEBSOCKET_EVENT_CLOSED);
+        }
+        client->running = false;
+        vTaskDelete(nullptr);
+        for (;;) {}
+    }
+
+    void stopTask(esp_websocket_client *client) {
+        if (!client->running) {
+            return;
+        }
+        client->stopRequested = true;
+        while (client->running) {
+            vTaskDelay(1);
+        }
+        client->task = nullptr;
+    }
+}
+
+esp_websocket_client_handle_t esp_websocket_client_init(const esp_websocket_client_config_t *config) {
+    if (config == nullptr || config->uri == nullptr) {
+        return nullptr;
+    }
+    auto client = new esp_websocket_client();
+    client->uri = config->uri;
+    if (config->buffer_size > 0) {
+        client->bufferSize = config->buffer_size;
+    }
+    if (config->reconnect_timeout_ms > 0) {
+        client->reconnectTimeoutMs = config->reconnect_timeout_ms;
+    }
+    client->autoReconnect = !config->disable_auto_reconnect;
+    client->userContext = config->user_context;
+    return client;
+}
+
+esp_err_t esp_websocket_client_set_uri(esp_websocket_client_handle_t client, const char *uri) {
+    if (client == nullptr || uri == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    client->uri = uri;
+    return ESP_OK;
+}
+
+esp_err_t esp_websocket_client_start(esp_websocket_client_handle_t client) {
+    if (client == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (client->running) {
+        return ESP_FAIL;
+    }
+    client->stopRequested = false;
+    client->running = true;
+    if (xTaskCreate(websocketTask, "websocket_task", 4096, client, 5, &client->task) != pdPASS) {
+        client->running = false;
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_websocket_client_stop(esp_websocket_client_handle_t client) {
+    if (client == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!client->running) {
+        return ESP_FAIL;
+    }
+    stopTask(client);
+    return ESP_OK;
+}
+
+esp_err_t esp_websocket_client_destroy(esp_websocket_client_handle_t client) {
+    if (client == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    stopTask(client);
+    delete client;
+    return ESP_OK;
+}
+
+esp_err_t esp_websocket_client_close(esp_websocket_client_handle_t client, TickType_t timeout) {
+    if (client == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!client->connected) {
+        return ESP_FAIL;
+    }
+    stopTask(client);
+    return ESP_OK;
+}
+
+esp_err_t esp_websocket_client_close_with_code(esp_websocket_client_handle_t client, int code, const char *data,
+                                               int len, TickType_t timeout) {
+    return esp_websocket_client_close(client, timeout);
+}
+
+bool esp_websocket_client_is_connected(esp_websocket_client_handle_t client) {
+    return client != nullptr && client->connected;
+}
+
+int esp_websocket_client_send_with_opcode(esp_websocket_client_handle_t client, ws_transport_opcodes_t opcode,
+                                          const uint8_t *data, int len, TickType_t timeout) {
+    if (client == nullptr || (data == nullptr && len > 0) || len < 0) {
+        return ESP_FAIL;
+    }
+    if (!client->txLock.try_lock_for(std::chrono::milliseconds(pdTICKS_TO_MS(timeout)))) {
+        return ESP_FAIL;
+    }
+    std::lock_guard<std::timed_mutex> lock(client->txLock, std::adopt_lock);
+    if (!client->connected) {
+        return ESP_FAIL;
+    }
+    const auto &timing = sim::timing();
+    vTaskDelay(pdMS_TO_TICKS(timing.websocketFrameMs + len / timing.websocketBytesPerMs));
+    if (!client->connected) {
+        return ESP_FAIL;
+    }
+    if (opcode == WS_TRANSPORT_OPCODES_BINARY) {
+        // Decoding the frame is the backend's work, not the firmware's
+        sim::heap::Uncounted uncounted;
+        sim::Metrics::get().recordFrame(data, len, esp_timer_get_time());
+    } else {
+        sim::Metrics::get().otherFrames++;
+    }
+    return len;
+}
+
+int esp_websocket_client_send_bin(esp_websocket_client_handle_t client, const char *data, int len, TickType_t timeout) {
+    return esp_websocket_client_send_with_opcode(client, WS_TRANSPORT_OPCODES_BINARY,
+                                                 reinterpret_cast<const uint8_t *>(data), len, timeout);
+}
+
+int esp_websocket_client_send_text(esp_websocket_client_handle_t client, const char *data, int len,
+                                   TickType_t timeout) {
+    return esp_websocket_client_send_with_opcode(client, WS_TRANSPORT_OPCODES_TEXT,
+                                                 reinterpret_cast<const uint8_t *>(data), len, timeout);
+}
+
+esp_err_t esp_websocket_register_events(esp_websocket_client_handle_t client, esp_websocket_event_id_t event,
+                                        esp_event_handler_t event_handler, void *event_handler_arg) {
+    if (client == nullptr || event_handler == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    client->handler = event_handler;
+    client->handlerArg = event_handler_arg;
+    client->handlerEvent = event;
+    return ESP_OK;
+}
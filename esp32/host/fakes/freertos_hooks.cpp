@@ -0,0 +1,43 @@
+// Application hooks required by the FreeRTOS POSIX port with the host FreeRTOSConfig.h
+
+#include <cstdio>
+#include <cstdlib>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+
+extern "C" {
+
+void vApplicationGetIdleTaskMemory(StaticTask_t **ppxIdleTaskTCBBuffer, StackType_t **ppxIdleTaskStackBuffer,
+                                   uint32_t *pulIdleTaskStackSize) {
+    static StaticTask_t idleTaskTCB;
+    static StackType_t idleTaskStack[configMINIMAL_STACK_SIZE];
+    *ppxIdleTaskTCBBuffer = &idleTaskTCB;
+    *ppxIdleTaskStackBuffer = idleTaskStack;
+    *pulIdleTaskStackSize = configMINIMAL_STACK_SIZE;
+}
+
+void vApplicationGetTimerTaskMemory(StaticTask_t **ppxTimerTaskTCBBuffer, StackType_t **ppxTimerTaskStackBuffer,
+                                    uint32_t *pulTimerTaskStackSize) {
+    static StaticTask_t timerTaskTCB;
+    static StackType_t timerTaskStack[configTIMER_TASK_STACK_DEPTH];
+    *ppxTimerTaskTCBBuffer = &timerTaskTCB;
+    *ppxTimerTaskStackBuffer = timerTaskStack;
+    *pulTimerTaskStackSize = configTIMER_TASK_STACK_DEPTH;
+}
+
+void vApplicationMallocFailedHook() {
+    fprintf(stderr, "pvPortMalloc failed: the FreeRTOS heap (configTOTAL_HEAP_SIZE) is exhausted\n");
+    abort();
+}
+
+void vHostAssertCalled(const char *file, int line) {
+    fprintf(stderr, "configASSERT failed at %s:%d\n", file, line);
+    abort();
+}
+
+uint32_t ulHostRunTimeCounter() {
+    return static_cast<uint32_t>(esp_timer_get_time());
+}
+
+}
@@ -0,0 +1,6 @@
+#ifndef ESP32_HOST_NIMBLECLIENT_H
+#define ESP32_HOST_NIMBLECLIENT_H
+
+#include "NimBLEDevice.h"
+
+#endif //ESP32_HOST_NIMBLECLIENT_H
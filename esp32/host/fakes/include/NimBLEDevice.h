@@ -0,0 +1,548 @@
+#ifndef ESP32_HOST_NIMBLEDEVICE_H
+#define ESP32_HOST_NIMBLEDEVICE_H
+
+// Host fake of the parts of esp-nimble-cpp 1.4 that the firmware uses. Remote devices are simulated by
+// sim::Peripheral, and notifications and advertisements are delivered from a "nimble_host" FreeRTOS task
+// the same way the NimBLE host task delivers them on the board. GATT operations wait for that task, so a
+// callback that blocks stalls the whole stack, as it does on the ESP32.
+
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <string>
+#include <vector>
+#include <type_traits>
+#include "sdkconfig.h"
+
+#define BLE_ADDR_PUBLIC 0x00
+#define BLE_ADDR_RANDOM 0x01
+
+#define BLE_HS_CONN_HANDLE_NONE 0xffff
+
+namespace sim {
+    class Peripheral;
+}
+
+/// NimBLEAddress is a 48-bit BLE address. Like esp-nimble-cpp, the native byte order is little endian.
+class NimBLEAddress {
+    uint8_t m_address[6]{};
+    uint8_t m_addrType = BLE_ADDR_PUBLIC;
+public:
+    NimBLEAddress() = default;
+
+    NimBLEAddress(const uint8_t address[6], uint8_t type = BLE_ADDR_PUBLIC);
+
+    NimBLEAddress(const std::string &stringAddress, uint8_t type = BLE_ADDR_PUBLIC);
+
+    NimBLEAddress(const uint64_t &address, uint8_t type = BLE_ADDR_PUBLIC);
+
+    [[nodiscard]] bool equals(const NimBLEAddress &otherAddress) const;
+
+    [[nodiscard]] const uint8_t *getNative() const;
+
+    [[nodiscard]] std::string toString() const;
+
+    [[nodiscard]] uint8_t getType() const;
+
+    bool operator==(const NimBLEAddress &rhs) const;
+
+    bool operator!=(const NimBLEAddress &rhs) const;
+
+    operator std::string() const;
+
+    operator uint64_t() const;
+};
+
+/// NimBLEUUID holds a 16, 32 or 128-bit UUID. The fake keeps the canonical lower case string.
+class NimBLEUUID {
+    std::string m_uuid;
+public:
+    NimBLEUUID() = default;
+
+    NimBLEUUID(const std::string &uuid);
+
+    NimBLEUUID(const char *uuid);
+
+    [[nodiscard]] std::string toString() const;
+
+    bool operator==(const NimBLEUUID &rhs) const;
+
+    bool operator!=(const NimBLEUUID &rhs) const;
+};
+
+/// NimBLEAttValue is the value read from a remote attribute
+using NimBLEAttValue = std::string;
+
+class NimBLEScan;
+
+class NimBLEClient;
+
+/// NimBLEAdvertisedDevice is a single advertisement report
+class NimBLEAdvertisedDevice {
+    NimBLEAddress m_address;
+    std::string m_name;
+    int m_rssi = -127;
+    std::vector<NimBLEUUID> m_serviceUUIDs;
+    std::string m_manufacturerData;
+    time_t m_timestamp = 0;
+
+    friend class NimBLEScan;
+
+    friend class sim::Peripheral;
+
+public:
+    NimBLEAdvertisedDevice() = default;
+
+    [[nodiscard]] NimBLEAddress getAddress() const;
+
+    [[nodiscard]] uint8_t getAddressType() const;
+
+    [[nodiscard]] std::string getName() const;
+
+    [[nodiscard]] bool haveName() const;
+
+    [[nodiscard]] int getRSSI() const;
+
+    [[nodiscard]] bool haveRSSI() const;
+
+    [[nodiscard]] std::string getManufacturerData() const;
+
+    [[nodiscard]] bool haveManufacturerData() const;
+
+    [[nodiscard]] size_t getServiceUUIDCount() const;
+
+    [[nodiscard]] NimBLEUUID getServiceUUID(uint8_t index = 0) const;
+
+    [[nodiscard]] bool haveServiceUUID() const;
+
+    [[nodiscard]] bool isAdvertisingService(const NimBLEUUID &uuid) const;
+
+    [[nodiscard]] time_t getTimestamp() const;
+};
+
+/// NimBLEAdvertisedDeviceCallbacks receives advertisements while a scan is running
+class NimBLEAdvertisedDeviceCallbacks {
+public:
+    virtual ~NimBLEAdvertisedDeviceCallbacks() = default;
+
+    virtual void onResult(NimBLEAdvertisedDevice *advertisedDevice) = 0;
+};
+
+/// NimBLEScanResults is the collection of devices found by a scan
+class NimBLEScanResults {
+    std::vector<NimBLEAdvertisedDevice> m_advertisedDevices;
+
+    friend class NimBLEScan;
+
+public:
+    void dump();
+
+    [[nodiscard]] int getCount();
+
+    NimBLEAdvertisedDevice getDevice(uint32_t i);
+
+    std::vector<NimBLEAdvertisedDevice>::iterator begin();
+
+    std::vector<NimBLEAdvertisedDevice>::iterator end();
+
+    NimBLEAdvertisedDevice *getDevice(const NimBLEAddress &address);
+};
+
+/// NimBLEScan performs scanning. A scan either blocks (getResults) or runs in the background (start with a
+/// callback) with advertisements reported from the host task.
+class NimBLEScan {
+    NimBLEAdvertisedDeviceCallbacks *m_pAdvertisedDeviceCallbacks = nullptr;
+    void (*m_scanCompleteCB)(NimBLEScanResults) = nullptr;
+    NimBLEScanResults m_scanResults;
+    bool m_wantDuplicates = false;
+    bool m_activeScan = false;
+    bool m_duplicateFilter = true;
+    uint8_t m_maxResults = 0xFF;
+    uint16_t m_interval = 100;
+    uint16_t m_window = 100;
+    volatile bool m_scanning = false;
+    int64_t m_endUs = 0;
+    /// m_seen holds the addresses reported during this scan, for the duplicate filter
+    std::vector<uint64_t> m_seen;
+
+    friend class NimBLEDevice;
+
+    friend class sim::Peripheral;
+
+    NimBLEScan() = default;
+
+    /// onAdvertisement is called from the host task for every advertisement heard while scanning
+    void onAdvertisement(const NimBLEAdvertisedDevice &device);
+
+    /// onTick ends a timed background scan
+    void onTick(int64_t nowUs);
+
+public:
+    bool start(uint32_t duration, void (*scanCompleteCB)(NimBLEScanResults), bool is_continue = false);
+
+    NimBLEScanResults start(uint32_t duration, bool is_continue = false);
+
+    bool isScanning();
+
+    void setAdvertisedDeviceCallbacks(NimBLEAdvertisedDeviceCallbacks *pAdvertisedDeviceCallbacks,
+                                      bool wantDuplicates = false);
+
+    void setActiveScan(bool active);
+
+    void setInterval(uint16_t intervalMSecs);
+
+    void setWindow(uint16_t windowMSecs);
+
+    void setDuplicateFilter(bool enabled);
+
+    void setMaxResults(uint8_t maxResults);
+
+    bool stop();
+
+    void clearResults();
+
+    void clearDuplicateCache();
+
+    NimBLEScanResults getResults();
+
+    /// getResults runs a blocking scan for duration milliseconds
+    NimBLEScanResults getResults(uint32_t duration, bool is_continue = false);
+
+    void erase(const NimBLEAddress &address);
+};
+
+class NimBLERemoteService;
+
+class NimBLERemoteCharacteristic;
+
+/// NimBLEConnInfo holds the details of an active connection
+class NimBLEConnInfo {
+    NimBLEAddress m_address;
+    uint16_t m_connHandle = BLE_HS_CONN_HANDLE_NONE;
+    uint16_t m_mtu = 23;
+
+    friend class NimBLEClient;
+
+public:
+    [[nodiscard]] NimBLEAddress getAddress() const;
+
+    [[nodiscard]] NimBLEAddress getIdAddress() const;
+
+    [[nodiscard]] uint16_t getConnHandle() const;
+
+    [[nodiscard]] uint16_t getMTU() const;
+};
+
+/// NimBLEClientCallbacks receives connection events
+class NimBLEClientCallbacks {
+public:
+    virtual ~NimBLEClientCallbacks() = default;
+
+    virtual void onConnect(NimBLEClient *pClient) {}
+
+    virtual void onDisconnect(NimBLEClient *pClient) {}
+};
+
+/// NimBLEClient is a GATT client connected to one peer
+class NimBLEClient {
+    NimBLEAddress m_peerAddress;
+    sim::Peripheral *m_peer = nullptr;
+    volatile bool m_connected = false;
+    uint16_t m_connHandle = BLE_HS_CONN_HANDLE_NONE;
+    std::vector<NimBLERemoteService *> m_servicesVector;
+    NimBLEClientCallbacks *m_pClientCallbacks = nullptr;
+    bool m_deleteCallbacks = false;
+    uint32_t m_connectTimeout = 30'000;
+
+    friend class NimBLEDevice;
+
+    friend class NimBLERemoteCharacteristic;
+
+    friend class sim::Peripheral;
+
+    explicit NimBLEClient(const NimBLEAddress &peerAddress);
+
+    ~NimBLEClient();
+
+    /// onPeerLost is called from the host task when the simulated peer drops the link
+    void onPeerLost();
+
+public:
+    bool connect(NimBLEAdvertisedDevice *device, bool deleteAttributes = true);
+
+    bool connect(const NimBLEAddress &address, bool deleteAttributes = true);
+
+    bool connect(bool deleteAttributes = true);
+
+    int disconnect(uint8_t reason = 0x13);
+
+    [[nodiscard]] NimBLEAddress getPeerAddress() const;
+
+    void setPeerAddress(const NimBLEAddress &address);
+
+    NimBLERemoteService *getService(const char *uuid);
+
+    NimBLERemoteService *getService(const NimBLEUUID &uuid);
+
+    std::vector<NimBLERemoteService *> *getServices(bool refresh = false);
+
+    void deleteServices();
+
+    bool discoverAttributes();
+
+    bool isConnected();
+
+    void setClientCallbacks(NimBLEClientCallbacks *pClientCallbacks, bool deleteCallbacks = true);
+
+    void setConnectTimeout(uint32_t timeout);
+
+    [[nodiscard]] uint16_t getConnId() const;
+
+    NimBLEConnInfo getConnInfo();
+};
+
+/// NimBLERemoteService is a service discovered on a remote device
+class NimBLERemoteService {
+    NimBLEUUID m_uuid;
+    NimBLEClient *m_pClient;
+    std::vector<NimBLERemoteCharacteristic *> m_characteristicVector;
+
+    friend class NimBLEClient;
+
+    friend class sim::Peripheral;
+
+    NimBLERemoteService(NimBLEClient *pClient, const NimBLEUUID &uuid);
+
+    ~NimBLERemoteService();
+
+public:
+    NimBLERemoteCharacteristic *getCharacteristic(const char *uuid);
+
+    NimBLERemoteCharacteristic *getCharacteristic(const NimBLEUUID &uuid);
+
+    std::vector<NimBLERemoteCharacteristic *> *getCharacteristics(bool refresh = false);
+
+    NimBLEClient *getClient();
+
+    [[nodiscard]] NimBLEUUID getUUID() const;
+};
+
+/// NimBLERemoteCharacteristic is a characteristic of a remote service
+class NimBLERemoteCharacteristic {
+public:
+    typedef std::function<void(NimBLERemoteCharacteristic *pBLERemoteCharacteristic, uint8_t *pData, size_t length,
+                               bool isNotify)> notify_callback;
+
+    static constexpr uint8_t PROPERTY_READ = 0x02;
+    static constexpr uint8_t PROPERTY_WRITE_NR = 0x04;
+    static constexpr uint8_t PROPERTY_WRITE = 0x08;
+    static constexpr uint8_t PROPERTY_NOTIFY = 0x10;
+    static constexpr uint8_t PROPERTY_INDICATE = 0x20;
+
+private:
+    NimBLEUUID m_uuid;
+    uint8_t m_charProp;
+    NimBLERemoteService *m_pRemoteService;
+    notify_callback m_notifyCallback;
+    std::string m_value;
+    /// m_role tells the simulated peer which reading this characteristic carries
+    int m_role;
+
+    friend class NimBLERemoteService;
+
+    friend class NimBLEClient;
+
+    friend class NimBLEDevice;
+
+    friend class sim::Peripheral;
+
+    NimBLERemoteCharacteristic(NimBLERemoteService *pRemoteService, const NimBLEUUID &uuid, uint8_t properties,
+                               int role);
+
+    /// onNotify is called from the host task
+    void onNotify(uint8_t *pData, size_t length);
+
+public:
+    [[nodiscard]] bool canRead() const;
+
+    [[nodiscard]] bool canWrite() const;
+
+    [[nodiscard]] bool canWriteNoResponse() const;
+
+    [[nodiscard]] bool canNotify() const;
+
+    [[nodiscard]] bool canIndicate() const;
+
+    NimBLEAttValue readValue(time_t *timestamp = nullptr);
+
+    bool writeValue(const uint8_t *data, size_t length, bool response = false);
+
+    bool writeValue(const std::vector<uint8_t> &v, bool response = false);
+
+    bool writeValue(const char *s, bool response = false);
+
+    template<typename T>
+    bool writeValue(const T &s, bool response = false) {
+        if constexpr (std::is_same_v<T, std::string>) {
+            return writeValue(reinterpret_cast<const uint8_t *>(s.data()), s.size(), response);
+        } else {
+            static_assert(std::is_trivially_copyable_v<T>);
+            return writeValue(reinterpret_cast<const uint8_t *>(&s), sizeof(T), response);
+        }
+    }
+
+    bool subscribe(bool notifications = true, notify_callback notifyCallback = nullptr, bool response = false);
+
+    bool unsubscribe(bool response = false);
+
+    NimBLERemoteService *getRemoteService();
+
+    [[nodiscard]] NimBLEUUID getUUID() const;
+};
+
+namespace NIMBLE_PROPERTY {
+    enum {
+        READ = 0x0002,
+        READ_ENC = 0x0004,
+        READ_AUTHEN = 0x0008,
+        READ_AUTHOR = 0x0010,
+        WRITE = 0x0020,
+        WRITE_NR = 0x0040,
+        WRITE_ENC = 0x0080,
+        WRITE_AUTHEN = 0x0100,
+        WRITE_AUTHOR = 0x0200,
+        BROADCAST = 0x0001,
+        NOTIFY = 0x0010,
+        INDICATE = 0x0020,
+    };
+}
+
+/// NimBLECharacteristic is a characteristic of the hub's own GATT server
+class NimBLECharacteristic {
+    NimBLEUUID m_uuid;
+    uint16_t m_properties;
+    std::string m_value;
+public:
+    NimBLECharacteristic(const NimBLEUUID &uuid, uint16_t properties);
+
+    void setValue(const uint8_t *data, size_t size);
+
+    void setValue(const std::string &value);
+
+    NimBLEAttValue getValue();
+
+    void notify(bool is_notification = true);
+
+    void indicate();
+
+    [[nodiscard]] NimBLEUUID getUUID() const;
+};
+
+/// NimBLEService is a service of the hub's own GATT server
+class NimBLEService {
+    NimBLEUUID m_uuid;
+    std::vector<NimBLECharacteristic *> m_chrVec;
+public:
+    explicit NimBLEService(const NimBLEUUID &uuid);
+
+    NimBLECharacteristic *createCharacteristic(const char *uuid, uint32_t properties = NIMBLE_PROPERTY::READ |
+                                                                                     NIMBLE_PROPERTY::WRITE);
+
+    bool start();
+
+    [[nodiscard]] NimBLEUUID getUUID() const;
+};
+
+/// NimBLEServer is the hub's own GATT server
+class NimBLEServer {
+    std::vector<NimBLEService *> m_svcVec;
+public:
+    NimBLEService *createService(const char *uuid);
+
+    void start();
+};
+
+/// NimBLEAdvertising controls the hub's own advertisements
+class NimBLEAdvertising {
+    std::vector<NimBLEUUID> m_serviceUUIDs;
+    bool m_scanResp = false;
+    bool m_advertising = false;
+public:
+    void addServiceUUID(const char *serviceUUID);
+
+    void addServiceUUID(const NimBLEUUID &serviceUUID);
+
+    void setScanResponse(bool scan);
+
+    bool start(uint32_t duration = 0);
+
+    bool stop();
+
+    bool isAdvertising();
+};
+
+/// NimBLEDevice is the entry point of the stack
+class NimBLEDevice {
+    /// hostTask delivers advertisements and notifications, like the NimBLE host task
+    [[noreturn]] static void hostTask(void *);
+
+public:
+    static void init(const std::string &deviceName);
+
+    static void deinit(bool clearAll = false);
+
+    static bool getInitialized();
+
+    static NimBLEAddress getAddress();
+
+    static NimBLEScan *getScan();
+
+    static NimBLEServer *createServer();
+
+    static NimBLEServer *getServer();
+
+    static NimBLEAdvertising *getAdvertising();
+
+    static bool startAdvertising();
+
+    static bool stopAdvertising();
+
+    /// createClient returns nullptr when CONFIG_BT_NIMBLE_MAX_CONNECTIONS clients already exist
+    static NimBLEClient *createClient(NimBLEAddress peerAddress = NimBLEAddress(""));
+
+    static bool deleteClient(NimBLEClient *pClient);
+
+    static NimBLEClient *getClientByID(uint16_t conn_id);
+
+    static NimBLEClient *getClientByPeerAddress(const NimBLEAddress &peer_addr);
+
+    static NimBLEClient *getDisconnectedClient();
+
+    static size_t getClientListSize();
+
+    static std::vector<NimBLEClient *> getClientList();
+
+    static int setMTU(uint16_t mtu);
+
+    static uint16_t getMTU();
+};
+
+// esp-nimble-cpp keeps the Arduino BLE names as aliases
+#define BLEDevice NimBLEDevice
+#define BLEClient NimBLEClient
+#define BLERemoteService NimBLERemoteService
+#define BLERemoteCharacteristic NimBLERemoteCharacteristic
+#define BLEAdvertisedDevice NimBLEAdvertisedDevice
+#define BLEScan NimBLEScan
+#define BLEScanResults NimBLEScanResults
+#define BLEUUID NimBLEUUID
+#define BLEAddress NimBLEAddress
+#define BLEServer NimBLEServer
+#define BLEService NimBLEService
+#define BLECharacteristic NimBLECharacteristic
+#define BLEAdvertising NimBLEAdvertising
+#define BLEAdvertisedDeviceCallbacks NimBLEAdvertisedDeviceCallbacks
+#define BLEClientCallbacks NimBLEClientCallbacks
+
+#endif //ESP32_HOST_NIMBLEDEVICE_H
@@ -0,0 +1,21 @@
+#ifndef ESP32_HOST_ESP_HEAP_CAPS_H
+#define ESP32_HOST_ESP_HEAP_CAPS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_DEFAULT (1 << 12)
+
+/// heap_caps_get_largest_free_block returns the FreeRTOS heap's free size; the host heap isn't fragmented
+size_t heap_caps_get_largest_free_block(uint32_t caps);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //ESP32_HOST_ESP_HEAP_CAPS_H
@@ -0,0 +1,16 @@
+#ifndef ESP32_HOST_ESP_RANDOM_H
+#define ESP32_HOST_ESP_RANDOM_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint32_t esp_random(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //ESP32_HOST_ESP_RANDOM_H
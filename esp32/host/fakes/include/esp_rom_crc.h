@@ -0,0 +1,17 @@
+#ifndef ESP32_HOST_ESP_ROM_CRC_H
+#define ESP32_HOST_ESP_ROM_CRC_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// esp_rom_crc32_le is the little endian CRC-32 of the ROM, as zlib computes it
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //ESP32_HOST_ESP_ROM_CRC_H
@@ -0,0 +1,40 @@
+#ifndef ESP32_HOST_ESP_SYSTEM_H
+#define ESP32_HOST_ESP_SYSTEM_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_random.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    ESP_RST_UNKNOWN,
+    ESP_RST_POWERON,
+    ESP_RST_EXT,
+    ESP_RST_SW,
+    ESP_RST_PANIC,
+    ESP_RST_INT_WDT,
+    ESP_RST_TASK_WDT,
+    ESP_RST_WDT,
+    ESP_RST_DEEPSLEEP,
+    ESP_RST_BROWNOUT,
+    ESP_RST_SDIO,
+} esp_reset_reason_t;
+
+esp_reset_reason_t esp_reset_reason(void);
+
+/// esp_get_free_heap_size and esp_get_minimum_free_heap_size report the FreeRTOS heap
+uint32_t esp_get_free_heap_size(void);
+
+uint32_t esp_get_minimum_free_heap_size(void);
+
+/// esp_restart ends the host process: a restart on the board loses all state, so a benchmark run is over
+void esp_restart(void) __attribute__((noreturn));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //ESP32_HOST_ESP_SYSTEM_H
@@ -0,0 +1,6 @@
+#ifndef ESP32_HOST_ESP_TASK_WDT_H
+#define ESP32_HOST_ESP_TASK_WDT_H
+
+#include "esp_err.h"
+
+#endif //ESP32_HOST_ESP_TASK_WDT_H
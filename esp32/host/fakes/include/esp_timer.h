@@ -0,0 +1,17 @@
+#ifndef ESP32_HOST_ESP_TIMER_H
+#define ESP32_HOST_ESP_TIMER_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// esp_timer_get_time returns microseconds since the host build started (monotonic)
+int64_t esp_timer_get_time(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //ESP32_HOST_ESP_TIMER_H
@@ -0,0 +1,11 @@
+#ifndef ESP32_HOST_FREERTOS_FREERTOS_H
+#define ESP32_HOST_FREERTOS_FREERTOS_H
+
+// ESP-IDF exposes the kernel headers under freertos/; the upstream kernel used by the host build does not.
+#include <FreeRTOS.h>
+// The ESP32 port pulls esp_system.h (esp_restart, esp_reset_reason, esp_random) and esp_timer.h (the run time
+// stats counter) in through portmacro.h, and the firmware relies on that
+#include "esp_system.h"
+#include "esp_timer.h"
+
+#endif //ESP32_HOST_FREERTOS_FREERTOS_H
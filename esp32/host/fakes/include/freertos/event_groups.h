@@ -0,0 +1,8 @@
+#ifndef ESP32_HOST_FREERTOS_EVENT_GROUPS_H
+#define ESP32_HOST_FREERTOS_EVENT_GROUPS_H
+
+// ESP-IDF exposes the kernel headers under freertos/; the upstream kernel used by the host build does not.
+#include "freertos/FreeRTOS.h"
+#include <event_groups.h>
+
+#endif //ESP32_HOST_FREERTOS_EVENT_GROUPS_H
@@ -0,0 +1,8 @@
+#ifndef ESP32_HOST_FREERTOS_QUEUE_H
+#define ESP32_HOST_FREERTOS_QUEUE_H
+
+// ESP-IDF exposes the kernel headers under freertos/; the upstream kernel used by the host build does not.
+#include "freertos/FreeRTOS.h"
+#include <queue.h>
+
+#endif //ESP32_HOST_FREERTOS_QUEUE_H
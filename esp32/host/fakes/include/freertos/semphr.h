@@ -0,0 +1,8 @@
+#ifndef ESP32_HOST_FREERTOS_SEMPHR_H
+#define ESP32_HOST_FREERTOS_SEMPHR_H
+
+// ESP-IDF exposes the kernel headers under freertos/; the upstream kernel used by the host build does not.
+#include "freertos/FreeRTOS.h"
+#include <semphr.h>
+
+#endif //ESP32_HOST_FREERTOS_SEMPHR_H
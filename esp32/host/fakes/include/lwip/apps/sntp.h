@@ -0,0 +1,29 @@
+#ifndef ESP32_HOST_LWIP_APPS_SNTP_H
+#define ESP32_HOST_LWIP_APPS_SNTP_H
+
+#include <stdint.h>
+#include <time.h>
+#include <sys/time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The host clock is already synchronised, so the SNTP client only has to exist.
+#define SNTP_OPMODE_POLL 0
+
+uint8_t sntp_enabled(void);
+
+void sntp_stop(void);
+
+void sntp_setoperatingmode(uint8_t operating_mode);
+
+void sntp_setservername(uint8_t idx, const char *server);
+
+void sntp_init(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //ESP32_HOST_LWIP_APPS_SNTP_H
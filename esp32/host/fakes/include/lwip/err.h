@@ -0,0 +1,8 @@
+#ifndef ESP32_HOST_LWIP_ERR_H
+#define ESP32_HOST_LWIP_ERR_H
+
+typedef signed char err_t;
+
+#define ERR_OK 0
+
+#endif //ESP32_HOST_LWIP_ERR_H
@@ -0,0 +1,18 @@
+#ifndef ESP32_HOST_NVS_FLASH_H
+#define ESP32_HOST_NVS_FLASH_H
+
+#include "nvs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t nvs_flash_init(void);
+
+esp_err_t nvs_flash_deinit(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //ESP32_HOST_NVS_FLASH_H
@@ -0,0 +1,9 @@
+#ifndef ESP32_HOST_SDKCONFIG_H
+#define ESP32_HOST_SDKCONFIG_H
+
+// The subset of esp32/sdkconfig that the firmware and the fakes read. Keep in sync with the board config.
+#define CONFIG_BT_NIMBLE_MAX_CONNECTIONS 9
+#define CONFIG_WS_BUFFER_SIZE 1024
+#define CONFIG_FREERTOS_HZ 100
+
+#endif //ESP32_HOST_SDKCONFIG_H
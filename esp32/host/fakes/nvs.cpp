@@ -0,0 +1,123 @@
+// Host fake of NVS. Namespaces are kept in memory for the lifetime of the process.
+
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "nvs.h"
+#include "nvs_flash.h"
+
+namespace {
+    std::mutex nvsMutex;
+    bool initialized = false;
+    std::map<std::string, std::map<std::string, std::vector<uint8_t>>> namespaces;
+    std::map<nvs_handle_t, std::string> openHandles;
+    nvs_handle_t nextHandle = 1;
+
+    /// entries returns the namespace behind handle or nullptr. nvsMutex must be held.
+    std::map<std::string, std::vector<uint8_t>> *entries(nvs_handle_t handle) {
+        auto it = openHandles.find(handle);
+        if (it == openHandles.end()) {
+            return nullptr;
+        }
+        return &namespaces[it->second];
+    }
+
+    esp_err_t get(nvs_handle_t handle, const char *key, void *out_value, size_t *length) {
+        std::lock_guard<std::mutex> lock(nvsMutex);
+        auto values = entries(handle);
+        if (values == nullptr || key == nullptr || length == nullptr) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        auto it = values->find(key);
+        if (it == values->end()) {
+            return ESP_ERR_NVS_NOT_FOUND;
+        }
+        if (out_value == nullptr) {
+            *length = it->second.size();
+            return ESP_OK;
+        }
+        if (*length < it->second.size()) {
+            return ESP_ERR_NVS_INVALID_LENGTH;
+        }
+        memcpy(out_value, it->second.data(), it->second.size());
+        *length = it->second.size();
+        return ESP_OK;
+    }
+
+    esp_err_t set(nvs_handle_t handle, const char *key, const void *value, size_t length) {
+        std::lock_guard<std::mutex> lock(nvsMutex);
+        auto values = entries(handle);
+        if (values == nullptr || key == nullptr || (value == nullptr && length > 0)) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        auto bytes = static_cast<const uint8_t *>(value);
+        (*values)[key] = std::vector<uint8_t>(bytes, bytes + length);
+        return ESP_OK;
+    }
+}
+
+esp_err_t nvs_flash_init() {
+    std::lock_guard<std::mutex> lock(nvsMutex);
+    initialized = true;
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_deinit() {
+    std::lock_guard<std::mutex> lock(nvsMutex);
+    initialized = false;
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle) {
+    std::lock_guard<std::mutex> lock(nvsMutex);
+    if (!initialized) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+    if (name == nullptr || out_handle == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *out_handle = nextHandle++;
+    openHandles[*out_handle] = name;
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle) {
+    std::lock_guard<std::mutex> lock(nvsMutex);
+    openHandles.erase(handle);
+}
+
+esp_err_t nvs_get_str(nvs_handle_t handle, const char *key, char *out_value, size_t *length) {
+    return get(handle, key, out_value, length);
+}
+
+esp_err_t nvs_set_str(nvs_handle_t handle, const char *key, const char *value) {
+    if (value == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // Like NVS, the stored length includes the terminating null
+    return set(handle, key, value, strlen(value) + 1);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length) {
+    return get(handle, key, out_value, length);
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length) {
+    return set(handle, key, value, length);
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key) {
+    std::lock_guard<std::mutex> lock(nvsMutex);
+    auto values = entries(handle);
+    if (values == nullptr || key == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return values->erase(key) > 0 ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+    std::lock_guard<std::mutex> lock(nvsMutex);
+    return openHandles.count(handle) > 0 ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
@@ -0,0 +1,140 @@
+// flashlog_bench fills the flash log on the host partition fake, reboots it by recovering a fresh FlashLog from the
+// same flash, and checks that the readings waiting to be sent come back. It reports how long appending and recovering
+// take.
+//
+//   flashlog_bench
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include "FlashLog.h"
+
+namespace {
+    /// reading returns the i-th reading written by the bench
+    SensorData reading(size_t i) {
+        SensorData r = SensorData_init_zero;
+        snprintf(r.address, sizeof(r.address), "aa:bb:cc:dd:%02x:%02x", static_cast<unsigned>((i >> 8) & 0xff),
+                 static_cast<unsigned>(i & 0xff));
+        r.data_type = DataType_DATA_TYPE_TEMP;
+        r.value = static_cast<float>(i);
+        r.timestamp = 1'700'000'000 + static_cast<long long>(i);
+        return r;
+    }
+
+    /// erase wipes the readings partition, as a freshly flashed hub has it
+    void erase() {
+        const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                                                    ESP_PARTITION_SUBTYPE_ANY, FLASH_LOG_LABEL);
+        esp_partition_erase_range(partition, 0, partition->size);
+    }
+
+    /// capacity returns how many readings the partition holds
+    size_t capacity() {
+        const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                                                    ESP_PARTITION_SUBTYPE_ANY, FLASH_LOG_LABEL);
+        return partition->size / sizeof(FlashLogRecord);
+    }
+
+    int failures = 0;
+
+    /// check reports one case and counts it as failed unless the log recovered expected readings starting with the
+    /// reading numbered first
+    void check(const char *name, FlashLog &log, size_t expected, size_t first) {
+        SensorData oldest = SensorData_init_zero;
+        bool const ok = log.size() == expected &&
+                        (expected == 0 || (log.peek(&oldest, 1) == 1 && oldest.value == reading(first).value));
+        printf("%-28s %6zu waiting, expected %6zu: %s\n", name, log.size(), expected, ok ? "ok" : "FAILED");
+        if (!ok) {
+            failures++;
+        }
+    }
+
+    /// fill appends count readings numbered from first, and returns how long it took per reading
+    double fill(FlashLog &log, size_t first, size_t count) {
+        auto const start = std::chrono::steady_clock::now();
+        for (size_t i = first; i < first + count; i++) {
+            if (!log.append(reading(i))) {
+                printf("appending reading %zu failed\n", i);
+                failures++;
+                break;
+            }
+        }
+        std::chrono::duration<double, std::nano> const took = std::chrono::steady_clock::now() - start;
+        return count == 0 ? 0 : took.count() / static_cast<double>(count);
+    }
+}
+
+int main() {
+    size_t const slots = capacity();
+    size_t const perSector = 4096 / sizeof(FlashLogRecord);
+
+    erase();
+    {
+        FlashLog log;
+        log.begin();
+        double const ns = fill(log, 0, slots / 2);
+        FlashLog rebooted;
+        auto const start = std::chrono::steady_clock::now();
+        rebooted.begin();
+        std::chrono::duration<double, std::milli> const took = std::chrono::steady_clock::now() - start;
+        check("half full", rebooted, slots / 2, 0);
+        printf("%-28s %.0f ns/reading to append, %.2f ms to recover %zu slots\n", "", ns, took.count(), slots);
+    }
+
+    erase();
+    {
+        FlashLog log;
+        log.begin();
+        fill(log, 0, slots);
+        FlashLog rebooted;
+        rebooted.begin();
+        check("full", rebooted, slots, 0);
+    }
+
+    erase();
+    {
+        // One more than fits drops the oldest sector
+        FlashLog log;
+        log.begin();
+        fill(log, 0, slots + 1);
+        check("one past full", log, slots - perSector + 1, perSector);
+        FlashLog rebooted;
+        rebooted.begin();
+        check("one past full, rebooted", rebooted, slots - perSector + 1, perSector);
+    }
+
+    erase();
+    {
+        FlashLog log;
+        log.begin();
+        fill(log, 0, slots);
+        log.consume(100);
+        FlashLog rebooted;
+        rebooted.begin();
+        check("full, 100 sent", rebooted, slots - 100, 100);
+        rebooted.consume(slots - 100);
+        FlashLog again;
+        again.begin();
+        check("full, all sent", again, 0, 0);
+    }
+
+    erase();
+    {
+        FlashLog log;
+        log.begin();
+        SensorData bad = reading(0);
+        strcpy(bad.address, "not an address");
+        bool const appended = log.append(bad);
+        printf("%-28s %s\n", "bad address", appended ? "FAILED, it was taken" : "ok, refused");
+        if (appended) {
+            failures++;
+        }
+        check("bad address", log, 0, 0);
+    }
+
+    if (failures > 0) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,311 @@
+// framer_bench measures how fast a custom sensor's notification stream is cut into readings, the way the hub first
+// did it (bytes pushed one at a time into a std::deque, rescanned for every null byte and parsed with std::stof) and
+// with safe_std::frame_splitter and parsePicoFrame. The stream is made of readings like T23.45, each followed by a
+// null byte, and arrives in notifications of --chunk bytes.
+//
+// With --fuzz it instead feeds the framer a seed corpus of streams and random mutations of it, and checks that every
+// frame it hands out fits, that every reading parsed is finite and that a clean reading after the garbage comes out.
+//
+//   framer_bench --readings 200000 --chunk 20
+//   framer_bench --fuzz 100000 --seed 1
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+#include "drivers/PicoFrame.h"
+#include "lib/frame_splitter.h"
+
+namespace {
+    /// allocations counts the calls to operator new, to show which path allocates
+    size_t allocations = 0;
+}
+
+void *operator new(size_t size) {
+    allocations++;
+    if (void *p = malloc(size == 0 ? 1 : size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    free(p);
+}
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+    using Framer = safe_std::frame_splitter<PICO_READING_MAX>;
+
+    struct Options {
+        size_t readings = 200000;
+        size_t chunk = 20;
+        size_t fuzz = 0;
+        unsigned seed = 1;
+    };
+
+    struct Result {
+        size_t readings = 0;
+        double sum = 0;
+        double nsPerByte = 0;
+        size_t allocations = 0;
+    };
+
+    void usage(const char *name) {
+        fprintf(stderr, "usage: %s [--readings N] [--chunk N] [--fuzz N] [--seed S]\n"
+                        "  --readings   readings in the stream (default 200000)\n"
+                        "  --chunk      bytes in a notification (default 20)\n"
+                        "  --fuzz       mutated streams to check the framer with instead of timing it\n"
+                        "  --seed       seed of the mutations (default 1)\n", name);
+        exit(1);
+    }
+
+    Options parse(int argc, char **argv) {
+        Options o;
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            if (i + 1 == argc) {
+                usage(argv[0]);
+            }
+            const char *value = argv[++i];
+            if (arg == "--readings") {
+                o.readings = strtoul(value, nullptr, 10);
+            } else if (arg == "--chunk") {
+                o.chunk = strtoul(value, nullptr, 10);
+            } else if (arg == "--fuzz") {
+                o.fuzz = strtoul(value, nullptr, 10);
+            } else if (arg == "--seed") {
+                o.seed = strtoul(value, nullptr, 10);
+            } else {
+                usage(argv[0]);
+            }
+        }
+        if (o.readings == 0 || o.chunk == 0) {
+            usage(argv[0]);
+        }
+        return o;
+    }
+
+    /// stream makes what a Pico sends: a temperature and a humidity at a time, each followed by a null byte. It
+    /// starts in the middle of a reading, as when the hub subscribes while the Pico is sending.
+    std::vector<uint8_t> stream(size_t readings) {
+        std::vector<uint8_t> s = {'.', '5', '0', 0};
+        std::mt19937 generator{42};
+        std::normal_distribution<float> noise{0, 0.5f};
+        char reading[PICO_READING_MAX + 1];
+        for (size_t i = 0; i < readings; i++) {
+            int const n = i % 2 == 0 ? snprintf(reading, sizeof(reading), "T%.2f", 21 + noise(generator))
+                                     : snprintf(reading, sizeof(reading), "H%.2f", 45 + noise(generator));
+            s.insert(s.end(), reading, reading + n + 1);
+        }
+        return s;
+    }
+
+    /// DequeFramer is how the hub first framed the stream, kept here to compare against
+    struct DequeFramer {
+        std::deque<uint8_t> data;
+        bool hitNull = false;
+
+        template<typename F>
+        void feed(const uint8_t *chunk, size_t length, const F &onReading) {
+            for (size_t i = 0; i < length; i++) {
+                if (chunk[i] == 0) {
+                    hitNull = true;
+                }
+                if (hitNull) {
+                    data.emplace_front(chunk[i]);
+                }
+            }
+            std::vector<std::string> full;
+            std::string tmp;
+            while (std::any_of(data.begin(), data.end(), [](auto a) { return a == 0; })) {
+                unsigned char const c = data.back();
+                data.pop_back();
+                if (c == 0) {
+                    full.emplace_back(tmp);
+                    tmp.clear();
+                } else {
+                    tmp += static_cast<char>(c);
+                }
+            }
+            // What was taken off past the last null byte goes back
+            for (char c: tmp) {
+                data.emplace_back(static_cast<uint8_t>(c));
+            }
+            for (const auto &reading: full) {
+                if (reading.size() >= 3) {
+                    onReading(std::stof(reading.substr(1)));
+                }
+            }
+        }
+    };
+
+    /// measure feeds s to framer chunk bytes at a time and adds up the readings
+    template<typename Framer>
+    Result measure(const std::vector<uint8_t> &s, size_t chunk, Framer &framer) {
+        Result result;
+        size_t const allocationsBefore = allocations;
+        auto const start = Clock::now();
+        for (size_t i = 0; i < s.size(); i += chunk) {
+            framer.feed(s.data() + i, std::min(chunk, s.size() - i), [&result](float value) {
+                result.readings++;
+                result.sum += value;
+            });
+        }
+        auto const elapsed = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+        result.nsPerByte = elapsed / static_cast<double>(s.size());
+        result.allocations = allocations - allocationsBefore;
+        return result;
+    }
+
+    /// SplitterFramer hands the readings parsePicoFrame finds in what frame_splitter cuts out
+    struct SplitterFramer {
+        Framer frames;
+
+        template<typename F>
+        void feed(const uint8_t *chunk, size_t length, const F &onReading) {
+            frames.feed(chunk, length, [&onReading](const char *frame, size_t size) {
+                auto const reading = parsePicoFrame(frame, size);
+                if (reading.has_value()) {
+                    onReading(reading->value);
+                }
+            });
+        }
+    };
+
+    void print(const char *name, const Result &result) {
+        printf("%-8s %8zu readings, sum %12.2f %8.2f ns/byte %10zu allocations\n", name, result.readings, result.sum,
+               result.nsPerByte, result.allocations);
+    }
+
+    /// CORPUS is the seed of the fuzzing: streams as Picos send them, and the ways they were seen to go wrong
+    const std::string CORPUS[] = {
+            std::string("T23.45\0H45.10\0", 14),
+            std::string("3.45\0t21\0h40\0p-3.5\0", 19),
+            std::string("\0\0\0T1\0", 6),
+            std::string("T\0H.\0H-\0T+.\0", 12),
+            std::string("X23.45\0T23.45.6\0T 23\0Tnan\0Tinf\0T1e9\0", 36),
+            std::string("T123456789012345678901234567890\0T1.5\0", 37),
+            std::string("\xff\xfe\x80T2.5\0\x7fH3\0", 12),
+    };
+
+    /// mutate makes a stream out of the corpus and breaks it the way a radio link or a buggy sensor would
+    std::string mutate(std::mt19937 &generator) {
+        std::uniform_int_distribution<size_t> pickSeed{0, std::size(CORPUS) - 1};
+        std::uniform_int_distribution<int> byte{0, 255};
+        std::string s;
+        for (int i = std::uniform_int_distribution<int>{1, 4}(generator); i > 0; i--) {
+            s += CORPUS[pickSeed(generator)];
+        }
+        for (int i = std::uniform_int_distribution<int>{0, 6}(generator); i > 0 && !s.empty(); i--) {
+            std::uniform_int_distribution<size_t> at{0, s.size() - 1};
+            switch (std::uniform_int_distribution<int>{0, 4}(generator)) {
+                case 0:
+                    // A flipped byte
+                    s[at(generator)] = static_cast<char>(byte(generator));
+                    break;
+                case 1:
+                    // A lost null byte, which runs two readings together
+                    if (auto const p = s.find('\0', at(generator)); p != std::string::npos) {
+                        s.erase(p, 1);
+                    }
+                    break;
+                case 2:
+                    // Garbage
+                    for (int n = std::uniform_int_distribution<int>{1, 40}(generator); n > 0; n--) {
+                        s.insert(s.begin() + static_cast<long>(at(generator)), static_cast<char>(byte(generator)));
+                    }
+                    break;
+                case 3:
+                    // A long run without a null byte
+                    s.insert(at(generator), std::uniform_int_distribution<size_t>{1, 100}(generator),
+                             static_cast<char>(std::uniform_int_distribution<int>{1, 255}(generator)));
+                    break;
+                default:
+                    // A cut
+                    s.erase(at(generator), std::uniform_int_distribution<size_t>{1, 10}(generator));
+                    break;
+            }
+        }
+        return s;
+    }
+
+    /// fuzz feeds count mutated streams to a framer in random chunks and checks what comes out. It returns the number
+    /// of failed checks.
+    size_t fuzz(const Options &options) {
+        std::mt19937 generator{options.seed};
+        std::uniform_int_distribution<size_t> chunk{1, 40};
+        size_t failures = 0;
+        size_t frames = 0;
+        size_t readings = 0;
+        size_t framerAllocations = 0;
+        auto fail = [&failures](size_t n, const char *what) {
+            if (failures++ < 10) {
+                fprintf(stderr, "stream %zu: %s\n", n, what);
+            }
+        };
+        for (size_t n = 0; n < options.fuzz; n++) {
+            std::string s = mutate(generator);
+            // The framer must come back in step after whatever came before
+            s += std::string("\0T1.00\0", 7);
+            auto const *data = reinterpret_cast<const uint8_t *>(s.data());
+            Framer framer;
+            bool sawLast = false;
+            for (size_t i = 0; i < s.size();) {
+                size_t const length = std::min(chunk(generator), s.size() - i);
+                size_t const allocationsBefore = allocations;
+                framer.feed(data + i, length, [&](const char *frame, size_t size) {
+                    frames++;
+                    sawLast = false;
+                    if (size > PICO_READING_MAX || frame[size] != '\0' || memchr(frame, 0, size) != nullptr) {
+                        fail(n, "frame out of bounds");
+                    }
+                    auto const reading = parsePicoFrame(frame, size);
+                    if (!reading.has_value()) {
+                        return;
+                    }
+                    readings++;
+                    if (!std::isfinite(reading->value)) {
+                        fail(n, "reading isn't finite");
+                    }
+                    sawLast = reading->measureType == DHT22_TEMP && reading->value == 1.0f;
+                });
+                framerAllocations += allocations - allocationsBefore;
+                i += length;
+            }
+            if (!sawLast) {
+                fail(n, "didn't resynchronize");
+            }
+        }
+        printf("%zu streams, %zu frames, %zu readings, %zu allocations in the framer, %zu failures\n", options.fuzz,
+               frames, readings, framerAllocations, failures);
+        return failures;
+    }
+}
+
+int main(int argc, char **argv) {
+    Options const options = parse(argc, argv);
+    if (options.fuzz > 0) {
+        return fuzz(options) == 0 ? 0 : 1;
+    }
+
+    std::vector<uint8_t> const s = stream(options.readings);
+    printf("%zu readings in %zu bytes, %zu bytes a notification\n", options.readings, s.size(), options.chunk);
+    DequeFramer deque;
+    print("deque", measure(s, options.chunk, deque));
+    SplitterFramer splitter;
+    Result const result = measure(s, options.chunk, splitter);
+    print("framer", result);
+    return result.readings == options.readings ? 0 : 1;
+}
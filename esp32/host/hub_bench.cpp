@@ -0,0 +1,401 @@
+// hub_bench runs the hub firmware on the FreeRTOS POSIX port against simulated sensors and a simulated backend,
+// and reports readings/sec, notify to websocket send latency and peak heap.
+//
+//   hub_bench --ti 100 --nordic 100 --pico 100 --beacon 100 --seconds 120 --notify-ms 1000
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include <unistd.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "pb_encode.h"
+#include "AdvertisedReadings.h"
+#include "BleAddr.h"
+#include "Constants.h"
+#include "GetSensorData.h"
+#include "TypeOfDevice.h"
+#include "generated/firmware_backend.pb.h"
+#include "packets/Trace.h"
+#include "sim/HeapTracker.h"
+#include "sim/Simulator.h"
+
+extern "C" [[noreturn]] void app_main();
+
+namespace {
+    struct Options {
+        int ti = 10;
+        int nordic = 10;
+        int pico = 10;
+        int beacon = 0;
+        uint32_t seconds = 60;
+        uint32_t notifyMs = 1000;
+        uint32_t outageAt = 0;
+        uint32_t outageFor = 0;
+        bool json = false;
+        bool log = false;
+        bool configureViaCommand = false;
+        uint32_t downlinkFrameBytes = 0;
+        int commandBurst = 1;
+        bool checkAllocations = false;
+        /// tracePath is where the trace the hub uploads at the end of the run goes, empty for no trace
+        std::string tracePath;
+    };
+
+    Options options;
+    FILE *report = stdout;
+    /// countedAllocations is sim::heap::countedAllocations when the check started
+    uint64_t countedAllocations = 0;
+    /// commandSensors is the number of sensors sent in the add_sensor command
+    size_t commandSensors = 0;
+    /// traceEvents is the number of events in the trace the hub uploaded
+    size_t traceEvents = 0;
+
+    /// unexpectedAllocations returns the allocations of the notify path since the check started
+    int64_t unexpectedAllocations() {
+        return static_cast<int64_t>(sim::heap::countedAllocations() - countedAllocations);
+    }
+
+    void usage(const char *name) {
+        fprintf(stderr, "usage: %s [--ti N] [--nordic N] [--pico N] [--beacon N] [--seconds S] [--notify-ms MS]\n"
+                        "          [--outage-at S --outage-for S] [--json] [--log] [--configure-via-command]\n"
+                        "          [--downlink-frame-bytes N] [--command-burst N] [--check-allocations]\n"
+                        "          [--trace PATH]\n"
+                        "  --ti, --nordic, --pico    number of simulated sensors of each kind (default 10)\n"
+                        "  --beacon                  number of simulated sensors that advertise their readings\n"
+                        "                            (default 0)\n"
+                        "  --seconds                 length of the run (default 60)\n"
+                        "  --notify-ms               notification interval of every sensor (default 1000)\n"
+                        "  --outage-at, --outage-for take the backend down S seconds into the run, for S seconds\n"
+                        "  --json                    print the report as JSON\n"
+                        "  --log                     keep the firmware log on stdout\n"
+                        "  --configure-via-command   send the sensor list as an add_sensor command over the websocket\n"
+                        "                            instead of calling GetSensorData::setDevices, and fail if the\n"
+                        "                            hub didn't take all of it\n"
+                        "  --downlink-frame-bytes    split the messages to the hub into frames of N bytes (default\n"
+                        "                            0, one frame a message)\n"
+                        "  --command-burst           send the add_sensor command N times in a row (default 1)\n"
+                        "  --check-allocations       fail if the notify callbacks or the uplink task allocate in the\n"
+                        "                            second half of the run\n"
+                        "  --trace                   ask the hub for its trace at the end of the run and write it to\n"
+                        "                            PATH, for trace_to_perfetto\n", name);
+        exit(1);
+    }
+
+    Options parse(int argc, char **argv) {
+        Options o;
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            auto value = [&]() -> long {
+                if (i + 1 >= argc) {
+                    usage(argv[0]);
+                }
+                return strtol(argv[++i], nullptr, 10);
+            };
+            if (arg == "--ti") {
+                o.ti = static_cast<int>(value());
+            } else if (arg == "--nordic") {
+                o.nordic = static_cast<int>(value());
+            } else if (arg == "--pico") {
+                o.pico = static_cast<int>(value());
+            } else if (arg == "--beacon") {
+                o.beacon = static_cast<int>(value());
+            } else if (arg == "--seconds") {
+                o.seconds = static_cast<uint32_t>(value());
+            } else if (arg == "--notify-ms") {
+                o.notifyMs = static_cast<uint32_t>(value());
+            } else if (arg == "--outage-at") {
+                o.outageAt = static_cast<uint32_t>(value());
+            } else if (arg == "--outage-for") {
+                o.outageFor = static_cast<uint32_t>(value());
+            } else if (arg == "--json") {
+                o.json = true;
+            } else if (arg == "--log") {
+                o.log = true;
+            } else if (arg == "--check-allocations") {
+                o.checkAllocations = true;
+            } else if (arg == "--configure-via-command") {
+                o.configureViaCommand = true;
+            } else if (arg == "--downlink-frame-bytes") {
+                o.downlinkFrameBytes = static_cast<uint32_t>(value());
+            } else if (arg == "--command-burst") {
+                o.commandBurst = static_cast<int>(value());
+            } else if (arg == "--trace") {
+                if (i + 1 >= argc) {
+                    usage(argv[0]);
+                }
+                o.tracePath = argv[++i];
+            } else {
+                usage(argv[0]);
+            }
+        }
+        if (o.ti < 0 || o.nordic < 0 || o.pico < 0 || o.beacon < 0 || o.seconds == 0 || o.notifyMs == 0 ||
+            o.commandBurst <= 0 ||
+            o.outageAt + o.outageFor > o.seconds) {
+            usage(argv[0]);
+        }
+        return o;
+    }
+
+    TypeOfDevice typeOfDevice(sim::SensorKind kind) {
+        switch (kind) {
+            case sim::SensorKind::TI:
+                return TypeOfDevice::TI;
+            case sim::SensorKind::Nordic:
+                return TypeOfDevice::Nordic;
+            case sim::SensorKind::Pico:
+                return TypeOfDevice::Custom;
+            case sim::SensorKind::Beacon:
+                return TypeOfDevice::Advertising;
+        }
+        return TypeOfDevice::Custom;
+    }
+
+    DeviceType deviceType(sim::SensorKind kind) {
+        switch (kind) {
+            case sim::SensorKind::TI:
+                return DeviceType_DEVICE_TYPE_TI;
+            case sim::SensorKind::Nordic:
+                return DeviceType_DEVICE_TYPE_NORDIC;
+            case sim::SensorKind::Pico:
+                return DeviceType_DEVICE_TYPE_CUSTOM;
+            case sim::SensorKind::Beacon:
+                return DeviceType_DEVICE_TYPE_ADVERTISING;
+        }
+        return DeviceType_DEVICE_TYPE_UNSPECIFIED;
+    }
+
+    /// configureDirectly hands the sensor list to GetSensorData, as the add_sensor command would
+    void configureDirectly() {
+        std::vector<std::tuple<BleAddr, TypeOfDevice>> devices;
+        for (const auto &peripheral: sim::World::get().peripherals()) {
+            devices.emplace_back(BleAddr(peripheral->address()), typeOfDevice(peripheral->kind()));
+        }
+        getGetSensorData()->setDevices(devices);
+    }
+
+    /// configureViaCommand sends the sensor list from the backend as an add_sensor command, options.commandBurst times
+    void configureViaCommand() {
+        auto packet = std::make_unique<BackendToFirmwarePacket>();
+        *packet = BackendToFirmwarePacket_init_zero;
+        packet->which_type = BackendToFirmwarePacket_add_sensor_tag;
+        auto &addSensor = packet->type.add_sensor;
+        constexpr size_t maxSensors = sizeof(addSensor.add_sensor_infos) / sizeof(addSensor.add_sensor_infos[0]);
+        const auto &peripherals = sim::World::get().peripherals();
+        if (peripherals.size() > maxSensors) {
+            fprintf(stderr, "add_sensor holds at most %zu sensors, configuring the first %zu\n", maxSensors,
+                    maxSensors);
+        }
+        for (const auto &peripheral: peripherals) {
+            if (addSensor.add_sensor_infos_count == maxSensors) {
+                break;
+            }
+            auto &info = addSensor.add_sensor_infos[addSensor.add_sensor_infos_count++];
+            info.has_sensor_info = true;
+            strncpy(info.sensor_info.address, peripheral->addressString().c_str(),
+                    sizeof(info.sensor_info.address) - 1);
+            info.device_type = deviceType(peripheral->kind());
+        }
+        size_t size = 0;
+        if (!pb_get_encoded_size(&size, BackendToFirmwarePacket_fields, packet.get())) {
+            fprintf(stderr, "Sizing add_sensor failed\n");
+            exit(1);
+        }
+        std::vector<uint8_t> buf(size);
+        pb_ostream_t output = pb_ostream_from_buffer(buf.data(), buf.size());
+        if (!pb_encode(&output, BackendToFirmwarePacket_fields, packet.get())) {
+            fprintf(stderr, "Encoding add_sensor failed: %s\n", PB_GET_ERROR(&output));
+            exit(1);
+        }
+        buf.resize(output.bytes_written);
+        commandSensors = addSensor.add_sensor_infos_count;
+        for (int i = 1; i < options.commandBurst; i++) {
+            sim::Network::get().sendToHub(buf);
+        }
+        sim::Network::get().sendToHub(std::move(buf));
+    }
+
+    /// fetchTrace sends a get_trace command and writes the dump the hub uploads to options.tracePath
+    bool fetchTrace() {
+        std::vector<uint8_t> buf(2);
+        pb_ostream_t output = pb_ostream_from_buffer(buf.data(), buf.size());
+        if (!encodeGetTrace(&output)) {
+            fprintf(stderr, "Encoding get_trace failed: %s\n", PB_GET_ERROR(&output));
+            return false;
+        }
+        sim::Network::get().sendToHub(std::move(buf));
+        std::string text;
+        for (int waited = 0; !sim::Metrics::get().trace(text); waited += 10) {
+            if (waited >= 10'000) {
+                fprintf(stderr, "The hub didn't upload its trace\n");
+                return false;
+            }
+            vTaskDelay(pdMS_TO_TICKS(10));
+        }
+        FILE *file = fopen(options.tracePath.c_str(), "w");
+        if (file == nullptr || fwrite(text.data(), 1, text.size(), file) != text.size() || fclose(file) != 0) {
+            perror(options.tracePath.c_str());
+            return false;
+        }
+        for (size_t at = text.find("trace: event "); at != std::string::npos; at = text.find("trace: event ", at + 1)) {
+            traceEvents++;
+        }
+        return true;
+    }
+
+    void printReport(double elapsedSeconds) {
+        auto &metrics = sim::Metrics::get();
+        const double readingsPerSecond = static_cast<double>(metrics.readingsDelivered) / elapsedSeconds;
+        const uint32_t p50 = metrics.latencyPercentileUs(50);
+        const uint32_t p95 = metrics.latencyPercentileUs(95);
+        const uint32_t p99 = metrics.latencyPercentileUs(99);
+        const uint32_t max = metrics.latencyPercentileUs(100);
+        const size_t freertosHeapPeak = configTOTAL_HEAP_SIZE - xPortGetMinimumEverFreeHeapSize();
+        const std::string notifyPathAllocations = options.checkAllocations ? std::to_string(
+                unexpectedAllocations()) : "null";
+        if (options.json) {
+            fprintf(report, "{\"sensors\":{\"ti\":%d,\"nordic\":%d,\"pico\":%d,\"beacon\":%d},\"seconds\":%.3f,\"notify_ms\":%u,"
+                            "\"notifications\":%llu,\"readings_delivered\":%llu,\"readings_unmatched\":%llu,"
+                            "\"readings_per_second\":%.2f,\"frames\":%llu,\"pings\":%llu,\"health_reports\":%llu,"
+                            "\"other_frames\":%llu,"
+                            "\"decode_errors\":%llu,\"payload_bytes\":%llu,\"wire_bytes\":%llu,"
+                            "\"latency_us\":{\"p50\":%u,\"p95\":%u,\"p99\":%u,\"max\":%u,\"count\":%zu},"
+                            "\"ble_connects\":%llu,\"ble_connect_failures\":%llu,\"websocket_connects\":%llu,"
+                            "\"heap\":{\"cpp_peak_bytes\":%zu,\"cpp_allocations\":%llu,"
+                            "\"freertos_peak_bytes\":%zu,\"notify_path_allocations\":%s}}\n",
+                    options.ti, options.nordic, options.pico, options.beacon, elapsedSeconds, options.notifyMs,
+                    (unsigned long long) metrics.notifications, (unsigned long long) metrics.readingsDelivered,
+                    (unsigned long long) metrics.readingsUnmatched, readingsPerSecond,
+                    (unsigned long long) metrics.frames, (unsigned long long) metrics.pings,
+                    (unsigned long long) metrics.healthReports, (unsigned long long) metrics.otherFrames,
+                    (unsigned long long) metrics.decodeErrors, (unsigned long long) metrics.payloadBytes, (unsigned long long) metrics.wireBytes,
+                    p50, p95, p99, max, metrics.latencyCount(),
+                    (unsigned long long) metrics.bleConnects, (unsigned long long) metrics.bleConnectFailures,
+                    (unsigned long long) metrics.websocketConnects, sim::heap::peakBytes(),
+                    (unsigned long long) sim::heap::allocations(), freertosHeapPeak, notifyPathAllocations.c_str());
+        } else {
+            fprintf(report, "sensors:             %d TI, %d Nordic, %d Pico, %d beacons, notifying every %u ms\n",
+                    options.ti, options.nordic, options.pico, options.beacon, options.notifyMs);
+            fprintf(report, "run time:            %.1f s\n", elapsedSeconds);
+            fprintf(report, "notifications:       %llu\n", (unsigned long long) metrics.notifications);
+            fprintf(report, "readings delivered:  %llu (%.2f/s), %llu unmatched\n",
+                    (unsigned long long) metrics.readingsDelivered, readingsPerSecond,
+                    (unsigned long long) metrics.readingsUnmatched);
+            fprintf(report, "frames sent:         %llu (%llu pings, %llu health reports, %llu other, %llu undecodable)\n",
+                    (unsigned long long) metrics.frames, (unsigned long long) metrics.pings,
+                    (unsigned long long) metrics.healthReports, (unsigned long long) metrics.otherFrames,
+                    (unsigned long long) metrics.decodeErrors);
+            fprintf(report, "bytes sent:          %llu payload, %llu on the wire\n",
+                    (unsigned long long) metrics.payloadBytes, (unsigned long long) metrics.wireBytes);
+            fprintf(report, "notify->send (us):   p50 %u, p95 %u, p99 %u, max %u over %zu readings\n", p50, p95, p99,
+                    max, metrics.latencyCount());
+            fprintf(report, "connections:         %llu BLE (%llu failed), %llu websocket\n",
+                    (unsigned long long) metrics.bleConnects, (unsigned long long) metrics.bleConnectFailures,
+                    (unsigned long long) metrics.websocketConnects);
+            fprintf(report, "peak heap:           %zu bytes C++ (%llu allocations), %zu bytes FreeRTOS\n",
+                    sim::heap::peakBytes(), (unsigned long long) sim::heap::allocations(), freertosHeapPeak);
+            auto health = std::make_unique<HealthReport>();
+            if (metrics.lastHealthReport(*health) && health->taskCount > 0) {
+                const TaskHealth *busiest = std::max_element(health->tasks, health->tasks + health->taskCount,
+                                                             [](const TaskHealth &a, const TaskHealth &b) {
+                                                                 return a.cpu < b.cpu;
+                                                             });
+                fprintf(report, "last health report:  %zu tasks, busiest %s at %.2f%%, %u websocket connects, "
+                                "commands waited up to %u ms\n", health->taskCount, busiest->name,
+                        busiest->cpu / 100.0, health->websocketConnects, health->commandMaxWaitMs);
+            }
+            if (!options.tracePath.empty()) {
+                fprintf(report, "trace:               %zu events in %llu chunks, written to %s\n", traceEvents,
+                        (unsigned long long) metrics.traceChunks, options.tracePath.c_str());
+            }
+            if (options.checkAllocations) {
+                fprintf(report, "notify path allocs:  %s in the second half\n",
+                    notifyPathAllocations.c_str());
+            }
+        }
+        fflush(report);
+    }
+
+    [[noreturn]] void benchTask(void *) {
+        const int64_t start = esp_timer_get_time();
+        if (options.configureViaCommand) {
+            while (sim::Metrics::get().websocketConnects == 0) {
+                vTaskDelay(pdMS_TO_TICKS(10));
+            }
+            configureViaCommand();
+        } else {
+            configureDirectly();
+        }
+        std::vector<std::pair<uint32_t, std::function<void()>>> events;
+        if (options.outageFor > 0) {
+            events.emplace_back(options.outageAt, [] { sim::Network::get().setBackendUp(false); });
+            events.emplace_back(options.outageAt + options.outageFor, [] { sim::Network::get().setBackendUp(true); });
+        }
+        if (options.checkAllocations) {
+            events.emplace_back(options.seconds / 2, [] {
+                sim::heap::countTask("Uplink");
+                countedAllocations = sim::heap::countedAllocations();
+            });
+        }
+        events.emplace_back(options.seconds, [] {});
+        std::stable_sort(events.begin(), events.end(), [](const auto &a, const auto &b) { return a.first < b.first; });
+        for (const auto &[at, event]: events) {
+            int64_t const due = start + static_cast<int64_t>(at) * 1'000'000;
+            int64_t const now = esp_timer_get_time();
+            if (due > now) {
+                vTaskDelay(pdMS_TO_TICKS((due - now) / 1000));
+            }
+            event();
+        }
+        double const elapsedSeconds = static_cast<double>(esp_timer_get_time() - start) / 1e6;
+        bool const traced = options.tracePath.empty() || fetchTrace();
+        printReport(elapsedSeconds);
+        fflush(stdout);
+        if (options.configureViaCommand && getGetSensorData()->getDevices()->size() != commandSensors) {
+            fprintf(stderr, "The hub took %zu of the %zu sensors in the add_sensor command\n",
+                    getGetSensorData()->getDevices()->size(), commandSensors);
+            std::_Exit(1);
+        }
+        if (!traced) {
+            std::_Exit(1);
+        }
+        if (options.checkAllocations && unexpectedAllocations() != 0) {
+            fprintf(stderr, "The notify path allocated %lld times\n", (long long) unexpectedAllocations());
+            std::_Exit(1);
+        }
+        // The firmware tasks never return, so end the process without running static destructors under them
+        std::_Exit(0);
+    }
+}
+
+int main(int argc, char **argv) {
+    options = parse(argc, argv);
+    if (!options.log) {
+        // The firmware logs to stdout; keep the report there and send the log away
+        report = fdopen(dup(STDOUT_FILENO), "w");
+        if (report == nullptr || freopen("/dev/null", "w", stdout) == nullptr) {
+            perror("redirecting the firmware log");
+            return 1;
+        }
+    }
+
+    sim::timing().downlinkFrameBytes = options.downlinkFrameBytes;
+    auto &world = sim::World::get();
+    world.addSensors(sim::SensorKind::TI, options.ti, options.notifyMs);
+    world.addSensors(sim::SensorKind::Nordic, options.nordic, options.notifyMs);
+    world.addSensors(sim::SensorKind::Pico, options.pico, options.notifyMs);
+    world.addSensors(sim::SensorKind::Beacon, options.beacon, options.notifyMs);
+
+    // ESP-IDF runs app_main in the "main" task at priority 1
+    xTaskCreate([](void *) { app_main(); }, "main", 8192, nullptr, 1, nullptr);
+    xTaskCreate(benchTask, "bench", 8192, nullptr, configMAX_PRIORITIES - 2, nullptr);
+    vTaskStartScheduler();
+    return 0;
+}
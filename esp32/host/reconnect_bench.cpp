@@ -0,0 +1,297 @@
+// reconnect_bench simulates a fleet of hubs losing the backend at the same moment, like during a deploy, and reports
+// how fast they come back and how many attempts per second the backend sees. Every hub runs ReconnectPolicy the way
+// the reconnect task does, or with --policy fixed the way the hub used to: one retry right away, then one every 10 s
+// from the client's own reconnect.
+// The backend takes --capacity connections a second. With --retry-after it turns the rest away with a 1013 close
+// that asks them to wait that many seconds, otherwise they just fail.
+//
+//   reconnect_bench --hubs 1000 --down-for 20 --capacity 200
+//   reconnect_bench --hubs 1000 --down-for 20 --capacity 200 --retry-after 10 --policy fixed
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+#include "ReconnectPolicy.h"
+
+namespace {
+    /// FIXED_RETRY_MS is how often the client retried on its own, its default reconnect_timeout_ms
+    constexpr uint64_t FIXED_RETRY_MS = 10'000;
+
+    enum class Policy {
+        Jitter, Fixed
+    };
+
+    struct Options {
+        uint32_t hubs = 1000;
+        /// downAt and downFor are when the backend goes away and for how long, in seconds
+        uint32_t downAt = 10;
+        uint32_t downFor = 20;
+        /// capacity is how many connections the backend takes a second, 0 for no limit
+        uint32_t capacity = 200;
+        /// retryAfter is the wait the backend asks of the hubs it turns away, in seconds, 0 to not ask
+        uint32_t retryAfter = 0;
+        /// connectMs is how long an attempt takes
+        uint32_t connectMs = 200;
+        uint32_t seconds = 600;
+        unsigned seed = 1;
+        Policy policy = Policy::Jitter;
+    };
+
+    void usage(const char *name) {
+        fprintf(stderr, "usage: %s [--hubs N] [--down-at S] [--down-for S] [--capacity N] [--retry-after S]\n"
+                        "          [--connect-ms MS] [--seconds S] [--seed S] [--policy jitter|fixed]\n", name);
+        exit(1);
+    }
+
+    Options parse(int argc, char **argv) {
+        Options o;
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            if (i + 1 == argc) {
+                usage(argv[0]);
+            }
+            const char *value = argv[++i];
+            if (arg == "--hubs") {
+                o.hubs = strtoul(value, nullptr, 10);
+            } else if (arg == "--down-at") {
+                o.downAt = strtoul(value, nullptr, 10);
+            } else if (arg == "--down-for") {
+                o.downFor = strtoul(value, nullptr, 10);
+            } else if (arg == "--capacity") {
+                o.capacity = strtoul(value, nullptr, 10);
+            } else if (arg == "--retry-after") {
+                o.retryAfter = strtoul(value, nullptr, 10);
+            } else if (arg == "--connect-ms") {
+                o.connectMs = strtoul(value, nullptr, 10);
+            } else if (arg == "--seconds") {
+                o.seconds = strtoul(value, nullptr, 10);
+            } else if (arg == "--seed") {
+                o.seed = strtoul(value, nullptr, 10);
+            } else if (arg == "--policy") {
+                std::string const policy = value;
+                if (policy == "jitter") {
+                    o.policy = Policy::Jitter;
+                } else if (policy == "fixed") {
+                    o.policy = Policy::Fixed;
+                } else {
+                    usage(argv[0]);
+                }
+            } else {
+                usage(argv[0]);
+            }
+        }
+        if (o.hubs == 0 || o.seconds <= o.downAt + o.downFor) {
+            usage(argv[0]);
+        }
+        return o;
+    }
+
+    std::mt19937 generator;
+
+    uint32_t simRandom() {
+        return generator();
+    }
+
+    struct Hub {
+        ReconnectPolicy policy{RECONNECT_BASE_MS, WEBSOCKET_RECONNECT_CAP_MS, simRandom};
+        bool connected = true;
+        uint64_t upAt = 0;
+        /// retryAfterMs is the wait the backend asked for when it turned the hub away
+        uint32_t retryAfterMs = 0;
+        /// fixedRetries counts the retries under Policy::Fixed
+        uint32_t fixedRetries = 0;
+    };
+
+    /// Step is an attempt that starts or ends
+    struct Step {
+        uint64_t atMs;
+        uint32_t hub;
+        bool ends;
+
+        bool operator>(const Step &other) const {
+            return atMs > other.atMs;
+        }
+    };
+
+    class Fleet {
+        const Options &options;
+        std::vector<Hub> hubs;
+        std::priority_queue<Step, std::vector<Step>, std::greater<>> steps;
+        uint64_t nowMs = 0;
+        /// accepted counts the connections the backend took in each second
+        std::vector<uint32_t> accepted;
+
+    public:
+        /// attempts counts the attempts started in each second
+        std::vector<uint32_t> attempts;
+        /// connectedAt is when each hub came back, in milliseconds after the backend did
+        std::vector<uint64_t> connectedAt;
+        uint64_t rejected = 0;
+        uint64_t failedWhileDown = 0;
+
+        explicit Fleet(const Options &options)
+                : options(options), hubs(options.hubs), accepted(options.seconds), attempts(options.seconds) {
+            // The hubs have been up long enough for their policies to start over
+            for (auto &hub: hubs) {
+                hub.upAt = 0;
+            }
+        }
+
+        [[nodiscard]] bool backendUp() const {
+            return nowMs < options.downAt * 1'000ULL || nowMs >= (options.downAt + options.downFor) * 1'000ULL;
+        }
+
+        /// retry schedules the next attempt of a hub whose connection failed or dropped
+        void retry(uint32_t index) {
+            Hub &hub = hubs[index];
+            uint64_t wait;
+            if (options.policy == Policy::Fixed) {
+                wait = hub.fixedRetries++ == 0 ? 0 : FIXED_RETRY_MS;
+            } else {
+                hub.policy.retryAfter(hub.retryAfterMs);
+                hub.retryAfterMs = 0;
+                wait = hub.policy.failed();
+            }
+            steps.push(Step{.atMs = nowMs + wait, .hub = index, .ends = false});
+        }
+
+        void drop(uint32_t index) {
+            Hub &hub = hubs[index];
+            hub.connected = false;
+            if (nowMs - hub.upAt >= WEBSOCKET_STABLE_MS) {
+                hub.policy.succeeded();
+                hub.fixedRetries = 0;
+            }
+            retry(index);
+        }
+
+        void step(const Step &s) {
+            Hub &hub = hubs[s.hub];
+            size_t const second = nowMs / 1'000;
+            if (!s.ends) {
+                attempts[second]++;
+                steps.push(Step{.atMs = nowMs + options.connectMs, .hub = s.hub, .ends = true});
+                return;
+            }
+            if (!backendUp()) {
+                failedWhileDown++;
+                retry(s.hub);
+                return;
+            }
+            if (options.capacity > 0 && accepted[second] >= options.capacity) {
+                rejected++;
+                hub.retryAfterMs = options.retryAfter * 1'000;
+                retry(s.hub);
+                return;
+            }
+            accepted[second]++;
+            hub.connected = true;
+            hub.upAt = nowMs;
+            connectedAt.push_back(nowMs - (options.downAt + options.downFor) * 1'000ULL);
+        }
+
+        void run() {
+            uint64_t const downAtMs = options.downAt * 1'000ULL;
+            uint64_t const endMs = options.seconds * 1'000ULL;
+            bool dropped = false;
+            for (;;) {
+                uint64_t const next = steps.empty() ? endMs : std::min(steps.top().atMs, endMs);
+                if (!dropped && downAtMs <= next) {
+                    // The backend goes away and every hub loses it at once
+                    nowMs = downAtMs;
+                    dropped = true;
+                    for (uint32_t i = 0; i < hubs.size(); i++) {
+                        drop(i);
+                    }
+                    continue;
+                }
+                if (next >= endMs) {
+                    break;
+                }
+                Step const s = steps.top();
+                steps.pop();
+                nowMs = s.atMs;
+                step(s);
+            }
+        }
+    };
+
+    /// percentile returns the p-th percentile of sorted values
+    template<typename T>
+    T percentile(const std::vector<T> &sorted, double p) {
+        if (sorted.empty()) {
+            return 0;
+        }
+        size_t const i = std::min(sorted.size() - 1, static_cast<size_t>(p * static_cast<double>(sorted.size())));
+        return sorted[i];
+    }
+}
+
+int main(int argc, char **argv) {
+    Options const options = parse(argc, argv);
+    generator.seed(options.seed);
+    Fleet fleet(options);
+    fleet.run();
+
+    uint32_t const backAt = options.downAt + options.downFor;
+    // The rates from the backend coming back until the last hub reconnected, or the end
+    std::vector<uint64_t> back = fleet.connectedAt;
+    std::sort(back.begin(), back.end());
+    uint32_t const recoveredAt = back.size() == options.hubs
+                                 ? backAt + static_cast<uint32_t>(back.back() / 1'000) + 1 : options.seconds;
+    std::vector<uint32_t> rates(fleet.attempts.begin() + backAt, fleet.attempts.begin() + recoveredAt);
+    std::vector<uint32_t> sortedRates = rates;
+    std::sort(sortedRates.begin(), sortedRates.end());
+    uint64_t total = 0;
+    for (uint32_t a: fleet.attempts) {
+        total += a;
+    }
+    uint32_t const peakDown = *std::max_element(fleet.attempts.begin() + options.downAt,
+                                                fleet.attempts.begin() + backAt);
+
+    printf("hubs:                %u, backend down %u s at %u s, takes %u/s%s\n", options.hubs, options.downFor,
+           options.downAt, options.capacity, options.capacity == 0 ? " (no limit)" : "");
+    printf("policy:              %s", options.policy == Policy::Jitter ? "decorrelated jitter" : "fixed 10 s");
+    if (options.retryAfter > 0) {
+        printf(", backend asks to retry after %u s", options.retryAfter);
+    }
+    printf("\n");
+    printf("attempts:            %llu (%llu while down, %llu turned away)\n", (unsigned long long) total,
+           (unsigned long long) fleet.failedWhileDown, (unsigned long long) fleet.rejected);
+    printf("reconnected:         %zu of %u\n", back.size(), options.hubs);
+    printf("back after (s):      p50 %.1f, p90 %.1f, p99 %.1f, all %.1f\n", percentile(back, 0.50) / 1e3,
+           percentile(back, 0.90) / 1e3, percentile(back, 0.99) / 1e3,
+           back.size() == options.hubs ? back.back() / 1e3 : -1.0);
+    printf("attempts/s down:     peak %u\n", peakDown);
+    printf("attempts/s back:     p50 %u, p90 %u, p99 %u, peak %u over %zu s\n", percentile(sortedRates, 0.50),
+           percentile(sortedRates, 0.90), percentile(sortedRates, 0.99), sortedRates.empty() ? 0 : sortedRates.back(),
+           sortedRates.size());
+
+    // How many seconds saw how many attempts, from the backend going away until the last hub was back
+    const uint32_t bounds[] = {0, 1, 10, 50, 100, 200, 500, 1'000};
+    std::vector<uint32_t> buckets(std::size(bounds));
+    for (uint32_t s = options.downAt; s < recoveredAt; s++) {
+        size_t b = std::size(bounds) - 1;
+        while (fleet.attempts[s] < bounds[b]) {
+            b--;
+        }
+        buckets[b]++;
+    }
+    printf("seconds by attempts:");
+    for (size_t b = 0; b < std::size(bounds); b++) {
+        if (b + 1 < std::size(bounds)) {
+            printf(" %u-%u: %u,", bounds[b], bounds[b + 1] - 1, buckets[b]);
+        } else {
+            printf(" %u+: %u\n", bounds[b], buckets[b]);
+        }
+    }
+    if (back.size() != options.hubs) {
+        fprintf(stderr, "%zu hubs didn't reconnect within the run\n", options.hubs - back.size());
+        return 1;
+    }
+    return 0;
+}
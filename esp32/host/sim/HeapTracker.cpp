@@ -0,0 +1,194 @@
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <malloc.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "HeapTracker.h"
+
+namespace {
+    std::atomic<size_t> live{0};
+    std::atomic<size_t> peak{0};
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> counted{0};
+
+    constexpr size_t maxCountedTasks = 4;
+    std::atomic<const char *> countedTasks[maxCountedTasks];
+    /// generation changes whenever a task is added, so that threads look their task up again
+    std::atomic<uint32_t> generation{0};
+
+    thread_local int countedDepth = 0;
+    thread_local int uncountedDepth = 0;
+    thread_local uint32_t checkedGeneration = 0;
+    thread_local bool countedTask = false;
+    thread_local bool lookingUp = false;
+
+    /// isCounted returns whether an allocation on this thread counts, as countTask and the scopes say
+    bool isCounted() {
+        if (uncountedDepth > 0 || lookingUp) {
+            return false;
+        }
+        if (countedDepth > 0) {
+            return true;
+        }
+        uint32_t const current = generation.load(std::memory_order_acquire);
+        if (current == 0) {
+            return false;
+        }
+        if (checkedGeneration != current) {
+            lookingUp = true;
+            const char *name = pcTaskGetName(nullptr);
+            countedTask = false;
+            for (auto &task: countedTasks) {
+                const char *watched = task.load(std::memory_order_acquire);
+                if (watched != nullptr && name != nullptr && strcmp(watched, name) == 0) {
+                    countedTask = true;
+                }
+            }
+            checkedGeneration = current;
+            lookingUp = false;
+        }
+        return countedTask;
+    }
+
+    void *track(void *p) {
+        if (p == nullptr) {
+            return nullptr;
+        }
+        // malloc_usable_size avoids a size header, which would break the alignment of aligned new
+        const size_t now = live.fetch_add(malloc_usable_size(p)) + malloc_usable_size(p);
+        size_t highest = peak.load();
+        while (now > highest && !peak.compare_exchange_weak(highest, now)) {}
+        count++;
+        if (isCounted()) {
+            counted++;
+        }
+        return p;
+    }
+
+    void untrack(void *p) {
+        if (p == nullptr) {
+            return;
+        }
+        live.fetch_sub(malloc_usable_size(p));
+        free(p);
+    }
+
+    void *allocate(size_t size) {
+        void *p = track(malloc(size == 0 ? 1 : size));
+        if (p == nullptr) {
+            throw std::bad_alloc();
+        }
+        return p;
+    }
+
+    void *allocateAligned(size_t size, std::align_val_t alignment) {
+        const auto align = static_cast<size_t>(alignment);
+        // aligned_alloc wants a size that is a multiple of the alignment
+        void *p = track(aligned_alloc(align, (size + align - 1) / align * align));
+        if (p == nullptr) {
+            throw std::bad_alloc();
+        }
+        return p;
+    }
+}
+
+size_t sim::heap::liveBytes() {
+    return live;
+}
+
+size_t sim::heap::peakBytes() {
+    return peak;
+}
+
+uint64_t sim::heap::allocations() {
+    return count;
+}
+
+sim::heap::Counted::Counted() {
+    countedDepth++;
+}
+
+sim::heap::Counted::~Counted() {
+    countedDepth--;
+}
+
+sim::heap::Uncounted::Uncounted() {
+    uncountedDepth++;
+}
+
+sim::heap::Uncounted::~Uncounted() {
+    uncountedDepth--;
+}
+
+void sim::heap::countTask(const char *name) {
+    for (auto &task: countedTasks) {
+        const char *expected = nullptr;
+        if (task.compare_exchange_strong(expected, name)) {
+            generation++;
+            return;
+        }
+    }
+    abort();
+}
+
+uint64_t sim::heap::countedAllocations() {
+    return counted;
+}
+
+void *operator new(size_t size) {
+    return allocate(size);
+}
+
+void *operator new[](size_t size) {
+    return allocate(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+    return track(malloc(size == 0 ? 1 : size));
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+    return track(malloc(size == 0 ? 1 : size));
+}
+
+void *operator new(size_t size, std::align_val_t alignment) {
+    return allocateAligned(size, alignment);
+}
+
+void *operator new[](size_t size, std::align_val_t alignment) {
+    return allocateAligned(size, alignment);
+}
+
+void operator delete(void *p) noexcept {
+    untrack(p);
+}
+
+void operator delete[](void *p) noexcept {
+    untrack(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    untrack(p);
+}
+
+void operator delete[](void *p, size_t) noexcept {
+    untrack(p);
+}
+
+void operator delete(void *p, std::align_val_t) noexcept {
+    untrack(p);
+}
+
+void operator delete[](void *p, std::align_val_t) noexcept {
+    untrack(p);
+}
+
+void operator delete(void *p, size_t, std::align_val_t) noexcept {
+    untrack(p);
+}
+
+void operator delete[](void *p, size_t, std::align_val_t) noexcept {
+    untrack(p);
+}
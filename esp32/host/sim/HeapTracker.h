@@ -0,0 +1,54 @@
+#ifndef ESP32_HOST_SIM_HEAPTRACKER_H
+#define ESP32_HOST_SIM_HEAPTRACKER_H
+
+#include <cstddef>
+#include <cstdint>
+
+/// The host build replaces the global operator new and delete to measure the C++ heap the firmware uses.
+/// On the ESP32 that heap is shared with FreeRTOS, so together with xPortGetMinimumEverFreeHeapSize() this
+/// gives the peak heap of a run.
+namespace sim::heap {
+    /// liveBytes returns the bytes currently allocated with operator new
+    size_t liveBytes();
+
+    /// peakBytes returns the highest value liveBytes has reached
+    size_t peakBytes();
+
+    /// allocations returns the number of calls to operator new so far
+    uint64_t allocations();
+
+    /// Counted counts the allocations its thread makes while it's alive in countedAllocations. The fakes put it
+    /// around the firmware code that must not allocate, such as the notify callbacks.
+    class Counted {
+    public:
+        Counted();
+
+        ~Counted();
+
+        Counted(const Counted &) = delete;
+
+        Counted &operator=(const Counted &) = delete;
+    };
+
+    /// Uncounted leaves the allocations its thread makes while it's alive out of countedAllocations. The fakes put it
+    /// around the simulator's own work on counted threads.
+    class Uncounted {
+    public:
+        Uncounted();
+
+        ~Uncounted();
+
+        Uncounted(const Uncounted &) = delete;
+
+        Uncounted &operator=(const Uncounted &) = delete;
+    };
+
+    /// countTask counts every allocation the FreeRTOS task called name makes from now on, outside Uncounted. It must
+    /// be called from a task once the scheduler runs, and at most 4 tasks can be counted.
+    void countTask(const char *name);
+
+    /// countedAllocations returns the number of counted calls to operator new so far
+    uint64_t countedAllocations();
+}
+
+#endif //ESP32_HOST_SIM_HEAPTRACKER_H
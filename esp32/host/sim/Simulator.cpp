@@ -0,0 +1,498 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include "Simulator.h"
+#include "esp_timer.h"
+#include "generated/firmware_backend.pb.h"
+#include "pb_decode.h"
+#include "packets/SensorDataBatch.h"
+#include "packets/SensorDataBlocks.h"
+#include "packets/HealthReport.h"
+#include "packets/Trace.h"
+#include "AdvertisedReadings.h"
+
+namespace sim {
+    namespace {
+        const char *TI_SERVICE = "f000aa00-0451-4000-b000-000000000000";
+        const char *TI_DATA = "f000aa01-0451-4000-b000-000000000000";
+        const char *TI_CONFIG = "f000aa02-0451-4000-b000-000000000000";
+        const char *NORDIC_ENVIRONMENT_SERVICE = "ef680200-9b35-4933-9b10-52ffa9740042";
+        const char *NORDIC_OTHER_SERVICES[] = {"ef680300-9b35-4933-9b10-52ffa9740042",
+                                               "ef680400-9b35-4933-9b10-52ffa9740042",
+                                               "ef680500-9b35-4933-9b10-52ffa9740042"};
+        const char *NORDIC_CONFIGURATION_SERVICE = "ef680100-9b35-4933-9b10-52ffa9740042";
+        const char *NORDIC_TEMP = "ef680201-9b35-4933-9b10-52ffa9740042";
+        const char *NORDIC_HUMIDITY = "ef680203-9b35-4933-9b10-52ffa9740042";
+        const char *UART_SERVICE = "0000ffe0-0000-1000-8000-00805f9b34fb";
+        const char *UART_CHARACTERISTIC = "0000ffe1-0000-1000-8000-00805f9b34fb";
+
+        /// PICO_LETTERS are the prefixes the Pico firmware sends, in the order it sends them
+        const char PICO_LETTERS[] = {'H', 'T', 'h', 't', 'p'};
+
+        /// maxPending bounds the readings kept per (address, data type) waiting to be delivered
+        constexpr size_t maxPending = 1024;
+
+        int picoDataType(char letter) {
+            switch (letter) {
+                case 'H':
+                    return DataType_DATA_TYPE_DHT22_HUMIDITY;
+                case 'T':
+                    return DataType_DATA_TYPE_DHT22_TEMP;
+                case 'h':
+                    return DataType_DATA_TYPE_DHT11_HUMIDITY;
+                case 't':
+                    return DataType_DATA_TYPE_DHT11_TEMP;
+                default:
+                    return DataType_DATA_TYPE_PICO_TEMP;
+            }
+        }
+
+        /// websocketHeaderBytes is the size of the header of a masked client frame with the given payload
+        size_t websocketHeaderBytes(size_t payload) {
+            size_t header = 2 + 4;
+            if (payload > 65535) {
+                header += 8;
+            } else if (payload > 125) {
+                header += 2;
+            }
+            return header;
+        }
+
+        /// tcpIpHeaderBytes is the IPv4 and TCP header overhead of one segment, without options
+        constexpr size_t tcpIpHeaderBytes = 40;
+    }
+
+    Timing &timing() {
+        static Timing t;
+        return t;
+    }
+
+    Peripheral::Peripheral(SensorKind kind, const NimBLEAddress &address, uint32_t notifyIntervalMs) :
+            _kind(kind), _address(address), _addressString(address.toString()), _notifyIntervalMs(notifyIntervalMs) {}
+
+    SensorKind Peripheral::kind() const {
+        return _kind;
+    }
+
+    const NimBLEAddress &Peripheral::address() const {
+        return _address;
+    }
+
+    const std::string &Peripheral::addressString() const {
+        return _addressString;
+    }
+
+    uint32_t Peripheral::notifyIntervalMs() const {
+        return _notifyIntervalMs;
+    }
+
+    NimBLEAdvertisedDevice Peripheral::advertisement() {
+        NimBLEAdvertisedDevice device;
+        device.m_address = _address;
+        device.m_timestamp = time(nullptr);
+        device.m_rssi = -45 - static_cast<int>(_address.getNative()[0] % 50);
+        switch (_kind) {
+            case SensorKind::TI:
+                device.m_name = "CC2650 SensorTag";
+                device.m_serviceUUIDs.emplace_back("aa80");
+                break;
+            case SensorKind::Nordic:
+                device.m_name = "Thingy";
+                device.m_serviceUUIDs.emplace_back(NORDIC_CONFIGURATION_SERVICE);
+                break;
+            case SensorKind::Pico:
+                device.m_name = "HMSoft";
+                device.m_serviceUUIDs.emplace_back(UART_SERVICE);
+                break;
+            case SensorKind::Beacon: {
+                const int64_t now = esp_timer_get_time();
+                if (_beaconData.empty() || now >= _nextBeaconReadingUs) {
+                    _nextBeaconReadingUs = now + static_cast<int64_t>(_notifyIntervalMs) * 1000;
+                    const uint32_t seq = _seq++;
+                    const std::pair<int, int16_t> readings[] = {
+                            {DataType_DATA_TYPE_TEMP,     static_cast<int16_t>(1500 + seq % 800)},
+                            {DataType_DATA_TYPE_HUMIDITY, static_cast<int16_t>(3000 + seq % 800)}};
+                    _beaconData = {static_cast<char>(ADVERTISED_READINGS_COMPANY_ID & 0xff),
+                                   static_cast<char>(ADVERTISED_READINGS_COMPANY_ID >> 8),
+                                   static_cast<char>(ADVERTISED_READINGS_FORMAT), static_cast<char>(seq & 0xff)};
+                    auto &metrics = Metrics::get();
+                    for (const auto &[dataType, hundredths]: readings) {
+                        _beaconData += static_cast<char>(dataType);
+                        _beaconData += static_cast<char>(hundredths & 0xff);
+                        _beaconData += static_cast<char>(hundredths >> 8);
+                        metrics.notifications++;
+                        metrics.recordReading(_addressString, dataType, static_cast<float>(hundredths) / 100, now);
+                    }
+                }
+                device.m_manufacturerData = _beaconData;
+                break;
+            }
+        }
+        return device;
+    }
+
+    void Peripheral::buildServices(NimBLEClient *client) const {
+        auto addService = [client](const char *uuid) {
+            auto service = new NimBLERemoteService(client, NimBLEUUID(uuid));
+            client->m_servicesVector.push_back(service);
+            return service;
+        };
+        auto addCharacteristic = [](NimBLERemoteService *service, const char *uuid, uint8_t properties, int role) {
+            service->m_characteristicVector.push_back(
+                    new NimBLERemoteCharacteristic(service, NimBLEUUID(uuid), properties, role));
+        };
+        switch (_kind) {
+            case SensorKind::TI: {
+                auto service = addService(TI_SERVICE);
+                addCharacteristic(service, TI_DATA,
+                                  NimBLERemoteCharacteristic::PROPERTY_READ |
+                                  NimBLERemoteCharacteristic::PROPERTY_NOTIFY, ROLE_TI_DATA);
+                addCharacteristic(service, TI_CONFIG,
+                                  NimBLERemoteCharacteristic::PROPERTY_READ | NimBLERemoteCharacteristic::PROPERTY_WRITE,
+                                  ROLE_TI_CONFIG);
+                break;
+            }
+            case SensorKind::Nordic: {
+                auto service = addService(NORDIC_ENVIRONMENT_SERVICE);
+                addCharacteristic(service, NORDIC_TEMP, NimBLERemoteCharacteristic::PROPERTY_NOTIFY,
+                                  ROLE_NORDIC_TEMP);
+                addCharacteristic(service, NORDIC_HUMIDITY, NimBLERemoteCharacteristic::PROPERTY_NOTIFY,
+                                  ROLE_NORDIC_HUMIDITY);
+                for (auto uuid: NORDIC_OTHER_SERVICES) {
+                    addService(uuid);
+                }
+                break;
+            }
+            case SensorKind::Pico: {
+                auto service = addService(UART_SERVICE);
+                addCharacteristic(service, UART_CHARACTERISTIC,
+                                  NimBLERemoteCharacteristic::PROPERTY_READ |
+                                  NimBLERemoteCharacteristic::PROPERTY_WRITE_NR |
+                                  NimBLERemoteCharacteristic::PROPERTY_NOTIFY, ROLE_UART);
+                break;
+            }
+            case SensorKind::Beacon:
+                // A beacon has nothing to connect to
+                break;
+        }
+    }
+
+    void Peripheral::onConnect() {
+        // The SensorTag turns its sensor off when the central goes away
+        _configured = false;
+    }
+
+    void Peripheral::onWrite(int role, const uint8_t *data, size_t length) {
+        if (role == ROLE_TI_CONFIG) {
+            _configured = length > 0 && data[0] == 1;
+        }
+    }
+
+    std::string Peripheral::readValue(int role) const {
+        if (role == ROLE_TI_CONFIG) {
+            return {static_cast<char>(_configured ? 1 : 0)};
+        }
+        return "";
+    }
+
+    bool Peripheral::notifies(int role) const {
+        switch (role) {
+            case ROLE_TI_DATA:
+                return _configured;
+            case ROLE_NORDIC_TEMP:
+            case ROLE_NORDIC_HUMIDITY:
+            case ROLE_UART:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    size_t Peripheral::nextNotification(int role, uint8_t *out, size_t capacity) {
+        const uint32_t seq = _seq++;
+        const int64_t now = esp_timer_get_time();
+        auto &metrics = Metrics::get();
+        metrics.notifications++;
+        // Every value in a window of a few hundred readings is distinct, so a delivered reading can be matched with
+        // the notification that carried it
+        switch (role) {
+            case ROLE_TI_DATA: {
+                const float value = 20.0f + static_cast<float>(seq % 800) * 0.01f;
+                if (capacity < sizeof(value)) {
+                    return 0;
+                }
+                memcpy(out, &value, sizeof(value));
+                metrics.recordReading(_addressString, DataType_DATA_TYPE_TEMP, value, now);
+                return sizeof(value);
+            }
+            case ROLE_NORDIC_TEMP:
+            case ROLE_NORDIC_HUMIDITY: {
+                // The Thingy sends an integer and a decimal byte
+                const uint8_t low = 10 + seq % 80;
+                const uint8_t high = (seq / 80) % 10;
+                if (capacity < 2) {
+                    return 0;
+                }
+                out[0] = low;
+                out[1] = high;
+                const float value = std::stof(std::to_string(low) + "." + std::to_string(high));
+                metrics.recordReading(_addressString, role == ROLE_NORDIC_TEMP ? DataType_DATA_TYPE_TEMP
+                                                                               : DataType_DATA_TYPE_HUMIDITY, value,
+                                      now);
+                return 2;
+            }
+            case ROLE_UART: {
+                // The Pico sends "<letter><value>\0" frames through the HM-10
+                const char letter = PICO_LETTERS[seq % sizeof(PICO_LETTERS)];
+                const float value = 10.0f + static_cast<float>((seq / sizeof(PICO_LETTERS)) % 800) * 0.05f;
+                char text[16];
+                int written = snprintf(text, sizeof(text), "%c%.2f", letter, value);
+                if (written < 0 || static_cast<size_t>(written) + 1 > capacity) {
+                    return 0;
+                }
+                memcpy(out, text, written + 1);
+                metrics.recordReading(_addressString, picoDataType(letter), std::stof(text + 1), now);
+                return written + 1;
+            }
+            default:
+                return 0;
+        }
+    }
+
+    World &World::get() {
+        static World world;
+        return world;
+    }
+
+    void World::addSensors(SensorKind kind, int count, uint32_t notifyIntervalMs) {
+        uint64_t prefix;
+        switch (kind) {
+            case SensorKind::TI:
+                prefix = 0x546c0e;
+                break;
+            case SensorKind::Nordic:
+                prefix = 0xd0f1a2;
+                break;
+            case SensorKind::Pico:
+                prefix = 0xa4c138;
+                break;
+            case SensorKind::Beacon:
+                prefix = 0xe4b3a0;
+                break;
+            default:
+                throw std::runtime_error("Unknown sensor kind");
+        }
+        const auto advertisingUs = static_cast<int64_t>(timing().advertisingIntervalMs) * 1000;
+        for (int i = 0; i < count; i++) {
+            const uint64_t index = _peripherals.size();
+            auto peripheral = std::make_unique<Peripheral>(kind, NimBLEAddress((prefix << 24) | index),
+                                                           notifyIntervalMs);
+            // Spread the advertisements over the interval
+            peripheral->nextAdvertisementUs = static_cast<int64_t>(index * 7919 * 1000) % advertisingUs;
+            _byAddress[peripheral->addressString()] = peripheral.get();
+            _peripherals.emplace_back(std::move(peripheral));
+        }
+    }
+
+    const std::vector<std::unique_ptr<Peripheral>> &World::peripherals() const {
+        return _peripherals;
+    }
+
+    Peripheral *World::find(const NimBLEAddress &address) {
+        auto it = _byAddress.find(address.toString());
+        return it == _byAddress.end() ? nullptr : it->second;
+    }
+
+    Network &Network::get() {
+        static Network network;
+        return network;
+    }
+
+    bool Network::wifiUp() const {
+        return _wifiUp;
+    }
+
+    void Network::setWifiUp(bool up) {
+        _wifiUp = up;
+    }
+
+    bool Network::backendUp() const {
+        return _backendUp;
+    }
+
+    void Network::setBackendUp(bool up) {
+        _backendUp = up;
+    }
+
+    void Network::sendToHub(std::vector<uint8_t> message) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _toHub.emplace_back(std::move(message));
+    }
+
+    bool Network::takeToHub(std::vector<uint8_t> &message) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_toHub.empty()) {
+            return false;
+        }
+        message = std::move(_toHub.front());
+        _toHub.pop_front();
+        return true;
+    }
+
+    Metrics &Metrics::get() {
+        static Metrics metrics;
+        return metrics;
+    }
+
+    void Metrics::recordReading(const std::string &address, int dataType, float value, int64_t timeUs) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto &pending = _pending[{address, dataType}];
+        if (pending.size() == maxPending) {
+            pending.pop_front();
+        }
+        pending.emplace_back(value, timeUs);
+    }
+
+    void Metrics::recordDelivery(const std::string &address, int dataType, float value, int64_t timeUs) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _pending.find({address, dataType});
+        if (it != _pending.end()) {
+            auto &pending = it->second;
+            // Readings ahead of the match were dropped by the hub
+            while (!pending.empty()) {
+                auto [pendingValue, notifiedUs] = pending.front();
+                pending.pop_front();
+                if (pendingValue == value) {
+                    readingsDelivered++;
+                    _latenciesUs.push_back(static_cast<uint32_t>(std::max<int64_t>(0, timeUs - notifiedUs)));
+                    return;
+                }
+            }
+        }
+        readingsUnmatched++;
+    }
+
+    void Metrics::recordFrame(const uint8_t *data, size_t length, int64_t timeUs) {
+        frames++;
+        payloadBytes += length;
+        wireBytes += length + websocketHeaderBytes(length) + tcpIpHeaderBytes;
+
+        auto packet = std::make_unique<FirmwareToBackendPacket>();
+        *packet = FirmwareToBackendPacket_init_zero;
+        pb_istream_t stream = pb_istream_from_buffer(data, length);
+        if (!pb_decode(&stream, FirmwareToBackendPacket_fields, packet.get())) {
+            decodeErrors++;
+            return;
+        }
+        switch (packet->which_type) {
+            case FirmwareToBackendPacket_ping_tag:
+                pings++;
+                break;
+            case FirmwareToBackendPacket_sensor_data_tag: {
+                const auto &sensorData = packet->type.sensor_data;
+                std::string address(sensorData.address, strnlen(sensorData.address, sizeof(sensorData.address)));
+                recordDelivery(address, sensorData.data_type, sensorData.value, timeUs);
+                break;
+            }
+            default: {
+                // sensor_data_batch, sensor_data_blocks, health_report and trace_chunk aren't in the generated code,
+                // so nanopb leaves which_type unset for them
+                std::vector<SensorData> readings;
+                stream = pb_istream_from_buffer(data, length);
+                if (!decodeSensorDataBatch(&stream, readings)) {
+                    readings.clear();
+                    stream = pb_istream_from_buffer(data, length);
+                    if (!decodeSensorDataBlocks(&stream, readings)) {
+                        auto report = std::make_unique<HealthReport>();
+                        stream = pb_istream_from_buffer(data, length);
+                        if (decodeHealthReport(&stream, *report)) {
+                            recordHealthReport(*report);
+                            break;
+                        }
+                        auto chunk = std::make_unique<TraceChunk>();
+                        stream = pb_istream_from_buffer(data, length);
+                        if (decodeTraceChunk(&stream, *chunk)) {
+                            recordTraceChunk(*chunk);
+                        } else {
+                            otherFrames++;
+                        }
+                        break;
+                    }
+                }
+                for (const auto &sensorData: readings) {
+                    std::string address(sensorData.address, strnlen(sensorData.address, sizeof(sensorData.address)));
+                    recordDelivery(address, sensorData.data_type, sensorData.value, timeUs);
+                }
+                break;
+            }
+        }
+    }
+
+    uint32_t Metrics::latencyPercentileUs(double percentile) {
+        std::vector<uint32_t> latencies;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            latencies = _latenciesUs;
+        }
+        if (latencies.empty()) {
+            return 0;
+        }
+        auto rank = static_cast<size_t>(percentile / 100.0 * static_cast<double>(latencies.size() - 1) + 0.5);
+        rank = std::min(rank, latencies.size() - 1);
+        std::nth_element(latencies.begin(), latencies.begin() + static_cast<long>(rank), latencies.end());
+        return latencies[rank];
+    }
+
+    size_t Metrics::latencyCount() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _latenciesUs.size();
+    }
+
+    void Metrics::recordHealthReport(const HealthReport &report) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        healthReports++;
+        if (!_lastHealthReport) {
+            _lastHealthReport = std::make_unique<HealthReport>();
+        }
+        *_lastHealthReport = report;
+    }
+
+    bool Metrics::lastHealthReport(HealthReport &report) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_lastHealthReport) {
+            return false;
+        }
+        report = *_lastHealthReport;
+        return true;
+    }
+
+    void Metrics::recordTraceChunk(const TraceChunk &chunk) {
+        traceChunks++;
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (chunk.part == 0) {
+            _trace.clear();
+            _traceParts = 0;
+            _traceComplete = false;
+        }
+        if (_traceComplete || chunk.part != _traceParts) {
+            // A part went missing, so wait for the next dump
+            _traceComplete = false;
+            _traceParts = UINT32_MAX;
+            return;
+        }
+        _trace.append(chunk.text, chunk.length);
+        _traceParts++;
+        _traceComplete = chunk.last;
+    }
+
+    bool Metrics::trace(std::string &text) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_traceComplete) {
+            return false;
+        }
+        text = _trace;
+        return true;
+    }
+}
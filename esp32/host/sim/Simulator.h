@@ -0,0 +1,221 @@
+#ifndef ESP32_HOST_SIM_SIMULATOR_H
+#define ESP32_HOST_SIM_SIMULATOR_H
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "NimBLEDevice.h"
+#include "packets/HealthReport.h"
+#include "packets/Trace.h"
+
+/// sim holds the simulated world the host build runs against: the sensors the hub talks to over BLE, the
+/// access point and the backend on the other end of the websocket. It also measures what the firmware does.
+namespace sim {
+
+    /// SensorKind is the kind of sensor a Peripheral emulates. A Beacon puts its readings in its advertisements.
+    enum class SensorKind {
+        TI, Nordic, Pico, Beacon
+    };
+
+    /// Role identifies what a simulated characteristic carries
+    enum Role {
+        ROLE_NONE, ROLE_TI_DATA, ROLE_TI_CONFIG, ROLE_NORDIC_TEMP, ROLE_NORDIC_HUMIDITY, ROLE_UART,
+    };
+
+    /// Timing holds the latencies of the simulated radio and network. Times are in milliseconds.
+    struct Timing {
+        /// connectMs is the time to establish a BLE connection
+        uint32_t connectMs = 60;
+        /// discoveryMs is the time to discover the services of a peer
+        uint32_t discoveryMs = 150;
+        /// gattOpMs is the time of one GATT round trip (write with response, read, CCCD write)
+        uint32_t gattOpMs = 15;
+        /// advertisingIntervalMs is how often each sensor advertises
+        uint32_t advertisingIntervalMs = 500;
+        /// wifiConnectMs is the time from esp_wifi_connect to an IP address
+        uint32_t wifiConnectMs = 100;
+        /// websocketConnectMs is the time to open the websocket
+        uint32_t websocketConnectMs = 200;
+        /// websocketFrameMs is the fixed cost of sending one frame
+        uint32_t websocketFrameMs = 1;
+        /// websocketBytesPerMs is the uplink bandwidth (125 bytes/ms = 1 Mbit/s)
+        uint32_t websocketBytesPerMs = 125;
+        /// downlinkFrameBytes is the largest frame the backend sends. Longer messages go out as a frame followed by
+        /// continuation frames. 0 sends every message in one frame.
+        uint32_t downlinkFrameBytes = 0;
+    };
+
+    /// timing returns the timing used by all fakes. Change it before the scheduler starts.
+    Timing &timing();
+
+    /// Peripheral is one simulated sensor
+    class Peripheral {
+        SensorKind _kind;
+        NimBLEAddress _address;
+        std::string _addressString;
+        uint32_t _notifyIntervalMs;
+        uint32_t _seq = 0;
+        bool _configured = false;
+        /// _nextBeaconReadingUs is when a beacon takes its next readings
+        int64_t _nextBeaconReadingUs = 0;
+        /// _beaconData is the manufacturer data a beacon advertises
+        std::string _beaconData;
+
+    public:
+        Peripheral(SensorKind kind, const NimBLEAddress &address, uint32_t notifyIntervalMs);
+
+        [[nodiscard]] SensorKind kind() const;
+
+        [[nodiscard]] const NimBLEAddress &address() const;
+
+        [[nodiscard]] const std::string &addressString() const;
+
+        [[nodiscard]] uint32_t notifyIntervalMs() const;
+
+        /// central is the client connected to this sensor. The sensors accept a single connection.
+        NimBLEClient *central = nullptr;
+
+        /// nextAdvertisementUs is when the sensor advertises next
+        int64_t nextAdvertisementUs = 0;
+
+        /// advertisement returns the advertisement report a scanner receives from this sensor. A beacon takes and
+        /// records new readings once every notification interval.
+        [[nodiscard]] NimBLEAdvertisedDevice advertisement();
+
+        /// buildServices creates the GATT table of this sensor on client
+        void buildServices(NimBLEClient *client) const;
+
+        /// onConnect resets the per-connection state of the sensor
+        void onConnect();
+
+        /// onWrite handles a write to one of the sensor's characteristics
+        void onWrite(int role, const uint8_t *data, size_t length);
+
+        /// readValue returns the value of one of the sensor's characteristics
+        [[nodiscard]] std::string readValue(int role) const;
+
+        /// notifies says whether a subscription to role produces notifications right now
+        [[nodiscard]] bool notifies(int role) const;
+
+        /// nextNotification writes the next notification for role to out and records the reading it carries
+        size_t nextNotification(int role, uint8_t *out, size_t capacity);
+    };
+
+    /// World holds the simulated sensors
+    class World {
+        std::vector<std::unique_ptr<Peripheral>> _peripherals;
+        std::map<std::string, Peripheral *> _byAddress;
+
+        World() = default;
+
+    public:
+        /// get returns the singleton. It has static lifetime.
+        static World &get();
+
+        /// addSensors creates count sensors of the given kind. Call it before the scheduler starts.
+        void addSensors(SensorKind kind, int count, uint32_t notifyIntervalMs);
+
+        [[nodiscard]] const std::vector<std::unique_ptr<Peripheral>> &peripherals() const;
+
+        /// find returns the sensor with the given address or nullptr
+        Peripheral *find(const NimBLEAddress &address);
+    };
+
+    /// Network is the simulated access point and backend
+    class Network {
+        std::atomic<bool> _wifiUp{true};
+        std::atomic<bool> _backendUp{true};
+        std::mutex _mutex;
+        std::deque<std::vector<uint8_t>> _toHub;
+
+        Network() = default;
+
+    public:
+        static Network &get();
+
+        [[nodiscard]] bool wifiUp() const;
+
+        /// setWifiUp takes the access point up or down. Going down disconnects the station.
+        void setWifiUp(bool up);
+
+        [[nodiscard]] bool backendUp() const;
+
+        /// setBackendUp takes the backend up or down. Going down drops open websockets.
+        void setBackendUp(bool up);
+
+        /// sendToHub queues a binary message from the backend to the hub
+        void sendToHub(std::vector<uint8_t> message);
+
+        /// takeToHub pops the next message from the backend, if any
+        bool takeToHub(std::vector<uint8_t> &message);
+    };
+
+    /// Metrics records what reaches the backend and how long it took
+    class Metrics {
+        std::mutex _mutex;
+        /// _pending holds readings that were notified but not delivered yet, per (address, data type)
+        std::map<std::tuple<std::string, int>, std::deque<std::tuple<float, int64_t>>> _pending;
+        std::vector<uint32_t> _latenciesUs;
+        /// _lastHealthReport is the last health report the hub sent
+        std::unique_ptr<HealthReport> _lastHealthReport;
+        /// _trace is the trace dump being put back together from trace_chunks, and _traceParts how many it has
+        std::string _trace;
+        uint32_t _traceParts = 0;
+        bool _traceComplete = false;
+
+        Metrics() = default;
+
+    public:
+        std::atomic<uint64_t> notifications{0};
+        std::atomic<uint64_t> readingsDelivered{0};
+        std::atomic<uint64_t> readingsUnmatched{0};
+        std::atomic<uint64_t> frames{0};
+        std::atomic<uint64_t> payloadBytes{0};
+        std::atomic<uint64_t> wireBytes{0};
+        std::atomic<uint64_t> pings{0};
+        std::atomic<uint64_t> healthReports{0};
+        std::atomic<uint64_t> traceChunks{0};
+        std::atomic<uint64_t> otherFrames{0};
+        std::atomic<uint64_t> decodeErrors{0};
+        std::atomic<uint64_t> websocketConnects{0};
+        std::atomic<uint64_t> bleConnects{0};
+        std::atomic<uint64_t> bleConnectFailures{0};
+
+        static Metrics &get();
+
+        /// recordReading is called when a sensor notifies a reading
+        void recordReading(const std::string &address, int dataType, float value, int64_t timeUs);
+
+        /// recordDelivery is called when the backend receives a reading. It matches it against the notification
+        /// that produced it to measure notify to send latency.
+        void recordDelivery(const std::string &address, int dataType, float value, int64_t timeUs);
+
+        /// recordFrame is called for every binary frame the hub sends. It decodes and accounts for the packet.
+        void recordFrame(const uint8_t *data, size_t length, int64_t timeUs);
+
+        /// latencyPercentileUs returns the given percentile (0-100) of the notify to send latency
+        uint32_t latencyPercentileUs(double percentile);
+
+        [[nodiscard]] size_t latencyCount();
+
+        /// recordHealthReport is called when the backend receives a health report
+        void recordHealthReport(const HealthReport &report);
+
+        /// lastHealthReport copies the last health report into report. It returns false if there was none.
+        bool lastHealthReport(HealthReport &report);
+
+        /// recordTraceChunk is called when the backend receives a part of a trace dump. A part 0 starts a new dump.
+        void recordTraceChunk(const TraceChunk &chunk);
+
+        /// trace copies the last trace dump into text. It returns false if there was none, or not all of it came in.
+        bool trace(std::string &text);
+    };
+}
+
+#endif //ESP32_HOST_SIM_SIMULATOR_H
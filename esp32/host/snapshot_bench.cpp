@@ -0,0 +1,276 @@
+// snapshot_bench measures how readers of the latest values hold up the writer, with the store behind a
+// safe_std::mutex that readers copy out of (as the hub sync used to) and behind a safe_std::snapshot that readers
+// view in place. The store is either the std::map the latest values used to be kept in or LatestValues. One writer
+// updates the values a batch at a time, like the uplink task, while the readers go through all of them as fast as
+// they can.
+//
+//   snapshot_bench --readers 3 --seconds 3 --sensors 32 --batch 4
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "LatestValues.h"
+#include "SensorDataStore.h"
+#include "lib/mutex.h"
+#include "lib/snapshot.h"
+
+namespace {
+    /// MapEntry is a value as the std::map kept it, with the address as text
+    struct MapEntry {
+        long long timestamp;
+        std::string address;
+        TypeOfDevice type;
+        float value;
+        MeasureType measureType;
+    };
+
+    using Map = std::map<std::string, MapEntry, std::less<>>;
+    using Clock = std::chrono::steady_clock;
+
+    struct Options {
+        int readers = 3;
+        double seconds = 3;
+        int sensors = 32;
+        int batch = 4;
+    };
+
+    struct Result {
+        double writesPerSecond = 0;
+        /// publishesPerSecond is how often readers got a new version
+        double publishesPerSecond = 0;
+        double readsPerSecond = 0;
+        /// The time a batch took to write and publish, in microseconds
+        double p50 = 0;
+        double p99 = 0;
+        double max = 0;
+    };
+
+    void usage(const char *name) {
+        fprintf(stderr, "usage: %s [--readers N] [--seconds S] [--sensors N] [--batch N]\n"
+                        "  --readers   threads reading all the values in a loop (default 3)\n"
+                        "  --seconds   length of each run (default 3)\n"
+                        "  --sensors   number of sensors, each with a temperature and a humidity (default 32,\n"
+                        "              at most 112)\n"
+                        "  --batch     values the writer updates before publishing them (default 4)\n", name);
+        exit(1);
+    }
+
+    Options parse(int argc, char **argv) {
+        Options o;
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            if (i + 1 == argc) {
+                usage(argv[0]);
+            }
+            const char *value = argv[++i];
+            if (arg == "--readers") {
+                o.readers = atoi(value);
+            } else if (arg == "--seconds") {
+                o.seconds = atof(value);
+            } else if (arg == "--sensors") {
+                o.sensors = atoi(value);
+            } else if (arg == "--batch") {
+                o.batch = atoi(value);
+            } else {
+                usage(argv[0]);
+            }
+        }
+        // Two values a sensor have to fit in LatestValues without evicting any
+        if (o.readers < 0 || o.seconds <= 0 || o.sensors <= 0 || o.batch <= 0 ||
+            2 * o.sensors > LATEST_VALUES_CAPACITY - LATEST_VALUES_CAPACITY / 8) {
+            usage(argv[0]);
+        }
+        return o;
+    }
+
+    /// addressOf returns the address at the start of a key
+    BleAddr addressOf(const std::string &key) {
+        return *BleAddr::parse(std::string_view(key).substr(0, ADDRESS_STRING_SIZE - 1));
+    }
+
+    /// values makes the latest values of options.sensors sensors, keyed the way the uplink used to key them
+    Map values(const Options &options) {
+        Map m;
+        for (int s = 0; s < options.sensors; s++) {
+            char address[ADDRESS_STRING_SIZE];
+            snprintf(address, sizeof(address), "aa:bb:cc:dd:%02x:%02x", (s >> 8) & 0xff, s & 0xff);
+            for (MeasureType measureType: {TEMP, HUMIDITY}) {
+                std::string const key = address + std::to_string(measureType);
+                m.emplace(key, MapEntry{.timestamp = 0, .address = address, .type = TI, .value = 0,
+                        .measureType = measureType});
+            }
+        }
+        return m;
+    }
+
+    /// table holds the same values as m in a LatestValues
+    LatestValues table(const Map &m) {
+        LatestValues t;
+        for (const auto &[key, value]: m) {
+            t.set(SensorDataStore{.timestamp = value.timestamp, .address = addressOf(key), .type = value.type,
+                    .value = value.value, .measure_type = value.measureType});
+        }
+        return t;
+    }
+
+    /// sum goes through the values the way the hub sync does
+    float sum(const Map &m) {
+        float total = 0;
+        for (const auto &[key, value]: m) {
+            total += value.value + static_cast<float>(value.address.size());
+        }
+        return total;
+    }
+
+    float sum(const LatestValues &t) {
+        float total = 0;
+        t.forEach([&total](const SensorDataStore &value) {
+            total += value.value + static_cast<float>(value.address.getNative()[0]);
+        });
+        return total;
+    }
+
+    /// update sets the value of key in m
+    void update(Map &m, const std::string &key, long long timestamp) {
+        auto &value = m.find(key)->second;
+        value.timestamp = timestamp;
+        value.value += 0.01f;
+    }
+
+    void update(LatestValues &t, const std::string &key, long long timestamp) {
+        auto const measureType = static_cast<MeasureType>(key.back() - '0');
+        auto value = *t.find(addressOf(key), measureType);
+        value.timestamp = timestamp;
+        value.value += 0.01f;
+        t.set(value);
+    }
+
+    /// run has a writer call write with a batch of keys to update while the readers call read, and times the writer.
+    /// write returns whether it published the values.
+    template<typename Write, typename Read>
+    Result run(const Options &options, const Map &initial, const Write &write, const Read &read) {
+        std::vector<std::string> keys;
+        for (const auto &[key, value]: initial) {
+            keys.push_back(key);
+        }
+        std::atomic<bool> stop{false};
+        std::atomic<uint64_t> reads{0};
+        std::vector<std::thread> readers;
+        for (int r = 0; r < options.readers; r++) {
+            readers.emplace_back([&] {
+                float total = 0;
+                uint64_t n = 0;
+                while (!stop.load(std::memory_order_relaxed)) {
+                    total += read();
+                    n++;
+                }
+                reads += n + (total == -1 ? 1 : 0);
+            });
+        }
+
+        std::mt19937 generator{42};
+        std::uniform_int_distribution<size_t> pick{0, keys.size() - 1};
+        std::vector<const std::string *> batch(options.batch);
+        std::vector<double> latencies;
+        auto const start = Clock::now();
+        auto const end = start + std::chrono::duration<double>(options.seconds);
+        long long timestamp = 0;
+        uint64_t publishes = 0;
+        while (Clock::now() < end) {
+            for (auto &key: batch) {
+                key = &keys[pick(generator)];
+            }
+            auto const before = Clock::now();
+            publishes += write(batch, ++timestamp) ? 1 : 0;
+            latencies.push_back(std::chrono::duration<double, std::micro>(Clock::now() - before).count());
+        }
+        auto const elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+        stop = true;
+        for (auto &reader: readers) {
+            reader.join();
+        }
+
+        std::sort(latencies.begin(), latencies.end());
+        auto percentile = [&latencies](double p) {
+            return latencies[std::min(latencies.size() - 1, static_cast<size_t>(p / 100 * latencies.size()))];
+        };
+        return Result{
+                .writesPerSecond = static_cast<double>(latencies.size() * options.batch) / elapsed,
+                .publishesPerSecond = static_cast<double>(publishes) / elapsed,
+                .readsPerSecond = static_cast<double>(reads) / elapsed,
+                .p50 = percentile(50),
+                .p99 = percentile(99),
+                .max = latencies.back(),
+        };
+    }
+
+    /// measureMutex runs with initial behind a mutex that readers copy it out of
+    template<typename Store>
+    Result measureMutex(const Options &options, const Map &map, const Store &initial) {
+        safe_std::mutex<Store> locked(initial);
+        return run(options, map, [&locked](const std::vector<const std::string *> &batch, long long timestamp) {
+            auto m = locked.lock();
+            for (const std::string *key: batch) {
+                update(*m, *key, timestamp);
+            }
+            return true;
+        }, [&locked] {
+            // Copy out from under the lock, then go through the copy
+            Store copy;
+            {
+                copy = *locked.lock();
+            }
+            return sum(copy);
+        });
+    }
+
+    /// measureSnapshot runs with initial in a snapshot of N buffers
+    template<size_t N, typename Store>
+    Result measureSnapshot(const Options &options, const Map &map, const Store &initial) {
+        safe_std::snapshot<Store, N> published;
+        Store latest = initial;
+        published.tryPublish(latest);
+        return run(options, map, [&published, &latest](const std::vector<const std::string *> &batch,
+                                                        long long timestamp) {
+            for (const std::string *key: batch) {
+                update(latest, *key, timestamp);
+            }
+            // Like the uplink, leave it for the next batch if readers hold every buffer
+            return published.tryPublish(latest);
+        }, [&published] {
+            auto const view = published.read();
+            return sum(*view);
+        });
+    }
+
+    void print(const char *name, const Result &result) {
+        printf("%-12s %9.0f writes/s %9.0f publishes/s %9.0f reads/s   batch us: p50 %6.1f p99 %6.1f max %8.1f\n",
+               name, result.writesPerSecond, result.publishesPerSecond, result.readsPerSecond, result.p50, result.p99,
+               result.max);
+    }
+}
+
+int main(int argc, char **argv) {
+    Options const options = parse(argc, argv);
+    Map const initial = values(options);
+    printf("%zu values, 1 writer updating %d at a time, %d readers, %.1f s each\n", initial.size(), options.batch,
+           options.readers, options.seconds);
+
+    print("map/mutex", measureMutex(options, initial, initial));
+    print("map/2", measureSnapshot<2>(options, initial, initial));
+    print("map/3", measureSnapshot<3>(options, initial, initial));
+
+    LatestValues const t = table(initial);
+    print("table/mutex", measureMutex(options, initial, t));
+    print("table/2", measureSnapshot<2>(options, initial, t));
+    print("table/3", measureSnapshot<3>(options, initial, t));
+    return 0;
+}
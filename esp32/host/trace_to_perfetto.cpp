@@ -0,0 +1,200 @@
+// trace_to_perfetto turns a trace dump of the hub into the Chrome JSON trace format, which ui.perfetto.dev and
+// chrome://tracing open. The dump is either the text the hub writes to the serial console, log lines and all, or
+// the trace_chunks it uploads put back together, as hub_bench --trace writes them. If there are several dumps the
+// last one is taken.
+//
+//   idf.py monitor | tee hub.log
+//   trace_to_perfetto hub.log trace.json
+//   hub_bench --seconds 30 --trace trace.txt && trace_to_perfetto trace.txt trace.json
+//
+// The ring overwrites the oldest events, so the first spans of a dump may have lost their begin. Those ends are
+// dropped, and spans that hadn't ended by the dump are left open.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+    struct Event {
+        long long timeUs;
+        unsigned task;
+        char phase;
+        unsigned value;
+        std::string name;
+    };
+
+    struct Dump {
+        std::map<unsigned, std::string> tasks;
+        std::vector<Event> events;
+        bool complete = false;
+    };
+
+    void usage(const char *name) {
+        fprintf(stderr, "usage: %s [DUMP [OUT]]\n"
+                        "  reads the dump from stdin and writes the trace to stdout when they aren't given\n", name);
+        exit(1);
+    }
+
+    /// parse reads the last dump in input. Lines that aren't part of a dump are skipped.
+    Dump parse(FILE *input) {
+        Dump last;
+        Dump current;
+        bool inDump = false;
+        char line[512];
+        while (fgets(line, sizeof(line), input) != nullptr) {
+            line[strcspn(line, "\r\n")] = '\0';
+            // The console may put a timestamp or a log prefix before it
+            const char *at = strstr(line, "trace: ");
+            if (at == nullptr) {
+                continue;
+            }
+            at += strlen("trace: ");
+            if (strncmp(at, "begin ", 6) == 0) {
+                current = Dump{};
+                inDump = true;
+                continue;
+            }
+            if (!inDump) {
+                continue;
+            }
+            unsigned task;
+            int consumed = 0;
+            Event event;
+            if (strcmp(at, "end") == 0) {
+                current.complete = true;
+                last = std::move(current);
+                current = Dump{};
+                inDump = false;
+            } else if (sscanf(at, "task %u %n", &task, &consumed) == 1 && consumed > 0) {
+                current.tasks[task] = at + consumed;
+            } else if (sscanf(at, "event %lld %u %c %u %n", &event.timeUs, &event.task, &event.phase, &event.value,
+                              &consumed) == 4 && consumed > 0) {
+                event.name = at + consumed;
+                current.events.push_back(std::move(event));
+            }
+        }
+        if (inDump && !last.complete) {
+            // The log was cut off in the middle of the only dump
+            fprintf(stderr, "The dump is incomplete, converting what there is\n");
+            last = std::move(current);
+        }
+        return last;
+    }
+
+    /// quote returns text as a JSON string
+    std::string quote(const std::string &text) {
+        std::string quoted = "\"";
+        for (char c: text) {
+            if (c == '"' || c == '\\') {
+                quoted += '\\';
+                quoted += c;
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                char escaped[8];
+                snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                quoted += escaped;
+            } else {
+                quoted += c;
+            }
+        }
+        return quoted + "\"";
+    }
+
+    class Writer {
+        FILE *output;
+        bool first = true;
+
+    public:
+        explicit Writer(FILE *output) : output(output) {
+            fprintf(output, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        }
+
+        void metadata(const char *name, unsigned task, const std::string &value) {
+            fprintf(output, "%s{\"name\":\"%s\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":%s}}",
+                    first ? "" : ",\n", name, task, quote(value).c_str());
+            first = false;
+        }
+
+        void event(const Event &event, char phase) {
+            fprintf(output, "%s{\"name\":%s,\"cat\":\"hub\",\"ph\":\"%c\",\"ts\":%lld,\"pid\":1,\"tid\":%u",
+                    first ? "" : ",\n", quote(event.name).c_str(), phase, event.timeUs, event.task);
+            if (phase == 'i') {
+                fprintf(output, ",\"s\":\"t\",\"args\":{\"value\":%u}", event.value);
+            }
+            fprintf(output, "}");
+            first = false;
+        }
+
+        bool finish() {
+            fprintf(output, "\n]}\n");
+            return fflush(output) == 0 && !ferror(output);
+        }
+    };
+}
+
+int main(int argc, char **argv) {
+    if (argc > 3 || (argc > 1 && argv[1][0] == '-' && argv[1][1] != '\0')) {
+        usage(argv[0]);
+    }
+    FILE *input = argc > 1 && strcmp(argv[1], "-") != 0 ? fopen(argv[1], "r") : stdin;
+    if (input == nullptr) {
+        perror(argv[1]);
+        return 1;
+    }
+    Dump const dump = parse(input);
+    if (dump.events.empty()) {
+        fprintf(stderr, "No trace events in the input\n");
+        return 1;
+    }
+    FILE *output = argc > 2 ? fopen(argv[2], "w") : stdout;
+    if (output == nullptr) {
+        perror(argv[2]);
+        return 1;
+    }
+
+    Writer writer(output);
+    writer.metadata("process_name", 0, "hub");
+    for (const auto &[task, name]: dump.tasks) {
+        writer.metadata("thread_name", task, name);
+    }
+    // Spans nest on each task, so an end closes the innermost span of that name and any left open inside it
+    std::map<unsigned, std::vector<const Event *>> open;
+    size_t dropped = 0;
+    for (const Event &event: dump.events) {
+        std::vector<const Event *> &spans = open[event.task];
+        if (event.phase == 'B') {
+            spans.push_back(&event);
+            writer.event(event, 'B');
+        } else if (event.phase == 'E') {
+            size_t depth = spans.size();
+            while (depth > 0 && spans[depth - 1]->name != event.name) {
+                depth--;
+            }
+            if (depth == 0) {
+                dropped++;
+                continue;
+            }
+            while (spans.size() >= depth) {
+                Event end = *spans.back();
+                end.timeUs = event.timeUs;
+                writer.event(end, 'E');
+                spans.pop_back();
+            }
+        } else {
+            writer.event(event, 'i');
+        }
+    }
+    size_t unfinished = 0;
+    for (const auto &[task, spans]: open) {
+        unfinished += spans.size();
+    }
+    if (!writer.finish()) {
+        perror(argc > 2 ? argv[2] : "stdout");
+        return 1;
+    }
+    fprintf(stderr, "%zu events on %zu tasks, %zu ends without their begin dropped, %zu spans left open\n",
+            dump.events.size(), dump.tasks.size(), dropped, unfinished);
+    return 0;
+}
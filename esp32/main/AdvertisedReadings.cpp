@@ -0,0 +1,32 @@
+#include "AdvertisedReadings.h"
+#include "EnumTables.h"
+
+/// HEADER_SIZE is the size of the company id, format and sequence
+#define HEADER_SIZE 4
+
+/// READING_SIZE is the size of one data type and value
+#define READING_SIZE 3
+
+bool decodeAdvertisedReadings(const std::string &manufacturerData, uint8_t &sequence,
+                              std::array<AdvertisedReading, ADVERTISED_READINGS_MAX> &readings, size_t &count) {
+    auto data = reinterpret_cast<const uint8_t *>(manufacturerData.data());
+    size_t const length = manufacturerData.size();
+    if (length < HEADER_SIZE + READING_SIZE || (length - HEADER_SIZE) % READING_SIZE != 0 ||
+        (length - HEADER_SIZE) / READING_SIZE > readings.size()) {
+        return false;
+    }
+    if ((data[0] | data[1] << 8) != ADVERTISED_READINGS_COMPANY_ID || data[2] != ADVERTISED_READINGS_FORMAT) {
+        return false;
+    }
+    sequence = data[3];
+    count = 0;
+    for (size_t i = HEADER_SIZE; i < length; i += READING_SIZE) {
+        auto const measureType = measureTypeOf(static_cast<DataType>(data[i]));
+        if (!measureType.has_value()) {
+            return false;
+        }
+        auto const hundredths = static_cast<int16_t>(data[i + 1] | data[i + 2] << 8);
+        readings[count++] = {*measureType, static_cast<float>(hundredths) / 100};
+    }
+    return true;
+}
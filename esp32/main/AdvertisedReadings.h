@@ -0,0 +1,54 @@
+#ifndef ESP32_SRC_ADVERTISEDREADINGS_H_
+#define ESP32_SRC_ADVERTISEDREADINGS_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "SensorDataStore.h"
+#include "generated/firmware_backend.pb.h"
+
+/// DEVICE_TYPE_ADVERTISING configures a sensor that puts its readings in its advertisements. It is defined in
+/// firmware_backend.proto as
+///
+///     enum DeviceType { ...; DEVICE_TYPE_ADVERTISING = 5; }
+///
+/// The generated code in generated/ predates it. nanopb decodes enums as plain integers, so it comes through as is.
+#define DeviceType_DEVICE_TYPE_ADVERTISING ((DeviceType) 5)
+
+/// ADVERTISED_READINGS_COMPANY_ID is the company identifier our advertising sensors put in front of their
+/// manufacturer specific data. 0xFFFF is reserved by the Bluetooth SIG for internal use.
+#define ADVERTISED_READINGS_COMPANY_ID 0xFFFF
+
+/// ADVERTISED_READINGS_FORMAT is the version of the layout below
+#define ADVERTISED_READINGS_FORMAT 1
+
+/// The manufacturer specific data of an advertising sensor is laid out as
+///
+///     company id   2 bytes, little endian, ADVERTISED_READINGS_COMPANY_ID
+///     format       1 byte, ADVERTISED_READINGS_FORMAT
+///     sequence     1 byte, bumped by the sensor whenever its readings change
+///     then for each reading
+///       data type  1 byte, the DataType of firmware_backend.proto
+///       value      2 bytes, signed little endian, in hundredths of the unit
+///
+/// A sensor repeats the same advertisement until it has new readings, so the sequence tells new readings from
+/// repeats.
+
+/// ADVERTISED_READINGS_MAX is the most readings an advertisement carries. Of the 31 bytes of an advertisement, the
+/// length and type of the manufacturer specific data take 2 and the header 4, which leaves room for 8.
+#define ADVERTISED_READINGS_MAX 8
+
+/// AdvertisedReading is one reading carried by an advertisement
+struct AdvertisedReading {
+    MeasureType measureType;
+    float value;
+};
+
+/// decodeAdvertisedReadings parses the manufacturer specific data of an advertising sensor into sequence and the
+/// first count of readings. It returns false if the data isn't in our format or holds more than
+/// ADVERTISED_READINGS_MAX readings.
+bool decodeAdvertisedReadings(const std::string &manufacturerData, uint8_t &sequence,
+                              std::array<AdvertisedReading, ADVERTISED_READINGS_MAX> &readings, size_t &count);
+
+#endif //ESP32_SRC_ADVERTISEDREADINGS_H_
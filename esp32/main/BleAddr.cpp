@@ -0,0 +1,12 @@
+#include <cstring>
+#include "BleAddr.h"
+#include "NimBLEDevice.h"
+
+BleAddr::BleAddr(const NimBLEAddress &address) : BleAddr(fromNative(address.getNative(), address.getType())) {}
+
+NimBLEAddress BleAddr::toNimBLE() const {
+    // esp-nimble-cpp takes the native address as non-const
+    uint8_t bytes[6];
+    memcpy(bytes, native.data(), sizeof(bytes));
+    return NimBLEAddress(bytes, type);
+}
@@ -0,0 +1,153 @@
+#ifndef ESP32_SRC_BLEADDR_H_
+#define ESP32_SRC_BLEADDR_H_
+
+#include <array>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+class NimBLEAddress;
+
+/// ADDRESS_STRING_SIZE is the size of an address as text, like aa:bb:cc:dd:ee:ff, with its terminator
+#define ADDRESS_STRING_SIZE 18
+
+/// BleAddr is a BLE address as its 6 bytes and its type. It is how addresses are held and compared inside the
+/// firmware; the text form is only for the logs and for the packets that still carry addresses as strings.
+/// Two addresses are equal when their bytes are, whatever their types: the backend configures sensors by their text,
+/// which doesn't say.
+class BleAddr {
+private:
+    /// native is the address least significant byte first, like NimBLEAddress holds it
+    std::array<uint8_t, 6> native{};
+    /// type is a BLE_ADDR_* of NimBLE. 0 is BLE_ADDR_PUBLIC.
+    uint8_t type = 0;
+
+public:
+    constexpr BleAddr() = default;
+
+    /// BleAddr takes the address from the low 48 bits of bits, the most significant byte of the text in bits 40 to 47
+    constexpr explicit BleAddr(uint64_t bits, uint8_t type = 0);
+
+    explicit BleAddr(const NimBLEAddress &address);
+
+    /// fromNative takes the address from 6 bytes, least significant first
+    static constexpr BleAddr fromNative(const uint8_t *native, uint8_t type = 0);
+
+    /// parse reads an address written like aa:bb:cc:dd:ee:ff, in either case. It returns nothing if text is anything
+    /// else.
+    static constexpr std::optional<BleAddr> parse(std::string_view text, uint8_t type = 0);
+
+    /// toNimBLE returns the address to connect to
+    [[nodiscard]] NimBLEAddress toNimBLE() const;
+
+    /// bits returns the address in the low 48 bits, the most significant byte of the text in bits 40 to 47
+    [[nodiscard]] constexpr uint64_t bits() const;
+
+    [[nodiscard]] constexpr uint8_t getType() const;
+
+    /// getNative returns the 6 bytes, least significant first
+    [[nodiscard]] constexpr const uint8_t *getNative() const;
+
+    /// format writes the address the way NimBLEAddress::toString does, without allocating a std::string
+    constexpr void format(char (&out)[ADDRESS_STRING_SIZE]) const;
+
+    /// toText returns the address as text, for the logs: LOG("%s", address.toText().data())
+    [[nodiscard]] constexpr std::array<char, ADDRESS_STRING_SIZE> toText() const;
+
+    friend constexpr bool operator==(const BleAddr &a, const BleAddr &b) {
+        return a.native == b.native;
+    }
+
+    friend constexpr std::strong_ordering operator<=>(const BleAddr &a, const BleAddr &b) {
+        return a.bits() <=> b.bits();
+    }
+};
+
+constexpr BleAddr::BleAddr(uint64_t bits, uint8_t type) : type(type) {
+    for (auto &byte: native) {
+        byte = static_cast<uint8_t>(bits);
+        bits >>= 8;
+    }
+}
+
+constexpr BleAddr BleAddr::fromNative(const uint8_t *native, uint8_t type) {
+    BleAddr address;
+    for (size_t i = 0; i < address.native.size(); i++) {
+        address.native[i] = native[i];
+    }
+    address.type = type;
+    return address;
+}
+
+constexpr std::optional<BleAddr> BleAddr::parse(std::string_view text, uint8_t type) {
+    if (text.size() != ADDRESS_STRING_SIZE - 1) {
+        return std::nullopt;
+    }
+    auto digit = [](char c) -> int {
+        if (c >= '0' && c <= '9') {
+            return c - '0';
+        }
+        if (c >= 'a' && c <= 'f') {
+            return c - 'a' + 10;
+        }
+        if (c >= 'A' && c <= 'F') {
+            return c - 'A' + 10;
+        }
+        return -1;
+    };
+    uint64_t bits = 0;
+    for (size_t i = 0; i < text.size(); i += 3) {
+        int const high = digit(text[i]);
+        int const low = digit(text[i + 1]);
+        if (high < 0 || low < 0 || (i + 2 < text.size() && text[i + 2] != ':')) {
+            return std::nullopt;
+        }
+        bits = bits << 8 | static_cast<uint64_t>(high << 4 | low);
+    }
+    return BleAddr(bits, type);
+}
+
+constexpr uint64_t BleAddr::bits() const {
+    uint64_t bits = 0;
+    for (size_t i = native.size(); i > 0; i--) {
+        bits = bits << 8 | native[i - 1];
+    }
+    return bits;
+}
+
+constexpr uint8_t BleAddr::getType() const {
+    return type;
+}
+
+constexpr const uint8_t *BleAddr::getNative() const {
+    return native.data();
+}
+
+constexpr void BleAddr::format(char (&out)[ADDRESS_STRING_SIZE]) const {
+    constexpr char digits[] = "0123456789abcdef";
+    char *p = out;
+    for (size_t i = native.size(); i > 0; i--) {
+        *p++ = digits[native[i - 1] >> 4];
+        *p++ = digits[native[i - 1] & 0xf];
+        *p++ = i == 1 ? '\0' : ':';
+    }
+}
+
+constexpr std::array<char, ADDRESS_STRING_SIZE> BleAddr::toText() const {
+    char text[ADDRESS_STRING_SIZE]{};
+    format(text);
+    std::array<char, ADDRESS_STRING_SIZE> out{};
+    for (size_t i = 0; i < ADDRESS_STRING_SIZE; i++) {
+        out[i] = text[i];
+    }
+    return out;
+}
+
+static_assert(BleAddr::parse("aa:BB:cc:dd:ee:0f")->bits() == 0xaabbccddee0f);
+static_assert(BleAddr::parse("aa:bb:cc:dd:ee:0f")->toText()[15] == '0');
+static_assert(!BleAddr::parse("aa:bb:cc:dd:ee:0g").has_value());
+static_assert(!BleAddr::parse("aa-bb-cc-dd-ee-ff").has_value());
+
+#endif //ESP32_SRC_BLEADDR_H_
@@ -0,0 +1,68 @@
+#include <exception>
+#include <stdexcept>
+#include "CommandWorker.h"
+#include "lib/log.h"
+#include "lib/trace/trace.h"
+
+CommandWorker *CommandWorker::getInstance() {
+    static CommandWorker w;
+    return &w;
+}
+
+void CommandWorker::start(Handler handle) {
+    handler = handle;
+    queue = xQueueCreateStatic(BACKEND_PACKET_POOL_SIZE, sizeof(Command), queueStorage, &queueBuffer);
+    TaskHandle_t const task = xTaskCreateStatic([](void *parameters) {
+        reinterpret_cast<CommandWorker *>(parameters)->loop();
+    }, "Commands", COMMAND_STACK_SIZE, this, 1, stack, &taskBuffer);
+    if (task == nullptr) {
+        throw std::runtime_error("Couldn't create thread");
+    }
+}
+
+bool CommandWorker::submit(BackendPacketPool::handle &packet) {
+    if (queue == nullptr) {
+        return false;
+    }
+    Command const command{.packet = packet.get(), .queuedAt = xTaskGetTickCount()};
+    // Every packet of the pool has a place in the queue, so this never waits
+    if (xQueueSend(queue, &command, 0) != pdTRUE) {
+        return false;
+    }
+    // The worker owns the packet now
+    packet.release();
+    return true;
+}
+
+size_t CommandWorker::queued() const {
+    return queue == nullptr ? 0 : uxQueueMessagesWaiting(queue);
+}
+
+uint32_t CommandWorker::takeMaxWaitMs() {
+    return pdTICKS_TO_MS(maxWait.exchange(0));
+}
+
+void CommandWorker::loop() {
+    for (;;) {
+        Command command{};
+        if (xQueueReceive(queue, &command, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        // Give the packet back to its pool once it's handled
+        auto const packet = backendPackets()->adopt(command.packet);
+        TickType_t const started = xTaskGetTickCount();
+        TickType_t const waited = started - command.queuedAt;
+        if (waited > maxWait.load()) {
+            maxWait = waited;
+        }
+        try {
+            TRACE_SCOPE("command");
+            handler(*packet);
+        } catch (const std::exception &e) {
+            LOG("Command %u failed: %s\n", (unsigned) packet->which_type, e.what());
+        }
+        LOG("Command %u waited %u ms and took %u ms, %u queued\n", (unsigned) packet->which_type,
+            (unsigned) pdTICKS_TO_MS(waited), (unsigned) pdTICKS_TO_MS(xTaskGetTickCount() - started),
+            (unsigned) uxQueueMessagesWaiting(queue));
+    }
+}
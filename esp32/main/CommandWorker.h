@@ -0,0 +1,61 @@
+#ifndef ESP32_SRC_COMMANDWORKER_H_
+#define ESP32_SRC_COMMANDWORKER_H_
+
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include "PacketPools.h"
+#include "generated/firmware_backend.pb.h"
+
+/// COMMAND_STACK_SIZE is the stack of the command worker. The packets live in their pools.
+#define COMMAND_STACK_SIZE 8'000
+
+/// CommandWorker is a singleton task that handles the commands from the backend one at a time, in the order they came.
+/// The websocket callback decodes a command into a packet of backendPackets() and queues it. The queue has a place
+/// for every packet of the pool, so a burst of commands is bounded by the pool rather than by the heap.
+/// A pointer to the object can be obtained using `CommandWorker::getInstance()`
+class CommandWorker {
+public:
+    /// Handler handles a command. Exceptions it throws are logged and the command is dropped.
+    using Handler = void (*)(const BackendToFirmwarePacket &packet);
+
+private:
+    /// Command is a queued command
+    struct Command {
+        BackendToFirmwarePacket *packet;
+        /// queuedAt is when the command was queued, in ticks
+        TickType_t queuedAt;
+    };
+
+    Handler handler = nullptr;
+    QueueHandle_t queue = nullptr;
+    StaticQueue_t queueBuffer{};
+    uint8_t queueStorage[BACKEND_PACKET_POOL_SIZE * sizeof(Command)]{};
+    StackType_t stack[COMMAND_STACK_SIZE]{};
+    StaticTask_t taskBuffer{};
+    /// maxWait is the longest a command waited in the queue since takeMaxWaitMs last ran, in ticks
+    std::atomic<TickType_t> maxWait{0};
+
+    CommandWorker() = default;
+
+    [[noreturn]] void loop();
+
+public:
+    static CommandWorker *getInstance();
+
+    /// start starts the task that hands the commands to handle
+    void start(Handler handle);
+
+    /// submit queues packet and takes it over. It returns false, leaving packet as it is, if the worker isn't
+    /// started.
+    bool submit(BackendPacketPool::handle &packet);
+
+    /// queued returns the number of commands waiting to be handled
+    [[nodiscard]] size_t queued() const;
+
+    /// takeMaxWaitMs returns the longest a command waited to be handled since the last call, and starts over
+    uint32_t takeMaxWaitMs();
+};
+
+#endif //ESP32_SRC_COMMANDWORKER_H_
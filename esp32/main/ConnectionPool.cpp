@@ -0,0 +1,166 @@
+#include <algorithm>
+#include "ConnectionPool.h"
+#include "lib/log.h"
+#include "lib/ArduinoSupport/ArduinoSupport.h"
+
+void ConnectionPool::disconnect(NimBLEClient *c) {
+    if (c == nullptr || !c->isConnected()) {
+        return;
+    }
+    c->disconnect();
+    // NimBLE reports the disconnection from its host task
+    for (int i = 0; i < 100 && c->isConnected(); i++) {
+        delay(10);
+    }
+}
+
+bool ConnectionPool::isActive(const BleAddr &address) {
+    auto s = slots.lock();
+    return std::any_of(s->begin(), s->end(), [&address](Slot &slot) {
+        NimBLEClient *c = slot.session.getClient();
+        return slot.address == address && (slot.busy || (c != nullptr && c->isConnected()));
+    });
+}
+
+std::optional<NimBLEAddress> ConnectionPool::knownAddress(const BleAddr &address) {
+    auto s = slots.lock();
+    for (const auto &slot: *s) {
+        if (slot.address == address) {
+            return slot.session.getAddress();
+        }
+    }
+    return std::nullopt;
+}
+
+SensorSession *ConnectionPool::acquire(const NimBLEAddress &address, TypeOfDevice type, int priority) {
+    BleAddr const sensor(address);
+    NimBLEClient *evicted = nullptr;
+    Slot *chosen = nullptr;
+    {
+        auto s = slots.lock();
+        TickType_t const now = xTaskGetTickCount();
+        for (auto &slot: *s) {
+            if (slot.address == sensor) {
+                chosen = slot.busy ? nullptr : &slot;
+                if (chosen == nullptr) {
+                    return nullptr;
+                }
+                break;
+            }
+        }
+        if (chosen == nullptr) {
+            // Prefer a free slot, then one whose sensor went away, then the lowest priority and least recently used
+            auto rank = [](const Slot &x) {
+                NimBLEClient *c = x.session.getClient();
+                bool const connected = c != nullptr && c->isConnected();
+                return std::make_tuple(x.address.has_value(), connected, x.priority);
+            };
+            for (auto &slot: *s) {
+                NimBLEClient *c = slot.session.getClient();
+                bool const evictable = !slot.address.has_value() || c == nullptr || !c->isConnected() ||
+                                       now - slot.connectedAt >= pdMS_TO_TICKS(MIN_CONNECTED_MS);
+                if (slot.busy || !evictable) {
+                    continue;
+                }
+                // Ticks wrap, so compare how long ago each was used rather than the raw ticks
+                if (chosen == nullptr || rank(slot) < rank(*chosen) ||
+                    (rank(slot) == rank(*chosen) && now - slot.lastUsed > now - chosen->lastUsed)) {
+                    chosen = &slot;
+                }
+            }
+            if (chosen == nullptr) {
+                return nullptr;
+            }
+            if (chosen->address.has_value()) {
+                LOG("Evicting %s for %s\n", chosen->address->toText().data(), sensor.toText().data());
+                evicted = chosen->session.getClient();
+            }
+        }
+        NimBLEClient *c = chosen->session.getClient();
+        if (c == nullptr) {
+            c = NimBLEDevice::createClient(address);
+            if (c == nullptr) {
+                return nullptr;
+            }
+        }
+        chosen->address = sensor;
+        chosen->priority = priority;
+        chosen->connectedAt = now;
+        chosen->lastUsed = now;
+        chosen->busy = true;
+        chosen->session.reset(c, address, type);
+    }
+    // Disconnecting waits on the host task, which may be waiting on us in touch, so do it unlocked
+    disconnect(evicted);
+    chosen->session.getClient()->setPeerAddress(address);
+    return &chosen->session;
+}
+
+size_t ConnectionPool::busyCount() {
+    auto s = slots.lock();
+    return std::count_if(s->begin(), s->end(), [](Slot &slot) { return slot.busy; });
+}
+
+void ConnectionPool::done(SensorSession *session, bool open) {
+    NimBLEClient *c = nullptr;
+    {
+        auto s = slots.lock();
+        for (auto &slot: *s) {
+            if (&slot.session != session) {
+                continue;
+            }
+            slot.busy = false;
+            slot.lastUsed = xTaskGetTickCount();
+            // Don't keep a half set up connection around, it would never be retried. The slot may also have been
+            // released while it was being set up.
+            if (!open || !slot.address.has_value()) {
+                slot.address.reset();
+                c = session->getClient();
+            }
+            break;
+        }
+    }
+    disconnect(c);
+}
+
+void ConnectionPool::touch(const BleAddr &address) {
+    auto s = slots.lock();
+    for (auto &slot: *s) {
+        if (slot.address == address) {
+            slot.lastUsed = xTaskGetTickCount();
+            return;
+        }
+    }
+}
+
+void ConnectionPool::release(const BleAddr &address) {
+    NimBLEClient *c = nullptr;
+    {
+        auto s = slots.lock();
+        for (auto &slot: *s) {
+            if (slot.address == address) {
+                slot.address.reset();
+                c = slot.session.getClient();
+                break;
+            }
+        }
+    }
+    // A session that is being set up fails and is cleaned up in done
+    disconnect(c);
+}
+
+void ConnectionPool::retain(const std::vector<BleAddr> &addresses) {
+    std::vector<BleAddr> toRelease;
+    {
+        auto s = slots.lock();
+        for (const auto &slot: *s) {
+            if (slot.address.has_value() &&
+                !std::binary_search(addresses.begin(), addresses.end(), *slot.address)) {
+                toRelease.emplace_back(*slot.address);
+            }
+        }
+    }
+    for (const auto &address: toRelease) {
+        release(address);
+    }
+}
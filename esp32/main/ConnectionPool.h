@@ -0,0 +1,77 @@
+#ifndef ESP32_SRC_CONNECTIONPOOL_H_
+#define ESP32_SRC_CONNECTIONPOOL_H_
+
+#include <array>
+#include <optional>
+#include <vector>
+#include <sdkconfig.h>
+#include <freertos/FreeRTOS.h>
+#include "BleAddr.h"
+#include "NimBLEDevice.h"
+#include "SensorSession.h"
+#include "TypeOfDevice.h"
+#include "lib/mutex.h"
+
+/// BLE_POOL_SIZE is how many sensors we keep connected at once. One of the controller's connections is left for
+/// another hub connecting to our server.
+#define BLE_POOL_SIZE (CONFIG_BT_NIMBLE_MAX_CONNECTIONS - 1)
+
+/// MIN_CONNECTED_MS is how long a connection is kept before it can be evicted, so that a pool smaller than the sensor
+/// list takes turns instead of thrashing
+#define MIN_CONNECTED_MS 60'000
+
+/// ConnectionPool keeps up to BLE_POOL_SIZE sensors connected, with their subscriptions active, for as long as they
+/// stay configured. Each slot holds the SensorSession of its connection and reuses its NimBLEClient, so the number
+/// of clients is bounded.
+/// When every slot is taken, the connection with the lowest priority, and among those the one that has gone the
+/// longest without data, is evicted.
+class ConnectionPool {
+private:
+    struct Slot {
+        /// address is the sensor's address. It is empty when the slot is free.
+        std::optional<BleAddr> address;
+        int priority = 0;
+        /// connectedAt is when the session was acquired, in ticks
+        TickType_t connectedAt = 0;
+        /// lastUsed is when the sensor last connected or sent data, in ticks
+        TickType_t lastUsed = 0;
+        /// busy is set between acquire and done, while a worker sets the session up
+        bool busy = false;
+        SensorSession session;
+    };
+
+    safe_std::mutex<std::array<Slot, BLE_POOL_SIZE>> slots;
+
+    /// disconnect drops c's connection and waits until NimBLE reports it gone
+    static void disconnect(NimBLEClient *c);
+
+public:
+    /// isActive returns whether address is connected or being connected
+    bool isActive(const BleAddr &address);
+
+    /// knownAddress returns the BLE address address was last connected with, so that it can be reconnected without
+    /// scanning for it
+    std::optional<NimBLEAddress> knownAddress(const BleAddr &address);
+
+    /// acquire reserves a slot for address and returns its session, ready to be opened, evicting a connection if
+    /// the pool is full. Higher priorities are evicted last. It returns nullptr if no slot can be had right now.
+    /// The session must be handed back with done.
+    SensorSession *acquire(const NimBLEAddress &address, TypeOfDevice type, int priority);
+
+    /// busyCount returns how many sessions are between acquire and done
+    size_t busyCount();
+
+    /// done hands back a session from acquire. A session that didn't stay open frees its slot.
+    void done(SensorSession *session, bool open);
+
+    /// touch marks address as recently used. Call it whenever the sensor sends data.
+    void touch(const BleAddr &address);
+
+    /// release disconnects address and frees its slot
+    void release(const BleAddr &address);
+
+    /// retain releases every connection whose address isn't in addresses, which must be sorted
+    void retain(const std::vector<BleAddr> &addresses);
+};
+
+#endif //ESP32_SRC_CONNECTIONPOOL_H_
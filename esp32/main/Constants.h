@@ -1,18 +1,59 @@
 #ifndef ESP32_CONSTANTS_H
 #define ESP32_CONSTANTS_H
 
-#include "SensorDataStore.h"
-#include "lib/mutex.h"
+#include "lib/snapshot.h"
 #include <memory>
-#include <map>
+#include <string>
 
 /// uuid returns a singleton containing the dynamically generated uuid of the device
 std::string* uuid();
 
-extern safe_std::mutex<std::map<std::string, SensorDataStore>> sensorData;
+class LatestValues;
 
-/// MS_TO_STAY_CONNECTED designates how long should the device be connected to a sensor via ble
-#define MS_TO_STAY_CONNECTED 15'000
+/// LATEST_VALUES_CAPACITY is the number of slots of LatestValues. It must be a power of two. To keep the probes short,
+/// at most 7/8 of them hold a value; past that the oldest value makes room.
+#define LATEST_VALUES_CAPACITY 256
+
+/// LATEST_VALUES_TTL_S is how long a sensor's latest value is kept after its last reading, in seconds, so that the
+/// values of sensors that were removed don't linger
+#define LATEST_VALUES_TTL_S (15 * 60)
+
+/// SENSOR_DATA_BUFFERS is how many versions of the latest values are kept. With two, readers that keep coming can hold
+/// the one that isn't current most of the time and the Uplink rarely gets to publish (see host/snapshot_bench).
+#define SENSOR_DATA_BUFFERS 3
+
+/// sensorData is the latest values as the Uplink last published them. Readers take a view of it rather than a copy,
+/// and don't hold up the Uplink.
+extern safe_std::snapshot<LatestValues, SENSOR_DATA_BUFFERS> sensorData;
+
+/// MAX_PARALLEL_SESSIONS is how many sensors are connected and set up at the same time
+#define MAX_PARALLEL_SESSIONS 3
+
+/// UPLINK_MAX_READINGS is the most readings sent in one sensor_data_batch
+#define UPLINK_MAX_READINGS 24
+
+/// UPLINK_MAX_BYTES is the largest sensor_data_batch packet. It keeps a batch within one websocket frame
+/// (CONFIG_WS_BUFFER_SIZE).
+#define UPLINK_MAX_BYTES 1'000
+
+/// UPLINK_MAX_DELAY_MS is the longest a reading waits for its batch to fill up before it's sent
+#define UPLINK_MAX_DELAY_MS 1'000
+
+/// UPLINK_MAX_PENDING is the most readings that wait to be sent while the websocket is down. Past that the oldest
+/// readings are dropped.
+#define UPLINK_MAX_PENDING 256
+
+/// UPLINK_MAX_REPLAY_READINGS is the most readings replayed from the flash log in one sensor_data_blocks packet. The
+/// packet is still kept within UPLINK_MAX_BYTES.
+#define UPLINK_MAX_REPLAY_READINGS 256
+
+/// UPLINK_RING_SIZE is how many readings the BLE callbacks can hand over before the uplink task takes them. It must
+/// be a power of two.
+#define UPLINK_RING_SIZE 128
+
+/// UPLINK_PUBLISH_RETRY_MS is how soon the uplink task publishes the latest values again when readers held every
+/// buffer of sensorData
+#define UPLINK_PUBLISH_RETRY_MS 100
 
 /// CHARACTERISTIC_SERVER_UUID is the device's CHARACTERISTIC
 #define CHARACTERISTIC_SERVER_UUID "2630acab-7bf5-4dee-97fb-af8d3955c2aa"
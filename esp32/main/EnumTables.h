@@ -0,0 +1,162 @@
+#ifndef ESP32_SRC_ENUMTABLES_H_
+#define ESP32_SRC_ENUMTABLES_H_
+
+#include <array>
+#include <cstddef>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include "AdvertisedReadings.h"
+#include "SensorDataStore.h"
+#include "TypeOfDevice.h"
+#include "generated/firmware_backend.pb.h"
+#include "generated/packet.pb.h"
+
+/// MeasureTypeRow is how a MeasureType is spelled in the backend and the hub to hub protocols
+struct MeasureTypeRow {
+    MeasureType measureType;
+    DataType dataType;
+    ValuesInterDevice_MEASURE_TYPE crossDevice;
+};
+
+/// MEASURE_TYPES lists every MeasureType. The conversions below are lookup tables built from it at compile time.
+inline constexpr MeasureTypeRow MEASURE_TYPES[] = {
+        {TEMP,           DataType_DATA_TYPE_TEMP,           ValuesInterDevice_MEASURE_TYPE_TEMP},
+        {HUMIDITY,       DataType_DATA_TYPE_HUMIDITY,       ValuesInterDevice_MEASURE_TYPE_HUMIDITY},
+        {DHT11_TEMP,     DataType_DATA_TYPE_DHT11_TEMP,     ValuesInterDevice_MEASURE_TYPE_DHT11_TEMP},
+        {DHT22_TEMP,     DataType_DATA_TYPE_DHT22_TEMP,     ValuesInterDevice_MEASURE_TYPE_DHT22_TEMP},
+        {DHT11_HUMIDITY, DataType_DATA_TYPE_DHT11_HUMIDITY, ValuesInterDevice_MEASURE_TYPE_DHT11_HUMIDITY},
+        {DHT22_HUMIDITY, DataType_DATA_TYPE_DHT22_HUMIDITY, ValuesInterDevice_MEASURE_TYPE_DHT22_HUMIDITY},
+        {PICO_TEMP,      DataType_DATA_TYPE_PICO_TEMP,      ValuesInterDevice_MEASURE_TYPE_PICO_TEMP},
+};
+
+/// DeviceTypeRow is how a TypeOfDevice is spelled in the backend and the hub to hub protocols
+struct DeviceTypeRow {
+    TypeOfDevice type;
+    DeviceType deviceType;
+    SensorInfoInterDevice_DEVICE_TYPE crossDeviceSensor;
+    ValuesInterDevice_DEVICE_TYPE crossDeviceValue;
+};
+
+/// DEVICE_TYPES lists every TypeOfDevice. Hubs don't know about advertising sensors, so they are unspecified to them.
+inline constexpr DeviceTypeRow DEVICE_TYPES[] = {
+        {Nordic,      DeviceType_DEVICE_TYPE_NORDIC,      SensorInfoInterDevice_DEVICE_TYPE_NORDIC,
+                ValuesInterDevice_DEVICE_TYPE_NORDIC},
+        {TI,          DeviceType_DEVICE_TYPE_TI,          SensorInfoInterDevice_DEVICE_TYPE_TI,
+                ValuesInterDevice_DEVICE_TYPE_TI},
+        {Custom,      DeviceType_DEVICE_TYPE_CUSTOM,      SensorInfoInterDevice_DEVICE_TYPE_CUSTOM,
+                ValuesInterDevice_DEVICE_TYPE_CUSTOM},
+        {Hub,         DeviceType_DEVICE_TYPE_HUB,         SensorInfoInterDevice_DEVICE_TYPE_HUB,
+                ValuesInterDevice_DEVICE_TYPE_HUB},
+        {Advertising, DeviceType_DEVICE_TYPE_ADVERTISING, SensorInfoInterDevice_DEVICE_TYPE_UNSPECIFIED,
+                ValuesInterDevice_DEVICE_TYPE_UNSPECIFIED},
+};
+
+namespace enum_tables {
+    /// Entry is a slot of a lookup table. present is false for keys that no row lists.
+    template<typename V>
+    struct Entry {
+        V value{};
+        bool present = false;
+    };
+
+    /// index builds a table that maps the Key column of rows to their Value column. It is meant to run at compile
+    /// time, where a key that doesn't fit in Size or is listed twice fails the build.
+    template<size_t Size, auto Key, auto Value, typename Row, size_t N>
+    constexpr auto index(const Row (&rows)[N]) {
+        using V = std::remove_cvref_t<decltype(rows[0].*Value)>;
+        std::array<Entry<V>, Size> table{};
+        for (const Row &row: rows) {
+            auto const key = static_cast<size_t>(row.*Key);
+            if (key >= Size || table[key].present) {
+                throw std::logic_error("Enum table key out of range or listed twice");
+            }
+            table[key] = {row.*Value, true};
+        }
+        return table;
+    }
+
+    /// complete returns whether every key of table is listed
+    template<typename V, size_t Size>
+    constexpr bool complete(const std::array<Entry<V>, Size> &table) {
+        for (const auto &entry: table) {
+            if (!entry.present) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /// find returns the value of key, or nothing if it isn't listed
+    template<typename V, size_t Size, typename K>
+    constexpr std::optional<V> find(const std::array<Entry<V>, Size> &table, K key) {
+        auto const i = static_cast<size_t>(key);
+        if (i >= Size || !table[i].present) {
+            return std::nullopt;
+        }
+        return table[i].value;
+    }
+
+    inline constexpr size_t MEASURE_TYPE_COUNT = PICO_TEMP + 1;
+    inline constexpr size_t DATA_TYPE_COUNT = DataType_DATA_TYPE_PICO_TEMP + 1;
+    inline constexpr size_t DEVICE_TYPE_COUNT = DeviceType_DEVICE_TYPE_ADVERTISING + 1;
+
+    inline constexpr auto dataTypes = index<MEASURE_TYPE_COUNT, &MeasureTypeRow::measureType,
+            &MeasureTypeRow::dataType>(MEASURE_TYPES);
+    inline constexpr auto crossDeviceMeasureTypes = index<MEASURE_TYPE_COUNT, &MeasureTypeRow::measureType,
+            &MeasureTypeRow::crossDevice>(MEASURE_TYPES);
+    inline constexpr auto measureTypes = index<DATA_TYPE_COUNT, &MeasureTypeRow::dataType,
+            &MeasureTypeRow::measureType>(MEASURE_TYPES);
+    inline constexpr auto typesOfDevice = index<DEVICE_TYPE_COUNT, &DeviceTypeRow::deviceType,
+            &DeviceTypeRow::type>(DEVICE_TYPES);
+    inline constexpr auto crossDeviceSensorTypes = index<TYPE_OF_DEVICE_COUNT, &DeviceTypeRow::type,
+            &DeviceTypeRow::crossDeviceSensor>(DEVICE_TYPES);
+    inline constexpr auto crossDeviceValueTypes = index<TYPE_OF_DEVICE_COUNT, &DeviceTypeRow::type,
+            &DeviceTypeRow::crossDeviceValue>(DEVICE_TYPES);
+
+    static_assert(complete(dataTypes), "MEASURE_TYPES must list every MeasureType");
+    static_assert(complete(crossDeviceSensorTypes), "DEVICE_TYPES must list every TypeOfDevice");
+}
+
+/// toDataType converts a MeasureType to the DataType the backend expects
+inline DataType toDataType(MeasureType measureType) {
+    auto const dataType = enum_tables::find(enum_tables::dataTypes, measureType);
+    if (!dataType.has_value()) {
+        throw std::runtime_error("Wrong measure type");
+    }
+    return *dataType;
+}
+
+/// toCrossDeviceMeasureType converts a MeasureType to what another hub expects
+inline ValuesInterDevice_MEASURE_TYPE toCrossDeviceMeasureType(MeasureType measureType) {
+    auto const crossDevice = enum_tables::find(enum_tables::crossDeviceMeasureTypes, measureType);
+    if (!crossDevice.has_value()) {
+        throw std::runtime_error("Wrong measure type");
+    }
+    return *crossDevice;
+}
+
+/// measureTypeOf converts a DataType from the backend or an advertisement. Unspecified and unknown data types have
+/// none.
+inline std::optional<MeasureType> measureTypeOf(DataType dataType) {
+    return enum_tables::find(enum_tables::measureTypes, dataType);
+}
+
+/// typeOfDevice converts a DeviceType from the backend. Unspecified and unknown device types have none.
+inline std::optional<TypeOfDevice> typeOfDevice(DeviceType deviceType) {
+    return enum_tables::find(enum_tables::typesOfDevice, deviceType);
+}
+
+/// toCrossDeviceSensorType converts a TypeOfDevice to what another hub expects in its sensor list
+inline SensorInfoInterDevice_DEVICE_TYPE toCrossDeviceSensorType(TypeOfDevice type) {
+    return enum_tables::find(enum_tables::crossDeviceSensorTypes, type).value_or(
+            SensorInfoInterDevice_DEVICE_TYPE_UNSPECIFIED);
+}
+
+/// toCrossDeviceValueType converts a TypeOfDevice to what another hub expects with a value
+inline ValuesInterDevice_DEVICE_TYPE toCrossDeviceValueType(TypeOfDevice type) {
+    return enum_tables::find(enum_tables::crossDeviceValueTypes, type).value_or(
+            ValuesInterDevice_DEVICE_TYPE_UNSPECIFIED);
+}
+
+#endif //ESP32_SRC_ENUMTABLES_H_
@@ -0,0 +1,39 @@
+#include "EventBus.h"
+
+EventBus::EventBus() : stateGroup(xEventGroupCreateStatic(&stateBuffer)) {}
+
+EventBus *EventBus::getInstance() {
+    static EventBus b;
+    return &b;
+}
+
+void EventBus::notify(Subscriber s, Event e) {
+    TaskHandle_t const task = tasks[static_cast<size_t>(s)].load(std::memory_order_acquire);
+    if (task != nullptr) {
+        xTaskNotify(task, eventBit(e), eSetBits);
+    }
+}
+
+void EventBus::subscribe(Subscriber s, TaskHandle_t task) {
+    tasks[static_cast<size_t>(s)].store(task, std::memory_order_release);
+}
+
+uint32_t EventBus::wait(TickType_t ticks) {
+    uint32_t events = 0;
+    if (xTaskNotifyWait(0, UINT32_MAX, &events, ticks) != pdTRUE) {
+        return 0;
+    }
+    return events;
+}
+
+EventBits_t EventBus::state() {
+    return xEventGroupGetBits(stateGroup);
+}
+
+bool EventBus::waitFor(EventBits_t bits, TickType_t ticks) {
+    return (xEventGroupWaitBits(stateGroup, bits, pdFALSE, pdTRUE, ticks) & bits) == bits;
+}
+
+uint32_t EventBus::count(Event e) const {
+    return published[static_cast<size_t>(e)].load(std::memory_order_relaxed);
+}
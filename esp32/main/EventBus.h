@@ -0,0 +1,119 @@
+#ifndef ESP32_SRC_EVENTBUS_H_
+#define ESP32_SRC_EVENTBUS_H_
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <utility>
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+#include <freertos/task.h>
+
+/// Event is a change of the hub's state that other tasks react to
+enum class Event : uint8_t {
+    WiFiUp, WiFiDown, TimeValid, WebsocketUp, WebsocketDown, ReadingStored, CommandReceived, Count
+};
+
+/// Subscriber is a task that is notified of events
+enum class Subscriber : uint8_t {
+    /// Leds is the task that shows the state on the LEDs
+    Leds,
+    /// Reconnect is the task that brings the websocket back
+    Reconnect,
+    /// Uplink is the uplink task
+    Uplink,
+    Count
+};
+
+/// STATE_WIFI, STATE_TIME and STATE_WEBSOCKET are the bits of EventBus::state(), set while the Wi-Fi is up, once the
+/// clock is set, and while the websocket is up
+#define STATE_WIFI (1 << 0)
+#define STATE_TIME (1 << 1)
+#define STATE_WEBSOCKET (1 << 2)
+
+/// eventBit is the notification bit of e
+constexpr uint32_t eventBit(Event e) {
+    return 1u << static_cast<unsigned>(e);
+}
+
+/// subscriptions returns the events s is notified of. The lists are fixed at compile time, so publishing an event
+/// only costs a notification per task that wants it.
+constexpr uint32_t subscriptions(Subscriber s) {
+    switch (s) {
+        case Subscriber::Leds:
+            return eventBit(Event::WiFiUp) | eventBit(Event::WiFiDown) | eventBit(Event::TimeValid) |
+                   eventBit(Event::WebsocketUp) | eventBit(Event::WebsocketDown);
+        case Subscriber::Reconnect:
+            return eventBit(Event::WebsocketUp) | eventBit(Event::WebsocketDown);
+        case Subscriber::Uplink:
+            return eventBit(Event::ReadingStored) | eventBit(Event::WebsocketUp);
+        default:
+            return 0;
+    }
+}
+
+/// EventBus hands events to the tasks that subscribe to them, in place of the tasks polling the state.
+/// The state events also keep an event group up to date, so a task can read the state or block until it is reached
+/// without subscribing. A subscriber is woken with the bits of the events it missed set in its notification value,
+/// which wait() returns. Since the bits only say something happened, a subscriber looks at state() for where things
+/// stand. Publishing never blocks or allocates, so it can be done from callbacks of other tasks.
+/// A pointer to the object can be obtained using `EventBus::getInstance()`
+class EventBus {
+private:
+    StaticEventGroup_t stateBuffer{};
+    EventGroupHandle_t stateGroup;
+    std::array<std::atomic<TaskHandle_t>, static_cast<size_t>(Subscriber::Count)> tasks{};
+    /// published counts the times each event was published
+    std::array<std::atomic<uint32_t>, static_cast<size_t>(Event::Count)> published{};
+
+    EventBus();
+
+    template<Event E, size_t... S>
+    void notify(std::index_sequence<S...>) {
+        ((subscriptions(static_cast<Subscriber>(S)) & eventBit(E) ? notify(static_cast<Subscriber>(S), E) : void()),
+                ...);
+    }
+
+    void notify(Subscriber s, Event e);
+
+public:
+    /// Gets a singleton instance. The EventBus pointer has a static lifetime.
+    static EventBus *getInstance();
+
+    /// publish updates the state with E and notifies the subscribers of E
+    template<Event E>
+    void publish() {
+        published[static_cast<size_t>(E)].fetch_add(1, std::memory_order_relaxed);
+        if constexpr (E == Event::WiFiUp) {
+            xEventGroupSetBits(stateGroup, STATE_WIFI);
+        } else if constexpr (E == Event::WiFiDown) {
+            xEventGroupClearBits(stateGroup, STATE_WIFI);
+        } else if constexpr (E == Event::TimeValid) {
+            xEventGroupSetBits(stateGroup, STATE_TIME);
+        } else if constexpr (E == Event::WebsocketUp) {
+            xEventGroupSetBits(stateGroup, STATE_WEBSOCKET);
+        } else if constexpr (E == Event::WebsocketDown) {
+            xEventGroupClearBits(stateGroup, STATE_WEBSOCKET);
+        }
+        notify<E>(std::make_index_sequence<static_cast<size_t>(Subscriber::Count)>{});
+    }
+
+    /// subscribe makes task the subscriber s. Events published before are missed, so the task should look at state()
+    /// after subscribing.
+    void subscribe(Subscriber s, TaskHandle_t task);
+
+    /// wait blocks the calling subscriber for up to ticks until it is notified. It returns the eventBit()s of the
+    /// events since the last wait, or 0 on a timeout.
+    static uint32_t wait(TickType_t ticks);
+
+    /// state returns the STATE_ bits that are set
+    [[nodiscard]] EventBits_t state();
+
+    /// waitFor blocks for up to ticks until all of bits are set in state(). It returns whether they are.
+    bool waitFor(EventBits_t bits, TickType_t ticks);
+
+    /// count returns the times e was published since the start
+    [[nodiscard]] uint32_t count(Event e) const;
+};
+
+#endif //ESP32_SRC_EVENTBUS_H_
@@ -0,0 +1,180 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <string_view>
+#include <esp_rom_crc.h>
+#include "FlashLog.h"
+#include "BleAddr.h"
+#include "lib/log.h"
+
+/// crcOf returns the crc of everything in record that comes before its crc
+static uint32_t crcOf(const FlashLogRecord &record) {
+    return esp_rom_crc32_le(0, reinterpret_cast<const uint8_t *>(&record), offsetof(FlashLogRecord, crc));
+}
+
+bool FlashLog::begin() {
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, FLASH_LOG_LABEL);
+    if (partition == nullptr) {
+        LOG("No %s partition, readings are dropped while the websocket is down\n", FLASH_LOG_LABEL);
+        return false;
+    }
+    const void *mapped = nullptr;
+    esp_err_t const error = esp_partition_mmap(partition, 0, partition->size, ESP_PARTITION_MMAP_DATA, &mapped,
+                                               &mapping);
+    if (error != ESP_OK) {
+        LOG("Mapping the %s partition failed: %d\n", FLASH_LOG_LABEL, error);
+        partition = nullptr;
+        return false;
+    }
+    records = static_cast<const FlashLogRecord *>(mapped);
+    recordsPerSector = partition->erase_size / sizeof(FlashLogRecord);
+    capacity = partition->size / partition->erase_size * recordsPerSector;
+    recover();
+    LOG("Flash log holds %zu readings, %zu waiting to be sent\n", capacity, pending);
+    return true;
+}
+
+bool FlashLog::isValid(size_t slot) const {
+    const FlashLogRecord &record = records[slot];
+    return record.sequence != UINT32_MAX && record.crc == crcOf(record);
+}
+
+bool FlashLog::isBlank(size_t slot) const {
+    auto bytes = reinterpret_cast<const uint8_t *>(&records[slot]);
+    return std::all_of(bytes, bytes + sizeof(FlashLogRecord), [](uint8_t b) { return b == 0xff; });
+}
+
+void FlashLog::recover() {
+    // The newest record is the one with the highest sequence. Sequences wrap after 4 billion records, which a
+    // sensor hub won't reach.
+    bool found = false;
+    size_t newest = 0;
+    for (size_t slot = 0; slot < capacity; slot++) {
+        if (isValid(slot) && (!found || records[slot].sequence > records[newest].sequence)) {
+            found = true;
+            newest = slot;
+        }
+    }
+    if (!found) {
+        head = tail = pending = 0;
+        nextSequence = 0;
+        return;
+    }
+    head = (newest + 1) % capacity;
+    nextSequence = records[newest].sequence + 1;
+    // A write cut short after the newest record leaves the next slot dirty. Start again from the next sector.
+    if (head % recordsPerSector != 0 && !isBlank(head)) {
+        head = (head / recordsPerSector + 1) * recordsPerSector % capacity;
+    }
+
+    // The records from head onwards are the oldest. The unsent ones come after the sent ones.
+    tail = head;
+    for (size_t i = 0; i < capacity; i++) {
+        size_t const slot = (head + i) % capacity;
+        if (isValid(slot) && records[slot].sent == UINT32_MAX) {
+            tail = slot;
+            break;
+        }
+    }
+    // tail == head is an empty log, unless the oldest record is still waiting, in which case every slot is
+    if (tail == head && isValid(head) && records[head].sent == UINT32_MAX) {
+        pending = capacity;
+        return;
+    }
+    pending = (head + capacity - tail) % capacity;
+}
+
+size_t FlashLog::size() const {
+    return pending;
+}
+
+bool FlashLog::append(const SensorData &reading) {
+    if (records == nullptr) {
+        return false;
+    }
+    // The address is stored native, least significant byte first, like NimBLEAddress holds it. Check it before a
+    // sector is erased for a record that would never be written.
+    auto const address = BleAddr::parse(std::string_view(reading.address, strnlen(reading.address,
+                                                                                    sizeof(reading.address))));
+    if (!address.has_value()) {
+        LOG("Not logging a reading from %s, it isn't a BLE address\n", reading.address);
+        return false;
+    }
+    if (head % recordsPerSector == 0) {
+        // Entering a sector erases it. If the oldest readings are still in it, the log is full and they go.
+        size_t const sectorEnd = head + recordsPerSector;
+        if (pending > 0 && tail >= head && tail < sectorEnd) {
+            LOG("Flash log full, dropping %zu readings\n", sectorEnd - tail);
+            pending -= sectorEnd - tail;
+            tail = sectorEnd % capacity;
+        }
+        esp_err_t const error = esp_partition_erase_range(partition, head * sizeof(FlashLogRecord),
+                                                          partition->erase_size);
+        if (error != ESP_OK) {
+            LOG("Erasing the flash log failed: %d\n", error);
+            return false;
+        }
+    }
+
+    FlashLogRecord record{};
+    record.timestamp = reading.timestamp;
+    record.sequence = nextSequence;
+    record.value = reading.value;
+    memcpy(record.address, address->getNative(), sizeof(record.address));
+    record.dataType = static_cast<uint8_t>(reading.data_type);
+    record.crc = crcOf(record);
+    record.sent = UINT32_MAX;
+    esp_err_t const error = esp_partition_write(partition, head * sizeof(FlashLogRecord), &record, sizeof(record));
+    if (error != ESP_OK) {
+        LOG("Writing the flash log failed: %d\n", error);
+        return false;
+    }
+    nextSequence++;
+    head = (head + 1) % capacity;
+    pending++;
+    return true;
+}
+
+size_t FlashLog::peek(SensorData *out, size_t max) const {
+    size_t count = 0;
+    for (size_t i = 0; i < pending && count < max; i++) {
+        size_t const slot = (tail + i) % capacity;
+        if (!isValid(slot)) {
+            continue;
+        }
+        const FlashLogRecord &record = records[slot];
+        SensorData &reading = out[count++];
+        reading = SensorData_init_zero;
+        char address[ADDRESS_STRING_SIZE];
+        BleAddr::fromNative(record.address).format(address);
+        static_assert(sizeof(reading.address) >= ADDRESS_STRING_SIZE);
+        memcpy(reading.address, address, sizeof(address));
+        reading.data_type = static_cast<DataType>(record.dataType);
+        reading.value = record.value;
+        reading.timestamp = record.timestamp;
+    }
+    return count;
+}
+
+void FlashLog::consume(size_t count) {
+    static const uint32_t sent = 0;
+    while (pending > 0 && count > 0) {
+        if (isValid(tail)) {
+            esp_err_t const error = esp_partition_write(partition, tail * sizeof(FlashLogRecord) +
+                                                                   offsetof(FlashLogRecord, sent), &sent,
+                                                        sizeof(sent));
+            if (error != ESP_OK) {
+                LOG("Marking a reading sent failed: %d\n", error);
+            }
+            count--;
+        }
+        tail = (tail + 1) % capacity;
+        pending--;
+    }
+    // Skip the torn records up to the next reading, so that size() reaches 0
+    while (pending > 0 && !isValid(tail)) {
+        tail = (tail + 1) % capacity;
+        pending--;
+    }
+}
@@ -0,0 +1,82 @@
+#ifndef ESP32_SRC_FLASHLOG_H_
+#define ESP32_SRC_FLASHLOG_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <esp_partition.h>
+#include "generated/firmware_backend.pb.h"
+
+/// FLASH_LOG_LABEL is the data partition that holds the log, see partitions.csv
+#define FLASH_LOG_LABEL "readings"
+
+/// FlashLogRecord is one reading in the log. It is written in one go and never moved.
+struct FlashLogRecord {
+    int64_t timestamp;
+    /// sequence counts the records ever written. It tells the newest record apart after a reboot.
+    uint32_t sequence;
+    float value;
+    uint8_t address[6];
+    uint8_t dataType;
+    uint8_t reserved;
+    /// crc covers every field before it, so that a record torn by a power cut is ignored
+    uint32_t crc;
+    /// sent is all ones until the reading has been replayed. Flash bits can be cleared without an erase, so it is
+    /// overwritten with zeros in place.
+    uint32_t sent;
+};
+
+static_assert(sizeof(FlashLogRecord) == 32, "FlashLogRecord must tile the flash sectors");
+
+/// FlashLog is an append-only ring of readings on a flash partition. It keeps the readings that couldn't be sent
+/// while the websocket was down, across reboots, until they are replayed.
+/// The ring moves through the partition one sector at a time and erases a sector only when it comes back to it, so
+/// every sector wears the same. The records are read in place through a memory mapping of the partition.
+/// When the log is full the oldest sector of readings is dropped.
+/// It isn't thread safe. Only the uplink task uses it.
+class FlashLog {
+private:
+    const esp_partition_t *partition = nullptr;
+    esp_partition_mmap_handle_t mapping = 0;
+    /// records is the partition mapped into the address space
+    const FlashLogRecord *records = nullptr;
+    /// capacity is how many records the partition holds
+    size_t capacity = 0;
+    /// recordsPerSector is how many records an erase sector holds
+    size_t recordsPerSector = 0;
+    /// head is the slot the next record is written to
+    size_t head = 0;
+    /// tail is the slot of the oldest record that hasn't been sent
+    size_t tail = 0;
+    /// pending is how many slots there are from tail to head. It is capacity when every slot waits to be sent.
+    size_t pending = 0;
+    uint32_t nextSequence = 0;
+
+    /// isValid returns whether slot holds a complete record
+    [[nodiscard]] bool isValid(size_t slot) const;
+
+    /// isBlank returns whether slot is still erased
+    [[nodiscard]] bool isBlank(size_t slot) const;
+
+    /// recover finds head and tail again from what is in flash
+    void recover();
+
+public:
+    /// begin maps the partition and recovers the log. It returns false if there is no partition, in which case the
+    /// log stays empty and append fails.
+    bool begin();
+
+    /// size returns how many slots are waiting to be sent. A torn record takes a slot without holding a reading.
+    [[nodiscard]] size_t size() const;
+
+    /// append writes a reading to the log. It returns false if it couldn't, or if the address of the reading isn't a
+    /// BLE address.
+    bool append(const SensorData &reading);
+
+    /// peek copies up to max of the oldest readings waiting to be sent into out and returns how many it copied
+    size_t peek(SensorData *out, size_t max) const;
+
+    /// consume marks the count oldest readings as sent
+    void consume(size_t count);
+};
+
+#endif //ESP32_SRC_FLASHLOG_H_
@@ -2,20 +2,47 @@
 #define ESP32_SRC_GETSENSORDATA_H_
 
 #include <deque>
-#include <string>
+#include <map>
 #include <optional>
+#include <tuple>
+#include <vector>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include "BleAddr.h"
 #include "TypeOfDevice.h"
+#include "ConnectionPool.h"
 #include "NimBLEDevice.h"
 #include "lib/mutex.h"
+#include "lib/snapshot.h"
+
+/// DeviceList is the configured sensors: the address and the type of device
+using DeviceList = std::deque<std::tuple<BleAddr, TypeOfDevice>>;
 
 /// GetSensorData is a singleton object that continuously polls the sensors and sends data to the server
 /// A pointer to the object can be obtained using `getGetSensorData()`
 class GetSensorData {
 private:
+    /// sessions hands the sessions to open to the session workers
+    QueueHandle_t sessions = nullptr;
+
+    /// advertisers maps the sensors configured as TypeOfDevice::Advertising to the sequence of the last readings
+    /// we took from them, or -1
+    safe_std::mutex<std::map<BleAddr, int>> advertisers;
+
+    /// nextDevice is where the loop starts going through the devices. Only the loop touches it.
+    size_t nextDevice = 0;
+
     GetSensorData();
 
+    /// startWorkers starts the MAX_PARALLEL_SESSIONS tasks that open sessions
+    void startWorkers();
+
+    /// open hands address to a session worker. It returns false if every worker is busy or the pool is full.
+    bool open(const NimBLEAddress &address, TypeOfDevice deviceType);
+
 public:
-    safe_std::mutex<std::unordered_map<std::string, NimBLEClient *>> pClient; 
+    /// connections holds the sensors we are connected to
+    ConnectionPool connections;
 
     /// loop is where the majority of the work takes place. It collects data and sends it from here.
     void loop();
@@ -24,9 +51,16 @@ public:
     void clearDevices();
 
     /// setDevices sets the list of devices that this device should connect to.
-    /// devices is a const reference to a vector which contains the string id of the device and a
+    /// devices is a const reference to a vector which contains the address of the device and a
     /// device type
-    void setDevices(std::vector<std::tuple<std::string, TypeOfDevice>> &devices);
+    void setDevices(std::vector<std::tuple<BleAddr, TypeOfDevice>> &devices);
+
+    /// getDevices returns a view of the list of devices that this device should connect to
+    safe_std::snapshot<DeviceList>::view getDevices();
+
+    /// ingestAdvertisement takes the readings out of an advertisement, if it comes from a sensor configured as
+    /// TypeOfDevice::Advertising. It is called from the scan callback, so it never connects.
+    void ingestAdvertisement(NimBLEAdvertisedDevice *advertisedDevice);
 
     friend GetSensorData *getGetSensorData();
 };
@@ -0,0 +1,77 @@
+#include <cstring>
+#include <esp_heap_caps.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+#include "Heartbeat.h"
+#include "CommandWorker.h"
+#include "EventBus.h"
+#include "Uplink.h"
+#include "lib/log.h"
+
+static_assert(HEALTH_TASK_NAME_SIZE >= configMAX_TASK_NAME_LEN, "Task names must fit in a health report");
+
+Heartbeat *Heartbeat::getInstance() {
+    static Heartbeat h;
+    return &h;
+}
+
+configRUN_TIME_COUNTER_TYPE Heartbeat::runTimeSince(UBaseType_t taskNumber) const {
+    for (size_t i = 0; i < previousCount; i++) {
+        if (previous[i].taskNumber == taskNumber) {
+            return previous[i].runTime;
+        }
+    }
+    return 0;
+}
+
+void Heartbeat::collectTasks() {
+    configRUN_TIME_COUNTER_TYPE total = 0;
+    // It fills in nothing if there are more tasks than statuses
+    UBaseType_t const count = uxTaskGetSystemState(statuses.data(), statuses.size(), &total);
+    if (count == 0) {
+        LOG("More than %u tasks, the health report leaves them out\n", (unsigned) statuses.size());
+    }
+    // The counters wrap, and the differences come out right as long as a report comes before they wrap twice
+    configRUN_TIME_COUNTER_TYPE const elapsed = total - previousTotal;
+    report.taskCount = count;
+    for (UBaseType_t i = 0; i < count; i++) {
+        const TaskStatus_t &status = statuses[i];
+        TaskHealth &task = report.tasks[i];
+        strncpy(task.name, status.pcTaskName, sizeof(task.name) - 1);
+        task.name[sizeof(task.name) - 1] = '\0';
+        configRUN_TIME_COUNTER_TYPE const ran = status.ulRunTimeCounter - runTimeSince(status.xTaskNumber);
+        task.cpu = elapsed == 0 ? 0 : static_cast<uint32_t>(static_cast<uint64_t>(ran) * 10'000 / elapsed);
+        task.stackFree = status.usStackHighWaterMark;
+    }
+    for (UBaseType_t i = 0; i < count; i++) {
+        previous[i] = Sample{.taskNumber = statuses[i].xTaskNumber, .runTime = statuses[i].ulRunTimeCounter};
+    }
+    previousCount = count;
+    previousTotal = total;
+}
+
+const HealthReport &Heartbeat::collect() {
+    report.uptimeS = static_cast<uint32_t>(esp_timer_get_time() / 1'000'000);
+    report.resetReason = esp_reset_reason();
+    report.freeHeap = esp_get_free_heap_size();
+    report.minFreeHeap = esp_get_minimum_free_heap_size();
+    report.largestFreeBlock = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    collectTasks();
+    EventBus *bus = EventBus::getInstance();
+    report.wifiConnects = bus->count(Event::WiFiUp);
+    report.websocketConnects = bus->count(Event::WebsocketUp);
+    report.commandsQueued = CommandWorker::getInstance()->queued();
+    report.commandMaxWaitMs = CommandWorker::getInstance()->takeMaxWaitMs();
+    report.readingsPending = Uplink::getInstance()->readingsPending();
+    report.readingsLogged = Uplink::getInstance()->readingsLogged();
+    return report;
+}
+
+WriteSocketError Heartbeat::send() {
+    collect();
+    LOG("Sending a health report: %u bytes free, %u at least, %u tasks\n", (unsigned) report.freeHeap,
+        (unsigned) report.minFreeHeap, (unsigned) report.taskCount);
+    return websocket::getInstance()->writeMessage([this](pb_ostream_t *output) {
+        return encodeHealthReport(output, report);
+    }, 5'000);
+}
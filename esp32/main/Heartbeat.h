@@ -0,0 +1,52 @@
+#ifndef ESP32_SRC_HEARTBEAT_H_
+#define ESP32_SRC_HEARTBEAT_H_
+
+#include <array>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "lib/websocket/websocket.h"
+#include "packets/HealthReport.h"
+
+/// HEARTBEAT_INTERVAL_MS is how often the hub sends a health report while the websocket is up
+#define HEARTBEAT_INTERVAL_MS (2 * 60'000)
+
+/// Heartbeat is a singleton that builds the health reports the hub sends in place of a ping, so that the backend can
+/// tell how a hub is doing without anyone going to see it. A report has the heap, the CPU each task took since the
+/// last report and its stack high-water mark, the depth of the queues, the longest a command waited since the last
+/// report, the reconnects so far and why the hub last restarted.
+/// Everything lives in the object, so a report doesn't allocate. Only the heartbeat task uses it.
+/// A pointer to the object can be obtained using `Heartbeat::getInstance()`
+class Heartbeat {
+private:
+    /// Sample is a task's run time counter as of the last report
+    struct Sample {
+        UBaseType_t taskNumber;
+        configRUN_TIME_COUNTER_TYPE runTime;
+    };
+
+    HealthReport report{};
+    std::array<TaskStatus_t, HEALTH_MAX_TASKS> statuses{};
+    std::array<Sample, HEALTH_MAX_TASKS> previous{};
+    size_t previousCount = 0;
+    configRUN_TIME_COUNTER_TYPE previousTotal = 0;
+
+    Heartbeat() = default;
+
+    /// runTimeSince returns how much run time the task had at the last report, or 0 if it wasn't there
+    [[nodiscard]] configRUN_TIME_COUNTER_TYPE runTimeSince(UBaseType_t taskNumber) const;
+
+    /// collectTasks fills in the tasks of report and remembers their run time for the next one
+    void collectTasks();
+
+public:
+    /// Gets a singleton instance. The Heartbeat pointer has a static lifetime.
+    static Heartbeat *getInstance();
+
+    /// collect builds a health report
+    const HealthReport &collect();
+
+    /// send builds a health report and sends it on the websocket
+    WriteSocketError send();
+};
+
+#endif //ESP32_SRC_HEARTBEAT_H_
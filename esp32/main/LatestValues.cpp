@@ -0,0 +1,102 @@
+#include "LatestValues.h"
+
+uint64_t LatestValues::keyOf(const BleAddr &address, MeasureType measureType) {
+    return OCCUPIED | address.bits() << 8 | static_cast<uint8_t>(measureType);
+}
+
+size_t LatestValues::home(uint64_t key) {
+    // Fibonacci hashing: the top bits of the product depend on all the bits of the key
+    constexpr int bits = std::countr_zero(CAPACITY);
+    return static_cast<size_t>((key * 0x9e37'79b9'7f4a'7c15) >> (64 - bits));
+}
+
+size_t LatestValues::slotOf(uint64_t key) const {
+    size_t slot = home(key);
+    while (keys[slot] != 0 && keys[slot] != key) {
+        slot = (slot + 1) % CAPACITY;
+    }
+    return slot;
+}
+
+SensorDataStore LatestValues::at(size_t slot) const {
+    return SensorDataStore{
+            .timestamp = timestamps[slot],
+            .address = BleAddr((keys[slot] & ~OCCUPIED) >> 8, addressTypes[slot]),
+            .type = static_cast<TypeOfDevice>(types[slot]),
+            .value = values[slot],
+            .measure_type = static_cast<MeasureType>(keys[slot] & 0xff),
+    };
+}
+
+void LatestValues::removeAt(size_t slot) {
+    size_t hole = slot;
+    for (size_t next = (hole + 1) % CAPACITY; keys[next] != 0; next = (next + 1) % CAPACITY) {
+        // The entry can fill the hole unless its probe starts after the hole
+        size_t const distance = (next - home(keys[next])) % CAPACITY;
+        if (distance >= (next - hole) % CAPACITY) {
+            keys[hole] = keys[next];
+            timestamps[hole] = timestamps[next];
+            values[hole] = values[next];
+            types[hole] = types[next];
+            addressTypes[hole] = addressTypes[next];
+            hole = next;
+        }
+    }
+    keys[hole] = 0;
+    count--;
+}
+
+void LatestValues::removeOldest() {
+    size_t oldest = CAPACITY;
+    for (size_t slot = 0; slot < CAPACITY; slot++) {
+        if (keys[slot] != 0 && (oldest == CAPACITY || timestamps[slot] < timestamps[oldest])) {
+            oldest = slot;
+        }
+    }
+    if (oldest != CAPACITY) {
+        removeAt(oldest);
+    }
+}
+
+void LatestValues::set(const SensorDataStore &value) {
+    uint64_t const key = keyOf(value.address, value.measure_type);
+    size_t slot = slotOf(key);
+    if (keys[slot] == 0) {
+        if (count == MAX_VALUES) {
+            removeOldest();
+            slot = slotOf(key);
+        }
+        keys[slot] = key;
+        count++;
+    }
+    timestamps[slot] = value.timestamp;
+    values[slot] = value.value;
+    types[slot] = static_cast<uint8_t>(value.type);
+    addressTypes[slot] = value.address.getType();
+}
+
+std::optional<SensorDataStore> LatestValues::find(const BleAddr &address, MeasureType measureType) const {
+    size_t const slot = slotOf(keyOf(address, measureType));
+    if (keys[slot] == 0) {
+        return std::nullopt;
+    }
+    return at(slot);
+}
+
+size_t LatestValues::expire(long long cutoff) {
+    size_t removed = 0;
+    for (size_t slot = 0; slot < CAPACITY;) {
+        if (keys[slot] != 0 && timestamps[slot] < cutoff) {
+            // Removing moves a later entry into the slot, so look at it again
+            removeAt(slot);
+            removed++;
+        } else {
+            slot++;
+        }
+    }
+    return removed;
+}
+
+size_t LatestValues::size() const {
+    return count;
+}
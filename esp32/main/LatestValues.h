@@ -0,0 +1,87 @@
+#ifndef ESP32_SRC_LATESTVALUES_H_
+#define ESP32_SRC_LATESTVALUES_H_
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include "BleAddr.h"
+#include "Constants.h"
+#include "SensorDataStore.h"
+#include "TypeOfDevice.h"
+
+/// LatestValues holds the latest value of every sensor and measure type. It is an open addressing hash table of
+/// LATEST_VALUES_CAPACITY slots, keyed by the address and the measure type, so its size is fixed and nothing
+/// allocates. Each column is an array of its own: a lookup only probes the keys, and going through the values reads
+/// every column front to back.
+/// Collisions are resolved by linear probing and removals shift the following entries back, so there are no
+/// tombstones. It is trivially copyable, which is all publishing it to sensorData takes.
+/// The type of an address isn't part of the key, as two addresses are the same whatever their types. It is kept
+/// beside the value, and the latest one is what the value comes back with.
+class LatestValues {
+private:
+    static constexpr size_t CAPACITY = LATEST_VALUES_CAPACITY;
+    static_assert(std::has_single_bit(CAPACITY), "LATEST_VALUES_CAPACITY must be a power of two");
+    static_assert(TYPE_OF_DEVICE_COUNT <= UINT8_MAX, "A TypeOfDevice must fit in a byte");
+
+    /// MAX_VALUES is the most values held, to keep a free slot at the end of every probe
+    static constexpr size_t MAX_VALUES = CAPACITY - CAPACITY / 8;
+
+    /// keys holds the address in bits 8 to 55 and the measure type in bits 0 to 7, with OCCUPIED set. 0 is a free
+    /// slot.
+    std::array<uint64_t, CAPACITY> keys{};
+    std::array<long long, CAPACITY> timestamps{};
+    std::array<float, CAPACITY> values{};
+    std::array<uint8_t, CAPACITY> types{};
+    /// addressTypes holds the BLE_ADDR_* type of the address of each slot
+    std::array<uint8_t, CAPACITY> addressTypes{};
+    size_t count = 0;
+
+    static constexpr uint64_t OCCUPIED = uint64_t{1} << 63;
+
+    static uint64_t keyOf(const BleAddr &address, MeasureType measureType);
+
+    /// home returns the slot where the probe for key starts
+    static size_t home(uint64_t key);
+
+    /// slotOf returns the slot that holds key, or the free slot it would go in
+    [[nodiscard]] size_t slotOf(uint64_t key) const;
+
+    /// at returns the value in slot
+    [[nodiscard]] SensorDataStore at(size_t slot) const;
+
+    /// removeAt frees slot and moves back the entries after it that belong before it
+    void removeAt(size_t slot);
+
+    /// removeOldest removes the value with the oldest timestamp
+    void removeOldest();
+
+public:
+    /// set records value as the latest of its address and measure type. When the table is full, the oldest value
+    /// makes room.
+    void set(const SensorDataStore &value);
+
+    /// find returns the latest value of address and measureType, if there is one
+    [[nodiscard]] std::optional<SensorDataStore> find(const BleAddr &address, MeasureType measureType) const;
+
+    /// expire removes the values taken before cutoff, a unix timestamp, and returns how many it removed
+    size_t expire(long long cutoff);
+
+    [[nodiscard]] size_t size() const;
+
+    /// forEach calls f with every value, in the order of the slots
+    template<typename F>
+    void forEach(const F &f) const;
+};
+
+template<typename F>
+void LatestValues::forEach(const F &f) const {
+    for (size_t slot = 0; slot < CAPACITY; slot++) {
+        if (keys[slot] != 0) {
+            f(at(slot));
+        }
+    }
+}
+
+#endif //ESP32_SRC_LATESTVALUES_H_
@@ -0,0 +1,11 @@
+#include "PacketPools.h"
+
+BackendPacketPool *backendPackets() {
+    static BackendPacketPool pool;
+    return &pool;
+}
+
+FirmwarePacketPool *firmwarePackets() {
+    static FirmwarePacketPool pool;
+    return &pool;
+}
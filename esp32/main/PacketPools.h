@@ -0,0 +1,24 @@
+#ifndef ESP32_SRC_PACKETPOOLS_H_
+#define ESP32_SRC_PACKETPOOLS_H_
+
+#include "generated/firmware_backend.pb.h"
+#include "lib/object_pool.h"
+
+/// BACKEND_PACKET_POOL_SIZE is how many commands from the backend can wait for the command worker, counting the one
+/// it is handling
+#define BACKEND_PACKET_POOL_SIZE 3
+
+/// FIRMWARE_PACKET_POOL_SIZE is how many packets to the backend can be built at once. They are several kilobytes
+/// each, so they live in the pool rather than on the stack of the sending task.
+#define FIRMWARE_PACKET_POOL_SIZE 2
+
+using BackendPacketPool = safe_std::object_pool<BackendToFirmwarePacket, BACKEND_PACKET_POOL_SIZE>;
+using FirmwarePacketPool = safe_std::object_pool<FirmwareToBackendPacket, FIRMWARE_PACKET_POOL_SIZE>;
+
+/// backendPackets returns the pool that the commands from the backend are decoded into
+BackendPacketPool *backendPackets();
+
+/// firmwarePackets returns the pool that the packets to the backend are built in
+FirmwarePacketPool *firmwarePackets();
+
+#endif //ESP32_SRC_PACKETPOOLS_H_
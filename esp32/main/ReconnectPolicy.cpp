@@ -0,0 +1,43 @@
+#include <algorithm>
+#include "ReconnectPolicy.h"
+
+ReconnectPolicy::ReconnectPolicy(uint32_t baseMs, uint32_t capMs, uint32_t (*random)())
+        : baseMs(baseMs), capMs(std::max(baseMs, capMs)), random(random), previousMs(baseMs) {}
+
+uint32_t ReconnectPolicy::between(uint32_t low, uint32_t high) {
+    uint64_t const span = static_cast<uint64_t>(high) - low + 1;
+    return low + static_cast<uint32_t>(random() % span);
+}
+
+uint32_t ReconnectPolicy::failed() {
+    failureCount++;
+    if (hintMs > 0) {
+        uint32_t const hint = hintMs;
+        hintMs = 0;
+        uint32_t const wait = between(hint, static_cast<uint32_t>(std::min<uint64_t>(2ULL * hint, UINT32_MAX)));
+        previousMs = std::clamp(wait, baseMs, capMs);
+        return wait;
+    }
+    if (failureCount == 1) {
+        return 0;
+    }
+    uint32_t const high = static_cast<uint32_t>(std::min<uint64_t>(3ULL * previousMs, capMs));
+    previousMs = between(baseMs, std::max(baseMs, high));
+    return previousMs;
+}
+
+void ReconnectPolicy::retryAfter(uint32_t ms) {
+    if (ms > 0) {
+        hintMs = ms;
+    }
+}
+
+void ReconnectPolicy::succeeded() {
+    failureCount = 0;
+    hintMs = 0;
+    previousMs = baseMs;
+}
+
+uint32_t ReconnectPolicy::failures() const {
+    return failureCount;
+}
@@ -0,0 +1,64 @@
+#ifndef ESP32_SRC_RECONNECTPOLICY_H_
+#define ESP32_SRC_RECONNECTPOLICY_H_
+
+#include <cstdint>
+
+/// RECONNECT_BASE_MS is the shortest wait between two attempts after the first retry
+#define RECONNECT_BASE_MS 1'000
+
+/// WIFI_RECONNECT_CAP_MS is the longest wait between two attempts to join the access point
+#define WIFI_RECONNECT_CAP_MS 60'000
+
+/// WIFI_MAX_FAILURES is how many attempts to join the access point fail in a row before the hub restarts
+#define WIFI_MAX_FAILURES 100
+
+/// WEBSOCKET_RECONNECT_CAP_MS is the longest wait between two attempts to open the websocket. The backend can ask for
+/// longer.
+#define WEBSOCKET_RECONNECT_CAP_MS (5 * 60'000)
+
+/// WEBSOCKET_CONNECT_TIMEOUT_MS is how long an attempt to open the websocket may take before it counts as failed
+#define WEBSOCKET_CONNECT_TIMEOUT_MS 30'000
+
+/// WEBSOCKET_STABLE_MS is how long the websocket must stay up for the policy to start over. A backend that accepts
+/// and then drops the hub keeps it backing off.
+#define WEBSOCKET_STABLE_MS 60'000
+
+/// ReconnectPolicy says how long to wait before the next attempt to connect, for the Wi-Fi and the websocket.
+/// The first failure is retried right away, since most drops are a blip. After that the waits grow with decorrelated
+/// jitter: each is random between RECONNECT_BASE_MS and three times the one before, up to the cap. Hubs that lost the
+/// backend at the same moment, like after a deploy, spread out instead of coming back in step.
+/// The backend can ask for a longer wait. The next one is then random between that and twice that, so the hubs it
+/// turned away don't all come back at once either.
+/// It isn't thread safe; every policy belongs to one task.
+class ReconnectPolicy {
+private:
+    uint32_t baseMs;
+    uint32_t capMs;
+    /// random returns a uniformly distributed 32 bit number, like esp_random
+    uint32_t (*random)();
+    /// previousMs is the last wait, without a hint
+    uint32_t previousMs;
+    uint32_t failureCount = 0;
+    /// hintMs is the wait the backend asked for, or 0
+    uint32_t hintMs = 0;
+
+    /// between returns a random number in [low, high]
+    uint32_t between(uint32_t low, uint32_t high);
+
+public:
+    ReconnectPolicy(uint32_t baseMs, uint32_t capMs, uint32_t (*random)());
+
+    /// failed records a failed attempt and returns how long to wait before the next one, in milliseconds
+    uint32_t failed();
+
+    /// retryAfter records that the backend asked for the next attempt to wait at least ms. 0 is ignored.
+    void retryAfter(uint32_t ms);
+
+    /// succeeded starts over once a connection held
+    void succeeded();
+
+    /// failures returns the attempts that failed since the last success
+    [[nodiscard]] uint32_t failures() const;
+};
+
+#endif //ESP32_SRC_RECONNECTPOLICY_H_
@@ -1,21 +1,131 @@
+#include <algorithm>
 #include "ScanResults.h"
-#include "NimBLEDevice.h"
+#include "Constants.h"
+#include "GetSensorData.h"
+#include "lib/log.h"
 #include "lib/ArduinoSupport/ArduinoSupport.h"
+#include "lib/trace/trace.h"
 
-NimBLEScanResults ScanResults::getScanResults() {
+/// isFresh returns whether an entry last seen at lastSeen is still young enough to be used
+static bool isFresh(TickType_t lastSeen, TickType_t now) {
+    // Ticks wrap, so compare the age rather than the raw ticks
+    return now - lastSeen < pdMS_TO_TICKS(SCAN_MAX_AGE_MS);
+}
 
-    scanResults = BLEDevice::getScan();
-    mutex.lock();
-    scanResults->clearResults();
-    auto returnVal = scanResults->getResults(5'000);
-    mutex.unlock();
-    return returnVal;
+/// guessType returns the kind of sensor a device is from the services it advertises
+static std::optional<TypeOfDevice> guessType(NimBLEAdvertisedDevice *device) {
+    static const std::vector<std::pair<BLEUUID, TypeOfDevice>> advertisedServices(
+            {{BLEUUID("aa80"),                                 TypeOfDevice::TI},
+             {BLEUUID("ef680100-9b35-4933-9b10-52ffa9740042"), TypeOfDevice::Nordic},
+             {BLEUUID("ffe0"),                                 TypeOfDevice::Custom},
+             {BLEUUID(SERVICE_UUID),                           TypeOfDevice::Hub}});
+    for (const auto &[uuid, type]: advertisedServices) {
+        if (device->isAdvertisingService(uuid)) {
+            return type;
+        }
+    }
+    return std::nullopt;
 }
 
 ScanResults::ScanResults() = default;
 
-ScanResults::~ScanResults() {
-    if (scanResults != nullptr) {
-        scanResults->stop();
+ScanResults *ScanResults::getInstance() {
+    static ScanResults scanResults;
+    return &scanResults;
+}
+
+void ScanResults::onResult(NimBLEAdvertisedDevice *advertisedDevice) {
+    BleAddr const address(advertisedDevice->getAddress());
+    TickType_t const now = xTaskGetTickCount();
+    {
+        auto t = table.lock();
+        auto entry = t->find(address);
+        if (entry == t->end()) {
+            if (t->size() >= SCAN_TABLE_SIZE) {
+                // Keep the devices that look like sensors we can connect to over the ones we know nothing about
+                auto oldest = std::max_element(t->begin(), t->end(), [now](const auto &a, const auto &b) {
+                    return std::make_tuple(!a.second.type.has_value(), now - a.second.lastSeen) <
+                           std::make_tuple(!b.second.type.has_value(), now - b.second.lastSeen);
+                });
+                t->erase(oldest);
+            }
+            entry = t->emplace(address, ScanEntry{}).first;
+        }
+        ScanEntry &e = entry->second;
+        e.address = advertisedDevice->getAddress();
+        // A device doesn't necessarily put its name in every advertisement
+        if (advertisedDevice->haveName()) {
+            e.name = advertisedDevice->getName();
+        }
+        if (advertisedDevice->haveManufacturerData()) {
+            e.manufacturerData = advertisedDevice->getManufacturerData();
+        }
+        e.rssi = advertisedDevice->getRSSI();
+        e.lastSeen = now;
+        auto type = guessType(advertisedDevice);
+        if (type.has_value()) {
+            e.type = type;
+        }
     }
-}
\ No newline at end of file
+    // Advertising sensors put their readings in the advertisement itself
+    getGetSensorData()->ingestAdvertisement(advertisedDevice);
+}
+
+void ScanResults::prune() {
+    TickType_t const now = xTaskGetTickCount();
+    auto t = table.lock();
+    for (auto it = t->begin(); it != t->end();) {
+        if (isFresh(it->second.lastSeen, now)) {
+            ++it;
+        } else {
+            it = t->erase(it);
+        }
+    }
+}
+
+void ScanResults::start() {
+    NimBLEScan *scan = NimBLEDevice::getScan();
+    // Every advertisement refreshes the table, so report duplicates, and keep nothing in NimBLE's own results
+    scan->setAdvertisedDeviceCallbacks(this, true);
+    scan->setDuplicateFilter(false);
+    scan->setMaxResults(0);
+    scan->setActiveScan(false);
+    // Leave half the radio time to the connections
+    scan->setInterval(100);
+    scan->setWindow(50);
+
+    xTaskCreate([](void *) {
+        for (;;) {
+            NimBLEScan *scan = NimBLEDevice::getScan();
+            if (!scan->isScanning()) {
+                TRACE_INSTANT("scan start", 0);
+                if (!scan->start(0, nullptr, true)) {
+                    LOG("Failed to start scanning\n");
+                }
+            }
+            getInstance()->prune();
+            delay(1'000);
+        }
+    }, "Scan", 4000, nullptr, 1, nullptr);
+}
+
+std::optional<ScanEntry> ScanResults::find(const BleAddr &address) {
+    auto t = table.lock();
+    auto entry = t->find(address);
+    if (entry == t->end() || !isFresh(entry->second.lastSeen, xTaskGetTickCount())) {
+        return std::nullopt;
+    }
+    return entry->second;
+}
+
+std::vector<ScanEntry> ScanResults::getEntries() {
+    TickType_t const now = xTaskGetTickCount();
+    std::vector<ScanEntry> entries;
+    auto t = table.lock();
+    for (const auto &[address, entry]: *t) {
+        if (isFresh(entry.lastSeen, now)) {
+            entries.emplace_back(entry);
+        }
+    }
+    return entries;
+}
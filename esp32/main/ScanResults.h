@@ -1,22 +1,60 @@
 #ifndef ESP32_SRC_BLEUTILS_H_
 #define ESP32_SRC_BLEUTILS_H_
 
-#include <mutex>
-#include "NimBLEScan.h"
-
-/// ScanResults gives NimBLEScan an RAII interface, ensuring that it stops scanning when a ScanResults
-/// instance goes out of scope and to make it thread safe
-class ScanResults {
-    std::mutex mutex;
-    NimBLEScan *scanResults = nullptr;
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+#include <freertos/FreeRTOS.h>
+#include "BleAddr.h"
+#include "NimBLEDevice.h"
+#include "TypeOfDevice.h"
+#include "lib/mutex.h"
+
+/// SCAN_MAX_AGE_MS is how long a device stays in the scan table after its last advertisement
+#define SCAN_MAX_AGE_MS 60'000
+
+/// SCAN_TABLE_SIZE is the most devices the scan table holds. Past that the device heard the longest ago is dropped,
+/// starting with the ones that don't advertise a sensor's services.
+#define SCAN_TABLE_SIZE 64
+
+/// ScanEntry is what we know about a device from its last advertisement
+struct ScanEntry {
+    NimBLEAddress address;
+    std::string name;
+    std::string manufacturerData;
+    int rssi = 0;
+    /// lastSeen is when the device last advertised, in ticks
+    TickType_t lastSeen = 0;
+    /// type is the kind of sensor its advertised services suggest, if any
+    std::optional<TypeOfDevice> type;
+};
+
+/// ScanResults scans passively in the background and keeps a table of the devices heard in the last
+/// SCAN_MAX_AGE_MS, so that finding a sensor or listing the sensors around never blocks on a scan
+class ScanResults : public NimBLEAdvertisedDeviceCallbacks {
 private:
-public:
+    safe_std::mutex<std::map<BleAddr, ScanEntry>> table;
+
     ScanResults();
 
-    NimBLEScanResults getScanResults();
+    void onResult(NimBLEAdvertisedDevice *advertisedDevice) override;
+
+    /// prune drops the entries that haven't advertised in SCAN_MAX_AGE_MS
+    void prune();
+
+public:
+    static ScanResults *getInstance();
+
+    /// start starts scanning and the task that keeps the scan running. NimBLE stops the scan whenever it connects
+    /// to a device, so the task restarts it.
+    void start();
 
-    ~ScanResults();
+    /// find returns the entry of address if it advertised recently
+    std::optional<ScanEntry> find(const BleAddr &address);
 
+    /// getEntries returns every device that advertised recently
+    std::vector<ScanEntry> getEntries();
 };
 
 #endif //ESP32_SRC_BLEUTILS_H_
@@ -1,7 +1,7 @@
 #ifndef ESP32_SRC_SENSORDATASTORE_H_
 #define ESP32_SRC_SENSORDATASTORE_H_
 
-#include <string>
+#include "BleAddr.h"
 #include "TypeOfDevice.h"
 
 /// MeasureType identifies the type of sensor and the type of measurement obtained from a remote device.
@@ -14,7 +14,7 @@ struct SensorDataStore {
     /// timestamp is a unix timestamp in UTC
     long long timestamp;
     /// address is a BLE address
-    std::string address;
+    BleAddr address;
     /// type is a device type
     TypeOfDevice type;
     /// value holds the measured value (of unit specified in measure_type)
@@ -0,0 +1,117 @@
+#include <mutex>
+#include <driver/gpio.h>
+#include "SensorSession.h"
+#include "BleAddr.h"
+#include "drivers/SensorDrivers.h"
+#include "lib/log.h"
+#include "lib/trace/trace.h"
+
+static std::mutex connectMutex;
+
+/// notify hands a notification to the decoder of its subscription
+static void notify(const SensorSubscription &subscription, NimBLERemoteCharacteristic *characteristic,
+                   const uint8_t *data, size_t length) {
+    ESP_ERROR_CHECK(gpio_set_level(GPIO_NUM_19, 1));
+    TRACE_SCOPE("notify");
+    BleAddr const remoteAddress(characteristic->getRemoteService()->getClient()->getConnInfo().getAddress());
+    subscription.decode(remoteAddress, subscription.measureType, data, length);
+    ESP_ERROR_CHECK(gpio_set_level(GPIO_NUM_19, 0));
+}
+
+void SensorSession::reset(NimBLEClient *c, const NimBLEAddress &a, TypeOfDevice t) {
+    client = c;
+    address = a;
+    type = t;
+}
+
+NimBLEClient *SensorSession::getClient() const {
+    return client;
+}
+
+const NimBLEAddress &SensorSession::getAddress() const {
+    return address;
+}
+
+TypeOfDevice SensorSession::getType() const {
+    return type;
+}
+
+bool SensorSession::open() {
+    const SensorDriver *driver = SensorDrivers::find(type);
+    if (driver == nullptr) {
+        LOG("No driver for %s\n", BleAddr(address).toText().data());
+        return false;
+    }
+    LOG("Forming a connection (%s) to %s \n", driver->name, BleAddr(address).toText().data());
+
+    bool connected;
+    {
+        TRACE_SCOPE("connect");
+        // The controller only establishes one connection at a time, the rest of the set up can run side by side
+        std::lock_guard<std::mutex> lock(connectMutex);
+        connected = client->connect(address);
+    }
+    if (!connected) {
+        LOG("Failed to connect to %s\n", BleAddr(address).toText().data());
+        return false;
+    }
+
+    // Obtain a reference to the service we are after in the remote BLE server.
+    TRACE_BEGIN("service discovery");
+    NimBLERemoteService *pRemoteService = nullptr;
+    for (const char *uuid: driver->services) {
+        pRemoteService = client->getService(NimBLEUUID(uuid));
+        if (pRemoteService != nullptr) {
+            break;
+        }
+    }
+    TRACE_END("service discovery");
+    if (pRemoteService == nullptr) {
+        LOG("Failed to find service UUID %s\n", BleAddr(client->getConnInfo().getAddress()).toText().data());
+        client->disconnect();
+        return false;
+    }
+
+    NimBLERemoteCharacteristic *writeCharacteristic = nullptr;
+    if (driver->write != nullptr) {
+        // Obtain a reference to the characteristic in the service of the remote BLE server.
+        writeCharacteristic = pRemoteService->getCharacteristic(NimBLEUUID(driver->write));
+        if (writeCharacteristic == nullptr) {
+            LOG("Failed to find our characteristic UUID (%s) write: %s\n", driver->name, driver->write);
+            client->disconnect();
+            return false;
+        }
+        if (!writeCharacteristic->canWrite()) {
+            LOG("Can't write to write: %s\n", driver->write);
+            client->disconnect();
+            return false;
+        }
+    }
+    if (driver->configure != nullptr) {
+        TRACE_SCOPE("configure");
+        if (!driver->configure(BleAddr(address), writeCharacteristic)) {
+            client->disconnect();
+            return false;
+        }
+    }
+
+    TRACE_BEGIN("subscribe");
+    for (const SensorSubscription &subscription: driver->subscriptions) {
+        NimBLERemoteCharacteristic *characteristic = pRemoteService->getCharacteristic(NimBLEUUID(subscription.uuid));
+        if (characteristic == nullptr || !characteristic->canNotify()) {
+            continue;
+        }
+        LOG("Subscribing to %s of %s\n", subscription.uuid, BleAddr(address).toText().data());
+        characteristic->subscribe(true, [&subscription](NimBLERemoteCharacteristic *c, uint8_t *data, size_t length,
+                                                        bool) {
+            notify(subscription, c, data, length);
+        });
+    }
+    TRACE_END("subscribe");
+    // Sensors stay connected with their subscriptions active until the pool evicts them. A hub only needed the write.
+    if (!driver->staysConnected) {
+        client->disconnect();
+        return false;
+    }
+    return true;
+}
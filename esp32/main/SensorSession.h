@@ -0,0 +1,30 @@
+#ifndef ESP32_SRC_SENSORSESSION_H_
+#define ESP32_SRC_SENSORSESSION_H_
+
+#include "NimBLEDevice.h"
+#include "TypeOfDevice.h"
+
+/// SensorSession is one connection to a sensor. It owns the client of that connection, so that several sensors can
+/// be set up at the same time. What is done with the sensor is up to the SensorDriver of its type.
+class SensorSession {
+private:
+    NimBLEClient *client = nullptr;
+    NimBLEAddress address;
+    TypeOfDevice type = TypeOfDevice::TI;
+
+public:
+    /// reset points the session at a new sensor. The previous sensor must be disconnected.
+    void reset(NimBLEClient *c, const NimBLEAddress &a, TypeOfDevice t);
+
+    /// open connects, discovers the sensor's services, configures it and subscribes to its readings. It returns whether
+    /// the session stays open. A hub session only writes our values and closes.
+    bool open();
+
+    [[nodiscard]] NimBLEClient *getClient() const;
+
+    [[nodiscard]] const NimBLEAddress &getAddress() const;
+
+    [[nodiscard]] TypeOfDevice getType() const;
+};
+
+#endif //ESP32_SRC_SENSORSESSION_H_
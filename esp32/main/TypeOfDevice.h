@@ -1,9 +1,15 @@
 #ifndef ESP32_SRC_DEVICETYPE_H_
 #define ESP32_SRC_DEVICETYPE_H_
 
-/// TypeOfDevice holds the different device types that we can connect to
+#include <cstddef>
+
+/// TypeOfDevice holds the different device types that we can connect to.
+/// Advertising sensors put their readings in their advertisements and are never connected to.
 enum TypeOfDevice {
-    Nordic, TI, Custom, Hub
+    Nordic, TI, Custom, Hub, Advertising
 };
 
+/// TYPE_OF_DEVICE_COUNT is how many types of devices there are. Advertising is the last.
+inline constexpr size_t TYPE_OF_DEVICE_COUNT = Advertising + 1;
+
 #endif //ESP32_SRC_DEVICETYPE_H_
@@ -0,0 +1,263 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include "Uplink.h"
+#include "BleAddr.h"
+#include "EnumTables.h"
+#include "EventBus.h"
+#include "GetSensorData.h"
+#include "getTime.h"
+#include "lib/log.h"
+#include "lib/websocket/websocket.h"
+#include "lib/ArduinoSupport/ArduinoSupport.h"
+#include "packets/SensorDataBatch.h"
+#include "packets/SensorDataBlocks.h"
+
+static_assert(UPLINK_MAX_BYTES <= WEBSOCKET_TX_BUFFER_SIZE, "A batch must fit in the websocket transmit buffer");
+
+Uplink *Uplink::getInstance() {
+    static Uplink u;
+    return &u;
+}
+
+void Uplink::start() {
+    if (flashLog.begin()) {
+        replay.resize(UPLINK_MAX_REPLAY_READINGS);
+    }
+    auto ret = xTaskCreate([](void *parameters) {
+        reinterpret_cast<Uplink *>(parameters)->loop();
+    }, "Uplink", 8000, this, 1, &task);
+    if (ret != pdPASS) {
+        LOG("Error: %d\n", (int) ret);
+        throw std::runtime_error("Couldn't create thread");
+    }
+    EventBus::getInstance()->subscribe(Subscriber::Uplink, task);
+}
+
+void Uplink::send(const SensorReading &reading) {
+    if (!incoming.push(reading)) {
+        dropped++;
+        return;
+    }
+    EventBus::getInstance()->publish<Event::ReadingStored>();
+}
+
+uint32_t Uplink::readingsPending() const {
+    return pendingCount.load(std::memory_order_relaxed);
+}
+
+uint32_t Uplink::readingsLogged() const {
+    return loggedCount.load(std::memory_order_relaxed);
+}
+
+void Uplink::take() {
+    uint32_t const lost = dropped.exchange(0);
+    if (lost != 0) {
+        LOG("Uplink fell behind, dropped %u readings\n", (unsigned) lost);
+    }
+    SensorReading reading{};
+    while (incoming.pop(reading)) {
+        // Nothing here allocates
+        latest.set(SensorDataStore{.timestamp = reading.timestamp, .address = reading.address, .type = reading.type,
+                .value = reading.value, .measure_type = reading.measureType});
+        unpublished = true;
+        if (reading.type != TypeOfDevice::Advertising) {
+            getGetSensorData()->connections.touch(reading.address);
+        }
+
+        Reading r{.sensorData = SensorData_init_zero, .size = 0, .queuedAt = reading.receivedAt};
+        // The text goes on the wire as address_bits, see packets/SensorDataBatch.h
+        char address[ADDRESS_STRING_SIZE];
+        reading.address.format(address);
+        static_assert(sizeof(r.sensorData.address) >= ADDRESS_STRING_SIZE);
+        memcpy(r.sensorData.address, address, ADDRESS_STRING_SIZE);
+        r.sensorData.data_type = toDataType(reading.measureType);
+        r.sensorData.value = reading.value;
+        r.sensorData.timestamp = reading.timestamp;
+        r.size = sensorDataBatchEntrySize(r.sensorData);
+        if (r.size == 0) {
+            throw std::runtime_error("Sizing sensor data failed");
+        }
+        if (pending.full()) {
+            LOG("Uplink is full, dropping the oldest reading\n");
+            pendingSize -= pending.front().size;
+            pending.pop_front();
+        }
+        pending.push_back(r);
+        pendingSize += r.size;
+    }
+    long long const now = getTime();
+    if (now - expiredAt >= LATEST_VALUES_TTL_S / 10) {
+        expiredAt = now;
+        if (latest.expire(now - LATEST_VALUES_TTL_S) > 0) {
+            unpublished = true;
+        }
+    }
+    if (unpublished) {
+        unpublished = !sensorData.tryPublish(latest);
+    }
+}
+
+bool Uplink::isFull() {
+    return pending.size() >= UPLINK_MAX_READINGS || sensorDataBatchPacketSize(pendingSize) > UPLINK_MAX_BYTES;
+}
+
+bool Uplink::isDue(const Reading &r) {
+    return xTaskGetTickCount() - r.queuedAt >= pdMS_TO_TICKS(UPLINK_MAX_DELAY_MS);
+}
+
+TickType_t Uplink::ticksUntilDue() {
+    // The websocket coming back wakes the task, but while readings wait in flash look for it every so often too
+    TickType_t poll = flashLog.size() > 0 ? pdMS_TO_TICKS(UPLINK_MAX_DELAY_MS) : portMAX_DELAY;
+    if (unpublished) {
+        poll = std::min(poll, pdMS_TO_TICKS(UPLINK_PUBLISH_RETRY_MS));
+    }
+    if (pending.empty()) {
+        return poll;
+    }
+    TickType_t const waited = xTaskGetTickCount() - pending.front().queuedAt;
+    TickType_t const maxDelay = pdMS_TO_TICKS(UPLINK_MAX_DELAY_MS);
+    return std::min(poll, waited >= maxDelay ? 0 : maxDelay - waited);
+}
+
+bool Uplink::spill() {
+    while (!pending.empty() && isDue(pending.front())) {
+        if (!flashLog.append(pending.front().sensorData)) {
+            return false;
+        }
+        pendingSize -= pending.front().size;
+        pending.pop_front();
+    }
+    return true;
+}
+
+WriteSocketError Uplink::write(size_t count, size_t entriesSize) {
+    LOG("Sending %zu readings\n", count);
+    return websocket::getInstance()->writeMessage([this, count, entriesSize](pb_ostream_t *output) {
+        return encodeSensorDataBatch(output, batch.data(), count, entriesSize);
+    }, 5'000);
+}
+
+bool Uplink::sendBatch() {
+    if (pending.empty()) {
+        return false;
+    }
+    if (!isDue(pending.front()) && !isFull()) {
+        return false;
+    }
+    size_t count = 0;
+    size_t entriesSize = 0;
+    while (!pending.empty() && count < batch.size() &&
+           sensorDataBatchPacketSize(entriesSize + pending.front().size) <= UPLINK_MAX_BYTES) {
+        const Reading &r = pending.front();
+        batch[count++] = r.sensorData;
+        entriesSize += r.size;
+        pendingSize -= r.size;
+        pending.pop_front();
+    }
+
+    WriteSocketError const error = write(count, entriesSize);
+    if (error != WriteSocketError::Ok) {
+        // Keep the batch for when the websocket is back. The flash log is empty here, so the order holds.
+        size_t logged = 0;
+        while (logged < count && flashLog.append(batch[logged])) {
+            logged++;
+        }
+        if (logged < count) {
+            // The rest go back to the front of pending, behind the ones in flash, as readings that are due. Nothing
+            // was taken since they left it, so there is room.
+            LOG("The flash log took %zu of %zu unsent readings, keeping the rest in memory\n", logged, count);
+            TickType_t const due = xTaskGetTickCount() - pdMS_TO_TICKS(UPLINK_MAX_DELAY_MS);
+            for (size_t i = count; i > logged; i--) {
+                Reading const r{.sensorData = batch[i - 1], .size = sensorDataBatchEntrySize(batch[i - 1]),
+                        .queuedAt = due};
+                pending.push_front(r);
+                pendingSize += r.size;
+            }
+        }
+        if (error == WriteSocketError::WriteError && websocket::getInstance()->isConnected()) {
+            throw std::runtime_error("Cannot send data to websocket");
+        }
+        return false;
+    }
+    return true;
+}
+
+WriteSocketError Uplink::writeBlocks(size_t count) {
+    LOG("Replaying %zu readings\n", count);
+    return websocket::getInstance()->writeMessage([this, count](pb_ostream_t *output) {
+        return encodeSensorDataBlocks(output, replay.data(), count);
+    }, 5'000);
+}
+
+bool Uplink::replayBatch() {
+    size_t count = flashLog.peek(replay.data(), replay.size());
+    if (count == 0) {
+        // Only torn records were left
+        flashLog.consume(0);
+        return false;
+    }
+    // Halve the readings until the packet fits in a websocket frame. Readings that barely change compress so well
+    // that the full count usually fits.
+    size_t size = 0;
+    for (;;) {
+        pb_ostream_t sizing = PB_OSTREAM_SIZING;
+        if (!encodeSensorDataBlocks(&sizing, replay.data(), count)) {
+            throw std::runtime_error(std::string("Sizing failed: ") + PB_GET_ERROR(&sizing));
+        }
+        size = sizing.bytes_written;
+        if (size <= UPLINK_MAX_BYTES || count == 1) {
+            break;
+        }
+        count /= 2;
+    }
+    if (size > UPLINK_MAX_BYTES) {
+        LOG("Dropping a reading from flash that can't be sent\n");
+        flashLog.consume(1);
+        return true;
+    }
+
+    WriteSocketError const error = writeBlocks(count);
+    if (error != WriteSocketError::Ok) {
+        // The readings stay in flash
+        if (error == WriteSocketError::WriteError && websocket::getInstance()->isConnected()) {
+            throw std::runtime_error("Cannot send data to websocket");
+        }
+        return false;
+    }
+    flashLog.consume(count);
+    return true;
+}
+
+void Uplink::loop() {
+    for (;;) {
+        EventBus::wait(ticksUntilDue());
+        take();
+        pendingCount = pending.size();
+        loggedCount = flashLog.size();
+        if (!websocket::getInstance()->isConnected()) {
+            // Nothing can be sent. The readings that are due wait in flash until the websocket comes back, or in
+            // pending if there is no flash log.
+            if (!spill()) {
+                // ticksUntilDue is 0 while due readings are stuck in pending, so sleep until a new reading or the
+                // websocket coming back wakes the task instead
+                EventBus::wait(unpublished ? pdMS_TO_TICKS(UPLINK_PUBLISH_RETRY_MS) : portMAX_DELAY);
+            }
+            continue;
+        }
+        // The readings in flash are the oldest, so they go first and new readings queue up behind them
+        while (flashLog.size() > 0 && replayBatch()) {
+            take();
+            spill();
+        }
+        if (flashLog.size() > 0) {
+            // Replaying failed, so sending the new readings now would put them ahead of the old ones
+            spill();
+            continue;
+        }
+        while (sendBatch()) {
+            take();
+        }
+    }
+}
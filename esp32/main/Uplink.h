@@ -0,0 +1,129 @@
+#ifndef ESP32_SRC_UPLINK_H_
+#define ESP32_SRC_UPLINK_H_
+
+#include <array>
+#include <atomic>
+#include <vector>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "Constants.h"
+#include "BleAddr.h"
+#include "FlashLog.h"
+#include "LatestValues.h"
+#include "SensorDataStore.h"
+#include "TypeOfDevice.h"
+#include "generated/firmware_backend.pb.h"
+#include "lib/fixed_deque.h"
+#include "lib/mpsc_ring.h"
+#include "lib/websocket/websocket.h"
+
+/// SensorReading is a reading as the BLE callbacks hand it over. It has a fixed size so that handing it over never
+/// allocates.
+struct SensorReading {
+    BleAddr address;
+    TypeOfDevice type;
+    MeasureType measureType;
+    float value;
+    /// timestamp is a unix timestamp in UTC
+    long long timestamp;
+    /// receivedAt is when the reading came in, in ticks
+    TickType_t receivedAt;
+};
+
+/// Uplink is a singleton that takes the readings from the BLE callbacks and coalesces them into sensor_data_batch
+/// packets before they go out on the websocket.
+/// The callbacks run on the NimBLE host task, so they only push a SensorReading into a lock-free ring. The uplink task
+/// does the rest: it records and publishes the latest values, encodes and sends.
+/// A batch is sent once it holds UPLINK_MAX_READINGS readings, once the next reading would take it past
+/// UPLINK_MAX_BYTES, or once its oldest reading has waited UPLINK_MAX_DELAY_MS.
+/// While the websocket is down, readings that are due go to a FlashLog instead. They are replayed in order, ahead of
+/// the new ones, once it is back. The backlog goes out as compressed sensor_data_blocks.
+/// A pointer to the object can be obtained using `Uplink::getInstance()`
+class Uplink {
+private:
+    /// Reading is a reading waiting to be sent
+    struct Reading {
+        SensorData sensorData;
+        /// size is what the reading adds to a sensor_data_batch
+        size_t size;
+        /// queuedAt is when the reading was queued, in ticks
+        TickType_t queuedAt;
+    };
+
+    /// incoming hands the readings from the callbacks to the uplink task
+    safe_std::mpsc_ring<SensorReading, UPLINK_RING_SIZE> incoming;
+    /// dropped counts the readings that didn't fit in incoming
+    std::atomic<uint32_t> dropped{0};
+    TaskHandle_t task = nullptr;
+
+    // Only touched by the uplink task
+    safe_std::fixed_deque<Reading, UPLINK_MAX_PENDING> pending;
+    /// pendingSize is the sum of the sizes of pending
+    size_t pendingSize = 0;
+    std::array<SensorData, UPLINK_MAX_READINGS> batch{};
+    FlashLog flashLog;
+    /// replay holds the readings being replayed from flashLog
+    std::vector<SensorData> replay;
+    /// latest is the latest values, published to sensorData after every take
+    LatestValues latest;
+    /// expiredAt is when the stale values were last removed from latest, as a unix timestamp
+    long long expiredAt = 0;
+    /// unpublished is set while latest has values that sensorData doesn't
+    bool unpublished = false;
+    /// pendingCount and loggedCount are the sizes of pending and flashLog as of the last take, for other tasks to read
+    std::atomic<uint32_t> pendingCount{0};
+    std::atomic<uint32_t> loggedCount{0};
+
+    Uplink() = default;
+
+    /// take moves the readings from incoming to pending and records them as the latest values. Every tenth of
+    /// LATEST_VALUES_TTL_S it also drops the values that outlived it.
+    void take();
+
+    /// isFull returns whether pending holds more than one batch can carry
+    bool isFull();
+
+    /// isDue returns whether r has waited long enough to be sent without a full batch
+    static bool isDue(const Reading &r);
+
+    /// ticksUntilDue returns how long the uplink task can sleep before the oldest reading is due
+    TickType_t ticksUntilDue();
+
+    /// spill moves the readings that are due to the flash log. It returns false if the flash log can't take them.
+    bool spill();
+
+    /// write encodes the first count readings of batch into one packet and sends it
+    WriteSocketError write(size_t count, size_t entriesSize);
+
+    /// sendBatch sends one batch if one is due and returns whether it did. A batch that can't be sent goes to the
+    /// flash log, and what the flash log doesn't take goes back to pending.
+    bool sendBatch();
+
+    /// writeBlocks encodes the first count readings of replay into one sensor_data_blocks packet and sends it
+    WriteSocketError writeBlocks(size_t count);
+
+    /// replayBatch sends one sensor_data_blocks packet of the oldest readings in the flash log and returns whether it
+    /// did
+    bool replayBatch();
+
+    [[noreturn]] void loop();
+
+public:
+    /// Gets a singleton instance. The Uplink pointer has a static lifetime.
+    static Uplink *getInstance();
+
+    /// start creates the task that sends the batches. It must be called once.
+    void start();
+
+    /// send queues a reading for the backend. It never blocks or allocates, so it is safe to call from the BLE
+    /// callbacks. The reading is dropped if the uplink task has fallen UPLINK_RING_SIZE readings behind.
+    void send(const SensorReading &reading);
+
+    /// readingsPending returns how many readings wait in memory to be sent
+    [[nodiscard]] uint32_t readingsPending() const;
+
+    /// readingsLogged returns how many readings wait in the flash log to be sent
+    [[nodiscard]] uint32_t readingsLogged() const;
+};
+
+#endif //ESP32_SRC_UPLINK_H_
@@ -0,0 +1,88 @@
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "HubDriver.h"
+#include "../BleAddr.h"
+#include "../Constants.h"
+#include "../EnumTables.h"
+#include "../GetSensorData.h"
+#include "../LatestValues.h"
+#include "../getTime.h"
+#include "../generated/packet.pb.h"
+#include "../../components/nanopb/pb_encode.h"
+
+namespace {
+    const char *const services[] = {SERVICE_UUID};
+
+    /// configure sends the hub our sensor list and latest values
+    bool configure(const BleAddr &, NimBLERemoteCharacteristic *write) {
+        // These are several kilobytes each, so keep them off the stack
+        auto p = std::make_unique<BLESendPacket>();
+        *p = BLESendPacket_init_zero;
+        p->which_type = BLESendPacket_crossDevicePacket_tag;
+
+        // Views rather than copies; the Uplink and the backend can publish new versions in the meantime
+        auto const devices = getGetSensorData()->getDevices();
+        auto const values = sensorData.read();
+        p->type.crossDevicePacket.has_sensorList = true;
+        p->type.crossDevicePacket.has_values = true;
+        p->type.crossDevicePacket.timestamp = getTime();
+        SensorsListInterDevice &sList = p->type.crossDevicePacket.sensorList;
+        ValuesInterDeviceList &vList = p->type.crossDevicePacket.values;
+
+        pb_size_t const sizeOfSList = std::min(devices->size(), static_cast<size_t>(64));
+        sList.sensor_info_count = sizeOfSList;
+        for (unsigned int i = 0; i < sizeOfSList; i++) {
+            const auto &[address, deviceType] = (*devices)[i];
+            char text[ADDRESS_STRING_SIZE];
+            address.format(text);
+            static_assert(sizeof(sList.sensor_info[i].address) >= ADDRESS_STRING_SIZE);
+            memcpy(sList.sensor_info[i].address, text, sizeof(text));
+            sList.sensor_info[i].device_type = toCrossDeviceSensorType(deviceType);
+        }
+
+        pb_size_t const sizeOfVList = std::min(values->size(), static_cast<size_t>(64));
+        vList.values_count = sizeOfVList;
+        size_t i = 0;
+        values->forEach([&vList, sizeOfVList, &i](const SensorDataStore &value) {
+            if (i == sizeOfVList) {
+                return;
+            }
+            char text[ADDRESS_STRING_SIZE];
+            value.address.format(text);
+            static_assert(sizeof(vList.values[i].address) >= ADDRESS_STRING_SIZE);
+            memcpy(vList.values[i].address, text, sizeof(text));
+            vList.values[i].timestamp = value.timestamp;
+            vList.values[i].value = value.value;
+            vList.values[i].measure_type = toCrossDeviceMeasureType(value.measure_type);
+            vList.values[i].device_type = toCrossDeviceValueType(value.type);
+            i++;
+        });
+
+        std::vector<pb_byte_t> buf(2024);
+        pb_ostream_t output = pb_ostream_from_buffer(buf.data(), buf.size());
+        int status = pb_encode(&output, BLESendPacket_fields, p.get());
+        if (!status) {
+            throw std::runtime_error(std::string("Encoding failed: ") + PB_GET_ERROR(&output));
+        }
+
+        write->writeValue(output.bytes_written, true);
+        std::vector<uint8_t> buf1;
+        buf1.assign(buf.begin(), buf.begin() + output.bytes_written);
+        write->writeValue(buf1);
+        return true;
+    }
+}
+
+const SensorDriver HubDriver::driver{
+        .name = "Hub",
+        .services = services,
+        .write = CHARACTERISTIC_SERVER_UUID,
+        .configure = configure,
+        .subscriptions = {},
+        .staysConnected = false,
+};
@@ -0,0 +1,12 @@
+#ifndef ESP32_SRC_DRIVERS_HUBDRIVER_H_
+#define ESP32_SRC_DRIVERS_HUBDRIVER_H_
+
+#include "SensorDriver.h"
+
+/// HubDriver sends another hub our sensor list and latest values. Hubs are only written to, then disconnected.
+struct HubDriver {
+    static constexpr TypeOfDevice type = TypeOfDevice::Hub;
+    static const SensorDriver driver;
+};
+
+#endif //ESP32_SRC_DRIVERS_HUBDRIVER_H_
@@ -0,0 +1,30 @@
+#include "NordicDriver.h"
+
+namespace {
+    const char *const services[] = {"ef680200-9b35-4933-9b10-52ffa9740042", "ef680300-9b35-4933-9b10-52ffa9740042",
+                                    "ef680400-9b35-4933-9b10-52ffa9740042", "ef680500-9b35-4933-9b10-52ffa9740042"};
+
+    void decode(const BleAddr &address, MeasureType measureType, const uint8_t *data, size_t length) {
+        int low = data[0];
+        int high = data[1];
+        // The Thingy sends the integer and the decimal part, so 23 and 45 read as 23.45. Dividing the digits as a
+        // whole rounds exactly like parsing the text would.
+        int const scale = high < 10 ? 10 : high < 100 ? 100 : 1000;
+        float const value = static_cast<float>(low * scale + high) / static_cast<float>(scale);
+        sendReading(address, NordicDriver::type, measureType, value);
+    }
+
+    const SensorSubscription subscriptions[] = {
+            {"ef680201-9b35-4933-9b10-52ffa9740042", MeasureType::TEMP,     decode},
+            {"ef680203-9b35-4933-9b10-52ffa9740042", MeasureType::HUMIDITY, decode},
+    };
+}
+
+const SensorDriver NordicDriver::driver{
+        .name = "Nordic",
+        .services = services,
+        .write = nullptr,
+        .configure = nullptr,
+        .subscriptions = subscriptions,
+        .staysConnected = true,
+};
@@ -0,0 +1,13 @@
+#ifndef ESP32_SRC_DRIVERS_NORDICDRIVER_H_
+#define ESP32_SRC_DRIVERS_NORDICDRIVER_H_
+
+#include "SensorDriver.h"
+
+/// NordicDriver takes the readings of Nordic Thingy:52s, which notify the temperature and the humidity on
+/// characteristics of their environment service
+struct NordicDriver {
+    static constexpr TypeOfDevice type = TypeOfDevice::Nordic;
+    static const SensorDriver driver;
+};
+
+#endif //ESP32_SRC_DRIVERS_NORDICDRIVER_H_
@@ -0,0 +1,62 @@
+#include <map>
+#include "PicoDriver.h"
+#include "PicoFrame.h"
+#include "../BleAddr.h"
+#include "../lib/frame_splitter.h"
+#include "../lib/log.h"
+#include "../lib/mutex.h"
+
+namespace {
+    const char *const services[] = {"0000ffe0-0000-1000-8000-00805f9b34fb"};
+
+    /// PicoStream splits a sensor's stream into readings
+    using PicoStream = safe_std::frame_splitter<PICO_READING_MAX>;
+
+    /// streams is keyed by the sensor's address. The entries are made when configuring, so that a notification only
+    /// looks one up.
+    safe_std::mutex<std::map<BleAddr, PicoStream>> streams;
+
+    /// configure drops what we buffered from the sensor, before subscribing to it again
+    bool configure(const BleAddr &address, NimBLERemoteCharacteristic *) {
+        (*streams.lock())[address] = PicoStream();
+        return true;
+    }
+
+    void decode(const BleAddr &address, MeasureType, const uint8_t *data, size_t length) {
+        bool gotReading = false;
+        {
+            auto lock = streams.lock();
+            auto it = lock->find(address);
+            if (it == lock->end()) {
+                it = lock->emplace(address, PicoStream()).first;
+            }
+            PicoStream &stream = it->second;
+            stream.feed(data, length, [&address, &gotReading](const char *frame, size_t size) {
+                auto const reading = parsePicoFrame(frame, size);
+                if (!reading.has_value()) {
+                    // Garbage on the line. The frames after it are taken as usual.
+                    LOG("Dropping a garbled reading from %s\n", address.toText().data());
+                    return;
+                }
+                sendReading(address, PicoDriver::type, reading->measureType, reading->value);
+                gotReading = true;
+            });
+        }
+        if (!gotReading) {
+            LOG("Not enough data\n");
+        }
+    }
+
+    const SensorSubscription subscriptions[] = {
+            {"0000ffe1-0000-1000-8000-00805f9b34fb", MeasureType::PICO_TEMP, decode},
+    };
+}
+
+const SensorDriver PicoDriver::driver{
+        .name = "Custom",
+        .services = services,
+        .write = nullptr,
+        .configure = configure,
+        .subscriptions = subscriptions,
+        .staysConnected = true,
+};
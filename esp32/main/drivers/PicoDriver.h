@@ -0,0 +1,13 @@
+#ifndef ESP32_SRC_DRIVERS_PICODRIVER_H_
+#define ESP32_SRC_DRIVERS_PICODRIVER_H_
+
+#include "SensorDriver.h"
+
+/// PicoDriver takes the readings of our Raspberry Pi Pico sensors. They stream their readings over a UART service as
+/// text like T23.45, separated by null bytes, with the letter saying what was measured.
+struct PicoDriver {
+    static constexpr TypeOfDevice type = TypeOfDevice::Custom;
+    static const SensorDriver driver;
+};
+
+#endif //ESP32_SRC_DRIVERS_PICODRIVER_H_
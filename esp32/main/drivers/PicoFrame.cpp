@@ -0,0 +1,72 @@
+#include <cstdint>
+#include "PicoFrame.h"
+#include "../EnumTables.h"
+
+namespace {
+    /// PicoLetter is the letter a reading starts with and what it measures
+    struct PicoLetter {
+        char letter;
+        MeasureType measureType;
+    };
+
+    constexpr PicoLetter letters[] = {
+            {'H', MeasureType::DHT22_HUMIDITY},
+            {'T', MeasureType::DHT22_TEMP},
+            {'h', MeasureType::DHT11_HUMIDITY},
+            {'t', MeasureType::DHT11_TEMP},
+            {'p', MeasureType::PICO_TEMP},
+    };
+
+    /// measureTypes maps the letters to what they measure
+    constexpr auto measureTypes = enum_tables::index<128, &PicoLetter::letter, &PicoLetter::measureType>(letters);
+
+    /// MAX_DIGITS is the most digits a number can have and still be held exactly in a double
+    constexpr int MAX_DIGITS = 15;
+
+    constexpr double powersOfTen[MAX_DIGITS + 1] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12,
+                                                    1e13, 1e14, 1e15};
+}
+
+bool parseDecimal(const char *text, size_t length, float &value) {
+    size_t i = 0;
+    bool negative = false;
+    if (i < length && (text[i] == '-' || text[i] == '+')) {
+        negative = text[i] == '-';
+        i++;
+    }
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int decimals = 0;
+    bool point = false;
+    for (; i < length; i++) {
+        char const c = text[i];
+        if (c == '.' && !point) {
+            point = true;
+        } else if (c >= '0' && c <= '9' && digits < MAX_DIGITS) {
+            mantissa = mantissa * 10 + static_cast<uint64_t>(c - '0');
+            digits++;
+            decimals += point ? 1 : 0;
+        } else {
+            return false;
+        }
+    }
+    if (digits == 0) {
+        return false;
+    }
+    // Both are exact in a double, so the quotient is the correctly rounded decimal
+    double const magnitude = static_cast<double>(mantissa) / powersOfTen[decimals];
+    value = static_cast<float>(negative ? -magnitude : magnitude);
+    return true;
+}
+
+std::optional<PicoReading> parsePicoFrame(const char *frame, size_t length) {
+    if (length < 2) {
+        return std::nullopt;
+    }
+    auto const measureType = enum_tables::find(measureTypes, static_cast<unsigned char>(frame[0]));
+    float value;
+    if (!measureType.has_value() || !parseDecimal(frame + 1, length - 1, value)) {
+        return std::nullopt;
+    }
+    return PicoReading{*measureType, value};
+}
@@ -0,0 +1,25 @@
+#ifndef ESP32_SRC_DRIVERS_PICOFRAME_H_
+#define ESP32_SRC_DRIVERS_PICOFRAME_H_
+
+#include <cstddef>
+#include <optional>
+#include "../SensorDataStore.h"
+
+/// PICO_READING_MAX is the longest custom sensor reading we take, like T23.45. Longer ones are dropped.
+#define PICO_READING_MAX 15
+
+/// PicoReading is a reading as a Pico sends it
+struct PicoReading {
+    MeasureType measureType;
+    float value;
+};
+
+/// parseDecimal reads a number like -12.50 that takes all of text: an optional sign, digits and an optional decimal
+/// point. Unlike strtof it doesn't depend on the locale and accepts nothing else, such as spaces, exponents or nan.
+bool parseDecimal(const char *text, size_t length, float &value);
+
+/// parsePicoFrame reads a frame like T23.45, a letter saying what was measured followed by the value. It returns
+/// nothing if the frame isn't a reading, which happens when the stream is garbled.
+std::optional<PicoReading> parsePicoFrame(const char *frame, size_t length);
+
+#endif //ESP32_SRC_DRIVERS_PICOFRAME_H_
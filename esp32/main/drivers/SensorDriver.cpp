@@ -0,0 +1,8 @@
+#include "SensorDriver.h"
+#include "../Uplink.h"
+#include "../getTime.h"
+
+void sendReading(const BleAddr &address, TypeOfDevice type, MeasureType measureType, float value) {
+    Uplink::getInstance()->send(SensorReading{.address = address, .type = type, .measureType = measureType,
+            .value = value, .timestamp = getTime(), .receivedAt = xTaskGetTickCount()});
+}
@@ -0,0 +1,44 @@
+#ifndef ESP32_SRC_DRIVERS_SENSORDRIVER_H_
+#define ESP32_SRC_DRIVERS_SENSORDRIVER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include "NimBLEDevice.h"
+#include "../BleAddr.h"
+#include "../SensorDataStore.h"
+#include "../TypeOfDevice.h"
+
+/// SensorDecoder turns the value of a notification into readings and hands them to sendReading. measureType is the
+/// one of the subscription, for sensors whose data doesn't say what it measures.
+using SensorDecoder = void (*)(const BleAddr &address, MeasureType measureType, const uint8_t *data, size_t length);
+
+/// SensorSubscription is a characteristic that a sensor notifies its readings on
+struct SensorSubscription {
+    const char *uuid;
+    MeasureType measureType;
+    SensorDecoder decode;
+};
+
+/// SensorDriver describes how to take the readings of one kind of device we connect to. SensorSession connects, finds
+/// the first of services that the device has, configures it and subscribes to the characteristics of subscriptions
+/// that can notify.
+/// Each driver is a struct with the TypeOfDevice it handles as type and its SensorDriver as driver, registered in
+/// SENSOR_DRIVERS.
+struct SensorDriver {
+    /// name is what the log calls the device
+    const char *name;
+    std::span<const char *const> services;
+    /// write is the characteristic configure writes to, or nullptr if the driver doesn't write. It must be writable.
+    const char *write;
+    /// configure sets the device up once its service is found. It may be nullptr. Returning false closes the session.
+    bool (*configure)(const BleAddr &address, NimBLERemoteCharacteristic *write);
+    std::span<const SensorSubscription> subscriptions;
+    /// staysConnected is false for devices that are only written to, which are disconnected once configured
+    bool staysConnected;
+};
+
+/// sendReading hands a reading from a decoder to the Uplink
+void sendReading(const BleAddr &address, TypeOfDevice type, MeasureType measureType, float value);
+
+#endif //ESP32_SRC_DRIVERS_SENSORDRIVER_H_
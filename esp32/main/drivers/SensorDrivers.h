@@ -0,0 +1,47 @@
+#ifndef ESP32_SRC_DRIVERS_SENSORDRIVERS_H_
+#define ESP32_SRC_DRIVERS_SENSORDRIVERS_H_
+
+#include <array>
+#include <stdexcept>
+#include "SensorDriver.h"
+#include "HubDriver.h"
+#include "NordicDriver.h"
+#include "PicoDriver.h"
+#include "TiDriver.h"
+
+/// SENSOR_DRIVERS lists the drivers built into the firmware. A hub that only talks to one vendor's sensors can be
+/// built with, say, -DSENSOR_DRIVERS=TiDriver, and the other drivers are left out of the image. Sensors without a
+/// driver are skipped.
+#ifndef SENSOR_DRIVERS
+#define SENSOR_DRIVERS TiDriver, NordicDriver, PicoDriver, HubDriver
+#endif
+
+/// SensorDriverRegistry finds the driver of a type of device. The table is built at compile time, and a type with
+/// two drivers fails the build.
+template<typename... Drivers>
+class SensorDriverRegistry {
+private:
+    using Table = std::array<const SensorDriver *, TYPE_OF_DEVICE_COUNT>;
+
+    static constexpr Table table = [] {
+        Table t{};
+        auto add = [&t](TypeOfDevice type, const SensorDriver *driver) {
+            if (t[type] != nullptr) {
+                throw std::logic_error("Two drivers for one type of device");
+            }
+            t[type] = driver;
+        };
+        (add(Drivers::type, &Drivers::driver), ...);
+        return t;
+    }();
+
+public:
+    /// find returns the driver of type, or nullptr if it isn't built in
+    static constexpr const SensorDriver *find(TypeOfDevice type) {
+        return static_cast<size_t>(type) < table.size() ? table[type] : nullptr;
+    }
+};
+
+using SensorDrivers = SensorDriverRegistry<SENSOR_DRIVERS>;
+
+#endif //ESP32_SRC_DRIVERS_SENSORDRIVERS_H_
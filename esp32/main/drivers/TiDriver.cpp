@@ -0,0 +1,35 @@
+#include <cassert>
+#include <cstring>
+#include "TiDriver.h"
+
+namespace {
+    const char *const services[] = {"f000aa00-0451-4000-b000-000000000000"};
+
+    /// configure switches the sensor on
+    bool configure(const BleAddr &, NimBLERemoteCharacteristic *write) {
+        write->writeValue((char) 1, true);
+        write->readValue();
+        return true;
+    }
+
+    void decode(const BleAddr &address, MeasureType measureType, const uint8_t *data, size_t length) {
+        assert(length == 4);
+        static_assert(sizeof(float) == 4, "float size is expected to be 4 bytes");
+        float f;
+        memcpy(&f, data, 4);
+        sendReading(address, TiDriver::type, measureType, f);
+    }
+
+    const SensorSubscription subscriptions[] = {
+            {"f000aa01-0451-4000-b000-000000000000", MeasureType::TEMP, decode},
+    };
+}
+
+const SensorDriver TiDriver::driver{
+        .name = "TI",
+        .services = services,
+        .write = "f000aa02-0451-4000-b000-000000000000",
+        .configure = configure,
+        .subscriptions = subscriptions,
+        .staysConnected = true,
+};
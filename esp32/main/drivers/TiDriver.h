@@ -0,0 +1,13 @@
+#ifndef ESP32_SRC_DRIVERS_TIDRIVER_H_
+#define ESP32_SRC_DRIVERS_TIDRIVER_H_
+
+#include "SensorDriver.h"
+
+/// TiDriver takes the readings of TI SensorTags, which notify the temperature as a float once their sensor is
+/// switched on
+struct TiDriver {
+    static constexpr TypeOfDevice type = TypeOfDevice::TI;
+    static const SensorDriver driver;
+};
+
+#endif //ESP32_SRC_DRIVERS_TIDRIVER_H_
@@ -0,0 +1,59 @@
+#ifndef ESP32_SRC_FIXED_DEQUE_H_
+#define ESP32_SRC_FIXED_DEQUE_H_
+
+#include <array>
+#include <cstddef>
+
+namespace safe_std {
+    template<class T, size_t N>
+/// fixed_deque is a queue of at most N values held in place, so pushing and popping never allocate. Unlike
+/// mpsc_ring it isn't thread safe.
+    class fixed_deque {
+        std::array<T, N> values{};
+        /// first is the index of the front value
+        size_t first = 0;
+        size_t count = 0;
+
+    public:
+        [[nodiscard]] bool empty() const noexcept {
+            return count == 0;
+        }
+
+        [[nodiscard]] bool full() const noexcept {
+            return count == N;
+        }
+
+        [[nodiscard]] size_t size() const noexcept {
+            return count;
+        }
+
+        T &front() noexcept {
+            return values[first];
+        }
+
+        const T &front() const noexcept {
+            return values[first];
+        }
+
+        /// push_back appends value. The deque must not be full.
+        void push_back(const T &value) noexcept {
+            values[(first + count) % N] = value;
+            count++;
+        }
+
+        /// push_front puts value ahead of the others. The deque must not be full.
+        void push_front(const T &value) noexcept {
+            first = (first + N - 1) % N;
+            values[first] = value;
+            count++;
+        }
+
+        /// pop_front drops the front value. The deque must not be empty.
+        void pop_front() noexcept {
+            first = (first + 1) % N;
+            count--;
+        }
+    };
+}
+
+#endif //ESP32_SRC_FIXED_DEQUE_H_
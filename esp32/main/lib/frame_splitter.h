@@ -0,0 +1,75 @@
+#ifndef ESP32_SRC_FRAME_SPLITTER_H_
+#define ESP32_SRC_FRAME_SPLITTER_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace safe_std {
+    template<size_t N>
+/// frame_splitter cuts a byte stream into frames that each end with a null byte, as the bytes come in. Every byte is
+/// looked at once, and a frame is held in place until its null byte comes, so it never allocates.
+/// The stream may be picked up in the middle of a frame, so the bytes before the first null byte are dropped. So are
+/// frames longer than N, up to their null byte. Either way the frames after them are taken as usual. It isn't thread
+/// safe; keep one per stream.
+    class frame_splitter {
+        /// frame holds the frame being collected, with room for its terminator
+        std::array<char, N + 1> frame{};
+        size_t length = 0;
+        /// synced is set once a null byte went by
+        bool synced = false;
+        /// overflowed is set while dropping a frame longer than N
+        bool overflowed = false;
+        /// dropped counts the frames longer than N
+        uint32_t dropped = 0;
+
+    public:
+        /// feed takes the next size bytes of the stream and calls onFrame(const char *frame, size_t length) with
+        /// every frame they complete. The frame is null terminated and only valid during the call.
+        template<typename F>
+        void feed(const uint8_t *data, size_t size, const F &onFrame) {
+            size_t i = 0;
+            while (i < size) {
+                auto const *end = static_cast<const uint8_t *>(memchr(data + i, 0, size - i));
+                size_t const stop = end == nullptr ? size : static_cast<size_t>(end - data);
+                size_t const n = stop - i;
+                if (synced && !overflowed) {
+                    if (length + n > N) {
+                        overflowed = true;
+                    } else {
+                        memcpy(frame.data() + length, data + i, n);
+                        length += n;
+                    }
+                }
+                if (end == nullptr) {
+                    return;
+                }
+                if (overflowed) {
+                    dropped++;
+                } else if (synced) {
+                    frame[length] = '\0';
+                    onFrame(static_cast<const char *>(frame.data()), length);
+                }
+                synced = true;
+                overflowed = false;
+                length = 0;
+                i = stop + 1;
+            }
+        }
+
+        /// reset drops what was collected and waits for a null byte again, as when the stream is picked up anew
+        void reset() noexcept {
+            length = 0;
+            synced = false;
+            overflowed = false;
+        }
+
+        /// droppedFrames counts the frames that were dropped for being longer than N
+        [[nodiscard]] uint32_t droppedFrames() const noexcept {
+            return dropped;
+        }
+    };
+}
+
+#endif //ESP32_SRC_FRAME_SPLITTER_H_
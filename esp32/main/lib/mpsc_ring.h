@@ -0,0 +1,83 @@
+#ifndef ESP32_SRC_MPSC_RING_H_
+#define ESP32_SRC_MPSC_RING_H_
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace safe_std {
+    template<class T, size_t N>
+/// mpsc_ring is a bounded lock-free queue with any number of producers and a single consumer. Pushing never blocks
+/// or allocates, so it can be done from callbacks of other tasks.
+/// Every cell carries a sequence number that says whose turn it is: the producer at position pos may write the cell
+/// when its sequence is pos, and the consumer may read it when its sequence is pos + 1.
+    class mpsc_ring {
+        static_assert(N >= 2 && (N & (N - 1)) == 0, "N must be a power of two");
+
+        struct cell {
+            std::atomic<size_t> sequence;
+            T value;
+        };
+
+        std::array<cell, N> cells;
+        /// tail is the next position producers write to
+        std::atomic<size_t> tail{0};
+        /// head is the next position the consumer reads from. Only the consumer touches it.
+        size_t head = 0;
+
+    public:
+        mpsc_ring() noexcept;
+
+        /// push copies value into the ring. It returns false if the ring is full.
+        bool push(const T &value) noexcept;
+
+        /// pop moves the oldest value into value. It returns false if the ring is empty.
+        /// Only one task may pop.
+        bool pop(T &value) noexcept;
+    };
+
+    template<class T, size_t N>
+    mpsc_ring<T, N>::mpsc_ring() noexcept {
+        for (size_t i = 0; i < N; i++) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    template<class T, size_t N>
+    bool mpsc_ring<T, N>::push(const T &value) noexcept {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        for (;;) {
+            cell &c = cells[pos & (N - 1)];
+            auto const diff = static_cast<intptr_t>(c.sequence.load(std::memory_order_acquire)) -
+                              static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                // The cell is free; claim the position, unless another producer got it first
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    c.value = value;
+                    c.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                // The consumer hasn't read this cell since the last time around
+                return false;
+            } else {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    template<class T, size_t N>
+    bool mpsc_ring<T, N>::pop(T &value) noexcept {
+        cell &c = cells[head & (N - 1)];
+        if (c.sequence.load(std::memory_order_acquire) != head + 1) {
+            return false;
+        }
+        value = c.value;
+        c.sequence.store(head + N, std::memory_order_release);
+        head++;
+        return true;
+    }
+}
+
+#endif //ESP32_SRC_MPSC_RING_H_
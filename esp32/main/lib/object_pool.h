@@ -0,0 +1,133 @@
+#ifndef ESP32_SRC_OBJECT_POOL_H_
+#define ESP32_SRC_OBJECT_POOL_H_
+
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+namespace safe_std {
+    template<class T, size_t N>
+/// object_pool hands out up to N objects from storage reserved at compile time, so that taking one never touches the
+/// heap. An object is default constructed when it's acquired and destroyed when its handle goes away.
+/// Acquiring and releasing are lock-free, so objects can be passed between tasks and callbacks.
+    class object_pool {
+        static_assert(N >= 1 && N <= 32, "N must fit in the bitmap of used slots");
+
+        alignas(T) std::byte storage[N][sizeof(T)];
+        /// used has bit i set while slot i is handed out
+        std::atomic<uint32_t> used{0};
+        /// exhaustions counts the times acquire found every slot taken
+        std::atomic<uint32_t> exhaustions{0};
+
+        void release(T *object) noexcept;
+
+    public:
+        /// handle owns an object of the pool, like a unique_ptr. It's empty if the pool was exhausted.
+        class handle {
+            object_pool *pool = nullptr;
+            T *object = nullptr;
+
+        public:
+            handle() = default;
+
+            handle(object_pool *p, T *o) noexcept: pool(p), object(o) {}
+
+            handle(handle &&other) noexcept: pool(other.pool), object(std::exchange(other.object, nullptr)) {}
+
+            handle &operator=(handle &&other) noexcept {
+                if (this != &other) {
+                    reset();
+                    pool = other.pool;
+                    object = std::exchange(other.object, nullptr);
+                }
+                return *this;
+            }
+
+            handle(const handle &) = delete;
+
+            handle &operator=(const handle &) = delete;
+
+            ~handle() {
+                reset();
+            }
+
+            /// reset gives the object back to the pool
+            void reset() noexcept {
+                if (object != nullptr) {
+                    pool->release(std::exchange(object, nullptr));
+                }
+            }
+
+            /// release gives up ownership without giving the object back, e.g. to pass it as a task parameter. Give
+            /// it back by adopting it into a handle again.
+            T *release() noexcept {
+                return std::exchange(object, nullptr);
+            }
+
+            explicit operator bool() const noexcept {
+                return object != nullptr;
+            }
+
+            T *get() const noexcept {
+                return object;
+            }
+
+            T &operator*() const noexcept {
+                return *object;
+            }
+
+            T *operator->() const noexcept {
+                return object;
+            }
+        };
+
+        object_pool() = default;
+
+        object_pool(const object_pool &) = delete;
+
+        object_pool &operator=(const object_pool &) = delete;
+
+        /// acquire takes a free object. The handle is empty if all N are in use.
+        handle acquire() noexcept;
+
+        /// adopt takes back ownership of an object that a handle released
+        handle adopt(T *object) noexcept {
+            return handle(this, object);
+        }
+
+        /// exhausted returns how many times acquire came back empty
+        [[nodiscard]] uint32_t exhausted() const noexcept {
+            return exhaustions.load(std::memory_order_relaxed);
+        }
+    };
+
+    template<class T, size_t N>
+    typename object_pool<T, N>::handle object_pool<T, N>::acquire() noexcept {
+        constexpr uint32_t all = N == 32 ? UINT32_MAX : (uint32_t{1} << N) - 1;
+        uint32_t current = used.load(std::memory_order_relaxed);
+        for (;;) {
+            uint32_t const free = ~current & all;
+            if (free == 0) {
+                exhaustions.fetch_add(1, std::memory_order_relaxed);
+                return handle();
+            }
+            uint32_t const bit = free & (0u - free);
+            if (used.compare_exchange_weak(current, current | bit, std::memory_order_acquire,
+                                           std::memory_order_relaxed)) {
+                return handle(this, new(storage[std::countr_zero(bit)]) T());
+            }
+        }
+    }
+
+    template<class T, size_t N>
+    void object_pool<T, N>::release(T *object) noexcept {
+        auto const slot = static_cast<size_t>(reinterpret_cast<std::byte *>(object) - storage[0]) / sizeof(T);
+        object->~T();
+        used.fetch_and(~(uint32_t{1} << slot), std::memory_order_release);
+    }
+}
+
+#endif //ESP32_SRC_OBJECT_POOL_H_
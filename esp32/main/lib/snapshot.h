@@ -0,0 +1,186 @@
+#ifndef ESP32_SRC_SNAPSHOT_H_
+#define ESP32_SRC_SNAPSHOT_H_
+
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+namespace safe_std {
+    template<class T, size_t N = 2>
+/// snapshot holds the versions of a value that is read far more often than it is written. Readers get an immutable
+/// view of the latest version without locking or copying it, and never hold up the writers.
+/// The value is kept in N buffers. A writer fills a buffer that is neither the current one nor held by a reader, then
+/// makes it the current one. Every buffer counts the views of it: a reader counts itself in and then checks that
+/// the buffer is still the current one, so a writer that finds no readers of a buffer can overwrite it.
+    class snapshot {
+        static_assert(N >= 2, "A snapshot needs a buffer to write besides the current one");
+
+        struct buffer {
+            T value{};
+            uint32_t version = 0;
+            std::atomic<uint32_t> readers{0};
+        };
+
+        std::array<buffer, N> buffers;
+        /// current is the index of the buffer with the latest version
+        std::atomic<size_t> current{0};
+        /// writer lets one writer in at a time
+        std::mutex writer;
+
+        /// freeBuffer returns a buffer no reader holds other than the current one, or nullptr. The writer must be
+        /// locked.
+        buffer *freeBuffer() noexcept;
+
+        /// makeCurrent publishes b, which was filled from the current buffer's version
+        void makeCurrent(buffer &b) noexcept;
+
+    public:
+        /// view is a reader's hold on a version. The version isn't overwritten until the view is gone, so keep it
+        /// only as long as needed.
+        class view {
+            buffer *_buffer;
+
+        public:
+            explicit view(buffer *b) noexcept;
+
+            view(view &&other) noexcept;
+
+            view(const view &) = delete;
+
+            view &operator=(const view &) = delete;
+
+            view &operator=(view &&) = delete;
+
+            ~view();
+
+            const T &operator*() const noexcept;
+
+            const T *operator->() const noexcept;
+
+            /// version counts the publications. It only goes up.
+            [[nodiscard]] uint32_t version() const noexcept;
+        };
+
+        snapshot() = default;
+
+        /// read returns a view of the latest version. It doesn't block.
+        view read() noexcept;
+
+        /// tryPublish makes a copy of value the latest version. It returns false, leaving the latest version as it
+        /// is, if readers hold every other buffer.
+        bool tryPublish(const T &value);
+
+        /// tryPublishWith has assign fill a buffer with the latest version. The buffer holds an older version, which
+        /// assign can reuse. It returns false without calling assign if readers hold every other buffer.
+        template<typename Assign>
+        bool tryPublishWith(const Assign &assign);
+
+        /// update applies f to a copy of the latest version and publishes the result. It waits for readers to let go
+        /// of a buffer, so keep it out of the hot paths.
+        template<typename F>
+        void update(const F &f);
+    };
+
+    template<class T, size_t N>
+    snapshot<T, N>::view::view(buffer *b) noexcept : _buffer(b) {}
+
+    template<class T, size_t N>
+    snapshot<T, N>::view::view(view &&other) noexcept : _buffer(other._buffer) {
+        other._buffer = nullptr;
+    }
+
+    template<class T, size_t N>
+    snapshot<T, N>::view::~view() {
+        if (_buffer != nullptr) {
+            _buffer->readers.fetch_sub(1);
+        }
+    }
+
+    template<class T, size_t N>
+    const T &snapshot<T, N>::view::operator*() const noexcept {
+        assert(_buffer != nullptr);
+        return _buffer->value;
+    }
+
+    template<class T, size_t N>
+    const T *snapshot<T, N>::view::operator->() const noexcept {
+        assert(_buffer != nullptr);
+        return &_buffer->value;
+    }
+
+    template<class T, size_t N>
+    uint32_t snapshot<T, N>::view::version() const noexcept {
+        assert(_buffer != nullptr);
+        return _buffer->version;
+    }
+
+    template<class T, size_t N>
+    typename snapshot<T, N>::view snapshot<T, N>::read() noexcept {
+        for (;;) {
+            buffer &b = buffers[current.load()];
+            b.readers.fetch_add(1);
+            // A writer may have picked the buffer before we counted ourselves in. It can only be writing it if it
+            // isn't the current one anymore.
+            if (&b == &buffers[current.load()]) {
+                return view(&b);
+            }
+            b.readers.fetch_sub(1);
+        }
+    }
+
+    template<class T, size_t N>
+    typename snapshot<T, N>::buffer *snapshot<T, N>::freeBuffer() noexcept {
+        size_t const c = current.load();
+        for (size_t i = 0; i < N; i++) {
+            if (i != c && buffers[i].readers.load() == 0) {
+                return &buffers[i];
+            }
+        }
+        return nullptr;
+    }
+
+    template<class T, size_t N>
+    void snapshot<T, N>::makeCurrent(buffer &b) noexcept {
+        b.version = buffers[current.load()].version + 1;
+        current.store(&b - buffers.data());
+    }
+
+    template<class T, size_t N>
+    bool snapshot<T, N>::tryPublish(const T &value) {
+        return tryPublishWith([&value](T &b) { b = value; });
+    }
+
+    template<class T, size_t N>
+    template<typename Assign>
+    bool snapshot<T, N>::tryPublishWith(const Assign &assign) {
+        std::lock_guard<std::mutex> lock(writer);
+        buffer *b = freeBuffer();
+        if (b == nullptr) {
+            return false;
+        }
+        assign(b->value);
+        makeCurrent(*b);
+        return true;
+    }
+
+    template<class T, size_t N>
+    template<typename F>
+    void snapshot<T, N>::update(const F &f) {
+        std::lock_guard<std::mutex> lock(writer);
+        buffer *b;
+        while ((b = freeBuffer()) == nullptr) {
+            // Sleep rather than yield, so that a reader of a lower priority gets to let go
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        b->value = buffers[current.load()].value;
+        f(b->value);
+        makeCurrent(*b);
+    }
+} // safe_std
+
+#endif //ESP32_SRC_SNAPSHOT_H_
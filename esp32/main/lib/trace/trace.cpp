@@ -0,0 +1,123 @@
+#include <algorithm>
+#include <cstdio>
+#include <mutex>
+#include "trace.h"
+
+namespace trace {
+    Ring &ring() {
+        static Ring r;
+        return r;
+    }
+
+    namespace {
+        /// Tasks names the tasks of a dump. Tasks that are gone by the time of the dump can't be named, so each of
+        /// them gets an id past the live ones.
+        class Tasks {
+            std::array<TaskStatus_t, TRACE_MAX_TASKS> live{};
+            UBaseType_t liveCount = 0;
+            std::array<TaskHandle_t, TRACE_MAX_TASKS> gone{};
+            size_t goneCount = 0;
+            UBaseType_t firstGoneId = 0;
+
+        public:
+            /// start takes the tasks that are running now
+            void start() {
+                // It fills in nothing if there are more tasks than statuses
+                liveCount = uxTaskGetSystemState(live.data(), live.size(), nullptr);
+                goneCount = 0;
+                firstGoneId = 1;
+                for (UBaseType_t i = 0; i < liveCount; i++) {
+                    firstGoneId = std::max<UBaseType_t>(firstGoneId, live[i].xTaskNumber + 1);
+                }
+            }
+
+            [[nodiscard]] UBaseType_t count() const {
+                return liveCount;
+            }
+
+            [[nodiscard]] const TaskStatus_t &at(UBaseType_t i) const {
+                return live[i];
+            }
+
+            /// id returns the id of task in the dump, and sets added if it is a task that is gone and this is its
+            /// first event. Events recorded before the scheduler started have id 0.
+            UBaseType_t id(TaskHandle_t task, bool &added) {
+                added = false;
+                if (task == nullptr) {
+                    return 0;
+                }
+                for (UBaseType_t i = 0; i < liveCount; i++) {
+                    if (live[i].xHandle == task) {
+                        return live[i].xTaskNumber;
+                    }
+                }
+                for (size_t i = 0; i < goneCount; i++) {
+                    if (gone[i] == task) {
+                        return firstGoneId + i;
+                    }
+                }
+                if (goneCount == gone.size()) {
+                    // Past that many they share the last id
+                    return firstGoneId + goneCount - 1;
+                }
+                gone[goneCount] = task;
+                added = true;
+                return firstGoneId + goneCount++;
+            }
+        };
+
+        /// TRACE_LINE_SIZE fits the longest line of a dump
+        constexpr size_t TRACE_LINE_SIZE = 96;
+    }
+
+    bool dump(Write write, void *context) {
+        // The task list and the line live here rather than on the stack of whoever asks for a dump
+        static std::mutex dumping;
+        static Tasks tasks;
+        static char line[TRACE_LINE_SIZE];
+        std::lock_guard<std::mutex> lock(dumping);
+
+        auto writeLine = [&](int length) {
+            if (length < 0) {
+                return true;
+            }
+            return write(line, std::min<size_t>(length, sizeof(line) - 1), context);
+        };
+
+        uint32_t const end = ring().end();
+        uint32_t const count = std::min<uint32_t>(end, TRACE_RING_SIZE);
+        tasks.start();
+        if (!writeLine(snprintf(line, sizeof(line), "trace: begin %u\n", (unsigned) count))) {
+            return false;
+        }
+        for (UBaseType_t i = 0; i < tasks.count(); i++) {
+            const TaskStatus_t &task = tasks.at(i);
+            if (!writeLine(snprintf(line, sizeof(line), "trace: task %u %s\n", (unsigned) task.xTaskNumber,
+                                    task.pcTaskName))) {
+                return false;
+            }
+        }
+        for (uint32_t position = end - count; position != end; position++) {
+            Event event;
+            if (!ring().read(position, event)) {
+                continue;
+            }
+            bool added;
+            UBaseType_t const id = tasks.id(event.task, added);
+            if (added && !writeLine(snprintf(line, sizeof(line), "trace: task %u (exited)\n", (unsigned) id))) {
+                return false;
+            }
+            if (!writeLine(snprintf(line, sizeof(line), "trace: event %lld %u %c %u %s\n", (long long) event.timeUs,
+                                    (unsigned) id, event.phase, (unsigned) event.value, event.name))) {
+                return false;
+            }
+        }
+        return writeLine(snprintf(line, sizeof(line), "trace: end\n"));
+    }
+
+    void dumpToConsole() {
+        dump([](const char *line, size_t length, void *) {
+            return fwrite(line, 1, length, stdout) == length;
+        }, nullptr);
+    }
+}
@@ -0,0 +1,140 @@
+#ifndef ESP32_SRC_LIB_TRACE_H_
+#define ESP32_SRC_LIB_TRACE_H_
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+/// TRACE_ENABLED turns the trace macros on. With 0 they compile to nothing.
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 1
+#endif
+
+/// TRACE_RING_SIZE is how many trace events are kept. Older ones are overwritten. It must be a power of two.
+#define TRACE_RING_SIZE 512
+
+/// TRACE_MAX_TASKS is the most tasks a dump names
+#define TRACE_MAX_TASKS 32
+
+/// trace keeps the last TRACE_RING_SIZE begin, end and instant events of the hub in RAM, so that one can see where
+/// the time of a poll cycle goes. Recording an event takes a timestamp and a few stores and never blocks or
+/// allocates, so it can be done from any task and from BLE callbacks.
+/// A dump is text, one line per event, which host/trace_to_perfetto turns into a trace Perfetto opens:
+///
+///     trace: begin 512
+///     trace: task 7 Session
+///     trace: event 12034511 7 B 0 connect
+///     trace: event 12094873 7 E 0 connect
+///     trace: end
+///
+/// An event line is the time in microseconds since boot, the task, the phase (B, E or i), a value and the name.
+namespace trace {
+    /// Event is one recorded event. name must be a string literal, since only the pointer is kept.
+    struct Event {
+        int64_t timeUs;
+        const char *name;
+        TaskHandle_t task;
+        uint32_t value;
+        char phase;
+    };
+
+    /// Ring is a fixed ring of events that any number of tasks record into. Writers never wait: each claims the next
+    /// position and overwrites what was there. Every slot carries the position it holds plus one, and 0 while it is
+    /// being written, so that a dump can tell a slot it may read from one that is being overwritten under it.
+    class Ring {
+        struct Slot {
+            std::atomic<uint32_t> sequence{0};
+            Event event{};
+        };
+        static_assert(TRACE_RING_SIZE >= 2 && (TRACE_RING_SIZE & (TRACE_RING_SIZE - 1)) == 0,
+                      "TRACE_RING_SIZE must be a power of two");
+
+        std::array<Slot, TRACE_RING_SIZE> slots{};
+        /// next is the position the next event goes to
+        std::atomic<uint32_t> next{0};
+
+    public:
+        void record(char phase, const char *name, uint32_t value) noexcept {
+            int64_t const now = esp_timer_get_time();
+            uint32_t const position = next.fetch_add(1, std::memory_order_relaxed);
+            Slot &slot = slots[position & (TRACE_RING_SIZE - 1)];
+            slot.sequence.store(0, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            slot.event = Event{.timeUs = now, .name = name, .task = xTaskGetCurrentTaskHandle(), .value = value,
+                    .phase = phase};
+            slot.sequence.store(position + 1, std::memory_order_release);
+        }
+
+        /// end returns the position the next event goes to. The ring holds the TRACE_RING_SIZE positions before it.
+        [[nodiscard]] uint32_t end() const noexcept {
+            return next.load(std::memory_order_acquire);
+        }
+
+        /// read copies the event at position into event. It returns false if the event was overwritten, or is being
+        /// written.
+        bool read(uint32_t position, Event &event) const noexcept {
+            const Slot &slot = slots[position & (TRACE_RING_SIZE - 1)];
+            if (slot.sequence.load(std::memory_order_acquire) != position + 1) {
+                return false;
+            }
+            event = slot.event;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return slot.sequence.load(std::memory_order_relaxed) == position + 1;
+        }
+    };
+
+    /// ring returns the ring every event goes to. It has static lifetime.
+    Ring &ring();
+
+    /// Scope records a begin event when it is created and the matching end when it goes out of scope
+    class Scope {
+        const char *name;
+
+    public:
+        explicit Scope(const char *name) noexcept: name(name) {
+            ring().record('B', name, 0);
+        }
+
+        ~Scope() {
+            ring().record('E', name, 0);
+        }
+
+        Scope(const Scope &) = delete;
+
+        Scope &operator=(const Scope &) = delete;
+    };
+
+    /// Write takes one line of a dump, with its newline
+    using Write = bool (*)(const char *line, size_t length, void *context);
+
+    /// dump writes the events in the ring, oldest first, one line at a time. Events recorded while it runs are left
+    /// out. It stops and returns false as soon as write does.
+    bool dump(Write write, void *context);
+
+    /// dumpToConsole writes the events in the ring to the serial console
+    void dumpToConsole();
+}
+
+#if TRACE_ENABLED
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+/// TRACE_BEGIN starts a span called name on the current task. name must be a string literal.
+#define TRACE_BEGIN(name) trace::ring().record('B', name, 0)
+/// TRACE_END ends the last span TRACE_BEGIN started on the current task
+#define TRACE_END(name) trace::ring().record('E', name, 0)
+/// TRACE_INSTANT records that something happened, with a value that goes along with it
+#define TRACE_INSTANT(name, value) trace::ring().record('i', name, static_cast<uint32_t>(value))
+/// TRACE_SCOPE records a span from here to the end of the enclosing scope
+#define TRACE_SCOPE(name) trace::Scope const TRACE_CONCAT(traceScope, __LINE__)(name)
+#else
+#define TRACE_BEGIN(name) do {} while (0)
+#define TRACE_END(name) do {} while (0)
+#define TRACE_INSTANT(name, value) do {} while (0)
+#define TRACE_SCOPE(name) do {} while (0)
+#endif
+
+#endif //ESP32_SRC_LIB_TRACE_H_
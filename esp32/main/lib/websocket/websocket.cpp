@@ -1,4 +1,5 @@
 //#include <esp_websocket_client.h>
+#include <cstring>
 #include <memory>
 #include <utility>
 #include <esp_event_base.h>
@@ -19,30 +20,25 @@ websocket *websocket::getInstance() {
     return &w;
 }
 
-WriteSocketError websocket::writeBytes(const std::vector<uint8_t> &bytes, int msToTimeut) {
+WriteSocketError websocket::send(esp_websocket_client_handle_t client, size_t length, int msToTimeut) {
     static_assert(CHAR_BIT == 8);
-    auto lockedSocket = socket.lock();
-    if (lockedSocket->has_value()) {
-        // This shouldn't panic since GPIO_NUM_18 is a constant
-        ESP_ERROR_CHECK(gpio_set_level(GPIO_NUM_18, 1));
-        int const result = esp_websocket_client_send_bin(lockedSocket->value(),
-                                                         reinterpret_cast<const char *>(bytes.data()), bytes.size(),
-                                                         pdMS_TO_TICKS(msToTimeut));
-        // This shouldn't panic since GPIO_NUM_18 is a constant
-        ESP_ERROR_CHECK(gpio_set_level(GPIO_NUM_18, 0));
-        if (result == ESP_FAIL) {
-            return WriteSocketError::WriteError;
-        }
-        return WriteSocketError::Ok;
-    } else {
-        return WriteSocketError::NotInitialized;
+    TRACE_SCOPE("websocket send");
+    // This shouldn't panic since GPIO_NUM_18 is a constant
+    ESP_ERROR_CHECK(gpio_set_level(GPIO_NUM_18, 1));
+    int const result = esp_websocket_client_send_bin(client, reinterpret_cast<const char *>(txBuffer.data()),
+                                                     static_cast<int>(length), pdMS_TO_TICKS(msToTimeut));
+    // This shouldn't panic since GPIO_NUM_18 is a constant
+    ESP_ERROR_CHECK(gpio_set_level(GPIO_NUM_18, 0));
+    if (result == ESP_FAIL) {
+        return WriteSocketError::WriteError;
     }
-
+    return WriteSocketError::Ok;
 }
 
 
 bool websocket::connect(const std::string &url,
-                        const std::function<void(const WebsocketConnectionType, int, const char *)> &onCall) {
+                        const std::function<void(const WebsocketConnectionType, int, const char *)> &onCall,
+                        bool whole) {
     auto lockedSocket = socket.lock();
 
     LOG("About to connect\n");
@@ -55,11 +51,17 @@ bool websocket::connect(const std::string &url,
     // Reinitialize websockets
     esp_websocket_client_config_t ws_cfg = {0};
     ws_cfg.uri = url.c_str();
+    // Reconnecting is up to the caller, so that a fleet of hubs doesn't retry in step
+    ws_cfg.disable_auto_reconnect = true;
     esp_websocket_client_handle_t websocket_client = esp_websocket_client_init(&ws_cfg);
     if (websocket_client == nullptr) {
         return false;
     }
     onCallGlobal.lockAndSwap(onCall);
+    // The old client is gone, so nothing else touches the rx fields
+    wholeMessages = whole;
+    rxLength = 0;
+    rxDropping = false;
     ESP_ERROR_CHECK(
             esp_websocket_register_events(websocket_client, WEBSOCKET_EVENT_ANY, websocket_event_handler, nullptr));
     esp_err_t const error = esp_websocket_client_start(websocket_client);
@@ -71,6 +73,58 @@ bool websocket::connect(const std::string &url,
     return true;
 }
 
+void websocket::receive(const esp_websocket_event_data_t &data,
+                        const std::function<void(const WebsocketConnectionType, int, const char *)> &onCall) {
+    if (data.op_code >= WS_TRANSPORT_OPCODES_CLOSE) {
+        // Control frames can come between the frames of a message, and aren't part of it
+        return;
+    }
+    if (data.payload_offset == 0 && data.op_code != WS_TRANSPORT_OPCODES_CONT) {
+        // The first piece of a message. One that wasn't finished is dropped.
+        rxLength = 0;
+        rxDropping = false;
+    }
+    if (!rxDropping) {
+        if (data.data_len < 0 || static_cast<size_t>(data.data_len) > rxBuffer.size() - rxLength) {
+            LOG("Dropping a websocket message larger than %zu bytes\n", rxBuffer.size());
+            rxDropping = true;
+        } else {
+            memcpy(rxBuffer.data() + rxLength, data.data_ptr, data.data_len);
+            rxLength += data.data_len;
+        }
+    }
+    // A frame comes in pieces, and the message ends with the frame that has fin set
+    if (data.payload_offset + data.data_len < data.payload_len || !data.fin) {
+        return;
+    }
+    if (!rxDropping) {
+        onCall(WebsocketConnectionType::Data, static_cast<int>(rxLength), rxBuffer.data());
+    }
+    rxLength = 0;
+    rxDropping = false;
+}
+
+void websocket::closing(const esp_websocket_event_data_t &data) {
+    if (data.data_len < 2 || data.payload_offset != 0) {
+        return;
+    }
+    auto const *payload = reinterpret_cast<const uint8_t *>(data.data_ptr);
+    unsigned const code = payload[0] << 8 | payload[1];
+    if (code != 1013) {
+        return;
+    }
+    uint32_t seconds = 0;
+    for (int i = 2; i < data.data_len && payload[i] >= '0' && payload[i] <= '9' && seconds < 86'400; i++) {
+        seconds = seconds * 10 + (payload[i] - '0');
+    }
+    LOG("The backend asked to reconnect in %u s\n", (unsigned) seconds);
+    retryAfter = seconds * 1'000;
+}
+
+uint32_t websocket::takeRetryAfterMs() {
+    return retryAfter.exchange(0);
+}
+
 bool websocket::isConnected() {
     auto lockedSocket = socket.lock();
     return lockedSocket->has_value() && esp_websocket_client_is_connected(lockedSocket->value());
@@ -94,9 +148,17 @@ void websocket_event_handler(void *arg, esp_event_base_t event_base, int32_t eve
         case WEBSOCKET_EVENT_DISCONNECTED:
             (*call)(WebsocketConnectionType::Disconnected, data->data_len, data->data_ptr);
             break;
-        case WEBSOCKET_EVENT_DATA:
-            (*call)(WebsocketConnectionType::Data, data->data_len, data->data_ptr);
+        case WEBSOCKET_EVENT_DATA: {
+            websocket *w = websocket::getInstance();
+            if (data->op_code == WS_TRANSPORT_OPCODES_CLOSE) {
+                w->closing(*data);
+            } else if (w->wholeMessages) {
+                w->receive(*data, *call);
+            } else {
+                (*call)(WebsocketConnectionType::Data, data->data_len, data->data_ptr);
+            }
             break;
+        }
         case WEBSOCKET_EVENT_CLOSED:
             (*call)(WebsocketConnectionType::Closed, data->data_len, data->data_ptr);
             break;
@@ -1,9 +1,22 @@
 #pragma once
 
+#include <array>
+#include <atomic>
 #include <optional>
 #include <functional>
+#include <stdexcept>
+#include <string>
 #include "esp_websocket_client.h"
 #include "lib/mutex.h"
+#include "lib/trace/trace.h"
+#include "../../../components/nanopb/pb_encode.h"
+
+/// WEBSOCKET_TX_BUFFER_SIZE is the largest message that can be sent. A full sensors_list is the largest we send.
+#define WEBSOCKET_TX_BUFFER_SIZE 2'048
+
+/// WEBSOCKET_RX_BUFFER_SIZE is the largest message put back together when connecting with wholeMessages. A full
+/// add_sensor command is the largest we receive.
+#define WEBSOCKET_RX_BUFFER_SIZE 4'096
 
 /// This represents the different type of connections
 enum WebsocketConnectionType {
@@ -20,21 +33,72 @@ class websocket {
 private:
     // Is behind a mutex since we can write to a socket from multiple threads
     safe_std::mutex<std::optional<esp_websocket_client_handle_t>> socket;
+    /// txBuffer is what messages are encoded into. It's only touched with socket locked.
+    std::array<pb_byte_t, WEBSOCKET_TX_BUFFER_SIZE> txBuffer{};
+    /// wholeMessages is set when data events are held back until their message is complete
+    bool wholeMessages = false;
+    /// rxBuffer is where a message is put back together from its pieces. The rx fields are only touched by the
+    /// client's task, which raises the events.
+    std::array<char, WEBSOCKET_RX_BUFFER_SIZE> rxBuffer{};
+    size_t rxLength = 0;
+    /// rxDropping is set while skipping the rest of a message that doesn't fit in rxBuffer
+    bool rxDropping = false;
+    /// retryAfter is how long the backend asked the hub to wait before reconnecting, in milliseconds, or 0
+    std::atomic<uint32_t> retryAfter{0};
 
     websocket() = default;
 
+    /// send sends the first length bytes of txBuffer. socket must be locked.
+    WriteSocketError send(esp_websocket_client_handle_t client, size_t length, int msToTimeut);
+
+    /// receive adds a data event to the message being put back together, and hands the message to onCall once it
+    /// is complete
+    void receive(const esp_websocket_event_data_t &data,
+                 const std::function<void(const WebsocketConnectionType, int, const char *)> &onCall);
+
+    /// closing reads the close frame the backend sent. A 1013 (try again later) close carries the seconds to wait
+    /// before reconnecting as its reason.
+    void closing(const esp_websocket_event_data_t &data);
+
+    friend void websocket_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data);
+
 public:
     /// Gets a singleton instance. The websocket pointer has a static lifetime.
     static websocket *getInstance();
 
     /// Connects to the server. On call is called when a websocket connection event occurs.
+    /// The client doesn't reconnect on its own; the caller decides when to try again.
     /// It may be called after connect returns, so make sure to copy or move all captured references.
+    /// The client hands over a message in pieces of its buffer size, and the server may split it into frames too.
+    /// With wholeMessages, onCall gets a Data event once per message, with all of it. Messages larger than
+    /// WEBSOCKET_RX_BUFFER_SIZE are dropped. Otherwise it gets every piece as it comes.
     bool connect(const std::string &url,
-                 const std::function<void(const WebsocketConnectionType, int, const char *)> &onCall);
+                 const std::function<void(const WebsocketConnectionType, int, const char *)> &onCall,
+                 bool wholeMessages = false);
 
-    /// Writes bytes as a binary value.
-    WriteSocketError writeBytes(const std::vector<uint8_t> &bytes, int msToTimeut);
+    /// writeMessage encodes a message straight into the transmit buffer with encode, a `bool(pb_ostream_t *)`, and
+    /// sends it as a binary value. Nothing is allocated and the message is encoded once. encode runs with the socket
+    /// locked, so it must not block, and it isn't called at all if there is no socket.
+    template<typename Encode>
+    WriteSocketError writeMessage(const Encode &encode, int msToTimeut) {
+        auto lockedSocket = socket.lock();
+        if (!lockedSocket->has_value()) {
+            return WriteSocketError::NotInitialized;
+        }
+        pb_ostream_t output = pb_ostream_from_buffer(txBuffer.data(), txBuffer.size());
+        {
+            TRACE_SCOPE("encode");
+            if (!encode(&output)) {
+                throw std::runtime_error(std::string("Encoding failed: ") + PB_GET_ERROR(&output));
+            }
+        }
+        return send(lockedSocket->value(), output.bytes_written, msToTimeut);
+    }
 
     [[nodiscard]] bool isConnected();
+
+    /// takeRetryAfterMs returns how long the backend asked the hub to wait before reconnecting, in milliseconds, and
+    /// forgets it. It returns 0 if the backend didn't ask.
+    uint32_t takeRetryAfterMs();
 };
 
@@ -1,4 +1,5 @@
 #include "NimBLEDevice.h"
+#include <algorithm>
 #include <vector>
 #include <cstring>
 #include <map>
@@ -6,18 +7,30 @@
 #include <esp_task_wdt.h>
 #include <esp_netif.h>
 #include <esp_wifi.h>
+#include <esp_random.h>
 #include <freertos/event_groups.h>
+#include <freertos/timers.h>
 
 #include "exceptions/StateException.h"
 #include "uuid.h"
 #include "Constants.h"
 #include "GetSensorData.h"
+#include "BleAddr.h"
 #include "generated/firmware_backend.pb.h"
 #include "../components/nanopb/pb_decode.h"
 #include "ScanResults.h"
+#include "EnumTables.h"
 #include "setClock.h"
 #include "lib/log.h"
 #include "lib/websocket/websocket.h"
+#include "Uplink.h"
+#include "CommandWorker.h"
+#include "EventBus.h"
+#include "Heartbeat.h"
+#include "ReconnectPolicy.h"
+#include "PacketPools.h"
+#include "packets/Trace.h"
+#include "lib/trace/trace.h"
 #include "secrets.h"
 #include "../components/nanopb/pb_encode.h"
 #include "driver/gpio.h"
@@ -27,20 +40,13 @@ using namespace std;
 
 NimBLECharacteristic *pRead = nullptr;
 
-safe_std::mutex<bool> *isWiFiConnected() {
-    static auto returnVal = safe_std::mutex(false);
-    return &returnVal;
-}
-
-safe_std::mutex<bool> *timeSet() {
-    static auto returnVal = safe_std::mutex(false);
-    return &returnVal;
-}
-
 void loop();
 
 void clientConnectLoop();
 
+/// handleCommand runs a command from the backend on the command worker
+void handleCommand(const BackendToFirmwarePacket &packet);
+
 /// initialize_wifi starts the wifi system and connects
 void initialize_wifi();
 
@@ -53,8 +59,7 @@ string *uuid() {
 /// All setup should be done here.
 
 extern "C" [[noreturn]] void app_main() {
-    // Catch the reason the device restarted.
-    // TODO: We should send this to the server for logging
+    // Catch the reason the device restarted. The server gets it with every health report, see Heartbeat::collect.
     auto reason = esp_reset_reason();
     switch (reason) {
         case ESP_RST_UNKNOWN:
@@ -119,32 +124,25 @@ extern "C" [[noreturn]] void app_main() {
     // This allocates on the heap but that should be OK since this only runs once and would panic
     // if it can't allocate.
     xTaskCreate([](void *arg) {
+        auto bus = EventBus::getInstance();
+        bus->subscribe(Subscriber::Leds, xTaskGetCurrentTaskHandle());
         for (;;) {
-            // Is wifi connected
-            bool _isWiFiConnected;
-            {
-                _isWiFiConnected = *isWiFiConnected()->lock();
-            }
-            // Is time set up
-            bool _isTimeSet;
-            {
-                _isTimeSet = *timeSet()->lock();
-            }
-            // If wifi is connected, turn on red led. Otherwise, turn it off.
-            if (_isWiFiConnected && _isTimeSet) {
+            EventBits_t const state = bus->state();
+            // If wifi is connected and the time is set, turn on red led. Otherwise, turn it off.
+            if ((state & (STATE_WIFI | STATE_TIME)) == (STATE_WIFI | STATE_TIME)) {
                 ESP_ERROR_CHECK(gpio_set_level(GPIO_NUM_23, 1));
             } else {
                 ESP_ERROR_CHECK(gpio_set_level(GPIO_NUM_23, 0));
             }
 
             // Are we connected to the websocket? If yes, turn on white led. Otherwise, turn it off
-            if (websocket::getInstance()->isConnected()) {
+            if (state & STATE_WEBSOCKET) {
                 ESP_ERROR_CHECK(gpio_set_level(GPIO_NUM_17, 1));
             } else {
                 ESP_ERROR_CHECK(gpio_set_level(GPIO_NUM_17, 0));
             }
-            // Keep checking every quarter of a second
-            delay(250);
+            // Sleep until one of them changes
+            EventBus::wait(portMAX_DELAY);
         }
     }, "WiFi loop", 1024, nullptr, 1, nullptr);
 
@@ -171,6 +169,9 @@ extern "C" [[noreturn]] void app_main() {
     name.erase(15, std::string::npos);
 
     NimBLEDevice::init(name);
+    // Ask every sensor for the largest MTU (the default is 23). The exchange is part of connect, so a session can go
+    // on to service discovery as soon as it is connected.
+    NimBLEDevice::setMTU(517);
     NimBLEServer *pServer = BLEDevice::createServer();
     NimBLEService *pService = pServer->createService(SERVICE_UUID);
 
@@ -182,6 +183,10 @@ extern "C" [[noreturn]] void app_main() {
     pAdvertising->addServiceUUID(SERVICE_UUID);
     pAdvertising->setScanResponse(true);
     NimBLEDevice::startAdvertising();
+    ScanResults::getInstance()->start();
+    // The uplink records the latest values for the other hubs too, so it starts before there is a websocket
+    Uplink::getInstance()->start();
+    CommandWorker::getInstance()->start(handleCommand);
 
     delay(100);
     TaskHandle_t Task2;
@@ -206,121 +211,110 @@ extern "C" [[noreturn]] void app_main() {
 }
 
 void getSensorsList() {
-    ScanResults scanResultsClass;
-    auto res = scanResultsClass.getScanResults();
-    vector<SensorInfo> sensorInfo;
-    for (int i = 0; i < res.getCount(); i++) {
-        auto device = res.getDevice(i);
-        string addressString = device.getAddress().toString();
-        string nameString = device.getName();
-        if (nameString.empty()) {
-            nameString = addressString;
+    auto packet = firmwarePackets()->acquire();
+    if (!packet) {
+        LOG("No packet to send the sensors list in, %u times so far\n", (unsigned) firmwarePackets()->exhausted());
+        return;
+    }
+    packet->which_type = FirmwareToBackendPacket_sensors_list_tag;
+    SensorsList &sensorsList = packet->type.sensors_list;
+    constexpr size_t maxSensors = sizeof(sensorsList.sensor_infos) / sizeof(sensorsList.sensor_infos[0]);
+    for (const auto &device: ScanResults::getInstance()->getEntries()) {
+        if (sensorsList.sensor_infos_count == maxSensors) {
+            break;
         }
-        SensorInfo info{};
-        int len = 0;
-        for (int j = 0; j < addressString.size() && j < sizeof(info.address) / sizeof(info.address[0]); j++) {
-            info.address[j] = addressString.at(j);
-            len = j;
+        SensorInfo &info = sensorsList.sensor_infos[sensorsList.sensor_infos_count++];
+        char address[ADDRESS_STRING_SIZE];
+        BleAddr(device.address).format(address);
+        static_assert(sizeof(info.address) >= ADDRESS_STRING_SIZE);
+        memcpy(info.address, address, sizeof(address));
+        strncpy(info.name, device.name.empty() ? address : device.name.c_str(), sizeof(info.name) - 1);
+    }
+    WriteSocketError const error = websocket::getInstance()->writeMessage([&packet](pb_ostream_t *output) {
+        return pb_encode(output, FirmwareToBackendPacket_fields, packet.get());
+    }, 5'000);
+    if (error != WriteSocketError::Ok) {
+        LOG("Sending the sensors list failed: %d\n", error);
+    }
+}
 
+void addSensors(const BackendToFirmwarePacket &packet) {
+    vector<std::tuple<BleAddr, TypeOfDevice>> newDevices;
+    for (int i = 0; i < packet.type.add_sensor.add_sensor_infos_count; i++) {
+        const auto &addSensorInfo = packet.type.add_sensor.add_sensor_infos[i];
+        auto const address = BleAddr::parse(addSensorInfo.sensor_info.address);
+        if (!address.has_value()) {
+            throw std::runtime_error(std::string("Assertion error: ") + addSensorInfo.sensor_info.address +
+                                     " is not a BLE address");
         }
-        info.address[len + 1] = 0;
-        len = 0;
-
-        for (int j = 0; j < nameString.size() && j < sizeof(info.name) / sizeof(info.name[0]); j++) {
-            info.name[j] = nameString.at(j);
-            len = j;
+        auto const deviceType = typeOfDevice(addSensorInfo.device_type);
+        if (!deviceType.has_value()) {
+            throw std::runtime_error("Assertion error: addSensorInfo.device_type is unspecified or unknown");
         }
-        info.name[len + 1] = 0;
-        sensorInfo.push_back(info);
+        newDevices.emplace_back(*address, *deviceType);
     }
-    res.getCount();
-    vector<pb_byte_t> buf(1024);
-    pb_ostream_t output = pb_ostream_from_buffer(buf.data(), buf.size());
-    SensorsList sensorsList{.sensor_infos_count = static_cast<pb_size_t>(sensorInfo.size())};
-
-    for (int i = 0;
-         i < sensorInfo.size() && i < sizeof(sensorsList.sensor_infos) / sizeof(sensorsList.sensor_infos[0]); i++) {
-
-        sensorsList.sensor_infos[i] = sensorInfo.at(i);
+    getGetSensorData()->setDevices(newDevices);
+}
 
+/// sendTraceChunk sends chunk and starts the next one
+bool sendTraceChunk(TraceChunk &chunk) {
+    WriteSocketError const error = websocket::getInstance()->writeMessage([&chunk](pb_ostream_t *output) {
+        return encodeTraceChunk(output, chunk);
+    }, 5'000);
+    if (error != WriteSocketError::Ok) {
+        LOG("Sending part %u of the trace failed: %d\n", (unsigned) chunk.part, error);
+        return false;
     }
-    int encodeResult = pb_encode(&output, SensorsList_fields, &sensorsList);
-    if (!encodeResult) {
-        throw std::runtime_error(string("Encoding failed: ") + PB_GET_ERROR(&output));
-    }
-    std::map<string, string> headers;
-    headers.emplace("Board", *uuid());
-    std::string url = "/api/v1/send-sensors";
-    buf.resize(output.bytes_written);
+    chunk.part++;
+    chunk.length = 0;
+    return true;
 }
 
-void addSensors(const unique_ptr<BackendToFirmwarePacket> &packet) {
-    vector<std::tuple<std::string, TypeOfDevice>> newDevices;
-    for (int i = 0; i < packet->type.add_sensor.add_sensor_infos_count; i++) {
-        auto addSensorInfo = packet->type.add_sensor.add_sensor_infos[i];
-        std::string address = addSensorInfo.sensor_info.address;
-        TypeOfDevice deviceType;
-        switch (addSensorInfo.device_type) {
-            case DeviceType_DEVICE_TYPE_TI:
-                deviceType = TypeOfDevice::TI;
-                break;
-            case DeviceType_DEVICE_TYPE_NORDIC:
-                deviceType = TypeOfDevice::Nordic;
-                break;
-            case DeviceType_DEVICE_TYPE_CUSTOM:
-                deviceType = TypeOfDevice::Custom;
-                break;
-            case DeviceType_DEVICE_TYPE_HUB:
-                deviceType = TypeOfDevice::Hub;
-                break;
-            case DeviceType_DEVICE_TYPE_UNSPECIFIED:
-                throw std::runtime_error("Assertion error: addSensorInfo.device_type is unspecified");
+/// sendTrace uploads the trace ring as trace_chunks. If that fails part way, the dump goes to the serial console.
+void sendTrace() {
+    // A chunk is too large for the stack of the command worker
+    static TraceChunk chunk;
+    chunk.part = 0;
+    chunk.last = false;
+    chunk.length = 0;
+    bool const sent = trace::dump([](const char *line, size_t length, void *) {
+        if (chunk.length + length > sizeof(chunk.text) && !sendTraceChunk(chunk)) {
+            return false;
         }
-        newDevices.emplace_back(address, deviceType);
+        length = std::min(length, sizeof(chunk.text) - chunk.length);
+        memcpy(chunk.text + chunk.length, line, length);
+        chunk.length += length;
+        return true;
+    }, nullptr);
+    chunk.last = true;
+    if (!sent || !sendTraceChunk(chunk)) {
+        trace::dumpToConsole();
+        return;
     }
-    getGetSensorData()->setDevices(newDevices);
+    LOG("Sent the trace in %u parts\n", (unsigned) chunk.part);
 }
 
-void recData(unique_ptr<BackendToFirmwarePacket> &packet) {
-    TaskHandle_t Task3;
-
-    // I *think* that this has to be a thread because it's called from a websocket callback. It seems that there's
-    // some kind of deadlock going on here if I don't
-    // TODO: verify if there is a requirement to have this as its own thread.
-
-    auto ret = xTaskCreate([](void *arg) {
-        // Ensure that all heap allocations are freed by the end of the function call
-        // vTaskDelete prevents the destructors on unique_ptr from being run, thus causing memory leaking
-
-        {
-
-            unique_ptr<BackendToFirmwarePacket> packet1 = unique_ptr<BackendToFirmwarePacket>(
-                    reinterpret_cast<BackendToFirmwarePacket *>(arg));
-            switch (packet1->which_type) {
-                case BackendToFirmwarePacket_get_sensors_list_tag: {
-                    getSensorsList();
-                    break;
-                }
-                case BackendToFirmwarePacket_clear_sensor_list_tag: {
-                    getGetSensorData()->clearDevices();
-                    break;
-                }
-                case BackendToFirmwarePacket_add_sensor_tag: {
-                    addSensors(packet1);
-                    break;
-                }
-                default: {
-                    throw runtime_error("Assertion error: packet1 has wrong type");
-                }
-            }
+void handleCommand(const BackendToFirmwarePacket &packet) {
+    switch (packet.which_type) {
+        case BackendToFirmwarePacket_get_trace_tag: {
+            sendTrace();
+            break;
+        }
+        case BackendToFirmwarePacket_get_sensors_list_tag: {
+            getSensorsList();
+            break;
+        }
+        case BackendToFirmwarePacket_clear_sensor_list_tag: {
+            getGetSensorData()->clearDevices();
+            break;
+        }
+        case BackendToFirmwarePacket_add_sensor_tag: {
+            addSensors(packet);
+            break;
+        }
+        default: {
+            throw runtime_error("Assertion error: packet has wrong type");
         }
-
-
-        vTaskDelete(nullptr);
-    }, "recData", 16000, packet.release(), 1, &Task3);
-    if (ret != pdPASS) {
-        LOG("Error: %d\n", ret);
-        throw runtime_error("Couldn't create thread");
     }
 }
 
@@ -333,19 +327,24 @@ void onWebsocketConnect(const WebsocketConnectionType type, int size, const char
         }
         case WebsocketConnectionType::Connected: {
             LOG("Connect type: Connected\n");
+            EventBus::getInstance()->publish<Event::WebsocketUp>();
             break;
         }
         case WebsocketConnectionType::Disconnected: {
             LOG("Connect type: Disconnected\n");
+            EventBus::getInstance()->publish<Event::WebsocketDown>();
             break;
         }
 
         case WebsocketConnectionType::Closed: {
             LOG("Connect type: Closed\n");
+            EventBus::getInstance()->publish<Event::WebsocketDown>();
             break;
         }
         case WebsocketConnectionType::Error: {
             LOG("Connect type: Error\n");
+            // The attempt failed or the connection broke
+            EventBus::getInstance()->publish<Event::WebsocketDown>();
             break;
         }
         case WebsocketConnectionType::Data: {
@@ -354,15 +353,30 @@ void onWebsocketConnect(const WebsocketConnectionType type, int size, const char
             }
 
 
-            unique_ptr<BackendToFirmwarePacket> message = make_unique<BackendToFirmwarePacket>();
-            *message = BackendToFirmwarePacket_init_zero;
-            auto stream = make_unique<pb_istream_t>();
-            *stream = pb_istream_from_buffer(reinterpret_cast<const pb_byte_t *>(data), size);
-            bool status = pb_decode(stream.get(), BackendToFirmwarePacket_fields, message.get());
+            auto message = backendPackets()->acquire();
+            if (!message) {
+                LOG("Dropping a command, the previous ones are still being handled. %u dropped so far\n",
+                    (unsigned) backendPackets()->exhausted());
+                break;
+            }
+            pb_istream_t stream = pb_istream_from_buffer(reinterpret_cast<const pb_byte_t *>(data), size);
+            bool status = pb_decode(&stream, BackendToFirmwarePacket_fields, message.get());
             if (!status) {
                 throw std::runtime_error("Stream decode bug");
             }
-            recData(message);
+            if (message->which_type == 0) {
+                // get_trace isn't in the generated code, so nanopb skips it
+                stream = pb_istream_from_buffer(reinterpret_cast<const pb_byte_t *>(data), size);
+                if (isGetTrace(&stream)) {
+                    message->which_type = BackendToFirmwarePacket_get_trace_tag;
+                }
+            }
+            TRACE_INSTANT("command received", message->which_type);
+            if (!CommandWorker::getInstance()->submit(message)) {
+                LOG("Dropping a command, the command worker isn't running\n");
+                break;
+            }
+            EventBus::getInstance()->publish<Event::CommandReceived>();
 
             break;
         }
@@ -372,8 +386,6 @@ void onWebsocketConnect(const WebsocketConnectionType type, int size, const char
     }
 }
 
-bool hasConnected = false;
-
 /// clientConnectLoop starts the thread responsible for communicating with the backend.
 /// By making it a thread, I can control how large of a stack space it gets. I can also pause it
 /// until either it needs to ping or it needs to send data
@@ -385,61 +397,58 @@ void clientConnectLoop() {
 
     auto websocketConnect = xTaskCreate([](void *parameters) {
         string const url = std::string(REMOTE_HOST_WS) + "/api/v1/hub-connect?Board=" + *uuid();
+        auto bus = EventBus::getInstance();
+        bus->subscribe(Subscriber::Reconnect, xTaskGetCurrentTaskHandle());
 
-        for (;;) {
+        ReconnectPolicy policy(RECONNECT_BASE_MS, WEBSOCKET_RECONNECT_CAP_MS, esp_random);
 
-            auto ws = websocket::getInstance();
-            if (!ws->isConnected()) {
-                hasConnected = false;
-                ws->connect(url, onWebsocketConnect);
-            } else {
-                hasConnected = true;
+        for (;;) {
+            // Forget what happened to the previous connection
+            EventBus::wait(0);
+            websocket::getInstance()->connect(url, onWebsocketConnect, true);
+            TickType_t const started = xTaskGetTickCount();
+            TickType_t const timeout = pdMS_TO_TICKS(WEBSOCKET_CONNECT_TIMEOUT_MS);
+            // Wait for the attempt to come up or fail
+            for (TickType_t waited = 0; !(bus->state() & STATE_WEBSOCKET) && waited < timeout;
+                 waited = xTaskGetTickCount() - started) {
+                if (EventBus::wait(timeout - waited) & eventBit(Event::WebsocketDown)) {
+                    break;
+                }
             }
-            if (hasConnected) {
-                delay(100);
-            } else {
-                for (int i = 0; i < 10; i++) {
-                    delay(6'000);
+            if (bus->state() & STATE_WEBSOCKET) {
+                TickType_t const upAt = xTaskGetTickCount();
+                // Sleep while it is up
+                while (bus->state() & STATE_WEBSOCKET) {
+                    EventBus::wait(portMAX_DELAY);
+                }
+                if (xTaskGetTickCount() - upAt >= pdMS_TO_TICKS(WEBSOCKET_STABLE_MS)) {
+                    policy.succeeded();
                 }
             }
+            policy.retryAfter(websocket::getInstance()->takeRetryAfterMs());
+            uint32_t const wait = policy.failed();
+            LOG("Reconnecting the websocket in %u ms, %u failures so far\n", (unsigned) wait,
+                (unsigned) policy.failures());
+            if (wait > 0) {
+                delay(wait);
+            }
         }
     }, "reconnect websocket", 8000, (void *) nullptr, 1, nullptr);
     if (websocketConnect != pdPASS) {
         LOG("websocketConnect: %d\n", websocketConnect);
     }
     auto ping = xTaskCreate([](void *parameters) {
-        string const url = std::string(REMOTE_HOST_WS) + "/api/v1/hub-connect?Board=" + *uuid();
         for (;;) {
             // Wait for a reconnect
-            while (!websocket::getInstance()->isConnected()) {
-                delay(100);
-            }
-            // Ping doesn't carry internal data
-            FirmwareToBackendPacket packet = {0};
-            packet.which_type = FirmwareToBackendPacket_ping_tag;
-            packet.type.ping = Ping{0};
-            // A ping is 2 bytes [10 0]
-            vector<uint8_t> buf(2);
-            pb_ostream_t output = pb_ostream_from_buffer(buf.data(), buf.size());
-            int status = pb_encode(&output, FirmwareToBackendPacket_fields, &packet);
-            if (!status) {
-                throw std::runtime_error(string("Encoding failed: ") + PB_GET_ERROR(&output));
-            }
-            buf.resize(output.bytes_written);
-            char buff[20];
-            time_t now = time(nullptr);
-            strftime(buff, 20, "%Y-%m-%d %H:%M:%S", localtime(&now));
-            LOG("Sending ping: %s\n", buff);
-            WriteSocketError error = websocket::getInstance()->writeBytes(buf, 5'000);
+            EventBus::getInstance()->waitFor(STATE_WEBSOCKET, portMAX_DELAY);
+            // The heartbeat is a health report rather than an empty ping
+            WriteSocketError error = Heartbeat::getInstance()->send();
             LOG("Error:%d\n", error);
             if (error == WriteSocketError::WriteError && websocket::getInstance()->isConnected()) {
                 LOG("%d\n", __LINE__);
                 throw std::runtime_error("Cannot send data to websocket");
             }
-            // Wait for 2 minutes
-            for (int i = 0; i < 100; i++) {
-                delay(1'200);
-            }
+            delay(HEARTBEAT_INTERVAL_MS);
         }
     }, "Send/rec from server", 8000, (void *) nullptr, 1, nullptr);
     if (ping != pdPASS) {
@@ -452,10 +461,20 @@ void loop() {
     delay(100);
 }
 
-int *s_retry_num() {
-    static int returnVal;
+/// wifiReconnect returns the policy for joining the access point again. It is only used by the event loop task.
+ReconnectPolicy *wifiReconnect() {
+    static ReconnectPolicy returnVal(RECONNECT_BASE_MS, WIFI_RECONNECT_CAP_MS, esp_random);
     return &returnVal;
-};
+}
+
+/// wifiRetryTimer returns the timer that tries to join the access point again once the policy's wait is over
+TimerHandle_t wifiRetryTimer() {
+    static StaticTimer_t buffer;
+    static TimerHandle_t returnVal = xTimerCreateStatic("WiFi retry", 1, pdFALSE, nullptr, [](TimerHandle_t) {
+        esp_wifi_connect();
+    }, &buffer);
+    return returnVal;
+}
 
 // Get an event from the WiFi subsystem. Most of this code is borrowed from the ESP website
 
@@ -463,23 +482,26 @@ static void event_handler(void *arg, esp_event_base_t event_base, int32_t event_
     if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
         esp_wifi_connect();
     } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
-        isWiFiConnected()->lockAndSwap(false);
-        if (*s_retry_num() < 100) {
-            esp_wifi_connect();
-            (*s_retry_num())++;
-            LOG("retry to connect to the AP\n");
-        } else {
+        EventBus::getInstance()->publish<Event::WiFiDown>();
+        if (wifiReconnect()->failures() >= WIFI_MAX_FAILURES) {
             LOG("Can't connect, restart\n");
             esp_restart();
         }
-        LOG("connect to the AP fail");
+        uint32_t const wait = wifiReconnect()->failed();
+        LOG("retry to connect to the AP in %u ms\n", (unsigned) wait);
+        if (wait == 0) {
+            esp_wifi_connect();
+        } else {
+            // The event loop must not block, so a timer makes the attempt
+            xTimerChangePeriod(wifiRetryTimer(), std::max<TickType_t>(pdMS_TO_TICKS(wait), 1), 0);
+        }
     } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
         auto *event = (ip_event_got_ip_t *) event_data;
         LOG("got ip: %d.%d.%d.%d\n", IP2STR(&event->ip_info.ip));
-        (*s_retry_num()) = 0;
-        isWiFiConnected()->lockAndSwap(true);
+        wifiReconnect()->succeeded();
+        EventBus::getInstance()->publish<Event::WiFiUp>();
         setClock();
-        timeSet()->lockAndSwap(true);
+        EventBus::getInstance()->publish<Event::TimeValid>();
     }
 }
 
@@ -0,0 +1,159 @@
+#include <algorithm>
+#include <cstring>
+#include "HealthReport.h"
+
+/// encodeUint32 writes value as field tag, unless it is 0
+static bool encodeUint32(pb_ostream_t *stream, uint32_t tag, uint32_t value) {
+    return value == 0 || (pb_encode_tag(stream, PB_WT_VARINT, tag) && pb_encode_varint(stream, value));
+}
+
+static bool encodeTaskHealthFields(pb_ostream_t *stream, const TaskHealth &task) {
+    size_t const nameLength = strnlen(task.name, sizeof(task.name));
+    return (nameLength == 0 || (pb_encode_tag(stream, PB_WT_STRING, TaskHealth_name_tag) &&
+                                pb_encode_string(stream, reinterpret_cast<const pb_byte_t *>(task.name),
+                                                 nameLength))) &&
+           encodeUint32(stream, TaskHealth_cpu_tag, task.cpu) &&
+           encodeUint32(stream, TaskHealth_stack_free_tag, task.stackFree);
+}
+
+/// encodeHealthReportFields writes the fields of report. The sizing and the writing pass both go through it.
+static bool encodeHealthReportFields(pb_ostream_t *stream, const HealthReport &report) {
+    if (!encodeUint32(stream, HealthReport_uptime_s_tag, report.uptimeS) ||
+        !encodeUint32(stream, HealthReport_reset_reason_tag, report.resetReason) ||
+        !encodeUint32(stream, HealthReport_free_heap_tag, report.freeHeap) ||
+        !encodeUint32(stream, HealthReport_min_free_heap_tag, report.minFreeHeap) ||
+        !encodeUint32(stream, HealthReport_largest_free_block_tag, report.largestFreeBlock)) {
+        return false;
+    }
+    for (size_t i = 0; i < report.taskCount && i < HEALTH_MAX_TASKS; i++) {
+        pb_ostream_t sizing = PB_OSTREAM_SIZING;
+        if (!encodeTaskHealthFields(&sizing, report.tasks[i]) ||
+            !pb_encode_tag(stream, PB_WT_STRING, HealthReport_tasks_tag) ||
+            !pb_encode_varint(stream, sizing.bytes_written) || !encodeTaskHealthFields(stream, report.tasks[i])) {
+            return false;
+        }
+    }
+    return encodeUint32(stream, HealthReport_wifi_connects_tag, report.wifiConnects) &&
+           encodeUint32(stream, HealthReport_websocket_connects_tag, report.websocketConnects) &&
+           encodeUint32(stream, HealthReport_commands_queued_tag, report.commandsQueued) &&
+           encodeUint32(stream, HealthReport_readings_pending_tag, report.readingsPending) &&
+           encodeUint32(stream, HealthReport_readings_logged_tag, report.readingsLogged) &&
+           encodeUint32(stream, HealthReport_command_max_wait_ms_tag, report.commandMaxWaitMs);
+}
+
+bool encodeHealthReport(pb_ostream_t *stream, const HealthReport &report) {
+    pb_ostream_t sizing = PB_OSTREAM_SIZING;
+    if (!encodeHealthReportFields(&sizing, report)) {
+        return false;
+    }
+    return pb_encode_tag(stream, PB_WT_STRING, FirmwareToBackendPacket_health_report_tag) &&
+           pb_encode_varint(stream, sizing.bytes_written) && encodeHealthReportFields(stream, report);
+}
+
+static bool decodeTaskHealth(pb_istream_t *stream, TaskHealth &task) {
+    pb_istream_t fields;
+    if (!pb_make_string_substream(stream, &fields)) {
+        return false;
+    }
+    task = TaskHealth{};
+    pb_wire_type_t wireType;
+    uint32_t tag;
+    bool eof;
+    while (pb_decode_tag(&fields, &wireType, &tag, &eof)) {
+        uint64_t value;
+        if (tag == TaskHealth_name_tag && wireType == PB_WT_STRING) {
+            pb_istream_t name;
+            if (!pb_make_string_substream(&fields, &name)) {
+                return false;
+            }
+            size_t const length = std::min(name.bytes_left, sizeof(task.name) - 1);
+            if (!pb_read(&name, reinterpret_cast<pb_byte_t *>(task.name), length) ||
+                !pb_read(&name, nullptr, name.bytes_left) || !pb_close_string_substream(&fields, &name)) {
+                return false;
+            }
+        } else if ((tag == TaskHealth_cpu_tag || tag == TaskHealth_stack_free_tag) && wireType == PB_WT_VARINT) {
+            if (!pb_decode_varint(&fields, &value)) {
+                return false;
+            }
+            (tag == TaskHealth_cpu_tag ? task.cpu : task.stackFree) = static_cast<uint32_t>(value);
+        } else if (!pb_skip_field(&fields, wireType)) {
+            return false;
+        }
+    }
+    return eof && pb_close_string_substream(stream, &fields);
+}
+
+/// field returns where a uint32 field of report goes, or nullptr if tag isn't one
+static uint32_t *field(HealthReport &report, uint32_t tag) {
+    switch (tag) {
+        case HealthReport_uptime_s_tag:
+            return &report.uptimeS;
+        case HealthReport_reset_reason_tag:
+            return &report.resetReason;
+        case HealthReport_free_heap_tag:
+            return &report.freeHeap;
+        case HealthReport_min_free_heap_tag:
+            return &report.minFreeHeap;
+        case HealthReport_largest_free_block_tag:
+            return &report.largestFreeBlock;
+        case HealthReport_wifi_connects_tag:
+            return &report.wifiConnects;
+        case HealthReport_websocket_connects_tag:
+            return &report.websocketConnects;
+        case HealthReport_commands_queued_tag:
+            return &report.commandsQueued;
+        case HealthReport_readings_pending_tag:
+            return &report.readingsPending;
+        case HealthReport_readings_logged_tag:
+            return &report.readingsLogged;
+        case HealthReport_command_max_wait_ms_tag:
+            return &report.commandMaxWaitMs;
+        default:
+            return nullptr;
+    }
+}
+
+bool decodeHealthReport(pb_istream_t *stream, HealthReport &report) {
+    bool found = false;
+    pb_wire_type_t wireType;
+    uint32_t tag;
+    bool eof;
+    while (pb_decode_tag(stream, &wireType, &tag, &eof)) {
+        if (tag != FirmwareToBackendPacket_health_report_tag || wireType != PB_WT_STRING) {
+            if (!pb_skip_field(stream, wireType)) {
+                return false;
+            }
+            continue;
+        }
+        found = true;
+        report = HealthReport{};
+        pb_istream_t fields;
+        if (!pb_make_string_substream(stream, &fields)) {
+            return false;
+        }
+        while (pb_decode_tag(&fields, &wireType, &tag, &eof)) {
+            uint32_t *value = field(report, tag);
+            if (tag == HealthReport_tasks_tag && wireType == PB_WT_STRING) {
+                TaskHealth task;
+                if (!decodeTaskHealth(&fields, task)) {
+                    return false;
+                }
+                if (report.taskCount < HEALTH_MAX_TASKS) {
+                    report.tasks[report.taskCount++] = task;
+                }
+            } else if (value != nullptr && wireType == PB_WT_VARINT) {
+                uint64_t decoded;
+                if (!pb_decode_varint(&fields, &decoded)) {
+                    return false;
+                }
+                *value = static_cast<uint32_t>(decoded);
+            } else if (!pb_skip_field(&fields, wireType)) {
+                return false;
+            }
+        }
+        if (!eof || !pb_close_string_substream(stream, &fields)) {
+            return false;
+        }
+    }
+    return eof && found;
+}
@@ -0,0 +1,170 @@
+#include <cstring>
+#include <string_view>
+#include "SensorDataBatch.h"
+#include "BleAddr.h"
+
+/// SENSOR_DATA_MAX_SIZE is the largest SensorData entry: a full address, every other field and address_bits
+#define SENSOR_DATA_MAX_SIZE 64
+
+/// varintSize returns how many bytes pb_encode_varint takes for value
+static size_t varintSize(size_t value) {
+    size_t size = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        size++;
+    }
+    return size;
+}
+
+std::optional<uint64_t> addressBitsOf(const SensorData &sensorData) {
+    auto const address = BleAddr::parse(std::string_view(sensorData.address,
+                                                         strnlen(sensorData.address, sizeof(sensorData.address))));
+    if (!address.has_value()) {
+        return std::nullopt;
+    }
+    return address->bits();
+}
+
+void setAddressBits(SensorData &sensorData, uint64_t bits) {
+    char address[ADDRESS_STRING_SIZE];
+    BleAddr(bits).format(address);
+    static_assert(sizeof(sensorData.address) >= ADDRESS_STRING_SIZE);
+    memcpy(sensorData.address, address, sizeof(address));
+}
+
+/// withoutAddress returns sensorData as the generated encoder writes it: without its address when that goes as
+/// address_bits, which it sets
+static SensorData withoutAddress(const SensorData &sensorData, std::optional<uint64_t> &bits) {
+    SensorData rest = sensorData;
+    bits = addressBitsOf(sensorData);
+    if (bits.has_value()) {
+        rest.address[0] = '\0';
+    }
+    return rest;
+}
+
+/// sensorDataSize sets size to the size of sensorData as encodeSensorData writes it. It returns false if sensorData
+/// can't be encoded.
+static bool sensorDataSize(const SensorData &sensorData, size_t &size) {
+    std::optional<uint64_t> bits;
+    SensorData const rest = withoutAddress(sensorData, bits);
+    if (!pb_get_encoded_size(&size, SensorData_fields, &rest)) {
+        return false;
+    }
+    // A one byte tag and the 8 bytes
+    size += bits.has_value() ? 1 + 8 : 0;
+    return true;
+}
+
+/// encodeSensorData writes sensorData, which is size bytes, as a field of a sensor_data_batch
+static bool encodeSensorData(pb_ostream_t *stream, const SensorData &sensorData, size_t size) {
+    std::optional<uint64_t> bits;
+    SensorData const rest = withoutAddress(sensorData, bits);
+    if (!pb_encode_tag(stream, PB_WT_STRING, SensorDataBatch_sensor_data_tag) || !pb_encode_varint(stream, size)) {
+        return false;
+    }
+    // address_bits goes after the generated fields, so the tags are in order as the generated encoder writes them
+    if (!pb_encode(stream, SensorData_fields, &rest)) {
+        return false;
+    }
+    return !bits.has_value() || (pb_encode_tag(stream, PB_WT_64BIT, SensorData_address_bits_tag) &&
+                                 pb_encode_fixed64(stream, &*bits));
+}
+
+/// decodeSensorData reads a SensorData entry of a sensor_data_batch
+static bool decodeSensorData(pb_istream_t *stream, SensorData &sensorData) {
+    // The generated decoder skips address_bits, so keep the entry to look for it afterwards
+    pb_istream_t entry;
+    if (!pb_make_string_substream(stream, &entry)) {
+        return false;
+    }
+    pb_byte_t bytes[SENSOR_DATA_MAX_SIZE];
+    size_t const size = entry.bytes_left;
+    bool const read = size <= sizeof(bytes) && pb_read(&entry, bytes, size);
+    if (!pb_close_string_substream(stream, &entry) || !read) {
+        return false;
+    }
+    pb_istream_t fields = pb_istream_from_buffer(bytes, size);
+    sensorData = SensorData_init_zero;
+    if (!pb_decode(&fields, SensorData_fields, &sensorData)) {
+        return false;
+    }
+    fields = pb_istream_from_buffer(bytes, size);
+    pb_wire_type_t wireType;
+    uint32_t tag;
+    bool eof;
+    while (pb_decode_tag(&fields, &wireType, &tag, &eof)) {
+        if (tag == SensorData_address_bits_tag && wireType == PB_WT_64BIT) {
+            uint64_t bits;
+            if (!pb_decode_fixed64(&fields, &bits)) {
+                return false;
+            }
+            setAddressBits(sensorData, bits);
+        } else if (!pb_skip_field(&fields, wireType)) {
+            return false;
+        }
+    }
+    return eof;
+}
+
+size_t sensorDataBatchEntrySize(const SensorData &sensorData) {
+    size_t size = 0;
+    if (!sensorDataSize(sensorData, size)) {
+        return 0;
+    }
+    // A one byte tag, the length and the message
+    return 1 + varintSize(size) + size;
+}
+
+size_t sensorDataBatchPacketSize(size_t entriesSize) {
+    return 1 + varintSize(entriesSize) + entriesSize;
+}
+
+bool encodeSensorDataBatch(pb_ostream_t *stream, const SensorData *readings, size_t count, size_t entriesSize) {
+    if (!pb_encode_tag(stream, PB_WT_STRING, FirmwareToBackendPacket_sensor_data_batch_tag) ||
+        !pb_encode_varint(stream, entriesSize)) {
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        size_t size = 0;
+        if (!sensorDataSize(readings[i], size) || !encodeSensorData(stream, readings[i], size)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool decodeSensorDataBatch(pb_istream_t *stream, std::vector<SensorData> &readings) {
+    bool found = false;
+    pb_wire_type_t wireType;
+    uint32_t tag;
+    bool eof;
+    while (pb_decode_tag(stream, &wireType, &tag, &eof)) {
+        if (tag != FirmwareToBackendPacket_sensor_data_batch_tag || wireType != PB_WT_STRING) {
+            if (!pb_skip_field(stream, wireType)) {
+                return false;
+            }
+            continue;
+        }
+        found = true;
+        pb_istream_t batch;
+        if (!pb_make_string_substream(stream, &batch)) {
+            return false;
+        }
+        while (pb_decode_tag(&batch, &wireType, &tag, &eof)) {
+            if (tag == SensorDataBatch_sensor_data_tag && wireType == PB_WT_STRING) {
+                SensorData sensorData;
+                if (!decodeSensorData(&batch, sensorData)) {
+                    return false;
+                }
+                readings.push_back(sensorData);
+            } else if (!pb_skip_field(&batch, wireType)) {
+                return false;
+            }
+        }
+        if (!eof || !pb_close_string_substream(stream, &batch)) {
+            return false;
+        }
+    }
+    return eof && found;
+}
@@ -0,0 +1,54 @@
+#ifndef ESP32_SRC_PACKETS_SENSORDATABATCH_H_
+#define ESP32_SRC_PACKETS_SENSORDATABATCH_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+#include "generated/firmware_backend.pb.h"
+#include "../../components/nanopb/pb_encode.h"
+#include "../../components/nanopb/pb_decode.h"
+
+/// sensor_data_batch carries several readings in a single FirmwareToBackendPacket. It is defined in
+/// firmware_backend.proto as
+///
+///     message SensorDataBatch { repeated SensorData sensor_data = 1; }
+///     message FirmwareToBackendPacket { oneof type { ...; SensorDataBatch sensor_data_batch = 4; } }
+///
+/// The generated code in generated/ predates it, so the variant is encoded here with the nanopb primitives. The
+/// bytes are exactly what the generated encoder would produce.
+#define FirmwareToBackendPacket_sensor_data_batch_tag 4
+#define SensorDataBatch_sensor_data_tag 1
+
+/// The readings of a sensor_data_batch carry their address as address_bits rather than as text when it is a BLE
+/// address, which takes 9 bytes instead of 19. It is added to firmware_backend.proto as
+///
+///     message SensorData { ...; optional fixed64 address_bits = 5; }
+///
+/// address_bits is the address in the low 48 bits, the most significant byte of the text in bits 40 to 47, as in
+/// BleAddr::bits. The address is left empty when it is set.
+#define SensorData_address_bits_tag 5
+
+/// addressBitsOf returns the address of sensorData as address_bits, or nothing if it isn't a BLE address
+std::optional<uint64_t> addressBitsOf(const SensorData &sensorData);
+
+/// setAddressBits writes the address in address_bits into sensorData as text
+void setAddressBits(SensorData &sensorData, uint64_t bits);
+
+/// sensorDataBatchEntrySize returns how many bytes a reading adds to a sensor_data_batch, or 0 if it can't be encoded
+size_t sensorDataBatchEntrySize(const SensorData &sensorData);
+
+/// sensorDataBatchPacketSize returns the size of a FirmwareToBackendPacket holding a sensor_data_batch whose
+/// entries add up to entriesSize bytes
+size_t sensorDataBatchPacketSize(size_t entriesSize);
+
+/// encodeSensorDataBatch writes a FirmwareToBackendPacket holding a sensor_data_batch with count readings.
+/// entriesSize is the sum of sensorDataBatchEntrySize over the readings.
+bool encodeSensorDataBatch(pb_ostream_t *stream, const SensorData *readings, size_t count, size_t entriesSize);
+
+/// decodeSensorDataBatch reads a FirmwareToBackendPacket and appends the readings of its sensor_data_batch to
+/// readings, with their address as text either way. It returns false if the packet is malformed or isn't a
+/// sensor_data_batch.
+bool decodeSensorDataBatch(pb_istream_t *stream, std::vector<SensorData> &readings);
+
+#endif //ESP32_SRC_PACKETS_SENSORDATABATCH_H_
@@ -0,0 +1,388 @@
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include "SensorDataBlocks.h"
+#include "SensorDataBatch.h"
+
+namespace {
+    /// BitWriter packs bits into a stream, the most significant first
+    class BitWriter {
+    private:
+        pb_ostream_t *stream;
+        uint8_t byte = 0;
+        int used = 0;
+
+    public:
+        explicit BitWriter(pb_ostream_t *s) : stream(s) {}
+
+        /// write writes the count low bits of bits
+        bool write(uint32_t bits, int count) {
+            for (int i = count - 1; i >= 0; i--) {
+                byte = static_cast<uint8_t>(byte << 1 | (bits >> i & 1));
+                if (++used == 8) {
+                    if (!pb_write(stream, &byte, 1)) {
+                        return false;
+                    }
+                    byte = 0;
+                    used = 0;
+                }
+            }
+            return true;
+        }
+
+        /// flush writes the last byte, padded with zeros
+        bool flush() {
+            return used == 0 || write(0, 8 - used);
+        }
+    };
+
+    /// BitReader reads the bits a BitWriter wrote
+    class BitReader {
+    private:
+        pb_istream_t *stream;
+        uint8_t byte = 0;
+        int left = 0;
+
+    public:
+        explicit BitReader(pb_istream_t *s) : stream(s) {}
+
+        bool read(int count, uint32_t &bits) {
+            bits = 0;
+            for (int i = 0; i < count; i++) {
+                if (left == 0) {
+                    if (!pb_read(stream, &byte, 1)) {
+                        return false;
+                    }
+                    left = 8;
+                }
+                bits = bits << 1 | (byte >> --left & 1);
+            }
+            return true;
+        }
+    };
+
+    /// sameBlock returns whether a and b belong in the same block
+    bool sameBlock(const SensorData &a, const SensorData &b) {
+        return a.data_type == b.data_type && strncmp(a.address, b.address, sizeof(a.address)) == 0;
+    }
+
+    /// Block is the readings of one sensor and data type: readings[first] and the readings after it that belong with
+    /// it
+    struct Block {
+        const SensorData *readings;
+        size_t first;
+        size_t count;
+
+        /// forEach calls f with each reading of the block, in order, until f returns false
+        template<typename F>
+        bool forEach(const F &f) const {
+            for (size_t i = first; i < count; i++) {
+                if (sameBlock(readings[i], readings[first]) && !f(readings[i], i == first)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    };
+
+    bool writeTimestamps(pb_ostream_t *stream, const Block &block) {
+        int64_t previous = 0;
+        int64_t previousDelta = 0;
+        size_t written = 0;
+        return block.forEach([&](const SensorData &reading, bool) {
+            int64_t const timestamp = reading.timestamp;
+            if (written == 0) {
+                if (!pb_encode_svarint(stream, timestamp)) {
+                    return false;
+                }
+            } else {
+                int64_t const delta = timestamp - previous;
+                if (!pb_encode_svarint(stream, written == 1 ? delta : delta - previousDelta)) {
+                    return false;
+                }
+                previousDelta = delta;
+            }
+            previous = timestamp;
+            written++;
+            return true;
+        });
+    }
+
+    bool writeValues(pb_ostream_t *stream, const Block &block) {
+        BitWriter bits(stream);
+        uint32_t previous = 0;
+        // The window of meaningful bits of the last XOR that was written out in full. 32 means there is none yet.
+        int leading = 32;
+        int trailing = 32;
+        return block.forEach([&](const SensorData &reading, bool first) {
+            auto const value = std::bit_cast<uint32_t>(reading.value);
+            if (first) {
+                previous = value;
+                return bits.write(value, 32);
+            }
+            uint32_t const x = value ^ previous;
+            previous = value;
+            if (x == 0) {
+                return bits.write(0, 1);
+            }
+            // Leading zeros are stored in 5 bits
+            int const lz = std::min(std::countl_zero(x), 31);
+            int const tz = std::countr_zero(x);
+            if (leading + trailing < 32 && lz >= leading && tz >= trailing) {
+                return bits.write(0b10, 2) && bits.write(x >> trailing, 32 - leading - trailing);
+            }
+            int const meaningful = 32 - lz - tz;
+            leading = lz;
+            trailing = tz;
+            return bits.write(0b11, 2) && bits.write(lz, 5) && bits.write(meaningful - 1, 5) &&
+                   bits.write(x >> tz, meaningful);
+        }) && bits.flush();
+    }
+
+    /// encodeBytes writes a bytes field whose content comes from write, sizing it first
+    template<typename Write>
+    bool encodeBytes(pb_ostream_t *stream, uint32_t tag, const Write &write) {
+        pb_ostream_t sizing = PB_OSTREAM_SIZING;
+        if (!write(&sizing)) {
+            return false;
+        }
+        if (!pb_encode_tag(stream, PB_WT_STRING, tag) || !pb_encode_varint(stream, sizing.bytes_written)) {
+            return false;
+        }
+        if (stream->callback == nullptr) {
+            // A sizing stream needs no content
+            return pb_write(stream, nullptr, sizing.bytes_written);
+        }
+        size_t const start = stream->bytes_written;
+        return write(stream) && stream->bytes_written - start == sizing.bytes_written;
+    }
+
+    bool writeBlock(pb_ostream_t *stream, const Block &block) {
+        const SensorData &first = block.readings[block.first];
+        size_t count = 0;
+        block.forEach([&count](const SensorData &, bool) {
+            count++;
+            return true;
+        });
+        auto const bits = addressBitsOf(first);
+        bool const address = bits.has_value() ?
+                             pb_encode_tag(stream, PB_WT_64BIT, SensorDataBlock_address_bits_tag) &&
+                             pb_encode_fixed64(stream, &*bits) :
+                             pb_encode_tag(stream, PB_WT_STRING, SensorDataBlock_address_tag) &&
+                             pb_encode_string(stream, reinterpret_cast<const pb_byte_t *>(first.address),
+                                              strnlen(first.address, sizeof(first.address)));
+        return address &&
+               pb_encode_tag(stream, PB_WT_VARINT, SensorDataBlock_data_type_tag) &&
+               pb_encode_varint(stream, first.data_type) &&
+               pb_encode_tag(stream, PB_WT_VARINT, SensorDataBlock_count_tag) &&
+               pb_encode_varint(stream, count) &&
+               encodeBytes(stream, SensorDataBlock_timestamps_tag,
+                           [&block](pb_ostream_t *s) { return writeTimestamps(s, block); }) &&
+               encodeBytes(stream, SensorDataBlock_values_tag,
+                           [&block](pb_ostream_t *s) { return writeValues(s, block); });
+    }
+
+    bool writeBlocks(pb_ostream_t *stream, const SensorData *readings, size_t count) {
+        // A block starts at the first reading of each sensor and data type. Finding them by scanning, rather than
+        // sorting the readings, keeps the encoder from allocating.
+        for (size_t first = 0; first < count; first++) {
+            bool const seen = std::any_of(readings, readings + first, [&](const SensorData &earlier) {
+                return sameBlock(earlier, readings[first]);
+            });
+            if (seen) {
+                continue;
+            }
+            Block const block{readings, first, count};
+            if (!encodeBytes(stream, SensorDataBlocks_blocks_tag,
+                             [&block](pb_ostream_t *s) { return writeBlock(s, block); })) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool readTimestamps(pb_istream_t *stream, SensorData *out, size_t count) {
+        int64_t previous = 0;
+        int64_t delta = 0;
+        for (size_t i = 0; i < count; i++) {
+            int64_t value;
+            if (!pb_decode_svarint(stream, &value)) {
+                return false;
+            }
+            if (i == 0) {
+                previous = value;
+            } else {
+                delta = i == 1 ? value : delta + value;
+                previous += delta;
+            }
+            out[i].timestamp = previous;
+        }
+        return true;
+    }
+
+    bool readValues(pb_istream_t *stream, SensorData *out, size_t count) {
+        BitReader bits(stream);
+        uint32_t previous = 0;
+        uint32_t leading = 32;
+        uint32_t trailing = 32;
+        for (size_t i = 0; i < count; i++) {
+            uint32_t bit;
+            if (i == 0) {
+                if (!bits.read(32, previous)) {
+                    return false;
+                }
+            } else {
+                if (!bits.read(1, bit)) {
+                    return false;
+                }
+                if (bit == 1) {
+                    if (!bits.read(1, bit)) {
+                        return false;
+                    }
+                    if (bit == 1) {
+                        uint32_t meaningful;
+                        if (!bits.read(5, leading) || !bits.read(5, meaningful)) {
+                            return false;
+                        }
+                        meaningful++;
+                        if (leading + meaningful > 32) {
+                            return false;
+                        }
+                        trailing = 32 - leading - meaningful;
+                    } else if (leading + trailing >= 32) {
+                        return false;
+                    }
+                    uint32_t x;
+                    if (!bits.read(static_cast<int>(32 - leading - trailing), x)) {
+                        return false;
+                    }
+                    previous ^= x << trailing;
+                }
+            }
+            out[i].value = std::bit_cast<float>(previous);
+        }
+        return true;
+    }
+
+    /// readBytes reads a bytes field into out
+    bool readBytes(pb_istream_t *stream, std::vector<uint8_t> &out) {
+        pb_istream_t field;
+        if (!pb_make_string_substream(stream, &field)) {
+            return false;
+        }
+        out.resize(field.bytes_left);
+        bool const ok = pb_read(&field, out.data(), out.size());
+        return pb_close_string_substream(stream, &field) && ok;
+    }
+
+    bool readBlock(pb_istream_t *stream, std::vector<SensorData> &readings) {
+        SensorData first = SensorData_init_zero;
+        uint64_t count = 0;
+        std::vector<uint8_t> timestamps;
+        std::vector<uint8_t> values;
+        pb_wire_type_t wireType;
+        uint32_t tag;
+        bool eof;
+        while (pb_decode_tag(stream, &wireType, &tag, &eof)) {
+            uint64_t number;
+            if (tag == SensorDataBlock_address_tag && wireType == PB_WT_STRING) {
+                pb_istream_t address;
+                if (!pb_make_string_substream(stream, &address)) {
+                    return false;
+                }
+                bool const fits = address.bytes_left < sizeof(first.address);
+                bool const ok = fits && pb_read(&address, reinterpret_cast<pb_byte_t *>(first.address),
+                                                address.bytes_left);
+                if (!pb_close_string_substream(stream, &address) || !ok) {
+                    return false;
+                }
+            } else if (tag == SensorDataBlock_address_bits_tag && wireType == PB_WT_64BIT) {
+                uint64_t bits;
+                if (!pb_decode_fixed64(stream, &bits)) {
+                    return false;
+                }
+                setAddressBits(first, bits);
+            } else if (tag == SensorDataBlock_data_type_tag && wireType == PB_WT_VARINT) {
+                if (!pb_decode_varint(stream, &number)) {
+                    return false;
+                }
+                first.data_type = static_cast<DataType>(number);
+            } else if (tag == SensorDataBlock_count_tag && wireType == PB_WT_VARINT) {
+                if (!pb_decode_varint(stream, &count)) {
+                    return false;
+                }
+            } else if (tag == SensorDataBlock_timestamps_tag && wireType == PB_WT_STRING) {
+                if (!readBytes(stream, timestamps)) {
+                    return false;
+                }
+            } else if (tag == SensorDataBlock_values_tag && wireType == PB_WT_STRING) {
+                if (!readBytes(stream, values)) {
+                    return false;
+                }
+            } else if (!pb_skip_field(stream, wireType)) {
+                return false;
+            }
+        }
+        if (!eof) {
+            return false;
+        }
+        // Every reading takes at least a byte of timestamps, which bounds count before anything is allocated
+        if (count > timestamps.size()) {
+            return false;
+        }
+        size_t const start = readings.size();
+        readings.resize(start + count, first);
+        pb_istream_t timestampStream = pb_istream_from_buffer(timestamps.data(), timestamps.size());
+        pb_istream_t valueStream = pb_istream_from_buffer(values.data(), values.size());
+        if (!readTimestamps(&timestampStream, &readings[start], count) ||
+            !readValues(&valueStream, &readings[start], count)) {
+            readings.resize(start);
+            return false;
+        }
+        return true;
+    }
+}
+
+bool encodeSensorDataBlocks(pb_ostream_t *stream, const SensorData *readings, size_t count) {
+    return encodeBytes(stream, FirmwareToBackendPacket_sensor_data_blocks_tag,
+                       [readings, count](pb_ostream_t *s) { return writeBlocks(s, readings, count); });
+}
+
+bool decodeSensorDataBlocks(pb_istream_t *stream, std::vector<SensorData> &readings) {
+    bool found = false;
+    pb_wire_type_t wireType;
+    uint32_t tag;
+    bool eof;
+    while (pb_decode_tag(stream, &wireType, &tag, &eof)) {
+        if (tag != FirmwareToBackendPacket_sensor_data_blocks_tag || wireType != PB_WT_STRING) {
+            if (!pb_skip_field(stream, wireType)) {
+                return false;
+            }
+            continue;
+        }
+        found = true;
+        pb_istream_t blocks;
+        if (!pb_make_string_substream(stream, &blocks)) {
+            return false;
+        }
+        while (pb_decode_tag(&blocks, &wireType, &tag, &eof)) {
+            if (tag == SensorDataBlocks_blocks_tag && wireType == PB_WT_STRING) {
+                pb_istream_t block;
+                if (!pb_make_string_substream(&blocks, &block)) {
+                    return false;
+                }
+                bool const ok = readBlock(&block, readings);
+                if (!pb_close_string_substream(&blocks, &block) || !ok) {
+                    return false;
+                }
+            } else if (!pb_skip_field(&blocks, wireType)) {
+                return false;
+            }
+        }
+        if (!eof || !pb_close_string_substream(stream, &blocks)) {
+            return false;
+        }
+    }
+    return eof && found;
+}
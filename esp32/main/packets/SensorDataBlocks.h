@@ -0,0 +1,52 @@
+#ifndef ESP32_SRC_PACKETS_SENSORDATABLOCKS_H_
+#define ESP32_SRC_PACKETS_SENSORDATABLOCKS_H_
+
+#include <cstddef>
+#include <vector>
+#include "generated/firmware_backend.pb.h"
+#include "../../components/nanopb/pb_encode.h"
+#include "../../components/nanopb/pb_decode.h"
+
+/// sensor_data_blocks carries a backlog of readings in a single FirmwareToBackendPacket, stored by column and
+/// compressed. It is defined in firmware_backend.proto as
+///
+///     message SensorDataBlock {
+///         string address = 1;
+///         DataType data_type = 2;
+///         uint32 count = 3;
+///         bytes timestamps = 4;
+///         bytes values = 5;
+///         optional fixed64 address_bits = 6;
+///     }
+///     message SensorDataBlocks { repeated SensorDataBlock blocks = 1; }
+///     message FirmwareToBackendPacket { oneof type { ...; SensorDataBlocks sensor_data_blocks = 5; } }
+///
+/// A block holds the readings of one sensor and data type, in the order they were taken. Its address goes as
+/// address_bits, like the address_bits of a SensorData, when it is a BLE address.
+/// timestamps is the first timestamp, the first delta and then the delta of each delta, as zigzag varints. Readings
+/// taken at a steady interval cost one byte each.
+/// values is the float bits XORed with the previous value's, as in Gorilla. The first value takes 32 bits. Then each
+/// value takes a 0 bit if it didn't change. Otherwise it takes a 1 bit, then either a 0 bit and the meaningful bits
+/// of the XOR within the previous value's window, or a 1 bit, 5 bits of leading zeros, 5 bits of the number of
+/// meaningful bits less one and the meaningful bits. The bits are packed from the most significant, and the last
+/// byte is padded with zeros.
+///
+/// The generated code in generated/ predates it, so the variant is encoded here with the nanopb primitives.
+#define FirmwareToBackendPacket_sensor_data_blocks_tag 5
+#define SensorDataBlocks_blocks_tag 1
+#define SensorDataBlock_address_tag 1
+#define SensorDataBlock_data_type_tag 2
+#define SensorDataBlock_count_tag 3
+#define SensorDataBlock_timestamps_tag 4
+#define SensorDataBlock_values_tag 5
+#define SensorDataBlock_address_bits_tag 6
+
+/// encodeSensorDataBlocks writes a FirmwareToBackendPacket holding a sensor_data_blocks with count readings.
+/// Encoding into a sizing stream (PB_OSTREAM_SIZING) gives the size of the packet. It doesn't allocate.
+bool encodeSensorDataBlocks(pb_ostream_t *stream, const SensorData *readings, size_t count);
+
+/// decodeSensorDataBlocks reads a FirmwareToBackendPacket and appends the readings of its sensor_data_blocks to
+/// readings, block by block, with their address as text either way. It returns false if the packet is malformed or isn't a sensor_data_blocks.
+bool decodeSensorDataBlocks(pb_istream_t *stream, std::vector<SensorData> &readings);
+
+#endif //ESP32_SRC_PACKETS_SENSORDATABLOCKS_H_
@@ -0,0 +1,95 @@
+#include <algorithm>
+#include "Trace.h"
+
+bool encodeGetTrace(pb_ostream_t *stream) {
+    // GetTrace has no fields
+    return pb_encode_tag(stream, PB_WT_STRING, BackendToFirmwarePacket_get_trace_tag) && pb_encode_varint(stream, 0);
+}
+
+bool isGetTrace(pb_istream_t *stream) {
+    bool found = false;
+    pb_wire_type_t wireType;
+    uint32_t tag;
+    bool eof;
+    while (pb_decode_tag(stream, &wireType, &tag, &eof)) {
+        if (tag == BackendToFirmwarePacket_get_trace_tag && wireType == PB_WT_STRING) {
+            found = true;
+        }
+        if (!pb_skip_field(stream, wireType)) {
+            return false;
+        }
+    }
+    return eof && found;
+}
+
+/// encodeTraceChunkFields writes the fields of chunk. The sizing and the writing pass both go through it.
+static bool encodeTraceChunkFields(pb_ostream_t *stream, const TraceChunk &chunk) {
+    size_t const length = std::min(chunk.length, sizeof(chunk.text));
+    return (chunk.part == 0 || (pb_encode_tag(stream, PB_WT_VARINT, TraceChunk_part_tag) &&
+                                pb_encode_varint(stream, chunk.part))) &&
+           (!chunk.last || (pb_encode_tag(stream, PB_WT_VARINT, TraceChunk_last_tag) &&
+                            pb_encode_varint(stream, 1))) &&
+           (length == 0 || (pb_encode_tag(stream, PB_WT_STRING, TraceChunk_text_tag) &&
+                            pb_encode_string(stream, reinterpret_cast<const pb_byte_t *>(chunk.text), length)));
+}
+
+bool encodeTraceChunk(pb_ostream_t *stream, const TraceChunk &chunk) {
+    pb_ostream_t sizing = PB_OSTREAM_SIZING;
+    if (!encodeTraceChunkFields(&sizing, chunk)) {
+        return false;
+    }
+    return pb_encode_tag(stream, PB_WT_STRING, FirmwareToBackendPacket_trace_chunk_tag) &&
+           pb_encode_varint(stream, sizing.bytes_written) && encodeTraceChunkFields(stream, chunk);
+}
+
+bool decodeTraceChunk(pb_istream_t *stream, TraceChunk &chunk) {
+    bool found = false;
+    pb_wire_type_t wireType;
+    uint32_t tag;
+    bool eof;
+    while (pb_decode_tag(stream, &wireType, &tag, &eof)) {
+        if (tag != FirmwareToBackendPacket_trace_chunk_tag || wireType != PB_WT_STRING) {
+            if (!pb_skip_field(stream, wireType)) {
+                return false;
+            }
+            continue;
+        }
+        found = true;
+        chunk.part = 0;
+        chunk.last = false;
+        chunk.length = 0;
+        pb_istream_t fields;
+        if (!pb_make_string_substream(stream, &fields)) {
+            return false;
+        }
+        while (pb_decode_tag(&fields, &wireType, &tag, &eof)) {
+            uint64_t value;
+            if ((tag == TraceChunk_part_tag || tag == TraceChunk_last_tag) && wireType == PB_WT_VARINT) {
+                if (!pb_decode_varint(&fields, &value)) {
+                    return false;
+                }
+                if (tag == TraceChunk_part_tag) {
+                    chunk.part = static_cast<uint32_t>(value);
+                } else {
+                    chunk.last = value != 0;
+                }
+            } else if (tag == TraceChunk_text_tag && wireType == PB_WT_STRING) {
+                pb_istream_t text;
+                if (!pb_make_string_substream(&fields, &text)) {
+                    return false;
+                }
+                chunk.length = std::min(text.bytes_left, sizeof(chunk.text));
+                if (!pb_read(&text, reinterpret_cast<pb_byte_t *>(chunk.text), chunk.length) ||
+                    !pb_read(&text, nullptr, text.bytes_left) || !pb_close_string_substream(&fields, &text)) {
+                    return false;
+                }
+            } else if (!pb_skip_field(&fields, wireType)) {
+                return false;
+            }
+        }
+        if (!eof || !pb_close_string_substream(stream, &fields)) {
+            return false;
+        }
+    }
+    return eof && found;
+}
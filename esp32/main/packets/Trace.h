@@ -0,0 +1,54 @@
+#ifndef ESP32_SRC_PACKETS_TRACE_H_
+#define ESP32_SRC_PACKETS_TRACE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include "../../components/nanopb/pb_encode.h"
+#include "../../components/nanopb/pb_decode.h"
+
+/// get_trace asks the hub for the events in its trace ring, and trace_chunk carries them back. They are defined in
+/// firmware_backend.proto as
+///
+///     message GetTrace {}
+///     message BackendToFirmwarePacket { oneof type { ...; GetTrace get_trace = 4; } }
+///     message TraceChunk {
+///         uint32 part = 1;
+///         bool last = 2;
+///         string text = 3;
+///     }
+///     message FirmwareToBackendPacket { oneof type { ...; TraceChunk trace_chunk = 7; } }
+///
+/// A dump goes out as trace_chunks numbered from 0, each holding whole lines of it, and the last one says so. Put
+/// back together, the text is what the hub writes to the serial console for a dump, see lib/trace/trace.h.
+///
+/// The generated code in generated/ predates them, so the variants are encoded here with the nanopb primitives.
+#define BackendToFirmwarePacket_get_trace_tag 4
+#define FirmwareToBackendPacket_trace_chunk_tag 7
+#define TraceChunk_part_tag 1
+#define TraceChunk_last_tag 2
+#define TraceChunk_text_tag 3
+
+/// TRACE_CHUNK_SIZE is the most text a trace_chunk holds. It leaves room in a websocket message for the rest.
+#define TRACE_CHUNK_SIZE 1'536
+
+struct TraceChunk {
+    uint32_t part;
+    bool last;
+    size_t length;
+    char text[TRACE_CHUNK_SIZE];
+};
+
+/// encodeGetTrace writes a BackendToFirmwarePacket holding a get_trace
+bool encodeGetTrace(pb_ostream_t *stream);
+
+/// isGetTrace says whether a BackendToFirmwarePacket holds a get_trace
+bool isGetTrace(pb_istream_t *stream);
+
+/// encodeTraceChunk writes a FirmwareToBackendPacket holding chunk as a trace_chunk. It doesn't allocate.
+bool encodeTraceChunk(pb_ostream_t *stream, const TraceChunk &chunk);
+
+/// decodeTraceChunk reads a FirmwareToBackendPacket holding a trace_chunk into chunk. Text past TRACE_CHUNK_SIZE is
+/// dropped. It returns false if the packet is malformed or isn't a trace_chunk.
+bool decodeTraceChunk(pb_istream_t *stream, TraceChunk &chunk);
+
+#endif //ESP32_SRC_PACKETS_TRACE_H_
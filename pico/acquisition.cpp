@@ -0,0 +1,156 @@
+#include "acquisition.h"
+#include "adc_sampler.h"
+#include <hardware/dma.h>
+#include <hardware/irq.h>
+#include <hardware/sync.h>
+#include <hardware/watchdog.h>
+#include <pico/stdlib.h>
+
+namespace {
+  /** \brief A DHT sensor and where its measurements stand. */
+  struct dht_channel_t {
+    dht_t dht;
+    char humidity_letter;
+    char temperature_letter;
+    uint32_t interval_us;
+    absolute_time_t next_start;
+    absolute_time_t started;
+    bool measuring;
+    /** \brief Set by the DMA interrupt once the data is in. */
+    volatile bool done;
+    uint failures;
+  };
+
+  acquisition_reading_t on_reading = nullptr;
+  dht_channel_t dhts[ACQUISITION_MAX_DHTS];
+  uint dht_count = 0;
+
+  char adc_letter = 0;
+  absolute_time_t next_adc_sample;
+
+  void __isr dma_irq_handler() {
+    for (uint i = 0; i < dht_count; i++) {
+      dht_channel_t &channel = dhts[i];
+      if (dma_channel_get_irq0_status(channel.dht.dma_chan)) {
+        dma_channel_acknowledge_irq0(channel.dht.dma_chan);
+        channel.done = true;
+      }
+    }
+    // Wake the loop even if it went to sleep just before the interrupt
+    __sev();
+  }
+
+  void start(dht_channel_t &channel, absolute_time_t now) {
+    channel.done = false;
+    channel.measuring = dht_start_measurement(&channel.dht) == 0;
+    channel.started = now;
+    channel.next_start = delayed_by_us(now, channel.interval_us);
+  }
+
+  void finish(dht_channel_t &channel) {
+    float humidity;
+    float temperature;
+    dht_result_t const result = dht_finish_measurement(&channel.dht, &humidity, &temperature);
+    if (result == DHT_RESULT_BUSY) {
+      return;
+    }
+    channel.measuring = false;
+    if (result != DHT_RESULT_OK) {
+      // A sensor that stopped answering only loses its own readings, until it has been failing for too long
+      if (++channel.failures >= ACQUISITION_MAX_FAILURES) {
+        watchdog_enable(1, true);
+        while (true);
+      }
+      return;
+    }
+    channel.failures = 0;
+    on_reading(channel.humidity_letter, humidity);
+    on_reading(channel.temperature_letter, temperature);
+  }
+
+  void sample_adc() {
+    int32_t code;
+    if (adc_sampler_read(ADC_TEMPERATURE_INPUT, &code)) {
+      on_reading(adc_letter, static_cast<float>(adc_temperature_millicelsius(code)) / 1000);
+    }
+  }
+}
+
+void acquisition_init(acquisition_reading_t callback) {
+  on_reading = callback;
+  irq_add_shared_handler(DMA_IRQ_0, dma_irq_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+  irq_set_enabled(DMA_IRQ_0, true);
+}
+
+bool acquisition_add_dht(dht_model_t model, PIO pio, uint8_t data_pin, char humidity_letter,
+                         char temperature_letter) {
+  if (dht_count == ACQUISITION_MAX_DHTS) {
+    return false;
+  }
+  dht_channel_t &channel = dhts[dht_count];
+  if (dht_init(&channel.dht, model, pio, data_pin, true) != 0) {
+    return false;
+  }
+  channel.humidity_letter = humidity_letter;
+  channel.temperature_letter = temperature_letter;
+  channel.interval_us = dht_get_min_interval_us(model);
+  channel.next_start = get_absolute_time();
+  channel.measuring = false;
+  channel.done = false;
+  channel.failures = 0;
+  dma_channel_set_irq0_enabled(channel.dht.dma_chan, true);
+  // Count the sensor in only now, so that the interrupt never looks at one being set up
+  dht_count++;
+  return true;
+}
+
+void acquisition_add_onboard_temperature(char letter) {
+  adc_sampler_start(1u << ADC_TEMPERATURE_INPUT);
+  adc_letter = letter;
+  next_adc_sample = get_absolute_time();
+}
+
+absolute_time_t acquisition_poll() {
+  absolute_time_t now = get_absolute_time();
+  absolute_time_t next = delayed_by_us(now, ACQUISITION_ADC_INTERVAL_US);
+  for (uint i = 0; i < dht_count; i++) {
+    dht_channel_t &channel = dhts[i];
+    if (channel.measuring) {
+      finish(channel);
+    }
+    if (!channel.measuring && absolute_time_diff_us(now, channel.next_start) <= 0) {
+      start(channel, now);
+    }
+    // A running measurement wakes us through its interrupt, or else when it times out
+    absolute_time_t const due = channel.measuring
+                                ? delayed_by_us(channel.started, dht_get_measurement_timeout_us(&channel.dht))
+                                : channel.next_start;
+    if (absolute_time_diff_us(due, next) > 0) {
+      next = due;
+    }
+  }
+  if (adc_letter != 0) {
+    if (absolute_time_diff_us(now, next_adc_sample) <= 0) {
+      sample_adc();
+      next_adc_sample = delayed_by_us(next_adc_sample, ACQUISITION_ADC_INTERVAL_US);
+    }
+    if (absolute_time_diff_us(next_adc_sample, next) > 0) {
+      next = next_adc_sample;
+    }
+  }
+  return next;
+}
+
+void acquisition_run() {
+  while (true) {
+    absolute_time_t const next = acquisition_poll();
+    // Any measurement that is done interrupts the sleep
+    bool any_done = false;
+    for (uint i = 0; i < dht_count; i++) {
+      any_done |= dhts[i].measuring && dhts[i].done;
+    }
+    if (!any_done) {
+      best_effort_wfe_or_timeout(next);
+    }
+  }
+}
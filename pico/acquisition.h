@@ -0,0 +1,77 @@
+#ifndef PICO_ACQUISITION_H_
+#define PICO_ACQUISITION_H_
+
+#include <cstdint>
+#include <hardware/pio.h>
+#include <pico/time.h>
+#include "dht.h"
+
+/** \file acquisition.h
+ *
+ * \brief Reads the sensors in the background, each at its own pace.
+ *
+ * Every DHT is started as soon as its model allows, so the measurements of
+ * different sensors overlap. A measurement runs in its PIO state machine and
+ * DMA channel, and the channel's interrupt wakes the core once the data is in.
+ * The onboard temperature is filtered from the samples adc_sampler takes all
+ * along, and read in the gaps.
+ */
+
+/** \brief Most DHT sensors the acquisition reads. */
+#define ACQUISITION_MAX_DHTS 4
+
+/** \brief Failed measurements in a row after which a sensor is given up on and the Pico reboots. */
+#define ACQUISITION_MAX_FAILURES 10
+
+/** \brief Time between two readings of the onboard temperature. */
+#define ACQUISITION_ADC_INTERVAL_US 2000000
+
+/**
+ * \brief Called with every reading, from the core that runs the acquisition.
+ *
+ * \param letter What was measured, as the hub expects it: H, T, h, t or p.
+ * \param value The reading.
+ */
+typedef void (*acquisition_reading_t)(char letter, float value);
+
+/**
+ * \brief Set up the acquisition.
+ *
+ * The DMA interrupt is taken on the calling core, so call this and the
+ * functions below from the core that runs the acquisition.
+ *
+ * \param on_reading Receives the readings.
+ */
+void acquisition_init(acquisition_reading_t on_reading);
+
+/**
+ * \brief Read a DHT sensor as often as its model allows.
+ *
+ * \return false if ACQUISITION_MAX_DHTS sensors are read already or the sensor
+ * can't be set up.
+ */
+bool acquisition_add_dht(dht_model_t model, PIO pio, uint8_t data_pin, char humidity_letter,
+                         char temperature_letter);
+
+/**
+ * \brief Read the onboard temperature every ACQUISITION_ADC_INTERVAL_US.
+ *
+ * This starts adc_sampler on the temperature sensor alone.
+ *
+ * \param letter What the readings are sent as.
+ */
+void acquisition_add_onboard_temperature(char letter);
+
+/**
+ * \brief Start and finish the measurements that are due.
+ *
+ * \return When something is due next.
+ */
+absolute_time_t acquisition_poll();
+
+/**
+ * \brief Poll forever, sleeping in between.
+ */
+[[noreturn]] void acquisition_run();
+
+#endif // PICO_ACQUISITION_H_
@@ -0,0 +1,122 @@
+#include "adc_sampler.h"
+#include <hardware/adc.h>
+#include <hardware/dma.h>
+#include <hardware/irq.h>
+
+namespace {
+  /** \brief Size of the ring buffer, which must be a power of two. */
+  constexpr uint RING_SAMPLES = 1024;
+  constexpr uint RING_BITS = 11;
+  static_assert(RING_SAMPLES * sizeof(uint16_t) == 1u << RING_BITS);
+
+  constexpr uint TAPS = 2 * ADC_CIC_LENGTH - 1;
+  constexpr uint INPUTS = 5;
+  // Leave room for the samples the DMA writes while a reading goes through the ring
+  static_assert(INPUTS * TAPS + INPUTS <= RING_SAMPLES, "The ring must hold a reading of every input");
+  static_assert(4095ll * ADC_CIC_LENGTH * ADC_CIC_LENGTH <= INT32_MAX, "The filter's sum must fit in 32 bits");
+
+  /** \brief The DMA channel writes the ring in place, wrapping at its size. */
+  alignas(RING_SAMPLES * sizeof(uint16_t)) uint16_t ring[RING_SAMPLES];
+
+  int dma_chan = -1;
+  /** \brief The inputs in the order the ADC goes round them. */
+  uint sequence[INPUTS];
+  uint sequence_length = 0;
+  /** \brief Samples taken before the transfer that is running. */
+  volatile uint64_t samples_before = 0;
+
+  void __isr dma_irq_handler() {
+    if (dma_chan < 0 || !dma_channel_get_irq0_status(dma_chan)) {
+      return;
+    }
+    dma_channel_acknowledge_irq0(dma_chan);
+    // Only happens every few days; carry on where the transfer stopped
+    samples_before = samples_before + UINT32_MAX;
+    dma_channel_set_trans_count(dma_chan, UINT32_MAX, true);
+  }
+
+  /** \brief Samples written so far, counting from the start. */
+  uint64_t samples_taken() {
+    for (;;) {
+      uint64_t const before = samples_before;
+      uint32_t const left = dma_channel_hw_addr(dma_chan)->transfer_count;
+      if (before == samples_before) {
+        return before + (UINT32_MAX - left);
+      }
+    }
+  }
+
+  /** \brief Weight of tap i of the filter: the boxcars make a triangle. */
+  constexpr int32_t weight(uint i) {
+    return i < ADC_CIC_LENGTH ? static_cast<int32_t>(i + 1) : static_cast<int32_t>(TAPS - i);
+  }
+}
+
+void adc_sampler_start(uint32_t input_mask) {
+  sequence_length = 0;
+  for (uint input = 0; input < INPUTS; input++) {
+    if (input_mask & (1u << input)) {
+      sequence[sequence_length++] = input;
+    }
+  }
+  if (sequence_length == 0) {
+    return;
+  }
+
+  adc_init();
+  if (input_mask & (1u << ADC_TEMPERATURE_INPUT)) {
+    adc_set_temp_sensor_enabled(true);
+  }
+  // The ADC goes from the selected input up through the mask, so start at the lowest one
+  adc_select_input(sequence[0]);
+  adc_set_round_robin(sequence_length > 1 ? input_mask : 0);
+  adc_fifo_setup(true /* en */, true /* dreq_en */, 1 /* dreq_thresh */, false /* err_in_fifo */,
+                 false /* byte_shift */);
+  // The ADC clock is 48 MHz and the divider counts one more cycle per sample
+  adc_set_clkdiv(48000000.0f / static_cast<float>(ADC_SAMPLE_RATE_HZ * sequence_length) - 1);
+
+  dma_chan = dma_claim_unused_channel(true /* required */);
+  dma_channel_config c = dma_channel_get_default_config(dma_chan);
+  channel_config_set_transfer_data_size(&c, DMA_SIZE_16);
+  channel_config_set_read_increment(&c, false);
+  channel_config_set_write_increment(&c, true);
+  channel_config_set_ring(&c, true /* write */, RING_BITS);
+  channel_config_set_dreq(&c, DREQ_ADC);
+  irq_add_shared_handler(DMA_IRQ_0, dma_irq_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+  dma_channel_set_irq0_enabled(dma_chan, true);
+  irq_set_enabled(DMA_IRQ_0, true);
+  dma_channel_configure(dma_chan, &c, ring, &adc_hw->fifo, UINT32_MAX, true /* trigger */);
+  adc_run(true);
+}
+
+bool adc_sampler_read(uint input, int32_t *code) {
+  uint position = sequence_length;
+  for (uint i = 0; i < sequence_length; i++) {
+    if (sequence[i] == input) {
+      position = i;
+    }
+  }
+  if (position == sequence_length) {
+    return false;
+  }
+  uint64_t const taken = samples_taken();
+  if (taken < static_cast<uint64_t>(TAPS) * sequence_length) {
+    return false;
+  }
+  // The latest sample of the input, then every sequence_length samples back
+  uint64_t const back = (taken - 1 - position) % sequence_length;
+  uint64_t n = taken - 1 - back;
+  int32_t sum = 0;
+  for (uint i = 0; i < TAPS; i++, n -= sequence_length) {
+    sum += weight(i) * (ring[n % RING_SAMPLES] & 0xfff);
+  }
+  // The triangle's weights add up to ADC_CIC_LENGTH squared
+  *code = static_cast<int32_t>((static_cast<int64_t>(sum) << ADC_FRACTION_BITS) / (ADC_CIC_LENGTH * ADC_CIC_LENGTH));
+  return true;
+}
+
+int32_t adc_temperature_millicelsius(int32_t code) {
+  // T = 27 - (V - 0.706) / 0.001721, with V = code * 3.3 / 4096
+  int64_t const microvolts = static_cast<int64_t>(code) * 3300000 / (4096 << ADC_FRACTION_BITS);
+  return static_cast<int32_t>(27000 - (microvolts - 706000) * 1000 / 1721);
+}
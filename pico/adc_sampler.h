@@ -0,0 +1,55 @@
+#ifndef PICO_ADC_SAMPLER_H_
+#define PICO_ADC_SAMPLER_H_
+
+#include <cstdint>
+#include <pico/types.h>
+
+/** \file adc_sampler.h
+ *
+ * \brief Samples ADC inputs continuously and averages them on demand.
+ *
+ * The ADC runs free, going round the inputs, and a DMA channel copies its
+ * FIFO into a ring buffer, so sampling takes no CPU. A reading filters the
+ * latest samples of an input with a second order CIC filter: two boxcars of
+ * ADC_CIC_LENGTH samples in a row, all in integer arithmetic.
+ */
+
+/** \brief The ADC input of the onboard temperature sensor. */
+#define ADC_TEMPERATURE_INPUT 4
+
+/** \brief Samples in each boxcar of the filter. A reading takes 2 * ADC_CIC_LENGTH - 1 samples of its input. */
+#define ADC_CIC_LENGTH 64
+
+/** \brief Samples of each input taken in a second. The ADC can't go slower than 733 samples a second in all. */
+#define ADC_SAMPLE_RATE_HZ 1000
+
+/** \brief Number of fractional bits of an averaged reading. */
+#define ADC_FRACTION_BITS 8
+
+/**
+ * \brief Start sampling.
+ *
+ * The DMA interrupt is taken on the calling core.
+ *
+ * \param input_mask The ADC inputs to go round, bit 4 being the temperature sensor.
+ */
+void adc_sampler_start(uint32_t input_mask);
+
+/**
+ * \brief Get the filtered ADC code of an input.
+ *
+ * \param input The ADC input.
+ * \param[out] code The 12 bit code with ADC_FRACTION_BITS fractional bits.
+ * \return false if the input isn't sampled or not enough samples came in yet.
+ */
+bool adc_sampler_read(uint input, int32_t *code);
+
+/**
+ * \brief Convert a code of the temperature sensor to degrees.
+ *
+ * \param code The code, as adc_sampler_read gives it.
+ * \return Thousandths of a degree Celsius.
+ */
+int32_t adc_temperature_millicelsius(int32_t code);
+
+#endif // PICO_ADC_SAMPLER_H_
@@ -0,0 +1,113 @@
+#include "aggregator.h"
+#include <cmath>
+
+namespace {
+  /** \brief A channel's configuration and the readings it has so far. */
+  struct channel_t {
+    aggregate_config_t config;
+    /** \brief The latest readings, for the running median. */
+    float recent[AGGREGATOR_MAX_MEDIAN];
+    uint recent_count;
+    uint recent_next;
+    aggregate_summary_t window;
+    float sum;
+    bool sent;
+    float last_mean;
+    uint skipped;
+  };
+
+  channel_t channels[AGGREGATOR_MAX_CHANNELS];
+  uint channel_count = 0;
+  aggregate_output_t output = nullptr;
+
+  channel_t *find(char letter) {
+    for (uint i = 0; i < channel_count; i++) {
+      if (channels[i].config.letter == letter) {
+        return &channels[i];
+      }
+    }
+    return nullptr;
+  }
+
+  /** \brief Add value to the latest readings and return their median. */
+  float median(channel_t &channel, float value) {
+    uint const n = channel.config.median_of;
+    channel.recent[channel.recent_next] = value;
+    channel.recent_next = (channel.recent_next + 1) % n;
+    if (channel.recent_count < n) {
+      channel.recent_count++;
+    }
+    // Insertion sort a copy; there are a handful at most
+    float sorted[AGGREGATOR_MAX_MEDIAN];
+    for (uint i = 0; i < channel.recent_count; i++) {
+      float const v = channel.recent[i];
+      uint j = i;
+      for (; j > 0 && sorted[j - 1] > v; j--) {
+        sorted[j] = sorted[j - 1];
+      }
+      sorted[j] = v;
+    }
+    return sorted[channel.recent_count / 2];
+  }
+
+  void close_window(channel_t &channel) {
+    aggregate_summary_t &window = channel.window;
+    window.mean = channel.sum / static_cast<float>(window.count);
+    bool hand_out = true;
+    if (channel.config.mode == AGGREGATE_ON_CHANGE && channel.sent &&
+        std::fabs(window.mean - channel.last_mean) < channel.config.change &&
+        channel.skipped < channel.config.max_skipped) {
+      hand_out = false;
+    }
+    if (hand_out) {
+      output(channel.config.letter, &window);
+      channel.sent = true;
+      channel.last_mean = window.mean;
+      channel.skipped = 0;
+    } else {
+      channel.skipped++;
+    }
+    window.count = 0;
+    channel.sum = 0;
+  }
+}
+
+void aggregator_init(const aggregate_config_t *configs, uint count, aggregate_output_t callback) {
+  output = callback;
+  channel_count = 0;
+  for (uint i = 0; i < count && channel_count < AGGREGATOR_MAX_CHANNELS; i++) {
+    aggregate_config_t const &config = configs[i];
+    if (config.median_of == 0 || config.median_of % 2 == 0 || config.median_of > AGGREGATOR_MAX_MEDIAN ||
+        config.window == 0 || find(config.letter) != nullptr) {
+      continue;
+    }
+    channels[channel_count] = channel_t{};
+    channels[channel_count++].config = config;
+  }
+}
+
+void aggregator_add(char letter, float value) {
+  if (!std::isfinite(value)) {
+    return;
+  }
+  channel_t *channel = find(letter);
+  if (channel == nullptr) {
+    aggregate_summary_t const single{.min = value, .max = value, .mean = value, .count = 1};
+    output(letter, &single);
+    return;
+  }
+  float const v = median(*channel, value);
+  aggregate_summary_t &window = channel->window;
+  if (window.count == 0) {
+    window.min = v;
+    window.max = v;
+  } else {
+    window.min = std::fmin(window.min, v);
+    window.max = std::fmax(window.max, v);
+  }
+  window.count++;
+  channel->sum += v;
+  if (window.count == channel->config.window) {
+    close_window(*channel);
+  }
+}
@@ -0,0 +1,76 @@
+#ifndef PICO_AGGREGATOR_H_
+#define PICO_AGGREGATOR_H_
+
+#include <pico/types.h>
+
+/** \file aggregator.h
+ *
+ * \brief Sums up the readings of each channel over a window.
+ *
+ * A channel is what a letter measures. Its readings first go through a
+ * running median of the last few, which drops single glitches that passed the
+ * checksum, then into a window. A full window gives a summary: the minimum,
+ * the maximum and the mean. In AGGREGATE_ON_CHANGE mode the summary is only
+ * handed out when the mean moved enough since the last one.
+ */
+
+/** \brief Most channels the aggregator keeps. Readings of other letters go out as they come. */
+#define AGGREGATOR_MAX_CHANNELS 8
+
+/** \brief Longest running median. */
+#define AGGREGATOR_MAX_MEDIAN 7
+
+/**
+ * \brief When a channel hands out its summaries.
+ */
+typedef enum aggregate_mode_t {
+    AGGREGATE_WINDOW, /**< Every window. */
+    AGGREGATE_ON_CHANGE, /**< When the mean moved by the channel's change, or max_skipped windows went by. */
+} aggregate_mode_t;
+
+/**
+ * \brief How a channel is aggregated.
+ */
+typedef struct aggregate_config_t {
+    char letter;
+    /** \brief Readings a median is taken of, an odd number up to AGGREGATOR_MAX_MEDIAN. 1 takes them as they are. */
+    uint median_of;
+    /** \brief Readings in a window. */
+    uint window;
+    aggregate_mode_t mode;
+    /** \brief Smallest change of the mean that is handed out, in AGGREGATE_ON_CHANGE mode. */
+    float change;
+    /** \brief Windows in a row that may be held back, in AGGREGATE_ON_CHANGE mode. */
+    uint max_skipped;
+} aggregate_config_t;
+
+/**
+ * \brief The readings of a window.
+ */
+typedef struct aggregate_summary_t {
+    float min;
+    float max;
+    float mean;
+    uint count;
+} aggregate_summary_t;
+
+/**
+ * \brief Receives the summaries.
+ */
+typedef void (*aggregate_output_t)(char letter, const aggregate_summary_t *summary);
+
+/**
+ * \brief Set up the channels.
+ *
+ * \param configs The channels, at most AGGREGATOR_MAX_CHANNELS. Bad ones are left out.
+ * \param count Number of channels.
+ * \param output Receives the summaries, on the core that adds the readings.
+ */
+void aggregator_init(const aggregate_config_t *configs, uint count, aggregate_output_t output);
+
+/**
+ * \brief Add a reading. It has the signature of acquisition_reading_t.
+ */
+void aggregator_add(char letter, float value);
+
+#endif // PICO_AGGREGATOR_H_
@@ -24,6 +24,10 @@ static uint get_start_pulse_duration_us(dht_model_t model) {
     return (model == DHT21 || model == DHT22) ? 1000 : 18000;
 }
 
+static uint32_t get_measurement_timeout_us(dht_model_t model) {
+    return get_start_pulse_duration_us(model) + DHT_MEASUREMENT_TIMEOUT_US;
+}
+
 static uint get_pio_sm_clocks(uint us) {
     float clocks_per_microsecond = PIO_SM_CLOCK_FREQUENCY / 1000000.0f;
     return roundf(us * clocks_per_microsecond);
@@ -62,7 +66,8 @@ static void dht_program_init(PIO pio, uint sm, uint offset, dht_model_t model, u
 static void configure_dma_channel(uint chan, PIO pio, uint sm, uint8_t *write_addr) {
     dma_channel_config c = dma_channel_get_default_config(chan);
     channel_config_set_dreq(&c, pio_get_dreq(pio, sm, false /* is_tx */));
-    channel_config_set_irq_quiet(&c, true);
+    // raise the channel's interrupt once the 5 bytes are in, for callers that enable it
+    channel_config_set_irq_quiet(&c, false);
     channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
     channel_config_set_read_increment(&c, false);
     channel_config_set_write_increment(&c, true);
@@ -171,18 +176,26 @@ int dht_start_measurement(dht_t *dht) {
     return 0;
 }
 
-dht_result_t dht_finish_measurement_blocking(dht_t *dht, float *humidity, float *temperature_c) {
+uint32_t dht_get_min_interval_us(dht_model_t model) {
+    return model == DHT11 ? 1000000 : 2000000;
+}
+
+uint32_t dht_get_measurement_timeout_us(const dht_t *dht) {
+    return get_measurement_timeout_us(dht->model);
+}
+
+dht_result_t dht_finish_measurement(dht_t *dht, float *humidity, float *temperature_c) {
     if(dht->pio == NULL) {
-        return 3;
+        return DHT_RESULT_NOT_STARTED;
     }
     if (!pio_sm_is_enabled(dht->pio, dht->sm)){
-        return 3;
+        return DHT_RESULT_NOT_STARTED;
     }
-
-    uint32_t timeout = get_start_pulse_duration_us(dht->model) + DHT_MEASUREMENT_TIMEOUT_US;
-    while (dma_channel_is_busy(dht->dma_chan) && time_us_32() - dht->start_time < timeout) {
-        tight_loop_contents();
+    if (dma_channel_is_busy(dht->dma_chan) &&
+        time_us_32() - dht->start_time < get_measurement_timeout_us(dht->model)) {
+        return DHT_RESULT_BUSY;
     }
+
     pio_sm_set_enabled(dht->pio, dht->sm, false);
     // make sure pin is left in hi-z mode
     pio_sm_exec(dht->pio, dht->sm, pio_encode_set(pio_pindirs, 0));
@@ -203,3 +216,11 @@ dht_result_t dht_finish_measurement_blocking(dht_t *dht, float *humidity, float
     }
     return DHT_RESULT_OK;
 }
+
+dht_result_t dht_finish_measurement_blocking(dht_t *dht, float *humidity, float *temperature_c) {
+    dht_result_t result;
+    while ((result = dht_finish_measurement(dht, humidity, temperature_c)) == DHT_RESULT_BUSY) {
+        tight_loop_contents();
+    }
+    return result;
+}
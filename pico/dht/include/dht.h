@@ -50,6 +50,8 @@ typedef enum dht_result_t {
     DHT_RESULT_OK, /**< No error.*/
     DHT_RESULT_TIMEOUT, /**< DHT sensor not reponding. */
     DHT_RESULT_BAD_CHECKSUM, /**< Sensor data doesn't match checksum. */
+    DHT_RESULT_NOT_STARTED, /**< No measurement was started. */
+    DHT_RESULT_BUSY, /**< Measurement still running. */
 } dht_result_t;
 
 /**
@@ -86,6 +88,19 @@ int dht_deinit(dht_t *dht);
  */
 int  dht_start_measurement(dht_t *dht);
 
+/**
+ * \brief Get the result of a measurement without waiting.
+ *
+ * The sensor's DMA channel raises its interrupt once the data is in, so the
+ * caller can sleep until then or until the measurement times out.
+ *
+ * \param dht DHT sensor.
+ * \param[out] humidity Relative humidity. May be NULL.
+ * \param[out] temperature_c Degrees Celsius. May be NULL.
+ * \return Result status, DHT_RESULT_BUSY while the measurement is running.
+ */
+dht_result_t dht_finish_measurement(dht_t *dht, float *humidity, float *temperature_c);
+
 /**
  * \brief Wait for measurement to complete and get the result.
  *
@@ -96,6 +111,20 @@ int  dht_start_measurement(dht_t *dht);
  */
 dht_result_t dht_finish_measurement_blocking(dht_t *dht, float *humidity, float *temperature_c);
 
+/**
+ * \brief Shortest time between the starts of two measurements.
+ *
+ * \param model DHT sensor model.
+ */
+uint32_t dht_get_min_interval_us(dht_model_t model);
+
+/**
+ * \brief Time after which a running measurement has failed.
+ *
+ * \param dht DHT sensor.
+ */
+uint32_t dht_get_measurement_timeout_us(const dht_t *dht);
+
 #ifdef __cplusplus
 }
 #endif
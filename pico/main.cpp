@@ -1,74 +1,87 @@
+#include <cmath>
 #include <cstdio>
-#include <hardware/adc.h>
-#include <hardware/watchdog.h>
+#include <iterator>
+#include <pico/multicore.h>
 #include "pico/stdlib.h"
-#include "dht.h"
+#include "acquisition.h"
+#include "aggregator.h"
 
-int count = 0;
-[[noreturn]]
-int main() {
-  stdio_init_all();
-  dht_t dht22;
-  dht_t dht11;
-  int result = dht_init(&dht22, DHT22, pio0, 14, true);
-  result = dht_init(&dht11, DHT11, pio1, 15, true);
-  adc_init();
-  adc_set_temp_sensor_enabled(true);
-  adc_select_input(4);
-  uart_init(uart0, 9600);
-
-  while (true) {
-    result = dht_start_measurement(&dht22);
+/// Set to 1 to read the sensors on core1 and hand the readings to core0, which sends them
+#define ACQUIRE_ON_CORE1 1
 
-    if (result != 0) {
-      uart_write_blocking(uart0, reinterpret_cast<const uint8_t *>("|a|"), 3);
-      watchdog_enable(1, true);
-      while (true);
+namespace {
+  /// send writes a reading the way the hub reads it: a letter, the value and a null byte
+  void send(char letter, float value) {
+    char buf[16];
+    int written = snprintf(buf, sizeof(buf), "%c%.2f", letter, value);
+    if (written < 0 || written >= static_cast<int>(sizeof(buf))) {
+      return;
     }
-    result = dht_start_measurement(&dht11);
-    if (result != 0) {
-      uart_write_blocking(uart0, reinterpret_cast<const uint8_t *>("|b|"), 3);
-      watchdog_enable(1, true);
-      while (true);
-    }
-    sleep_ms(2'000);
-    float humidity;
-    float temp;
-    result = dht_finish_measurement_blocking(&dht22, &humidity, &temp);
-    if (result != 0) {
-      uart_write_blocking(uart0, reinterpret_cast<const uint8_t *>("|c|"), 3);
-      watchdog_enable(1, true);
-      while (true);
-    }
-    uint8_t buf[11];
-    int written = snprintf((char*)buf,10,"H%f",humidity);
-    uart_write_blocking(uart0, buf, written);
+    uart_write_blocking(uart0, reinterpret_cast<const uint8_t *>(buf), written + 1);
+  }
 
-    written = snprintf((char*)buf,10,"T%f",temp);
-    uart_write_blocking(uart0, buf, written);
+  /// aggregates says how each reading is summed up before it is sent. The DHTs are read every 1 or 2 s and the onboard
+  /// temperature every 2 s, so a summary goes out at most every 30 s, and every 5 min when nothing changes.
+  const aggregate_config_t aggregates[] = {
+      {.letter = 'H', .median_of = 3, .window = 15, .mode = AGGREGATE_ON_CHANGE, .change = 0.5f, .max_skipped = 9},
+      {.letter = 'T', .median_of = 3, .window = 15, .mode = AGGREGATE_ON_CHANGE, .change = 0.1f, .max_skipped = 9},
+      {.letter = 'h', .median_of = 3, .window = 30, .mode = AGGREGATE_ON_CHANGE, .change = 1.0f, .max_skipped = 9},
+      {.letter = 't', .median_of = 3, .window = 30, .mode = AGGREGATE_ON_CHANGE, .change = 0.5f, .max_skipped = 9},
+      {.letter = 'p', .median_of = 1, .window = 15, .mode = AGGREGATE_ON_CHANGE, .change = 0.2f, .max_skipped = 9},
+  };
 
-    result = dht_finish_measurement_blocking(&dht11, &humidity, &temp);
-    if (result != 0) {
-      uart_write_blocking(uart0, reinterpret_cast<const uint8_t *>("|d|"), 3);
-      watchdog_enable(1, true);
-      while (true);
-    }
-    written = snprintf((char*)buf,10,"h%f",humidity);
-    uart_write_blocking(uart0, buf, written);
+  /// setup_acquisition reads the sensors and hands the summaries of their readings to on_summary
+  void setup_acquisition(aggregate_output_t on_summary) {
+    aggregator_init(aggregates, std::size(aggregates), on_summary);
+    acquisition_init(aggregator_add);
+    acquisition_add_dht(DHT22, pio0, 14, 'H', 'T');
+    acquisition_add_dht(DHT11, pio1, 15, 'h', 't');
+    acquisition_add_onboard_temperature('p');
+  }
 
-    written = snprintf((char*)buf,10,"t%f",temp);
-    uart_write_blocking(uart0, buf, written);
+#if ACQUIRE_ON_CORE1
+  /// pack fits a reading in a FIFO word: the letter in the top byte and the value in hundredths below it
+  uint32_t pack(char letter, float value) {
+    auto hundredths = static_cast<int32_t>(lroundf(value * 100));
+    return static_cast<uint32_t>(static_cast<uint8_t>(letter)) << 24 | (static_cast<uint32_t>(hundredths) & 0xffffff);
+  }
 
-    
-    float reading = static_cast<float>(adc_read()) * 3.3f / static_cast<float>(1 << 12);
-    float onboard_temp = 27.0f - (reading - 0.706f) / 0.001721f;
-    written = snprintf((char*)buf,10,"p%f",onboard_temp);
-    uart_write_blocking(uart0, buf, written);
+  void unpack(uint32_t word, char &letter, float &value) {
+    letter = static_cast<char>(word >> 24);
+    // Sign extend the 24 bit value
+    auto hundredths = static_cast<int32_t>(word << 8) >> 8;
+    value = static_cast<float>(hundredths) / 100;
+  }
+
+  void push_summary(char letter, const aggregate_summary_t *summary) {
+    // Rather drop a reading than hold up the sensors if core0 falls behind
+    multicore_fifo_push_timeout_us(pack(letter, summary->mean), 0);
+  }
 
+  void core1_main() {
+    setup_acquisition(push_summary);
+    acquisition_run();
   }
-  if(count > 30*60){
-      watchdog_enable(1, true);
-      while (true);
+#endif
+}
+
+[[noreturn]]
+int main() {
+  stdio_init_all();
+  uart_init(uart0, 9600);
+
+#if ACQUIRE_ON_CORE1
+  multicore_launch_core1(core1_main);
+  while (true) {
+    char letter;
+    float value;
+    unpack(multicore_fifo_pop_blocking(), letter, value);
+    send(letter, value);
   }
-  count++;
+#else
+  setup_acquisition([](char letter, const aggregate_summary_t *summary) {
+    send(letter, summary->mean);
+  });
+  acquisition_run();
+#endif
 }